@@ -0,0 +1,10 @@
+/*
+fingerprint of the system catalog, cached tree, preview and autocomplete results
+are dropped as soon as it changes (altering a table changes modify_date of the table,
+so columns are not counted)
+*/
+select
+	(select cast(count(*) as varchar(20)) + ':' + convert(varchar(30), max(create_date), 126) from sys.databases) db,
+	(select cast(count(*) as varchar(20)) + ':' + convert(varchar(30), max(modify_date), 126) from sys.objects) obj,
+	(select cast(count(*) as varchar(20)) + ':' + convert(varchar(30), max(modify_date), 126) from sys.database_principals) prn,
+	(select cast(count(*) as varchar(20)) + ':' + convert(varchar(30), max(modify_date), 126) from sys.server_principals) srv
@@ -1,3 +1,4 @@
+/* cache: session */
 /*
 autocomplete source, table-level
 */
@@ -0,0 +1,58 @@
+/*
+fingerprint of the system catalog, cached tree, preview and autocomplete results
+are dropped as soon as it changes (any DDL inserts, updates or deletes catalog rows).
+Rows of a catalog are counted and their latest xmin is taken, so a change is seen by the
+next statement, on a standby too. Objects of temporary schemas are skipped, so temp tables
+of sessions don't invalidate the caches. No row (no caching) if the catalogs can't be read.
+*/
+with temp as (
+	select n.oid
+	from pg_catalog.pg_namespace n
+	where n.nspname like 'pg\_temp\_%' or n.nspname like 'pg\_toast\_temp\_%'
+), rel as (
+	select c.oid, c.xmin::text::bigint tx
+	from pg_catalog.pg_class c
+	where c.relnamespace not in (select oid from temp)
+), cat(name, n, tx) as (
+	select 'class', count(*), max(tx) from rel
+	union all
+	select 'namespace', count(*), max(n.xmin::text::bigint)
+	from pg_catalog.pg_namespace n
+	where n.oid not in (select oid from temp)
+	union all
+	select 'attribute', count(*), max(a.xmin::text::bigint)
+	from pg_catalog.pg_attribute a
+	where a.attrelid in (select oid from rel)
+	union all
+	select 'constraint', count(*), max(c.xmin::text::bigint)
+	from pg_catalog.pg_constraint c
+	where c.connamespace not in (select oid from temp)
+	union all
+	select 'trigger', count(*), max(t.xmin::text::bigint)
+	from pg_catalog.pg_trigger t
+	where t.tgrelid in (select oid from rel)
+	union all
+	select 'rewrite', count(*), max(r.xmin::text::bigint)
+	from pg_catalog.pg_rewrite r
+	where r.ev_class in (select oid from rel)
+	union all
+	select 'type', count(*), max(t.xmin::text::bigint)
+	from pg_catalog.pg_type t
+	where t.typnamespace not in (select oid from temp)
+	union all
+	select 'proc', count(*), max(p.xmin::text::bigint)
+	from pg_catalog.pg_proc p
+	where p.pronamespace not in (select oid from temp)
+	union all
+	select 'operator', count(*), max(o.xmin::text::bigint) from pg_catalog.pg_operator o
+	union all
+	select 'opclass', count(*), max(o.xmin::text::bigint) from pg_catalog.pg_opclass o
+	union all
+	select 'extension', count(*), max(e.xmin::text::bigint) from pg_catalog.pg_extension e
+	union all
+	select 'database', count(*), max(d.xmin::text::bigint) from pg_catalog.pg_database d
+	union all
+	select 'description', count(*), max(d.xmin::text::bigint) from pg_catalog.pg_description d
+)
+select string_agg(name || ':' || n || ':' || coalesce(tx, 0), ' ' order by name) marker
+from cat
@@ -1,3 +1,4 @@
+/* cache: ddl */
 select 'DROP EXTENSION ' || quote_ident(extname) || E';\n\n' ||
 	'CREATE EXTENSION ' || quote_ident(extname) ||
 	E'\n\tSCHEMA ' || quote_ident(extnamespace::regnamespace::text) ||
@@ -1,3 +1,4 @@
+/* cache: ddl */
 select 
 	p.proname || ' (' || oidvectortypes(p.proargtypes) || ')' "function",
 	p.oid, 
@@ -1 +1,2 @@
+/* cache: ddl */
 select 'create schema $information_schema.name$;' script;
\ No newline at end of file
@@ -1,3 +1,4 @@
+/* cache: ddl */
 do
 $$
 declare
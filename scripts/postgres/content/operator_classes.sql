@@ -1,3 +1,4 @@
+/* cache: ddl */
 select 
 	op.opcname || ' (' || m.amname || ')' "opclass",
 	op.oid,
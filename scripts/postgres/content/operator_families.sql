@@ -1,3 +1,4 @@
+/* cache: ddl */
 select 
 	f.opfname || coalesce(' (' || m.amname || ')', '') "opfamily",
 	f.oid,
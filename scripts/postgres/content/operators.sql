@@ -1,3 +1,4 @@
+/* cache: ddl */
 select
 	op.oprname || ' (' || 
 	case
@@ -1,3 +1,4 @@
+/* cache: ddl */
 select 
 	t.typname, t.oid, t.typowner::regrole, obj_description(t.oid, 'pg_type') "comment"
 from pg_type t
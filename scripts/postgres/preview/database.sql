@@ -1,3 +1,4 @@
+/* nocache */
 with tmp as
 (
 	select 
@@ -1,3 +1,4 @@
+/* nocache */
 with recursive tmp1 as
 (
 	-- roles which contain current role
@@ -1,3 +1,4 @@
+/* nocache */
 select
     r.rolname, 
     r.oid,
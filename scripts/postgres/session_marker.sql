@@ -0,0 +1,4 @@
+/*
+fingerprint of session settings affecting results of scripts marked "cache: session"
+*/
+select array_to_string(current_schemas(true), ',') || ' ' || current_user
@@ -1,3 +1,4 @@
+/* nocache */
 select distinct
 	'pg_settings_group' node_type,
 	category "name",
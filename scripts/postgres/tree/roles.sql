@@ -1,3 +1,4 @@
+/* nocache */
 select 
     'role' node_type,
     rolname ui_name,
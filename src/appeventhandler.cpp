@@ -11,11 +11,9 @@
 #include "codeeditor.h"
 #include "settings.h"
 
-#include <QJsonDocument>
-#include <QJsonObject>
-#include <QJsonArray>
-#include <QVBoxLayout>
-#include "jsonsyntaxhighlighter.h"
+#include "jsonviewer.h"
+#include "gridcopy.h"
+#include "selectionaggregate.h"
 
 AppEventHandler::AppEventHandler(QObject *parent) : QObject(parent)
 {
@@ -55,7 +53,12 @@ bool AppEventHandler::eventFilter(QObject *obj, QEvent *event)
 
             QString stringValue;
             if (QTableView *tv = qobject_cast<QTableView*>(obj))
-                stringValue = tv->selectionModel()->currentIndex().data().toString();
+            {
+                // the whole text of truncated values is kept by the edit role
+                QModelIndex index = tv->selectionModel()->currentIndex();
+                QVariant whole = index.data(Qt::EditRole);
+                stringValue = (whole.type() == QVariant::String ? whole.toString() : index.data().toString());
+            }
             else if (QPlainTextEdit *ed = qobject_cast<QPlainTextEdit*>(obj))
             {
                 stringValue = ed->textCursor().selectedText();
@@ -65,93 +68,7 @@ bool AppEventHandler::eventFilter(QObject *obj, QEvent *event)
             else
                 return QObject::eventFilter(obj, event);
 
-            QJsonParseError err;
-            QString preparedJsonString = stringValue.trimmed();
-            // remove line breaks because QJsonDocument::fromJson() doesn't parse formatted json
-            preparedJsonString.replace(QRegularExpression("\\R", QRegularExpression::UseUnicodePropertiesOption), "");
-            QJsonDocument doc = QJsonDocument::fromJson(preparedJsonString.toUtf8(), &err);
-
-            std::function<QJsonValue(const QJsonValue&)> expandJsonValue;
-            expandJsonValue = [&expandJsonValue](const QJsonValue &node) -> QJsonValue {
-                // extract json from textual escaped representation
-                if (node.isString())
-                {
-                    QString v = node.toString();
-                    if (!v.startsWith('{'))
-                        return node;
-
-                    QJsonDocument doc = QJsonDocument::fromJson(v.toUtf8());
-                    return doc.isObject() ? doc.object() : node;
-                }
-
-                if (node.isArray())
-                {
-                    QJsonArray new_array;
-                    for (auto i: node.toArray())
-                    {
-                        QJsonValue v(expandJsonValue(i));
-                        if (i.isString() && v.isObject())
-                            new_array.append(i); // add previous value if it was changed
-                        new_array.append(v);
-                    }
-                    return new_array;
-                }
-
-                if (!node.isObject())
-                    return node;
-
-                QJsonObject obj = node.toObject();
-                for (auto &k: obj.keys())
-                {
-                    QJsonValueRef jv = obj[k];
-                    if (jv.isObject() || jv.isArray())
-                        obj.insert(k, expandJsonValue(jv)); // replace
-                    else
-                    {
-                        auto newValue = expandJsonValue(jv);
-                        if (newValue.isObject())
-                            obj.insert(k + "(nice)", newValue);
-                    }
-                }
-                return obj;
-            };
-
-            if (!doc.isNull())
-            {
-                if (doc.isObject())
-                {
-                    QJsonValue rootValue(doc.object());
-                    doc.setObject(expandJsonValue(rootValue).toObject());
-                }
-                else if (doc.isArray())
-                {
-                    QJsonValue rootValue(doc.array());
-                    doc.setArray(expandJsonValue(rootValue).toArray());
-                }
-                stringValue = doc.toJson(QJsonDocument::Indented);
-            }
-
-
-            QDialog *dlg = new QDialog(QApplication::activeWindow());
-            dlg->setObjectName("_viewer_");
-            dlg->setAttribute(Qt::WA_DeleteOnClose);
-            dlg->setWindowTitle(QObject::tr("json"));
-
-            QVBoxLayout *layout = new QVBoxLayout();
-            QPlainTextEdit *ed = new QPlainTextEdit(dlg);
-            ed->setObjectName("_def_wrap_");
-            layout->addWidget(ed);
-            ed->setPlainText(err.errorString() + '\n' + stringValue);
-
-            JsonSyntaxHighlighter *hl = new JsonSyntaxHighlighter(ed);
-            hl->setDocument(ed->document());
-
-            QStatusBar *status = new QStatusBar(dlg);
-            status->setMaximumHeight(QFontMetrics(QApplication::font()).height());
-            layout->addWidget(status);
-            layout->setContentsMargins(0, 0, 0, 0);
-            dlg->setLayout(layout);
-            dlg->resize(800, 600);
+            JsonViewer *dlg = new JsonViewer(stringValue, QApplication::activeWindow());
             dlg->open();
             return true;
         }
@@ -160,116 +77,39 @@ bool AppEventHandler::eventFilter(QObject *obj, QEvent *event)
         {
             if (keyEvent->matches(QKeySequence::Copy))
             {
-                QString result;
-                QModelIndexList indexes = tv->selectionModel()->selectedIndexes();
-                if(indexes.size() < 1)
+                QItemSelection selection = tv->selectionModel()->selection();
+                if (selection.isEmpty())
                     return true;
-                std::sort(indexes.begin(), indexes.end());
-                QModelIndex prev;
-                for (const QModelIndex &cur: indexes)
+                GridCopy::Format format = GridCopy::format(SqtSettings::value("gridCopyFormat", "values").toString());
+                if (format == GridCopy::Format::Values &&
+                        selection.size() == 1 && selection.first().width() == 1 && selection.first().height() == 1)
                 {
-                    if (!prev.isValid())
-                        ;
-                    else if (cur.row() != prev.row())
-                        result.append(QString(QChar::LineFeed));
-                    else
-                        result.append(",");
-
+                    QModelIndex cur = selection.first().topLeft();
                     QString value = cur.data(Qt::EditRole).toString();
-                    if (
-                            (cur.data(Qt::TextAlignmentRole).toInt() & Qt::AlignRight) ||
-                            // When single cell selected:
-                            //   copy plain text if clipboard's value is distinct from current selected value;
-                            //   copy quoted literal when clipboard contains it's plain value already.
-                            (indexes.size() == 1 && QApplication::clipboard()->text() != value)
-                       )
-                        result += value;
+                    // When single cell selected:
+                    //   copy plain text if clipboard's value is distinct from current selected value;
+                    //   copy quoted literal when clipboard contains it's plain value already.
+                    if ((cur.data(Qt::TextAlignmentRole).toInt() & Qt::AlignRight) ||
+                            QApplication::clipboard()->text() != value)
+                        QApplication::clipboard()->setText(value);
                     else if (cur.data(Qt::EditRole).isValid())
-                        result += "'" + value.replace("'","''") + "'";
-                    prev = cur;
+                        QApplication::clipboard()->setText("'" + value.replace("'","''") + "'");
+                    else
+                        QApplication::clipboard()->setText(QString());
+                    return true;
                 }
-
-                QApplication::clipboard()->setText(result);
+                QApplication::clipboard()->setText(GridCopy::text(tv->model(), selection, format));
                 return true;
             }
             else if (keyCode == Qt::Key_F6) // sum numerical values of selected cells
             {
-                // lets try to sum big numerics precisely
-                double sumDouble = 0;
-                qlonglong sumInt = 0;
-                qlonglong sumFrac = 0;
-                int maxScale = 0;
-                bool ok;
-                int count = 0;
-                QString res;
-                QModelIndexList il = tv->selectionModel()->selectedIndexes();
-                for (const QModelIndex &i: il)
-                {
-                    double val = i.data(Qt::EditRole).toDouble(&ok);
-                    if (ok)
-                    {
-                        QString tmp = i.data(Qt::EditRole).toString();
-                        int dotPos = tmp.indexOf('.');
-                        if (tmp.indexOf('e') != -1 || (dotPos == -1 && val != static_cast<qlonglong>(val))) // floating point exponential form
-                        {
-                            sumDouble += val;
-                            maxScale = std::max(maxScale, 6);
-                        }
-                        else if (dotPos == -1) // integer
-                        {
-                            sumInt += val;
-                        }
-                        else    // decimal
-                        {
-                            maxScale = std::max(maxScale, tmp.length() - dotPos - 1);
-                            qlonglong frac = (tmp + "000000000000000000").mid(dotPos + 1, 18).toLongLong() * (val < 0 ? -1 : 1);
-
-                            sumInt += tmp.mid(0, dotPos).toLongLong();
-                            sumFrac += frac;
-                            if (llabs(sumFrac) >= 1000000000000000000LL)
-                            {
-                                sumInt += (sumFrac < 0 ? -1 : 1);
-                                sumFrac = sumFrac - 1000000000000000000LL * (sumFrac < 0 ? -1 : 1);
-                            }
-
-                        }
-                        ++count;
-                        res += (res.isEmpty() ? "" : " + ") + tmp;
-                    }
-                }
-
-                QString totalAmount;
-                QLocale locale;
-                if (sumDouble != 0) //if there was a floating point, cast result to double
-                {
-                    double sum = sumDouble + sumInt + sumFrac/1000000000000000000.0;
-                    totalAmount = locale.toString(sum, 'f', maxScale);
-                }
-                else
-                {
-                    if ((sumInt > 0 && sumFrac < 0) || (sumInt < 0 && sumFrac > 0))
-                    {
-                        sumInt += (sumFrac < 0 ? -1 : 1);
-                        sumFrac = sumFrac - 1000000000000000000LL * (sumFrac < 0 ? -1 : 1);
-                    }
-
-                    if (sumInt < 0 || sumFrac < 0)
-                        totalAmount = '-';
-
-                    totalAmount += locale.toString(llabs(sumInt));
-                    if (maxScale)
-                    {
-                        totalAmount +=
-                                locale.decimalPoint() +
-                                ("000000000000000000" + QString::number(llabs(sumFrac))).right(18).mid(0, maxScale);
-                    }
-                }
-
-                if (count)
-                    QApplication::clipboard()->setText(res);
+                // the same aggregates as the status bar shows, the sum is copied
+                SelectionAggregateResult res = SelectionAggregate::compute(tv->model(), tv->selectionModel()->selection());
+                if (res.numbers)
+                    QApplication::clipboard()->setText(res.sum);
                 QMainWindow *w = qobject_cast<QMainWindow*>(QApplication::activeWindow());
                 if (w && w->statusBar())
-                    w->statusBar()->showMessage(QString("%1 (%2 cells)").arg(totalAmount).arg(count), 1000*15);
+                    w->statusBar()->showMessage(res.toString(), 1000*15);
                 return true;
             }
         }
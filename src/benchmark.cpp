@@ -0,0 +1,226 @@
+#include "benchmark.h"
+#include "datatable.h"
+#include "tablemodel.h"
+#include "sqlsyntaxhighlighter.h"
+#include "dbconnection.h"
+#include "dbconnectionfactory.h"
+#include "pgtypes.h"
+#include "settings.h"
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextDocument>
+#include <cstdio>
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// rows taken at once, the same as a fetched() portion
+#define BENCHMARK_CHUNK FETCH_COUNT_NOTIFY
+
+Benchmark::Benchmark() :
+    _out(stdout)
+{
+}
+
+int Benchmark::run(const QStringList &connectionStrings)
+{
+    // fetching options (binary format, chunks) are the same as within the application
+    SqtSettings::load();
+    _out << "benchmark,rows,ms,rows/sec,peak rss KB\n";
+    benchmarkTakeRows();
+    benchmarkModelData();
+    benchmarkHighlighter();
+    bool ok = true;
+    for (const QString &cs: connectionStrings)
+        ok = benchmarkConnection(cs) && ok;
+    _out.flush();
+    return ok ? 0 : 1;
+}
+
+void Benchmark::report(const QString &name, qint64 rows, qint64 us)
+{
+    _out << name << ',' << rows << ',' << QString::number(us / 1000.0, 'f', 1) << ','
+         << (us ? rows * 1000000 / us : 0) << ',' << peakRss() << '\n';
+    _out.flush();
+}
+
+static void addColumns(DataTable &table)
+{
+    table.addColumn(new DataColumn("id", QMetaType::Int, INT4OID, -1, 0, Qt::AlignRight));
+    table.addColumn(new DataColumn("name", QMetaType::QString, TEXTOID, -1, 1, Qt::AlignLeft));
+    table.addColumn(new DataColumn("value", QMetaType::Double, FLOAT8OID, -1, 1, Qt::AlignRight));
+    table.addColumn(new DataColumn("note", QMetaType::QString, TEXTOID, -1, 1, Qt::AlignLeft));
+}
+
+static void appendRows(DataTable &table, int from, int count)
+{
+    for (int r = from; r < from + count; ++r)
+    {
+        table.storage(0).appendInt32(r);
+        QByteArray name = "name " + QByteArray::number(r);
+        table.storage(1).appendString(name.constData(), name.size());
+        table.storage(2).appendDouble(r / 3.0);
+        if (r % 10)
+            table.storage(3).appendNull();
+        else
+            table.storage(3).appendString(QStringLiteral("note of the row %1").arg(r));
+    }
+    table.commitRow(count);
+}
+
+void Benchmark::benchmarkTakeRows()
+{
+    DataTable dst;
+    DataTable chunk;
+    addColumns(chunk);
+    qint64 us = 0;
+    for (int from = 0; from < BENCHMARK_ROWS; from += BENCHMARK_CHUNK)
+    {
+        appendRows(chunk, from, BENCHMARK_CHUNK);
+        QElapsedTimer timer;
+        timer.start();
+        dst.takeRows(&chunk);
+        us += timer.nsecsElapsed() / 1000;
+    }
+    report("DataTable::takeRows", dst.rowCount(), us);
+}
+
+void Benchmark::benchmarkModelData()
+{
+    DataTable table;
+    addColumns(table);
+    appendRows(table, 0, BENCHMARK_ROWS);
+    TableModel model;
+    model.take(&table);
+
+    QElapsedTimer timer;
+    timer.start();
+    const int rows = model.rowCount();
+    const int columns = model.columnCount();
+    qint64 chars = 0;
+    for (int r = 0; r < rows; ++r)
+    {
+        for (int c = 0; c < columns; ++c)
+        {
+            QModelIndex index = model.index(r, c);
+            chars += model.data(index, Qt::DisplayRole).toString().length();
+            model.data(index, Qt::BackgroundRole);
+        }
+    }
+    report("TableModel::data", rows, timer.nsecsElapsed() / 1000);
+    // keep the loop from being optimized out
+    if (!chars)
+        _out << "no data\n";
+}
+
+void Benchmark::benchmarkHighlighter()
+{
+    QJsonObject settings;
+    QFile file(QApplication::applicationDirPath() + "/scripts/postgres/hl.conf");
+    if (file.open(QIODevice::ReadOnly | QIODevice::Text))
+        settings = QJsonDocument::fromJson(file.readAll()).object();
+
+    QString script;
+    for (int i = 0; i < BENCHMARK_SCRIPT_LINES / 5; ++i)
+    {
+        script += QStringLiteral("select t.id, t.name, 'literal %1' as s, $$dollar$$ -- comment\n"
+                                 "from public.items t /* block\n"
+                                 "comment */ join other o on o.id = t.id\n"
+                                 "where t.value > %1.5 and o.\"Quoted\" is not null\n"
+                                 "order by 1, 2;\n").arg(i);
+    }
+    QTextDocument doc(script);
+    SqlSyntaxHighlighter highlighter(settings);
+    QElapsedTimer timer;
+    timer.start();
+    highlighter.setDocument(&doc);
+    highlighter.rehighlight();
+    report("SqlSyntaxHighlighter::highlightBlock", doc.blockCount(), timer.nsecsElapsed() / 1000);
+}
+
+bool Benchmark::benchmarkConnection(const QString &connectionString)
+{
+    std::shared_ptr<DbConnection> connection = DbConnectionFactory::createConnection(QString(), connectionString);
+    QObject::connect(connection.get(), &DbConnection::error, [this](const QString &msg) {
+        _out << "error: " << msg.trimmed() << '\n';
+    });
+    if (!connection->open())
+        return false;
+
+    QString dbms = connection->dbmsName();
+    QString narrow, wide;
+    if (dbms == "PostgreSQL")
+    {
+        narrow = QString("select i from generate_series(1, %1) i").arg(BENCHMARK_SERVER_ROWS);
+        wide = QString("select i, i::text || ' name' as name, md5(i::text) as hash, i / 3.0::float8 as value, "
+                       "i::numeric / 7 as amount, i % 2 = 0 as flag, now() as moment, current_date + i % 1000 as day, "
+                       "case when i % 10 = 0 then null else repeat('x', i % 50) end as note, "
+                       "array[i, i + 1] as pair "
+                       "from generate_series(1, %1) i").arg(BENCHMARK_SERVER_ROWS);
+    }
+    else if (dbms.contains("Microsoft SQL"))
+    {
+        QString rows = QString("with n as (select top (%1) row_number() over (order by (select null)) as i "
+                               "from sys.all_columns a cross join sys.all_columns b) ").arg(BENCHMARK_SERVER_ROWS);
+        narrow = rows + "select i from n";
+        wide = rows + "select i, convert(varchar(20), i) + ' name' as name, "
+                      "convert(varchar(32), hashbytes('MD5', convert(varchar(20), i)), 2) as hash, "
+                      "i / 3.0e0 as value, convert(decimal(18, 4), i / 7.0) as amount, "
+                      "convert(bit, i % 2) as flag, sysdatetime() as moment, dateadd(day, i % 1000, convert(date, getdate())) as day, "
+                      "case when i % 10 = 0 then null else replicate('x', i % 50) end as note "
+                      "from n";
+    }
+    else
+    {
+        _out << "unsupported dbms: " << dbms << '\n';
+        return false;
+    }
+
+    return benchmarkQuery(connection.get(), dbms + " narrow", narrow) &&
+            benchmarkQuery(connection.get(), dbms + " wide", wide);
+}
+
+bool Benchmark::benchmarkQuery(DbConnection *connection, const QString &name, const QString &query)
+{
+    QEventLoop loop;
+    QObject::connect(connection, &DbConnection::queryFinished, &loop, &QEventLoop::quit);
+    connection->executeAsync(query);
+    loop.exec();
+
+    const QueryTimings &t = connection->timings();
+    if (!t.rows)
+        return false;
+    report(name, t.rows, t.finished);
+    report(name + " receive", t.rows, t.receive);
+    report(name + " decode", t.rows, t.decode);
+    _out << name << " bytes," << t.bytes << '\n';
+    connection->clearResultsets();
+    return true;
+}
+
+qint64 Benchmark::peakRss()
+{
+#ifdef Q_OS_WIN
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return qint64(counters.PeakWorkingSetSize / 1024);
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage))
+        return 0;
+#ifdef Q_OS_MACOS
+    // bytes on macOS
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
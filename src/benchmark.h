@@ -0,0 +1,49 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+
+// rows of synthetic resultsets
+#define BENCHMARK_ROWS 1000000
+// rows of resultsets generated by servers
+#define BENCHMARK_SERVER_ROWS 1000000
+// lines of synthetic script
+#define BENCHMARK_SCRIPT_LINES 100000
+
+class DbConnection;
+
+/*!
+ * \brief Throughput of the hot paths, run by "sqt-benchmark [connection string...]"
+ * (built by qmake CONFIG+=benchmark, the application does not include it).
+ *
+ * Synthetic input drives DataTable::takeRows(), TableModel::data() and
+ * SqlSyntaxHighlighter. Every connection string gets narrow and wide generated
+ * resultsets, decoding (PgConnection::appendRawDataToTable) is reported by QueryTimings.
+ */
+class Benchmark
+{
+public:
+    Benchmark();
+    /*!
+     * \return process exit code
+     */
+    int run(const QStringList &connectionStrings);
+
+private:
+    void report(const QString &name, qint64 rows, qint64 us);
+    void benchmarkTakeRows();
+    void benchmarkModelData();
+    void benchmarkHighlighter();
+    bool benchmarkConnection(const QString &connectionString);
+    bool benchmarkQuery(DbConnection *connection, const QString &name, const QString &query);
+    /*!
+     * \brief peak resident set size of the process, KB (0 if unknown)
+     */
+    static qint64 peakRss();
+
+    QTextStream _out;
+};
+
+#endif // BENCHMARK_H
@@ -0,0 +1,13 @@
+#include <QtWidgets/QApplication>
+#include "benchmark.h"
+
+// sqt-benchmark [connection string...]
+int main(int argc, char *argv[])
+{
+    QApplication a(argc, argv);
+    QCoreApplication::setOrganizationName("parihaaraka");
+    QCoreApplication::setApplicationName("sqt");
+    setlocale(LC_NUMERIC, "C");
+
+    return Benchmark().run(a.arguments().mid(1));
+}
@@ -9,6 +9,7 @@
 #include <QCompleter>
 #include <QAbstractItemView>
 #include "settings.h"
+#include "trace.h"
 
 #define RIGHT_MARGIN 2
 #define ICON_PLACE_WIDTH 13
@@ -62,6 +63,8 @@ CodeEditor::CodeEditor(QWidget *parent) : QPlainTextEdit(parent)
         _hlTimer->start();
     });
     connect(this, &CodeEditor::selectionChanged, _hlTimer, static_cast<void(QTimer::*)(void)>(&QTimer::start));
+    connect(document(), &QTextDocument::contentsChange, this, &CodeEditor::indexContents);
+    reindex();
 
     updateLeftSideBarWidth();
     installEventFilter(this);
@@ -506,11 +509,11 @@ bool operator == (QTextEdit::ExtraSelection &l, QTextEdit::ExtraSelection &r)
 
 void CodeEditor::onHlTimerTimeout()
 {
+    SQT_TRACE_SCOPE("CodeEditor::onHlTimerTimeout");
     // ------------ match selected word ------------
     QTextCursor curCursor = textCursor();
     QString selectedText = curCursor.selectedText();
     QList<QTextEdit::ExtraSelection> selections;
-    QString content;
     if (!selectedText.isEmpty())
     {
         // prevent search for not a word
@@ -530,75 +533,38 @@ void CodeEditor::onHlTimerTimeout()
         testCursor.select(QTextCursor::WordUnderCursor);
         if (mayBeWord && selectedText == testCursor.selectedText())
         {
-            int pos_backward = testCursor.selectionStart() - 1;
-            int pos_forward = testCursor.selectionEnd();
-            int forward_counter = 0;
-            int backward_counter = 0;
-            int total_hits = 0;
-            int wordLength = selectedText.length();
-            content = text();
+            if (_tokens.size() != blockCount())
+                reindex();
+
             QColor selectionColor(Qt::yellow);
             selectionColor.setAlphaF(0.7);
             QTextEdit::ExtraSelection s;
             s.format.setBackground(selectionColor);
 
-            auto verifyPos = [this, &selections, wordLength, &s, &testCursor, &content, &total_hits](int &pos, int &counter)
+            // visible blocks and some around them
+            int first = qMax(0, firstVisibleBlock().blockNumber() - WORD_MATCH_MARGIN);
+            int visible = viewport()->height() / qMax(1, fontMetrics().height());
+            int last = qMin(_tokens.size() - 1, firstVisibleBlock().blockNumber() + visible + WORD_MATCH_MARGIN);
+            int wordLength = selectedText.length();
+            QTextBlock block = document()->findBlockByNumber(first);
+            for (int n = first; n <= last && block.isValid() && selections.size() < WORD_MATCH_LIMIT; ++n, block = block.next())
             {
-                ++total_hits;
-                bool left_ok = true;
-                bool right_ok = true;
-                if (pos)
-                {
-                    QChar c = content[pos - 1];
-                    if (c.isLetterOrNumber() || c == '_')
-                        left_ok = false;
-                }
-                if (left_ok && pos < content.length() - wordLength)
-                {
-                    QChar c = content[pos + wordLength];
-                    if (c.isLetterOrNumber() || c == '_')
-                        right_ok = false;
-                }
-
-                if (left_ok && right_ok)
+                const BlockTokens &tokens = _tokens.at(n);
+                QString blockText;
+                for (const auto &word: tokens.words)
                 {
-                    testCursor.setPosition(pos);
-                    testCursor.setPosition(pos + wordLength, QTextCursor::KeepAnchor);
+                    if (word.second != wordLength)
+                        continue;
+                    if (blockText.isNull())
+                        blockText = block.text();
+                    if (blockText.midRef(word.first, wordLength) != selectedText)
+                        continue;
+                    testCursor.setPosition(block.position() + word.first);
+                    testCursor.setPosition(block.position() + word.first + wordLength, QTextCursor::KeepAnchor);
                     s.cursor = testCursor;
                     selections.append(s);
-                    ++counter;
-                }
-            };
-
-            // search current word in both directions
-            // * max word matches in every direction: 100
-            // * max total matches (including partial): 500
-            do
-            {
-                if (pos_forward >= 0)
-                    pos_forward = content.indexOf(selectedText, pos_forward);
-                if (pos_backward >= 0)
-                    pos_backward = content.lastIndexOf(selectedText, pos_backward);
-
-                if (pos_forward >= 0)
-                {
-                    verifyPos(pos_forward, forward_counter);
-                    if (forward_counter == 100)
-                        pos_forward = -1;
-                    else
-                        pos_forward += wordLength;
-                }
-
-                if (pos_backward >= 0)
-                {
-                    verifyPos(pos_backward, backward_counter);
-                    if (backward_counter == 100)
-                        pos_backward = -1;
-                    else
-                        pos_backward -= 1;
                 }
             }
-            while ((pos_backward >= 0 || pos_forward >= 0) && total_hits < 500);
         }
     }
 
@@ -615,14 +581,14 @@ void CodeEditor::onHlTimerTimeout()
         if (c.movePosition(QTextCursor::PreviousCharacter, QTextCursor::KeepAnchor))
         {
             // get bracket to the left and matching one selected
-            left_bracket_selections.append(matchBracket(content, c));
+            left_bracket_selections.append(matchBracket(c));
             c.movePosition(QTextCursor::NextCharacter);
         }
 
         if (c.movePosition(QTextCursor::NextCharacter, QTextCursor::KeepAnchor))
         {
             // get bracket to the right and matching one selected
-            right_bracket_selections.append(matchBracket(content, c, left_bracket_selections.empty() ? 100 : 115));
+            right_bracket_selections.append(matchBracket(c, left_bracket_selections.empty() ? 100 : 115));
         }
     }
 
@@ -650,7 +616,7 @@ void CodeEditor::insertCompletion(const QString &completion)
     tc.insertText(completion.right(extra));
 }
 
-QList<QTextEdit::ExtraSelection> CodeEditor::matchBracket(QString &docContent, const QTextCursor &selectedBracket, int darkerFactor) const
+QList<QTextEdit::ExtraSelection> CodeEditor::matchBracket(const QTextCursor &selectedBracket, int darkerFactor)
 {
     QList<QTextEdit::ExtraSelection> selections;
     QChar c1 = selectedBracket.selectedText()[0];
@@ -669,36 +635,47 @@ QList<QTextEdit::ExtraSelection> CodeEditor::matchBracket(QString &docContent, c
     selection.cursor = selectedBracket;
     selections.append(selection);
 
-    if (docContent.isEmpty())
-        docContent = text();
+    if (_tokens.size() != blockCount())
+        reindex();
 
     int depth = 1;
-    int distance = 0;
     int delta = (c1pos < 3 ? 1 : -1);
-    int length = docContent.length();
-    int pos = selectedBracket.selectionStart();
+    int start = selectedBracket.selectionStart();
+    int pos = -1;
 
-    // manual search to speed it up
-    do
+    // only brackets of blocks are visited
+    QTextBlock block = document()->findBlock(start);
+    for (int n = block.blockNumber(); depth && block.isValid(); n += delta)
     {
-        pos += delta;
-        ++distance;
         // prevent extremely far search
-        if (distance > 500000)
+        if (qAbs(block.position() - start) > 500000)
         {
             selections.clear();
             return selections;
         }
 
-        if (pos < 0 || pos == length)
-            break;
-        QCharRef c = docContent[pos];
-        if ((c != c1 && c != c2) || isEnveloped(pos))
-            continue;
-
-        depth += (c == c1 ? 1 : -1);
+        const QVector<int> &positions = _tokens.at(n).brackets;
+        QString blockText;
+        for (int i = (delta > 0 ? 0 : positions.size() - 1); i >= 0 && i < positions.size(); i += delta)
+        {
+            int p = block.position() + positions.at(i);
+            if (delta > 0 ? p <= start : p >= start)
+                continue;
+            if (blockText.isNull())
+                blockText = block.text();
+            QChar c = blockText.at(positions.at(i));
+            if ((c != c1 && c != c2) || isEnveloped(p))
+                continue;
+
+            depth += (c == c1 ? 1 : -1);
+            if (!depth)
+            {
+                pos = p;
+                break;
+            }
+        }
+        block = (delta > 0 ? block.next() : block.previous());
     }
-    while (depth);
 
     if (depth) // pair is not matched - change color of initial character
         selections[0].format.setBackground(QColor(255,160,160).darker(darkerFactor));
@@ -713,6 +690,75 @@ QList<QTextEdit::ExtraSelection> CodeEditor::matchBracket(QString &docContent, c
     return selections;
 }
 
+void CodeEditor::tokenize(const QTextBlock &block, BlockTokens &tokens)
+{
+    tokens.words.clear();
+    tokens.brackets.clear();
+    QString text = block.text();
+    int wordStart = -1;
+    for (int i = 0; i <= text.length(); ++i)
+    {
+        QChar c = (i < text.length() ? text.at(i) : QChar());
+        if (c.isLetterOrNumber() || c == '_')
+        {
+            if (wordStart < 0)
+                wordStart = i;
+            continue;
+        }
+        if (wordStart >= 0)
+        {
+            tokens.words.append({wordStart, i - wordStart});
+            wordStart = -1;
+        }
+        switch (c.unicode())
+        {
+        case '(': case ')': case '[': case ']': case '{': case '}':
+            tokens.brackets.append(i);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void CodeEditor::reindex()
+{
+    _tokens.clear();
+    _tokens.resize(blockCount());
+    int n = 0;
+    for (QTextBlock block = document()->firstBlock(); block.isValid() && n < _tokens.size(); block = block.next(), ++n)
+        tokenize(block, _tokens[n]);
+}
+
+void CodeEditor::indexContents(int position, int charsRemoved, int charsAdded)
+{
+    Q_UNUSED(charsRemoved);
+    // the index had the previous number of blocks
+    int delta = blockCount() - _tokens.size();
+    QTextBlock first = document()->findBlock(position);
+    QTextBlock last = document()->findBlock(position + charsAdded);
+    if (!first.isValid() || !last.isValid())
+    {
+        reindex();
+        return;
+    }
+
+    int from = first.blockNumber();
+    int count = last.blockNumber() - from + 1;
+    if (count - delta < 0 || from + count - delta > _tokens.size())
+    {
+        reindex();
+        return;
+    }
+    if (delta > 0)
+        _tokens.insert(from, delta, BlockTokens());
+    else if (delta < 0)
+        _tokens.remove(from, -delta);
+
+    for (int n = from; n < from + count && first.isValid(); ++n, first = first.next())
+        tokenize(first, _tokens[n]);
+}
+
 QList<QTextEdit::ExtraSelection> CodeEditor::currentLineSelection() const
 {
     if (isReadOnly() || !SqtSettings::value("highlightCurrentLine", false).toBool())
@@ -3,11 +3,18 @@
 
 #include <QPlainTextEdit>
 #include <QTextBlockUserData>
+#include <QVector>
+#include <QPair>
 
 class CodeBlockProperties;
 class QCompleter;
 class CodeEditor;
 
+// blocks around the viewport searched for the selected word
+#define WORD_MATCH_MARGIN 200
+// max number of highlighted word matches
+#define WORD_MATCH_LIMIT 500
+
 namespace Bookmarks
 {
     CodeBlockProperties* next();
@@ -47,11 +54,23 @@ private slots:
     void updateLeftSideBar(const QRect &rect, int dy);
     void onHlTimerTimeout();
     void insertCompletion(const QString &completion);
+    void indexContents(int position, int charsRemoved, int charsAdded);
 
 private:
-    QList<QTextEdit::ExtraSelection> matchBracket(QString &docContent, const QTextCursor &selectedBracket, int darkerFactor = 100) const;
+    /*!
+     * \brief words and brackets of a block to look them up instead of scanning the text
+     */
+    struct BlockTokens
+    {
+        QVector<QPair<int, int>> words;     ///< <position in block, length>
+        QVector<int> brackets;              ///< positions in block
+    };
+    static void tokenize(const QTextBlock &block, BlockTokens &tokens);
+    void reindex();
+    QList<QTextEdit::ExtraSelection> matchBracket(const QTextCursor &selectedBracket, int darkerFactor = 100);
     QList<QTextEdit::ExtraSelection> currentLineSelection() const;
     bool isEnveloped(int pos) const;
+    QVector<BlockTokens> _tokens;           ///< per block, follows document changes
     QWidget *_leftSideBar;
     QTimer *_hlTimer;
     QCompleter *_completer = nullptr;
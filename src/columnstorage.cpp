@@ -0,0 +1,774 @@
+#include "columnstorage.h"
+#include "spillfile.h"
+#include <QDateTime>
+#include <QHash>
+#include <algorithm>
+#include <cstring>
+
+static const qint64 MSECS_PER_DAY = 86400000;
+
+ColumnStorage::ColumnStorage()
+{
+    _offsets.push_back(0);
+}
+
+void ColumnStorage::markNull(bool isNull)
+{
+    size_t word = size_t(_size) >> 6;
+    if (word == _nulls.size())
+        _nulls.push_back(0);
+    if (isNull)
+        _nulls[word] |= quint64(1) << (_size & 63);
+    ++_size;
+}
+
+char* ColumnStorage::arenaAppend(size_t length)
+{
+    if (_arena.empty() || _arena.back().spilled || _arena.back().data.capacity() - _arena.back().data.size() < length)
+    {
+        size_t capacity = (_arena.empty() ?
+                               size_t(COLUMN_ARENA_FIRST_CHUNK) :
+                               _arena.back().spilled ?
+                                   size_t(COLUMN_ARENA_CHUNK) :
+                                   std::min(_arena.back().data.capacity() * 2, size_t(COLUMN_ARENA_CHUNK)));
+        ArenaChunk chunk;
+        chunk.base = (_arena.empty() ? 0 : _arena.back().base + _arena.back().size());
+        chunk.data.reserve(std::max(capacity, length));
+        _arena.push_back(std::move(chunk));
+    }
+    std::vector<char> &data = _arena.back().data;
+    size_t pos = data.size();
+    data.resize(pos + length);
+    return data.data() + pos;
+}
+
+const char* ColumnStorage::arenaAt(size_t offset) const noexcept
+{
+    if (_arena.empty())
+        return "";
+    // the last chunk of the same base is the one holding the bytes (the previous ones are empty)
+    auto it = std::upper_bound(_arena.cbegin(), _arena.cend(), offset,
+                               [](size_t o, const ArenaChunk &c) { return o < c.base; });
+    --it;
+    return it->bytes() + (offset - it->base);
+}
+
+quint32 ColumnStorage::encode(const char *utf8, int length)
+{
+    if (length <= 0)
+        return 0;
+    if (_dict_slots.empty())
+        rehashDictionary(64);
+    size_t mask = _dict_slots.size() - 1;
+    for (size_t i = qHashBits(utf8, size_t(length)) & mask; ; i = (i + 1) & mask)
+    {
+        quint32 slot = _dict_slots[i];
+        if (!slot)
+        {
+            // the empty string is not counted
+            size_t distinct = _offsets.size() - 2;
+            if (distinct >= COLUMN_DICT_MAX_VALUES ||
+                    (distinct >= COLUMN_DICT_PROBE_VALUES && distinct * 2 > size_t(_size)))
+            {
+                expandDictionary();
+                return 0;
+            }
+            memcpy(arenaAppend(size_t(length)), utf8, size_t(length));
+            _offsets.push_back(_offsets.back() + size_t(length));
+            quint32 code = quint32(_offsets.size() - 2);
+            _dict_slots[i] = code + 1;
+            if (code * 2 >= _dict_slots.size())
+                rehashDictionary(_dict_slots.size() * 2);
+            return code;
+        }
+        quint32 code = slot - 1;
+        size_t start = _offsets[code];
+        if (_offsets[code + 1] - start == size_t(length) && !memcmp(arenaAt(start), utf8, size_t(length)))
+            return code;
+    }
+}
+
+void ColumnStorage::rehashDictionary(size_t slots)
+{
+    std::vector<quint32>(slots, 0).swap(_dict_slots);
+    size_t mask = slots - 1;
+    for (quint32 code = 1; code + 1 < _offsets.size(); ++code)
+    {
+        size_t start = _offsets[code];
+        size_t i = qHashBits(arenaAt(start), _offsets[code + 1] - start) & mask;
+        while (_dict_slots[i])
+            i = (i + 1) & mask;
+        _dict_slots[i] = code + 1;
+    }
+}
+
+void ColumnStorage::expandDictionary()
+{
+    ColumnStorage plain;
+    plain._dict = false;
+    plain._offsets.reserve(size_t(_size) + 1);
+    for (int i = 0; i < _size; ++i)
+    {
+        // null rows refer to the empty string
+        int length;
+        const char *data = utf8At(i, length);
+        if (length)
+            memcpy(plain.arenaAppend(size_t(length)), data, size_t(length));
+        plain._offsets.push_back(plain._offsets.back() + size_t(length));
+    }
+    _arena.swap(plain._arena);
+    _offsets.swap(plain._offsets);
+    _dict = false;
+    std::vector<quint32>().swap(_codes);
+    std::vector<quint32>().swap(_dict_slots);
+}
+
+void ColumnStorage::setKind(Kind kind)
+{
+    // fill the gap with placeholders of leading nulls
+    size_t n = size_t(_size);
+    switch (kind)
+    {
+    case Kind::Int32:
+    case Kind::Time:
+        _i32.resize(n, 0);
+        break;
+    case Kind::Int64:
+    case Kind::Date:
+    case Kind::DateTime:
+        _i64.resize(n, 0);
+        break;
+    case Kind::Float:
+        _flt.resize(n, 0);
+        break;
+    case Kind::Double:
+        _dbl.resize(n, 0);
+        break;
+    case Kind::Bool:
+        _bool.resize(n, 0);
+        break;
+    case Kind::String:
+        if (_dict)
+        {
+            _codes.resize(n, 0);
+            // code 0 is the empty string
+            _offsets.assign(2, 0);
+        }
+        else
+            _offsets.resize(n + 1, 0);
+        break;
+    case Kind::Variant:
+        _var.resize(n);
+        break;
+    case Kind::Unknown:
+        break;
+    }
+    _kind = kind;
+}
+
+bool ColumnStorage::accept(Kind kind)
+{
+    if (_kind == kind)
+        return true;
+    if (_kind == Kind::Unknown)
+    {
+        setKind(kind);
+        return true;
+    }
+    if (_kind != Kind::Variant)
+        demote();
+    return false;
+}
+
+void ColumnStorage::demote()
+{
+    int width = displayWidth();
+    std::vector<QVariant> values;
+    values.reserve(size_t(_size));
+    for (int i = 0; i < _size; ++i)
+        values.push_back(value(i));
+    std::vector<quint64> nulls;
+    nulls.swap(_nulls);
+    // truncated rows keep their prefixes, the whole values stay within the file
+    std::map<int, LongValue> long_values;
+    long_values.swap(_long);
+    int size = _size;
+    clear();
+    _nulls.swap(nulls);
+    _long.swap(long_values);
+    _size = size;
+    _var.swap(values);
+    _kind = Kind::Variant;
+    _width = width;
+}
+
+void ColumnStorage::appendNull()
+{
+    switch (_kind)
+    {
+    case Kind::Int32:
+    case Kind::Time:
+        _i32.push_back(0);
+        break;
+    case Kind::Int64:
+    case Kind::Date:
+    case Kind::DateTime:
+        _i64.push_back(0);
+        break;
+    case Kind::Float:
+        _flt.push_back(0);
+        break;
+    case Kind::Double:
+        _dbl.push_back(0);
+        break;
+    case Kind::Bool:
+        _bool.push_back(0);
+        break;
+    case Kind::String:
+        if (_dict)
+            _codes.push_back(0);
+        else
+            _offsets.push_back(_offsets.back());
+        break;
+    case Kind::Variant:
+        _var.push_back(QVariant());
+        break;
+    case Kind::Unknown:
+        break;
+    }
+    markNull(true);
+}
+
+void ColumnStorage::appendInt32(qint32 value)
+{
+    if (!accept(Kind::Int32))
+        return appendVariant(value);
+    _i32.push_back(value);
+    _int_min = std::min(_int_min, qint64(value));
+    _int_max = std::max(_int_max, qint64(value));
+    markNull(false);
+}
+
+void ColumnStorage::appendInt64(qint64 value)
+{
+    if (!accept(Kind::Int64))
+        return appendVariant(value);
+    _i64.push_back(value);
+    _int_min = std::min(_int_min, value);
+    _int_max = std::max(_int_max, value);
+    markNull(false);
+}
+
+void ColumnStorage::appendFloat(float value)
+{
+    if (!accept(Kind::Float))
+        return appendVariant(value);
+    _flt.push_back(value);
+    markNull(false);
+}
+
+void ColumnStorage::appendDouble(double value)
+{
+    if (!accept(Kind::Double))
+        return appendVariant(value);
+    _dbl.push_back(value);
+    markNull(false);
+}
+
+void ColumnStorage::appendBool(bool value)
+{
+    if (!accept(Kind::Bool))
+        return appendVariant(value);
+    _bool.push_back(value ? 1 : 0);
+    markNull(false);
+}
+
+void ColumnStorage::appendString(const char *utf8, int length)
+{
+    if (!accept(Kind::String))
+        return appendVariant(QString::fromUtf8(utf8, length));
+    // chars are not more than bytes, so shorter values are not counted
+    if (length > _width)
+        _width = std::max(_width, utf8Chars(utf8, length));
+    if (_dict)
+    {
+        quint32 code = encode(utf8, length);
+        // the encoding may be turned off by the value
+        if (_dict)
+        {
+            _codes.push_back(code);
+            return markNull(false);
+        }
+    }
+    if (length > 0)
+        memcpy(arenaAppend(size_t(length)), utf8, size_t(length));
+    _offsets.push_back(_offsets.back() + size_t(qMax(length, 0)));
+    markNull(false);
+}
+
+void ColumnStorage::appendString(const QString &value)
+{
+    if (_kind != Kind::String && _kind != Kind::Unknown)
+        return appendVariant(value);
+    QByteArray utf8 = value.toUtf8();
+    appendString(utf8.constData(), utf8.size());
+}
+
+void ColumnStorage::appendVariant(const QVariant &value)
+{
+    if (value.isNull())
+        return appendNull();
+
+    if (_kind != Kind::Variant)
+    {
+        switch (QMetaType::Type(value.type()))
+        {
+        case QMetaType::Int:
+            if (_kind == Kind::Int32 || _kind == Kind::Unknown)
+                return appendInt32(value.toInt());
+            break;
+        case QMetaType::LongLong:
+            if (_kind == Kind::Int64 || _kind == Kind::Unknown)
+                return appendInt64(value.toLongLong());
+            break;
+        case QMetaType::Float:
+            if (_kind == Kind::Float || _kind == Kind::Unknown)
+                return appendFloat(value.toFloat());
+            break;
+        case QMetaType::Double:
+            if (_kind == Kind::Double || _kind == Kind::Unknown)
+                return appendDouble(value.toDouble());
+            break;
+        case QMetaType::Bool:
+            if (_kind == Kind::Bool || _kind == Kind::Unknown)
+                return appendBool(value.toBool());
+            break;
+        case QMetaType::QString:
+            if (_kind == Kind::String || _kind == Kind::Unknown)
+                return appendString(value.toString());
+            break;
+        case QMetaType::QDate:
+            if (accept(Kind::Date))
+            {
+                _i64.push_back(value.toDate().toJulianDay());
+                return markNull(false);
+            }
+            break;
+        case QMetaType::QTime:
+            if (accept(Kind::Time))
+            {
+                _i32.push_back(value.toTime().msecsSinceStartOfDay());
+                return markNull(false);
+            }
+            break;
+        case QMetaType::QDateTime:
+        {
+            QDateTime dt = value.toDateTime();
+            if (dt.isValid() && accept(Kind::DateTime))
+            {
+                _i64.push_back(dt.date().toJulianDay() * MSECS_PER_DAY + dt.time().msecsSinceStartOfDay());
+                return markNull(false);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+        if (_kind == Kind::Unknown)
+            setKind(Kind::Variant);
+        else if (_kind != Kind::Variant)
+            demote();
+    }
+    _var.push_back(value);
+    _width = std::max(_width, value.toString().length());
+    markNull(false);
+}
+
+QVariant ColumnStorage::value(int row) const
+{
+    if (row < 0 || row >= _size || isNull(row))
+        return QVariant();
+
+    size_t i = size_t(row);
+    switch (_kind)
+    {
+    case Kind::Int32:
+        return _i32[i];
+    case Kind::Int64:
+        return _i64[i];
+    case Kind::Float:
+        return _flt[i];
+    case Kind::Double:
+        return _dbl[i];
+    case Kind::Bool:
+        return _bool[i] != 0;
+    case Kind::String:
+        return stringAt(row);
+    case Kind::Date:
+        return QDate::fromJulianDay(_i64[i]);
+    case Kind::Time:
+        return QTime::fromMSecsSinceStartOfDay(_i32[i]);
+    case Kind::DateTime:
+    {
+        qint64 v = _i64[i];
+        return QDateTime(QDate::fromJulianDay(v / MSECS_PER_DAY),
+                         QTime::fromMSecsSinceStartOfDay(int(v % MSECS_PER_DAY)));
+    }
+    case Kind::Variant:
+        return _var[i];
+    case Kind::Unknown:
+        break;
+    }
+    return QVariant();
+}
+
+QString ColumnStorage::stringAt(int row) const
+{
+    if (_kind != Kind::String)
+        return value(row).toString();
+    int length;
+    const char *data = utf8At(row, length);
+    return QString::fromUtf8(data, length);
+}
+
+bool ColumnStorage::appendTruncated(const char *utf8, int length, int prefix, const std::shared_ptr<SpillFile> &file)
+{
+    std::shared_ptr<const char> mapped = (length > prefix ? file->append(utf8, size_t(length)) : nullptr);
+    if (!mapped)
+    {
+        appendString(utf8, length);
+        return false;
+    }
+    // continuation bytes of utf-8 are 10xxxxxx
+    while (prefix > 0 && (uchar(utf8[prefix]) & 0xC0) == 0x80)
+        --prefix;
+    _long.insert(std::make_pair(_size, LongValue { mapped, length }));
+    appendString(utf8, prefix);
+    return true;
+}
+
+QString ColumnStorage::wholeString(int row) const
+{
+    auto it = _long.find(row);
+    if (it == _long.end())
+        return stringAt(row);
+    return QString::fromUtf8(it->second.data.get(), it->second.length);
+}
+
+void ColumnStorage::take(ColumnStorage &src)
+{
+    if (&src == this || !src._size)
+        return;
+
+    if (!_size)
+    {
+        std::swap(*this, src);
+        src.clear();
+        return;
+    }
+
+    for (const auto &v: src._long)
+        _long.insert(std::make_pair(v.first + _size, v.second));
+
+    if (src._kind == Kind::Unknown)
+    {
+        for (int i = 0; i < src._size; ++i)
+            appendNull();
+        src.clear();
+        return;
+    }
+
+    if (_kind == Kind::Unknown)
+        setKind(src._kind);
+
+    if (_kind != src._kind)
+    {
+        for (int i = 0; i < src._size; ++i)
+            appendVariant(src.value(i));
+        src.clear();
+        return;
+    }
+
+    bool encoded = false;
+    if (_kind == Kind::String && _dict && src._dict)
+    {
+        // codes of the source mean nothing within this dictionary, its distinct values are encoded once
+        std::vector<quint32> remap(src._offsets.size() - 1, 0);
+        for (size_t code = 1; code < remap.size() && _dict; ++code)
+        {
+            size_t start = src._offsets[code];
+            remap[code] = encode(src.arenaAt(start), int(src._offsets[code + 1] - start));
+        }
+        // the encoding may be turned off by the values
+        if (_dict)
+        {
+            _codes.reserve(_codes.size() + src._codes.size());
+            for (quint32 code: src._codes)
+                _codes.push_back(remap[code]);
+            encoded = true;
+        }
+    }
+    else if (_kind == Kind::String && _dict)
+    {
+        for (int i = 0; i < src._size; ++i)
+        {
+            if (src.isNull(i))
+            {
+                appendNull();
+                continue;
+            }
+            int length;
+            const char *data = src.utf8At(i, length);
+            appendString(data, length);
+        }
+        src.clear();
+        return;
+    }
+    // the arena of plain values is moved as is
+    if (_kind == Kind::String && !_dict && src._dict)
+        src.expandDictionary();
+
+    _width = std::max(_width, src._width);
+    _int_min = std::min(_int_min, src._int_min);
+    _int_max = std::max(_int_max, src._int_max);
+    switch (_kind)
+    {
+    case Kind::Int32:
+    case Kind::Time:
+        _i32.insert(_i32.end(), src._i32.begin(), src._i32.end());
+        break;
+    case Kind::Int64:
+    case Kind::Date:
+    case Kind::DateTime:
+        _i64.insert(_i64.end(), src._i64.begin(), src._i64.end());
+        break;
+    case Kind::Float:
+        _flt.insert(_flt.end(), src._flt.begin(), src._flt.end());
+        break;
+    case Kind::Double:
+        _dbl.insert(_dbl.end(), src._dbl.begin(), src._dbl.end());
+        break;
+    case Kind::Bool:
+        _bool.insert(_bool.end(), src._bool.begin(), src._bool.end());
+        break;
+    case Kind::String:
+    {
+        if (encoded)
+            break;
+        size_t shift = _offsets.back();
+        if (src._offsets.back() < COLUMN_ARENA_CHUNK)
+        {
+            // small portions are packed together, a value never spans chunks
+            for (const ArenaChunk &c: src._arena)
+            {
+                if (c.size())
+                    memcpy(arenaAppend(c.size()), c.bytes(), c.size());
+            }
+        }
+        else
+        {
+            for (ArenaChunk &c: src._arena)
+            {
+                c.base += shift;
+                _arena.push_back(std::move(c));
+            }
+        }
+        _offsets.reserve(_offsets.size() + src._offsets.size() - 1);
+        for (auto it = src._offsets.begin() + 1; it != src._offsets.end(); ++it)
+            _offsets.push_back(*it + shift);
+        break;
+    }
+    case Kind::Variant:
+        _var.insert(_var.end(), src._var.begin(), src._var.end());
+        break;
+    case Kind::Unknown:
+        break;
+    }
+
+    // null bitmap: whole words are moved as is if aligned
+    if ((_size & 63) == 0)
+    {
+        _nulls.insert(_nulls.end(), src._nulls.begin(), src._nulls.end());
+        _size += src._size;
+    }
+    else
+    {
+        for (int i = 0; i < src._size; ++i)
+            markNull(src.isNull(i));
+    }
+    src.clear();
+}
+
+qint64 ColumnStorage::residentBytes() const noexcept
+{
+    qint64 bytes = qint64(sizeof(ColumnStorage) +
+                          _nulls.capacity() * sizeof(quint64) +
+                          _i32.capacity() * sizeof(qint32) +
+                          _i64.capacity() * sizeof(qint64) +
+                          _flt.capacity() * sizeof(float) +
+                          _dbl.capacity() * sizeof(double) +
+                          _bool.capacity() +
+                          _offsets.capacity() * sizeof(size_t) +
+                          _codes.capacity() * sizeof(quint32) +
+                          _dict_slots.capacity() * sizeof(quint32) +
+                          _var.capacity() * sizeof(QVariant) +
+                          _arena.capacity() * sizeof(ArenaChunk));
+    for (const ArenaChunk &c: _arena)
+        bytes += qint64(c.data.capacity());
+    // a node of the tree holds three pointers and the color besides the pair
+    bytes += qint64(_long.size() * (sizeof(std::pair<const int, LongValue>) + 4 * sizeof(void*)));
+    return bytes;
+}
+
+qint64 ColumnStorage::spillChunk(const std::shared_ptr<SpillFile> &file, size_t chunk)
+{
+    // the last chunk is still being filled
+    if (chunk + 1 >= _arena.size())
+        return 0;
+    ArenaChunk &c = _arena[chunk];
+    if (c.spilled || c.data.empty())
+        return 0;
+    std::shared_ptr<const char> mapped = file->append(c.data.data(), c.data.size());
+    if (!mapped)
+        return 0;
+    c.spilled = mapped;
+    c.spilledSize = c.data.size();
+    qint64 released = qint64(c.data.capacity());
+    std::vector<char>().swap(c.data);
+    return released;
+}
+
+void ColumnStorage::findText(int from, int to, int length, const std::function<const char*(const char*, const char*)> &find,
+                             std::vector<int> &rows) const
+{
+    if (_kind != Kind::String || length <= 0 || from >= to)
+        return;
+    // hit() gets indexes of values within _offsets, a chunk never splits a value
+    auto scan = [this, length, &find](size_t first, size_t last, const std::function<void(size_t)> &hit) {
+        size_t start = _offsets[first];
+        const size_t end = _offsets[last];
+        auto chunk = std::upper_bound(_arena.cbegin(), _arena.cend(), start,
+                                      [](size_t o, const ArenaChunk &c) { return o < c.base; });
+        if (chunk != _arena.cbegin())
+            --chunk;
+        for (; chunk != _arena.cend() && start < end; ++chunk)
+        {
+            const size_t stop = std::min(end, chunk->base + chunk->size());
+            if (stop <= start)
+                continue;
+            const char *data = chunk->bytes();
+            const char *p = data + (start - chunk->base);
+            const char *limit = data + (stop - chunk->base);
+            while (p < limit)
+            {
+                const char *m = find(p, limit);
+                if (!m)
+                    break;
+                const size_t o = chunk->base + size_t(m - data);
+                const size_t v = size_t(std::upper_bound(_offsets.cbegin() + first, _offsets.cbegin() + last + 1, o) -
+                                        _offsets.cbegin()) - 1;
+                const size_t value_end = _offsets[v + 1];
+                if (o + size_t(length) > value_end)
+                {
+                    p = m + 1;
+                    continue;
+                }
+                hit(v);
+                // the rest of the value is not scanned
+                p = data + (value_end - chunk->base);
+            }
+            start = stop;
+        }
+    };
+
+    const size_t found = rows.size();
+    if (!_dict)
+        scan(size_t(from), size_t(to), [&rows](size_t v) { rows.push_back(int(v)); });
+    else
+    {
+        std::vector<quint8> verdicts(_offsets.size() - 1, 0);
+        scan(0, _offsets.size() - 1, [&verdicts](size_t v) { verdicts[v] = 1; });
+        for (int r = from; r < to; ++r)
+        {
+            if (verdicts[_codes[size_t(r)]])
+                rows.push_back(r);
+        }
+    }
+    if (_long.empty())
+        return;
+    for (auto it = _long.lower_bound(from); it != _long.end() && it->first < to; ++it)
+    {
+        if (find(it->second.data.get(), it->second.data.get() + it->second.length))
+            rows.push_back(it->first);
+    }
+    std::sort(rows.begin() + std::ptrdiff_t(found), rows.end());
+    rows.erase(std::unique(rows.begin() + std::ptrdiff_t(found), rows.end()), rows.end());
+}
+
+void ColumnStorage::clear()
+{
+    _kind = Kind::Unknown;
+    _size = 0;
+    std::vector<quint64>().swap(_nulls);
+    std::vector<qint32>().swap(_i32);
+    std::vector<qint64>().swap(_i64);
+    std::vector<float>().swap(_flt);
+    std::vector<double>().swap(_dbl);
+    std::vector<quint8>().swap(_bool);
+    std::vector<ArenaChunk>().swap(_arena);
+    std::vector<size_t>(1, 0).swap(_offsets);
+    std::vector<QVariant>().swap(_var);
+    _dict = true;
+    std::vector<quint32>().swap(_codes);
+    std::vector<quint32>().swap(_dict_slots);
+    _width = 0;
+    _int_min = 0;
+    _int_max = 0;
+    _long.clear();
+}
+
+static int digits(qint64 value) noexcept
+{
+    int n = (value < 0 ? 2 : 1);
+    for (value /= 10; value; value /= 10)
+        ++n;
+    return n;
+}
+
+int ColumnStorage::displayWidth() const noexcept
+{
+    switch (_kind)
+    {
+    case Kind::Int32:
+    case Kind::Int64:
+        return std::max(digits(_int_min), digits(_int_max));
+    case Kind::Float:
+        return 12;
+    case Kind::Double:
+        // the shortest representation of most of doubles
+        return 18;
+    case Kind::Bool:
+        return 5;
+    case Kind::Date:
+        return 10;
+    case Kind::Time:
+        return 12;
+    case Kind::DateTime:
+        return 23;
+    case Kind::String:
+    case Kind::Variant:
+        return _width;
+    case Kind::Unknown:
+        break;
+    }
+    return 0;
+}
+
+int ColumnStorage::utf8Chars(const char *utf8, int length) noexcept
+{
+    // continuation bytes are 10xxxxxx
+    int n = 0;
+    for (int i = 0; i < length; ++i)
+        n += ((utf8[i] & 0xC0) != 0x80);
+    return n;
+}
@@ -0,0 +1,197 @@
+#ifndef COLUMNSTORAGE_H
+#define COLUMNSTORAGE_H
+
+#include <QtGlobal>
+#include <QVariant>
+#include <QString>
+#include <vector>
+#include <memory>
+#include <map>
+#include <functional>
+
+// max size of a chunk of textual values, bytes
+#define COLUMN_ARENA_CHUNK (1024 * 1024)
+// size of the first chunk, the next ones are twice as large up to COLUMN_ARENA_CHUNK
+#define COLUMN_ARENA_FIRST_CHUNK 4096
+// distinct textual values of a dictionary encoded column, more of them turn the encoding off
+#define COLUMN_DICT_MAX_VALUES 4096
+// distinct values enough to tell the encoding is useless if they are more than half of rows
+#define COLUMN_DICT_PROBE_VALUES 256
+
+/*!
+ * \brief Single column values of a DataTable.
+ * Storage type is determined by the first non-null value appended. Fixed-width
+ * values are kept in typed buffers, textual values are kept as utf-8 within
+ * an arena of chunks. Nulls are tracked by a bitmap. If a value of another type
+ * arrives, the column falls back to QVariant storage.
+ *
+ * Chunks are never reallocated: growing the column does not copy strings, and take()
+ * moves chunks of a large source instead of copying their bytes.
+ *
+ * Sealed chunks (all but the last one) may be spilled into a SpillFile: their bytes are
+ * released and read through the mapping of the file from then on.
+ *
+ * Textual columns are dictionary encoded while they have few distinct values:
+ * the arena keeps every distinct value once and rows refer to them by codes.
+ * Once turned off (too many distinct values) the encoding stays off until clear().
+ */
+class SpillFile;
+
+class ColumnStorage
+{
+public:
+    enum class Kind : quint8 { Unknown, Int32, Int64, Float, Double, Bool, String, Date, Time, DateTime, Variant };
+
+    ColumnStorage();
+
+    void appendNull();
+    void appendInt32(qint32 value);
+    void appendInt64(qint64 value);
+    void appendFloat(float value);
+    void appendDouble(double value);
+    void appendBool(bool value);
+    void appendString(const char *utf8, int length);
+    void appendString(const QString &value);
+    void appendVariant(const QVariant &value);
+
+    Kind kind() const noexcept { return _kind; }
+    int size() const noexcept { return _size; }
+    bool isNull(int row) const noexcept
+    {
+        return (_nulls[size_t(row) >> 6] >> (row & 63)) & 1;
+    }
+    QVariant value(int row) const;
+    QString stringAt(int row) const;
+    /*!
+     * \brief append the beginning of the long text keeping the whole value within the file
+     * \param prefix bytes kept within the column (cut at a character boundary)
+     * \return false if the file failed (the whole value is appended then)
+     */
+    bool appendTruncated(const char *utf8, int length, int prefix, const std::shared_ptr<SpillFile> &file);
+    bool isTruncated(int row) const noexcept { return !_long.empty() && _long.count(row); }
+    /*!
+     * \brief the whole value of the row, the regular accessors return the prefix of truncated values
+     */
+    QString wholeString(int row) const;
+
+    // raw values of non-null rows, the accessor must match the kind
+    // (Time shares Int32 buffer, Date and DateTime share Int64 buffer)
+    qint32 int32At(int row) const noexcept { return _i32[size_t(row)]; }
+    qint64 int64At(int row) const noexcept { return _i64[size_t(row)]; }
+    float floatAt(int row) const noexcept { return _flt[size_t(row)]; }
+    double doubleAt(int row) const noexcept { return _dbl[size_t(row)]; }
+    bool boolAt(int row) const noexcept { return _bool[size_t(row)] != 0; }
+    const char* utf8At(int row, int &length) const noexcept
+    {
+        size_t i = (_dict ? _codes[size_t(row)] : size_t(row));
+        size_t start = _offsets[i];
+        length = int(_offsets[i + 1] - start);
+        return arenaAt(start);
+    }
+    bool isDictionaryEncoded() const noexcept { return _dict && _kind == Kind::String; }
+    /*!
+     * \brief code of the distinct value of the row within a dictionary encoded column
+     *
+     * Equal values have equal codes (0 is the empty string), codes are not ordered.
+     */
+    quint32 dictionaryCode(int row) const noexcept { return _codes[size_t(row)]; }
+
+    /*!
+     * \brief max length of values as grids show them (chars), tracked while appending
+     *
+     * Fixed-width kinds are estimated by the kind (and the range of integers).
+     */
+    int displayWidth() const noexcept;
+    static int utf8Chars(const char *utf8, int length) noexcept;
+
+    // moves all the values of src to the end of this column
+    // (distinct values of a dictionary encoded src are encoded once, not every row)
+    void take(ColumnStorage &src);
+    void clear();
+    /*!
+     * \brief bytes allocated by the column, the values, the strings and the row overhead
+     * (values of QVariant storage are estimated by sizeof, spilled chunks are not counted)
+     */
+    qint64 residentBytes() const noexcept;
+    /*!
+     * \brief move the sealed chunk of the arena into the file
+     * \return bytes released, 0 if the chunk is the last one, spilled already or failed to be written
+     */
+    qint64 spillChunk(const std::shared_ptr<SpillFile> &file, size_t chunk);
+    /*!
+     * \brief chunks of the arena, the last one is not sealed
+     */
+    size_t chunkCount() const noexcept { return _arena.size(); }
+    /*!
+     * \brief rows of [from, to) whose text holds a match of length bytes, in order
+     * \param find the first match within the bytes [begin, end), nullptr if none
+     *
+     * The arena is scanned chunk by chunk as the values lie one after another, a match crossing
+     * the end of a value is skipped. Distinct values of a dictionary encoded column are scanned
+     * once, whole values of truncated rows are scanned within the file.
+     */
+    void findText(int from, int to, int length, const std::function<const char*(const char*, const char*)> &find,
+                  std::vector<int> &rows) const;
+
+private:
+    void setKind(Kind kind);
+    // makes sure the storage can accept value of the kind
+    bool accept(Kind kind);
+    void demote();
+    void markNull(bool isNull);
+    /*!
+     * \brief room for length bytes at the end of the arena, within a single chunk
+     */
+    char* arenaAppend(size_t length);
+    const char* arenaAt(size_t offset) const noexcept;
+    /*!
+     * \brief code of the value, added to the dictionary if new (the encoding may be turned off meanwhile)
+     */
+    quint32 encode(const char *utf8, int length);
+    void rehashDictionary(size_t slots);
+    /*!
+     * \brief store values of every row within the arena and drop the dictionary
+     */
+    void expandDictionary();
+
+    struct ArenaChunk
+    {
+        size_t base;                ///< offset of the first byte within the whole arena
+        std::vector<char> data;     ///< capacity is reserved once
+        std::shared_ptr<const char> spilled;    ///< bytes mapped from the file instead of data
+        size_t spilledSize = 0;
+
+        const char* bytes() const noexcept { return spilled ? spilled.get() : data.data(); }
+        size_t size() const noexcept { return spilled ? spilledSize : data.size(); }
+    };
+
+    Kind _kind = Kind::Unknown;
+    int _size = 0;
+    std::vector<quint64> _nulls;
+    // Int32, Time (msecs since midnight)
+    std::vector<qint32> _i32;
+    // Int64, Date (julian day), DateTime (julian day * msecs per day + msecs since midnight)
+    std::vector<qint64> _i64;
+    std::vector<float> _flt;
+    std::vector<double> _dbl;
+    std::vector<quint8> _bool;
+    std::vector<ArenaChunk> _arena;
+    // offsets within the whole arena, value i is [_offsets[i], _offsets[i + 1])
+    // (of distinct values if the dictionary is used)
+    std::vector<size_t> _offsets;
+    bool _dict = true;
+    std::vector<quint32> _codes;        ///< distinct value of every row
+    std::vector<quint32> _dict_slots;   ///< open addressing hash of codes + 1, 0 is a free slot
+    std::vector<QVariant> _var;
+    struct LongValue
+    {
+        std::shared_ptr<const char> data;   ///< mapped from the file
+        int length;
+    };
+    std::map<int, LongValue> _long;     ///< whole values of truncated rows
+    int _width = 0;             ///< max length of textual and QVariant values, chars
+    qint64 _int_min = 0;        ///< range of integer values
+    qint64 _int_max = 0;
+};
+
+#endif // COLUMNSTORAGE_H
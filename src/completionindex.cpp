@@ -0,0 +1,90 @@
+#include "completionindex.h"
+#include "datatable.h"
+#include <QHash>
+#include <QPair>
+#include <algorithm>
+#include <numeric>
+
+CompletionIndex::CompletionIndex(const DataTable &source) :
+    _table(new DataTable(source))
+{
+    const int rows = _table->rowCount();
+    QVector<QString> names(rows);
+    for (int i = 0; i < rows; ++i)
+        names[i] = _table->value(i, 0).toString().toLower();
+    _rows.resize(rows);
+    std::iota(_rows.begin(), _rows.end(), 0);
+    std::stable_sort(_rows.begin(), _rows.end(), [&names](int l, int r) { return names.at(l) < names.at(r); });
+    _keys.reserve(rows);
+    for (int row: _rows)
+        _keys.append(names.at(row));
+}
+
+CompletionIndex::~CompletionIndex() = default;
+
+void CompletionIndex::appendRow(DataTable &dst, int index) const
+{
+    int row = _rows.at(index);
+    QVector<QVariant> values(_table->columnCount());
+    for (int c = 0; c < values.size(); ++c)
+        values[c] = _table->value(row, c);
+    dst.appendRow(values);
+}
+
+DataTable* CompletionIndex::filter(const QString &prefix, int limit) const
+{
+    DataTable *res = new DataTable();
+    for (int c = 0; c < _table->columnCount(); ++c)
+        res->addColumn(new DataColumn(_table->getColumn(c)));
+
+    QString key = prefix.toLower();
+    auto first = std::lower_bound(_keys.cbegin(), _keys.cend(), key);
+    int begin = int(first - _keys.cbegin());
+    int end = begin;
+    for (; end < _keys.size() && res->rowCount() < limit && _keys.at(end).startsWith(key); ++end)
+        appendRow(*res, end);
+
+    // substrings are looked for only if prefixes are not enough
+    if (!key.isEmpty() && res->rowCount() < limit)
+    {
+        for (int i = 0; i < _keys.size() && res->rowCount() < limit; ++i)
+        {
+            if (i == begin)
+                i = end;
+            if (i < _keys.size() && _keys.at(i).contains(key))
+                appendRow(*res, i);
+        }
+    }
+    return res;
+}
+
+// indexes are used by the gui thread only
+static QHash<QString, QPair<std::shared_ptr<const CompletionIndex>, quint64>> _indexes;
+static quint64 _serial = 0;
+
+std::shared_ptr<const CompletionIndex> CompletionIndex::cached(const QString &key)
+{
+    auto it = _indexes.find(key);
+    if (key.isEmpty() || it == _indexes.end())
+        return nullptr;
+    it->second = ++_serial;
+    return it->first;
+}
+
+void CompletionIndex::cache(const QString &key, std::shared_ptr<const CompletionIndex> index)
+{
+    if (key.isEmpty())
+        return;
+    // evict the least recently used index
+    if (_indexes.size() >= COMPLETION_INDEX_CACHE_SIZE && !_indexes.contains(key))
+    {
+        auto lru = _indexes.begin();
+        for (auto i = _indexes.begin(); i != _indexes.end(); ++i)
+        {
+            if (i->second < lru->second)
+                lru = i;
+        }
+        _indexes.erase(lru);
+    }
+    _indexes.insert(key, {index, ++_serial});
+}
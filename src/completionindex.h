@@ -0,0 +1,44 @@
+#ifndef COMPLETIONINDEX_H
+#define COMPLETIONINDEX_H
+
+#include <QString>
+#include <QVector>
+#include <memory>
+
+class DataTable;
+
+// completion candidates passed to the completer at most
+#define COMPLETION_LIMIT 200
+// indexes of autocomplete sources kept at once
+#define COMPLETION_INDEX_CACHE_SIZE 32
+
+/*!
+ * \brief Autocomplete source (names in the first column) sorted once for prefix lookups.
+ *
+ * Indexes are shared by the editors and reused while the key of the source
+ * (script, catalog and session state) stays the same.
+ */
+class CompletionIndex
+{
+public:
+    explicit CompletionIndex(const DataTable &source);
+    ~CompletionIndex();
+    /*!
+     * \brief rows starting with the prefix followed by rows containing it (case-insensitively)
+     */
+    DataTable* filter(const QString &prefix, int limit = COMPLETION_LIMIT) const;
+
+    static std::shared_ptr<const CompletionIndex> cached(const QString &key);
+    /*!
+     * \brief keep the index, empty key is ignored
+     */
+    static void cache(const QString &key, std::shared_ptr<const CompletionIndex> index);
+
+private:
+    std::unique_ptr<DataTable> _table;
+    QVector<QString> _keys;     ///< lowercase names, sorted
+    QVector<int> _rows;         ///< rows of _table ordered as _keys
+    void appendRow(DataTable &dst, int index) const;
+};
+
+#endif // COMPLETIONINDEX_H
@@ -1,6 +1,9 @@
 #include "copycontext.h"
 #include <QRegularExpression>
 
+// amount of COPY TO output kept for the log widget
+#define COPY_LOG_TAIL (64 * 1024)
+
 void PgCopyContext::init(const QString &query)
 {
     clear();
@@ -34,7 +37,9 @@ void PgCopyContext::init(const QString &query)
 
 void PgCopyContext::clear()
 {
-    _file.close();
+    finishDestination();
+    _source.close();
+    _inline.reset();
     _srcFiles.clear();
     _dstFiles.clear();
     _curSrcIndex = -1;
@@ -44,27 +49,31 @@ void PgCopyContext::clear()
 
 bool PgCopyContext::nextSource()
 {
-    if (_file.isOpen())
-        _file.close();
+    _source.close();
+    _inline.reset();
     if (++_curSrcIndex > _srcFiles.size() - 1)
     {
         emit error(tr("COPY source file is not specified.\n"
                       "  Use special comment to pass source file: /*sqt CopySrc(<file>) */"));
         return false;
     }
-    _file.setFileName(_srcFiles[_curSrcIndex]);
-    if (!_file.open(QIODevice::ReadOnly))
+    if (!_source.open(_srcFiles[_curSrcIndex]))
     {
-        emit error(_file.errorString());
+        emit error(_source.errorString());
         return false;
     }
     return true;
 }
 
+void PgCopyContext::setInlineSource(std::shared_ptr<CopyPipe> data)
+{
+    _source.close();
+    _inline = data;
+}
+
 bool PgCopyContext::nextDestination()
 {
-    if (_file.isOpen())
-        _file.close();
+    finishDestination();
     if (++_curDstIndex > _dstFiles.size() - 1)
     {
         emit error(tr("COPY destination file is not specified.\n"
@@ -77,10 +86,9 @@ bool PgCopyContext::nextDestination()
     if (_dstFiles[_curDstIndex].isEmpty())
         return true;
 
-    _file.setFileName(_dstFiles[_curDstIndex]);
-    if (!_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    if (!_sink.open(_dstFiles[_curDstIndex]))
     {
-        emit error(_file.errorString());
+        emit error(_sink.errorString());
         return false;
     }
     return true;
@@ -89,35 +97,70 @@ bool PgCopyContext::nextDestination()
 bool PgCopyContext::write(const char *data, qint64 size)
 {
     if (_dstFiles[_curDstIndex].isEmpty())
-        emit message(QString::fromStdString(data));
-    else
     {
-        qint64 bytesWritten = _file.write(data, size);
-        if (bytesWritten == size)
-            return true;
-        else if (bytesWritten < 0)
-            emit error(_file.errorString());
-        else
-            emit error(tr("% bytes out of % were sucessfully written").arg(bytesWritten).arg(size));
-        return false;
+        // only the tail is shown, the log widget is not able to render huge outputs
+        _logTail.append(data, int(size));
+        if (_logTail.size() > 2 * COPY_LOG_TAIL)
+        {
+            int cut = _logTail.size() - COPY_LOG_TAIL;
+            _logSkipped += cut;
+            _logTail.remove(0, cut);
+        }
+        return true;
     }
-    return true;
+    if (_sink.write(data, size_t(size)))
+        return true;
+    emit error(_sink.errorString());
+    return false;
 }
 
-bool PgCopyContext::read(std::vector<char> &data, size_t maxSize)
+bool PgCopyContext::finishDestination()
 {
-    if (data.size() < maxSize)
-        data.resize(maxSize);
-    qint64 size = _file.read(data.data(), static_cast<qint64>(maxSize));
-    if (size < 0)
+    if (_logSkipped || _logTail.size())
     {
-        data.resize(0);
-        emit error(_file.errorString());
+        if (_logTail.size() > COPY_LOG_TAIL)
+        {
+            _logSkipped += _logTail.size() - COPY_LOG_TAIL;
+            _logTail.remove(0, _logTail.size() - COPY_LOG_TAIL);
+        }
+        // start from the whole line
+        int eol = (_logSkipped ? _logTail.indexOf('\n') : -1);
+        if (eol >= 0)
+        {
+            _logSkipped += eol + 1;
+            _logTail.remove(0, eol + 1);
+        }
+        if (_logSkipped)
+            emit message(tr("... %1 bytes skipped ...").arg(_logSkipped));
+        emit message(QString::fromUtf8(_logTail));
+        _logTail.clear();
+        _logSkipped = 0;
+    }
+    if (_sink.close())
+        return true;
+    emit error(_sink.errorString());
+    return false;
+}
+
+bool PgCopyContext::read(std::vector<char> &data)
+{
+    if (_inline)
+    {
+        if (_inline->read(data))
+            return true;
+        emit error(tr("inline data of COPY is incomplete"));
         return false;
     }
-    if (static_cast<size_t>(size) < maxSize)
-        data.resize(static_cast<size_t>(size));
-    return true;
+    if (_source.read(data))
+        return true;
+    emit error(_source.errorString());
+    return false;
+}
+
+bool PgCopyContext::readable() const
+{
+    // file sources are read ahead by the reader thread
+    return !_inline || _inline->readable();
 }
 
 PgCopyContext::operator bool() const
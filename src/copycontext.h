@@ -3,6 +3,7 @@
 
 #include <QStringList>
 #include <QFile>
+#include "copystreams.h"
 
 class PgCopyContext : public QObject
 {
@@ -12,12 +13,31 @@ public:
     void init(const QString &query);
     void clear();
     bool nextSource();
+    /*!
+     * \brief use the data (e.g. inline data of a script) as the current source
+     */
+    void setInlineSource(std::shared_ptr<CopyPipe> data);
     bool nextDestination();
     operator bool() const;
     bool write(const char *data, qint64 size);
-    bool read(std::vector<char> &data, size_t maxSize);
+    /*!
+     * \brief flush the current destination (file or the log tail)
+     */
+    bool finishDestination();
+    /*!
+     * \brief take the next read-ahead chunk of the source (empty at the end of file)
+     */
+    bool read(std::vector<char> &data);
+    /*!
+     * \brief read() won't wait for inline data to be written
+     */
+    bool readable() const;
 private:
-    QFile _file;
+    CopySource _source;
+    std::shared_ptr<CopyPipe> _inline;     ///< null if the source is a file
+    CopySink _sink;
+    QByteArray _logTail; ///< the last part of output to the log widget
+    qint64 _logSkipped = 0;
     QStringList _srcFiles;
     QStringList _dstFiles;
     int _curSrcIndex;
@@ -0,0 +1,630 @@
+#include "copystreams.h"
+#include <QFileInfo>
+#include <QObject>
+#ifdef SQT_HAS_ZLIB
+#include <zlib.h>
+#endif
+#ifdef SQT_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace
+{
+
+class PlainDecoder : public CopyDecoder
+{
+public:
+    virtual bool decode(QFile &src, std::vector<char> &dst, QString &error) override
+    {
+        dst.resize(COPY_BUFFER_SIZE);
+        qint64 size = src.read(dst.data(), qint64(dst.size()));
+        if (size < 0)
+        {
+            dst.resize(0);
+            error = src.errorString();
+            return false;
+        }
+        dst.resize(size_t(size));
+        return true;
+    }
+};
+
+#ifdef SQT_HAS_ZLIB
+class GzipDecoder : public CopyDecoder
+{
+public:
+    GzipDecoder()
+    {
+        _zs.zalloc = Z_NULL;
+        _zs.zfree = Z_NULL;
+        _zs.opaque = Z_NULL;
+        _zs.next_in = Z_NULL;
+        _zs.avail_in = 0;
+        // automatic gzip/zlib header detection
+        _ok = (inflateInit2(&_zs, 15 + 32) == Z_OK);
+        _in.resize(COPY_BUFFER_SIZE);
+    }
+    virtual ~GzipDecoder() override
+    {
+        if (_ok)
+            inflateEnd(&_zs);
+    }
+    virtual bool decode(QFile &src, std::vector<char> &dst, QString &error) override
+    {
+        dst.resize(COPY_BUFFER_SIZE);
+        _zs.next_out = reinterpret_cast<Bytef*>(dst.data());
+        _zs.avail_out = uInt(dst.size());
+        while (_ok && _zs.avail_out)
+        {
+            if (!_zs.avail_in && !_eof)
+            {
+                qint64 size = src.read(_in.data(), qint64(_in.size()));
+                if (size < 0)
+                {
+                    error = src.errorString();
+                    _ok = false;
+                    break;
+                }
+                if (!size)
+                    _eof = true;
+                else
+                {
+                    _zs.next_in = reinterpret_cast<Bytef*>(_in.data());
+                    _zs.avail_in = uInt(size);
+                    _ended = false;
+                }
+            }
+            // output kept by inflate is taken at the end of file too
+            if (!_zs.avail_in && _eof && _ended)
+                break;
+            int res = inflate(&_zs, Z_NO_FLUSH);
+            if (res == Z_STREAM_END)
+            {
+                // concatenated members are allowed
+                _ended = !_zs.avail_in;
+                res = inflateReset(&_zs);
+            }
+            else if (res == Z_BUF_ERROR && _eof && !_zs.avail_in)
+            {
+                error = QObject::tr("gzip: unexpected end of file");
+                _ok = false;
+                break;
+            }
+            if (res != Z_OK && res != Z_BUF_ERROR)
+            {
+                error = QObject::tr("gzip: %1").arg(_zs.msg ? _zs.msg : "corrupted data");
+                _ok = false;
+            }
+        }
+        dst.resize(dst.size() - _zs.avail_out);
+        return _ok;
+    }
+private:
+    z_stream _zs;
+    std::vector<char> _in;
+    bool _ok;
+    bool _eof = false;
+    bool _ended = true;         ///< no data of a member is taken since the end of the previous one
+};
+#endif
+
+#ifdef SQT_HAS_ZSTD
+class ZstdDecoder : public CopyDecoder
+{
+public:
+    ZstdDecoder() :
+        _ds(ZSTD_createDStream())
+    {
+        ZSTD_initDStream(_ds);
+        _in.resize(ZSTD_DStreamInSize());
+        _input = { _in.data(), 0, 0 };
+    }
+    virtual ~ZstdDecoder() override
+    {
+        ZSTD_freeDStream(_ds);
+    }
+    virtual bool decode(QFile &src, std::vector<char> &dst, QString &error) override
+    {
+        dst.resize(COPY_BUFFER_SIZE);
+        ZSTD_outBuffer output = { dst.data(), dst.size(), 0 };
+        while (output.pos < output.size)
+        {
+            if (_input.pos == _input.size && !_eof)
+            {
+                qint64 size = src.read(_in.data(), qint64(_in.size()));
+                if (size < 0)
+                {
+                    error = src.errorString();
+                    dst.resize(output.pos);
+                    return false;
+                }
+                if (!size)
+                    _eof = true;
+                else
+                    _input = { _in.data(), size_t(size), 0 };
+            }
+            // output kept by the stream is taken at the end of file too
+            if (_input.pos == _input.size && _eof && !_pending)
+                break;
+            const size_t before = output.pos;
+            size_t res = ZSTD_decompressStream(_ds, &output, &_input);
+            if (ZSTD_isError(res))
+            {
+                error = QObject::tr("zstd: %1").arg(ZSTD_getErrorName(res));
+                dst.resize(output.pos);
+                return false;
+            }
+            // 0 is returned as a frame is decoded and flushed entirely
+            _pending = (res != 0);
+            if (_pending && _eof && _input.pos == _input.size && output.pos == before)
+            {
+                error = QObject::tr("zstd: unexpected end of file");
+                dst.resize(output.pos);
+                return false;
+            }
+        }
+        dst.resize(output.pos);
+        return true;
+    }
+private:
+    ZSTD_DStream *_ds;
+    std::vector<char> _in;
+    ZSTD_inBuffer _input;
+    bool _eof = false;
+    bool _pending = false;      ///< the frame is not complete
+};
+#endif
+
+class PlainEncoder : public CopyEncoder
+{
+public:
+    virtual bool encode(QFile &dst, const char *data, size_t size, QString &error) override
+    {
+        if (dst.write(data, qint64(size)) == qint64(size))
+            return true;
+        error = dst.errorString();
+        return false;
+    }
+    virtual bool finish(QFile &, QString &) override
+    {
+        return true;
+    }
+};
+
+#ifdef SQT_HAS_ZLIB
+class GzipEncoder : public CopyEncoder
+{
+public:
+    GzipEncoder()
+    {
+        _zs.zalloc = Z_NULL;
+        _zs.zfree = Z_NULL;
+        _zs.opaque = Z_NULL;
+        // gzip header and trailer
+        _ok = (deflateInit2(&_zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+        _out.resize(COPY_BUFFER_SIZE);
+    }
+    virtual ~GzipEncoder() override
+    {
+        if (_ok)
+            deflateEnd(&_zs);
+    }
+    virtual bool encode(QFile &dst, const char *data, size_t size, QString &error) override
+    {
+        _zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        _zs.avail_in = uInt(size);
+        return deflateAll(dst, Z_NO_FLUSH, error);
+    }
+    virtual bool finish(QFile &dst, QString &error) override
+    {
+        _zs.next_in = Z_NULL;
+        _zs.avail_in = 0;
+        return deflateAll(dst, Z_FINISH, error);
+    }
+private:
+    bool deflateAll(QFile &dst, int flush, QString &error)
+    {
+        if (!_ok)
+        {
+            error = QObject::tr("gzip: compressor is not initialized");
+            return false;
+        }
+        int res;
+        do
+        {
+            _zs.next_out = reinterpret_cast<Bytef*>(_out.data());
+            _zs.avail_out = uInt(_out.size());
+            res = deflate(&_zs, flush);
+            qint64 size = qint64(_out.size() - _zs.avail_out);
+            if (size && dst.write(_out.data(), size) != size)
+            {
+                error = dst.errorString();
+                return false;
+            }
+        }
+        while (flush == Z_FINISH ? res == Z_OK : _zs.avail_out == 0);
+        return true;
+    }
+    z_stream _zs;
+    std::vector<char> _out;
+    bool _ok;
+};
+#endif
+
+#ifdef SQT_HAS_ZSTD
+class ZstdEncoder : public CopyEncoder
+{
+public:
+    ZstdEncoder() :
+        _cs(ZSTD_createCStream())
+    {
+        ZSTD_initCStream(_cs, 3);
+        _out.resize(ZSTD_CStreamOutSize());
+    }
+    virtual ~ZstdEncoder() override
+    {
+        ZSTD_freeCStream(_cs);
+    }
+    virtual bool encode(QFile &dst, const char *data, size_t size, QString &error) override
+    {
+        ZSTD_inBuffer input = { data, size, 0 };
+        while (input.pos < input.size)
+        {
+            ZSTD_outBuffer output = { _out.data(), _out.size(), 0 };
+            size_t res = ZSTD_compressStream(_cs, &output, &input);
+            if (!check(res, error) || !put(dst, output, error))
+                return false;
+        }
+        return true;
+    }
+    virtual bool finish(QFile &dst, QString &error) override
+    {
+        size_t left;
+        do
+        {
+            ZSTD_outBuffer output = { _out.data(), _out.size(), 0 };
+            left = ZSTD_endStream(_cs, &output);
+            if (!check(left, error) || !put(dst, output, error))
+                return false;
+        }
+        while (left);
+        return true;
+    }
+private:
+    bool check(size_t res, QString &error)
+    {
+        if (!ZSTD_isError(res))
+            return true;
+        error = QObject::tr("zstd: %1").arg(ZSTD_getErrorName(res));
+        return false;
+    }
+    bool put(QFile &dst, const ZSTD_outBuffer &output, QString &error)
+    {
+        if (!output.pos || dst.write(_out.data(), qint64(output.pos)) == qint64(output.pos))
+            return true;
+        error = dst.errorString();
+        return false;
+    }
+    ZSTD_CStream *_cs;
+    std::vector<char> _out;
+};
+#endif
+
+} // namespace
+
+CopyEncoder* CopyEncoder::create(const QString &fileName, QString &error)
+{
+    QString suffix = QFileInfo(fileName).suffix().toLower();
+    if (suffix == "gz")
+    {
+#ifdef SQT_HAS_ZLIB
+        return new GzipEncoder();
+#else
+        error = QObject::tr("gzip compression is not supported by this build");
+        return nullptr;
+#endif
+    }
+    if (suffix == "zst")
+    {
+#ifdef SQT_HAS_ZSTD
+        return new ZstdEncoder();
+#else
+        error = QObject::tr("zstd compression is not supported by this build");
+        return nullptr;
+#endif
+    }
+    return new PlainEncoder();
+}
+
+CopyDecoder* CopyDecoder::create(const QString &fileName, QString &error)
+{
+    QString suffix = QFileInfo(fileName).suffix().toLower();
+    if (suffix == "gz")
+    {
+#ifdef SQT_HAS_ZLIB
+        return new GzipDecoder();
+#else
+        error = QObject::tr("gzip compression is not supported by this build");
+        return nullptr;
+#endif
+    }
+    if (suffix == "zst")
+    {
+#ifdef SQT_HAS_ZSTD
+        return new ZstdDecoder();
+#else
+        error = QObject::tr("zstd compression is not supported by this build");
+        return nullptr;
+#endif
+    }
+    return new PlainDecoder();
+}
+
+CopySource::~CopySource()
+{
+    close();
+}
+
+bool CopySource::open(const QString &fileName)
+{
+    close();
+    _error.clear();
+    _decoder.reset(CopyDecoder::create(fileName, _error));
+    if (!_decoder)
+        return false;
+    _file.setFileName(fileName);
+    if (!_file.open(QIODevice::ReadOnly))
+    {
+        _error = _file.errorString();
+        return false;
+    }
+    _ring.resize(COPY_RING_SIZE);
+    _head = 0;
+    _count = 0;
+    _eof = false;
+    _stop = false;
+    _reader = std::thread(&CopySource::run, this);
+    return true;
+}
+
+void CopySource::close()
+{
+    if (_reader.joinable())
+    {
+        _mutex.lock();
+        _stop = true;
+        _freed.wakeAll();
+        _mutex.unlock();
+        _reader.join();
+    }
+    _file.close();
+    _decoder.reset();
+    _ring.clear();
+    _count = 0;
+}
+
+bool CopySource::read(std::vector<char> &data)
+{
+    QMutexLocker lk(&_mutex);
+    while (!_count && !_eof && !_stop)
+        _filled.wait(&_mutex);
+    if (_count)
+    {
+        // the consumer's buffer takes the place of the filled one
+        data.swap(_ring[_head]);
+        _ring[_head].resize(0);
+        _head = (_head + 1) % _ring.size();
+        --_count;
+        _freed.wakeOne();
+        return true;
+    }
+    data.resize(0);
+    return _error.isEmpty();
+}
+
+QString CopySource::errorString() const
+{
+    QMutexLocker lk(&_mutex);
+    return _error;
+}
+
+void CopySource::run()
+{
+    QMutexLocker lk(&_mutex);
+    while (!_stop && !_eof)
+    {
+        if (_count == _ring.size())
+        {
+            _freed.wait(&_mutex);
+            continue;
+        }
+        // the slot next to filled ones is owned by the reader until counted
+        std::vector<char> &buf = _ring[(_head + _count) % _ring.size()];
+        lk.unlock();
+        QString error;
+        bool ok = _decoder->decode(_file, buf, error);
+        lk.relock();
+        if (!ok)
+        {
+            _error = error;
+            _eof = true;
+        }
+        else if (buf.empty())
+            _eof = true;
+        else
+            ++_count;
+        _filled.wakeOne();
+    }
+}
+
+CopyPipe::CopyPipe(std::function<void()> drained) :
+    _drained(drained)
+{
+}
+
+bool CopyPipe::writable() const
+{
+    QMutexLocker lk(&_mutex);
+    return _chunks.size() < COPY_RING_SIZE && !_finished && !_aborted;
+}
+
+void CopyPipe::write(const QByteArray &data)
+{
+    QMutexLocker lk(&_mutex);
+    _chunks.emplace_back(data.constData(), data.constData() + data.size());
+    _written.wakeOne();
+}
+
+void CopyPipe::finish()
+{
+    QMutexLocker lk(&_mutex);
+    _finished = true;
+    _written.wakeOne();
+}
+
+void CopyPipe::abort()
+{
+    QMutexLocker lk(&_mutex);
+    _aborted = true;
+    _chunks.clear();
+    _written.wakeOne();
+}
+
+bool CopyPipe::readable() const
+{
+    QMutexLocker lk(&_mutex);
+    return !_chunks.empty() || _finished || _aborted;
+}
+
+bool CopyPipe::read(std::vector<char> &data)
+{
+    QMutexLocker lk(&_mutex);
+    while (_chunks.empty() && !_finished && !_aborted)
+        _written.wait(&_mutex);
+    data.resize(0);
+    if (_chunks.empty())
+        return !_aborted;
+    data.swap(_chunks.front());
+    _chunks.pop_front();
+    lk.unlock();
+    // the writer may refill the pipe
+    if (_drained)
+        _drained();
+    return true;
+}
+
+CopySink::~CopySink()
+{
+    close();
+}
+
+bool CopySink::open(const QString &fileName)
+{
+    close();
+    _error.clear();
+    _failed = false;
+    _encoder.reset(CopyEncoder::create(fileName, _error));
+    if (!_encoder)
+        return false;
+    _file.setFileName(fileName);
+    if (!_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        _error = _file.errorString();
+        return false;
+    }
+    _ring.resize(COPY_RING_SIZE);
+    _current.reserve(COPY_BUFFER_SIZE);
+    _head = 0;
+    _count = 0;
+    _closing = false;
+    _writer = std::thread(&CopySink::run, this);
+    return true;
+}
+
+bool CopySink::write(const char *data, size_t size)
+{
+    _current.insert(_current.end(), data, data + size);
+    if (_current.size() >= COPY_BUFFER_SIZE)
+        submit();
+    QMutexLocker lk(&_mutex);
+    return !_failed;
+}
+
+void CopySink::submit()
+{
+    QMutexLocker lk(&_mutex);
+    while (_count == _ring.size() && !_failed)
+        _freed.wait(&_mutex);
+    if (_failed)
+    {
+        _current.resize(0);
+        return;
+    }
+    // the written buffer returns to the producer
+    _current.swap(_ring[(_head + _count) % _ring.size()]);
+    _current.resize(0);
+    ++_count;
+    _filled.wakeOne();
+}
+
+bool CopySink::close()
+{
+    // nothing to report if not opened or closed already
+    if (!_writer.joinable())
+        return true;
+
+    if (!_current.empty())
+        submit();
+    _mutex.lock();
+    _closing = true;
+    _filled.wakeAll();
+    _mutex.unlock();
+    _writer.join();
+
+    QString error;
+    if (!_failed && !_encoder->finish(_file, error))
+    {
+        _error = error;
+        _failed = true;
+    }
+    _file.close();
+    _encoder.reset();
+    _ring.clear();
+    _current.clear();
+    return !_failed;
+}
+
+QString CopySink::errorString() const
+{
+    QMutexLocker lk(&_mutex);
+    return _error;
+}
+
+void CopySink::run()
+{
+    QMutexLocker lk(&_mutex);
+    while (!_failed)
+    {
+        if (!_count)
+        {
+            if (_closing)
+                break;
+            _filled.wait(&_mutex);
+            continue;
+        }
+        // the head buffer is not touched by the producer until released
+        std::vector<char> &buf = _ring[_head];
+        lk.unlock();
+        QString error;
+        bool ok = _encoder->encode(_file, buf.data(), buf.size(), error);
+        lk.relock();
+        if (!ok)
+        {
+            _error = error;
+            _failed = true;
+        }
+        _head = (_head + 1) % _ring.size();
+        --_count;
+        _freed.wakeOne();
+    }
+}
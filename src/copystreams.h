@@ -0,0 +1,164 @@
+#ifndef COPYSTREAMS_H
+#define COPYSTREAMS_H
+
+#include <QFile>
+#include <QMutex>
+#include <QWaitCondition>
+#include <vector>
+#include <thread>
+#include <memory>
+#include <deque>
+#include <functional>
+
+// size of a single buffer of COPY streams
+#define COPY_BUFFER_SIZE (1024 * 1024)
+// buffers within the read-ahead ring
+#define COPY_RING_SIZE 4
+// ms until an empty pipe of inline COPY data is checked again
+#define COPY_PIPE_RETRY 5
+
+/*!
+ * \brief decompressor of a file read by chunks, selected by the file suffix (.gz, .zst)
+ */
+class CopyDecoder
+{
+public:
+    virtual ~CopyDecoder() = default;
+    static CopyDecoder* create(const QString &fileName, QString &error);
+    /*!
+     * \brief fill dst with decompressed data, dst is empty at the end of stream
+     */
+    virtual bool decode(QFile &src, std::vector<char> &dst, QString &error) = 0;
+};
+
+/*!
+ * \brief compressor of a file written by chunks, selected by the file suffix (.gz, .zst)
+ */
+class CopyEncoder
+{
+public:
+    virtual ~CopyEncoder() = default;
+    static CopyEncoder* create(const QString &fileName, QString &error);
+    virtual bool encode(QFile &dst, const char *data, size_t size, QString &error) = 0;
+    /*!
+     * \brief write the rest of compressed stream
+     */
+    virtual bool finish(QFile &dst, QString &error) = 0;
+};
+
+/*!
+ * \brief Read-ahead source of COPY FROM data.
+ * A reader thread fills a ring of buffers while the connection sends previous ones,
+ * so file and network i/o run in parallel.
+ */
+class CopySource
+{
+public:
+    CopySource() = default;
+    ~CopySource();
+    bool open(const QString &fileName);
+    void close();
+    /*!
+     * \brief swap the next filled buffer into data (data is empty at the end of file)
+     *
+     * The previous content of data is reused as a free buffer of the ring.
+     */
+    bool read(std::vector<char> &data);
+    QString errorString() const;
+
+private:
+    void run();
+    QFile _file;
+    std::unique_ptr<CopyDecoder> _decoder;
+    std::vector<std::vector<char>> _ring;
+    size_t _head = 0;
+    size_t _count = 0;
+    bool _eof = false;
+    bool _stop = false;
+    QString _error;
+    mutable QMutex _mutex;
+    QWaitCondition _filled;
+    QWaitCondition _freed;
+    std::thread _reader;
+};
+
+/*!
+ * \brief Source of COPY FROM data written by chunks from another thread (e.g. inline data of a script).
+ * The connection waits in read() for the next chunk, the writer is told by the drained callback
+ * that the pipe has room again, so at most COPY_RING_SIZE chunks are held.
+ */
+class CopyPipe
+{
+public:
+    /*!
+     * \param drained called by the reading thread after a chunk is taken
+     */
+    explicit CopyPipe(std::function<void()> drained = nullptr);
+    bool writable() const;
+    void write(const QByteArray &data);
+    /*!
+     * \brief no more data, read() returns an empty chunk after the rest
+     */
+    void finish();
+    /*!
+     * \brief the data is incomplete, read() fails
+     */
+    void abort();
+    /*!
+     * \brief read() won't wait: a chunk is written, or the pipe is finished or aborted
+     */
+    bool readable() const;
+    /*!
+     * \brief take the next chunk into data (data is empty at the end)
+     */
+    bool read(std::vector<char> &data);
+
+private:
+    std::function<void()> _drained;
+    std::deque<std::vector<char>> _chunks;
+    bool _finished = false;
+    bool _aborted = false;
+    mutable QMutex _mutex;
+    QWaitCondition _written;
+};
+
+/*!
+ * \brief Buffered destination of COPY TO data.
+ * Data is collected into big buffers which are compressed (if needed) and
+ * written by a background thread, so the connection keeps receiving meanwhile.
+ */
+class CopySink
+{
+public:
+    CopySink() = default;
+    ~CopySink();
+    bool open(const QString &fileName);
+    /*!
+     * \brief false if previous data failed to be written
+     */
+    bool write(const char *data, size_t size);
+    /*!
+     * \brief write all the data left, complete compressed stream and close the file
+     */
+    bool close();
+    QString errorString() const;
+
+private:
+    void submit();
+    void run();
+    QFile _file;
+    std::unique_ptr<CopyEncoder> _encoder;
+    std::vector<char> _current;
+    std::vector<std::vector<char>> _ring;
+    size_t _head = 0;
+    size_t _count = 0;
+    bool _closing = false;
+    bool _failed = false;
+    QString _error;
+    mutable QMutex _mutex;
+    QWaitCondition _filled;
+    QWaitCondition _freed;
+    std::thread _writer;
+};
+
+#endif // COPYSTREAMS_H
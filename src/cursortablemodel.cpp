@@ -0,0 +1,220 @@
+#include "cursortablemodel.h"
+#include "dbconnection.h"
+#include "datatable.h"
+#include <QTimer>
+
+CursorTableModel::CursorTableModel(DbConnection *connection, QObject *parent) :
+    TableModel(parent), _connection(connection)
+{
+    // both are emitted by the I/O thread, so an error of a request comes before its finish
+    connect(_connection.get(), &DbConnection::error, this, [this](const QString &msg) {
+        _failed = true;
+        emit error(msg);
+    }, Qt::QueuedConnection);
+    connect(_connection.get(), &DbConnection::queryFinished, this, &CursorTableModel::onFinished, Qt::QueuedConnection);
+}
+
+CursorTableModel::~CursorTableModel()
+{
+    qDeleteAll(_pages);
+    // closing of the connection discards the cursor and its transaction,
+    // a connection in the middle of a statement is deleted as soon as the statement is cancelled
+    if (isBusy())
+    {
+        DbConnection *connection = _connection.release();
+        connection->disconnect(this);
+        connect(connection, &DbConnection::queryFinished, connection, &QObject::deleteLater);
+        connection->cancel();
+    }
+}
+
+void CursorTableModel::open(const QString &query, int pageSize, int cachedPages)
+{
+    _pageSize = qMax(pageSize, 1);
+    // visible rows may span a few pages, they must not evict each other
+    _cachedPages = qMax(cachedPages, 4);
+    send(Request::Open, "begin;\ndeclare sqt_lazy scroll cursor for\n" + query +
+         QString("\n;\nfetch forward %1 from sqt_lazy").arg(_pageSize));
+}
+
+void CursorTableModel::cancel() noexcept
+{
+    if (isBusy())
+        _connection->cancel();
+}
+
+int CursorTableModel::rowCount(const QModelIndex &) const
+{
+    return _rowCount;
+}
+
+QVariant CursorTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+
+    int page = index.row() / _pageSize;
+    auto it = _pages.constFind(page);
+    if (it == _pages.constEnd())
+    {
+        // evicted page is requested back after the view finishes painting
+        if (role == Qt::DisplayRole && !_closed && !_pendingPages.contains(page))
+        {
+            if (_pendingPages.isEmpty())
+                QTimer::singleShot(0, const_cast<CursorTableModel*>(this), &CursorTableModel::requestNext);
+            _pendingPages.insert(page);
+        }
+        return (role == Qt::TextAlignmentRole ?
+                    int(table()->getColumn(index.column()).hAlignment() | Qt::AlignVCenter) :
+                    QVariant());
+    }
+
+    if (_lru.last() != page)
+    {
+        _lru.removeOne(page);
+        _lru.append(page);
+    }
+    return cellData(*it.value(), index.row() - page * _pageSize, index.column(), role);
+}
+
+bool CursorTableModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && !_atEnd && !_closed;
+}
+
+void CursorTableModel::fetchMore(const QModelIndex &parent)
+{
+    if (parent.isValid() || _atEnd || _closed)
+        return;
+    _fetchMoreWanted = true;
+    requestNext();
+}
+
+void CursorTableModel::send(Request request, const QString &query)
+{
+    _request = request;
+    _failed = false;
+    emit busyChanged(true);
+    _connection->executeAsync(query);
+}
+
+void CursorTableModel::requestPage(int page)
+{
+    _requestedPage = page;
+    send(Request::Page, QString("move absolute %1 in sqt_lazy; fetch forward %2 from sqt_lazy").
+         arg(qint64(page) * _pageSize).
+         arg(_pageSize));
+}
+
+void CursorTableModel::requestNext()
+{
+    // one statement at a time, the rest waits for it to finish
+    if (isBusy() || _closed)
+        return;
+    if (_fetchMoreWanted)
+    {
+        _fetchMoreWanted = false;
+        if (!_atEnd)
+        {
+            requestPage(_rowCount / _pageSize);
+            return;
+        }
+    }
+    while (!_pendingPages.isEmpty())
+    {
+        int page = *_pendingPages.begin();
+        _pendingPages.erase(_pendingPages.begin());
+        if (!_pages.contains(page))
+        {
+            requestPage(page);
+            return;
+        }
+    }
+}
+
+void CursorTableModel::onFinished()
+{
+    Request request = _request;
+    int page = _requestedPage;
+    _request = Request::None;
+    _requestedPage = -1;
+
+    // the statement is finished, so the resultsets are not accessed by the I/O thread anymore
+    DataTable *t = (!_failed && !_connection->_resultsets.isEmpty() ?
+                        _connection->_resultsets.takeLast() :
+                        nullptr);
+    _connection->clearResultsets();
+    if (!t || !t->columnCount())
+    {
+        // the error is reported already, the transaction is rolled back with the cursor
+        delete t;
+        _closed = true;
+        _atEnd = true;
+        _fetchMoreWanted = false;
+        _pendingPages.clear();
+        emit busyChanged(false);
+        return;
+    }
+
+    if (request == Request::Open)
+        onOpened(t);
+    else
+        onPage(page, t);
+    emit busyChanged(false);
+    requestNext();
+}
+
+void CursorTableModel::onOpened(DataTable *first)
+{
+    beginResetModel();
+    for (int c = 0; c < first->columnCount(); ++c)
+        table()->addColumn(new DataColumn(first->getColumn(c)));
+    _connection->clarifyTableStructure(*table());
+    _rowCount = first->rowCount();
+    _atEnd = (_rowCount < _pageSize);
+    cachePage(0, first);
+    endResetModel();
+    emit opened();
+}
+
+void CursorTableModel::onPage(int page, DataTable *table)
+{
+    int first = page * _pageSize;
+    if (first < _rowCount)
+    {
+        // evicted page is back
+        cachePage(page, table);
+        int last = qMin(first + table->rowCount(), _rowCount) - 1;
+        if (last >= first)
+            emit dataChanged(index(first, 0), index(last, columnCount() - 1));
+        return;
+    }
+
+    int rows = table->rowCount();
+    _atEnd = (rows < _pageSize);
+    if (!rows)
+    {
+        delete table;
+        return;
+    }
+    beginInsertRows(QModelIndex(), _rowCount, _rowCount + rows - 1);
+    cachePage(page, table);
+    _rowCount += rows;
+    endInsertRows();
+}
+
+void CursorTableModel::cachePage(int page, DataTable *table)
+{
+    auto it = _pages.find(page);
+    if (it != _pages.end())
+    {
+        delete it.value();
+        it.value() = table;
+    }
+    else
+        _pages.insert(page, table);
+    _lru.removeOne(page);
+    _lru.append(page);
+    while (_lru.size() > _cachedPages)
+        delete _pages.take(_lru.takeFirst());
+}
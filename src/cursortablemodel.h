@@ -0,0 +1,75 @@
+#ifndef CURSORTABLEMODEL_H
+#define CURSORTABLEMODEL_H
+
+#include "tablemodel.h"
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <memory>
+
+#define CURSOR_CACHED_PAGES 32
+
+class DbConnection;
+
+/*!
+ * \brief Model of a resultset being read by pages from server-side cursor.
+ * Rows are fetched on demand while scrolling, pages far from the recently
+ * displayed ones are evicted. The cursor lives within a transaction of its
+ * own dedicated connection, pages are fetched asynchronously one at a time.
+ */
+class CursorTableModel : public TableModel
+{
+    Q_OBJECT
+public:
+    /*!
+     * \brief the model takes ownership of the connection
+     */
+    explicit CursorTableModel(DbConnection *connection, QObject *parent = nullptr);
+    virtual ~CursorTableModel() override;
+
+    /*!
+     * \brief declare the cursor and fetch the first page, opened() or error() follows
+     */
+    void open(const QString &query, int pageSize, int cachedPages = CURSOR_CACHED_PAGES);
+    /*!
+     * \brief stop the statement in progress, the cursor is closed then
+     */
+    void cancel() noexcept;
+    bool isBusy() const noexcept { return _request != Request::None; }
+    virtual int rowCount(const QModelIndex & = QModelIndex()) const override;
+    virtual QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    virtual bool canFetchMore(const QModelIndex &parent) const override;
+    virtual void fetchMore(const QModelIndex &parent) override;
+
+signals:
+    void opened();
+    void error(const QString &msg);
+    void busyChanged(bool busy);
+
+private:
+    enum class Request { None, Open, Page };
+
+    std::unique_ptr<DbConnection> _connection;
+    int _pageSize = 1;
+    int _cachedPages = CURSOR_CACHED_PAGES;
+    int _rowCount = 0;
+    bool _atEnd = true;
+    bool _closed = false;   ///< the cursor is gone with its transaction after an error
+    bool _failed = false;   ///< the request in progress reported an error
+    Request _request = Request::None;
+    int _requestedPage = -1;
+    bool _fetchMoreWanted = false;
+    QHash<int, DataTable*> _pages;
+    mutable QList<int> _lru; ///< recently used pages at the end
+    mutable QSet<int> _pendingPages;
+
+    void send(Request request, const QString &query);
+    void requestPage(int page);
+    void requestNext();
+    void onFinished();
+    void onOpened(DataTable *first);
+    void onPage(int page, DataTable *table);
+    void cachePage(int page, DataTable *table);
+};
+
+#endif // CURSORTABLEMODEL_H
@@ -1,15 +1,14 @@
 #include "datatable.h"
 #include <QApplication>
+#include <algorithm>
 
 DataTable::DataTable(const DataTable &table) : QObject()
 {
     for(const DataColumn *c: table._columns)
         _columns.append(new DataColumn(*c));
-    for(const DataRow *r: table._rows)
-    {
-        _rows.append(new DataRow(*r));
-        _rows.last()->_table = this;
-    }
+    for(const ColumnStorage *s: table._storages)
+        _storages.append(new ColumnStorage(*s));
+    _rowCount = table._rowCount;
 }
 
 DataTable::DataTable(QObject *parent): QObject(parent)
@@ -23,8 +22,9 @@ DataTable::~DataTable()
 
 void DataTable::clear()
 {
-    qDeleteAll(_rows);
-    _rows.clear();
+    qDeleteAll(_storages);
+    _storages.clear();
+    _rowCount = 0;
     qDeleteAll(_columns);
     _columns.clear();
 }
@@ -36,44 +36,84 @@ int DataTable::columnCount() const
 
 int DataTable::rowCount() const
 {
-    return _rows.size();
+    return _rowCount;
 }
 
 QVariant DataTable::value(int row, int column) const
 {
     if (column >= 0 && column < _columns.size() &&
-            row >= 0 && row < _rows.size())
-        return (*_rows[row])[column];
+            row >= 0 && row < _rowCount)
+        return _storages[column]->value(row);
     return QVariant();
 }
 
+bool DataTable::isNull(int row, int column) const
+{
+    if (column >= 0 && column < _columns.size() &&
+            row >= 0 && row < _rowCount)
+        return _storages[column]->isNull(row);
+    return true;
+}
+
 QVariant DataTable::value(int row, QString columnName) const
 {
     return value(row, getColumnOrd(columnName));
 }
 
-DataRow& DataTable::getRow(int ind) const
+void DataTable::addColumn(DataColumn *column)
 {
-    return *_rows.at(ind);
+    _columns.append(column);
+    ColumnStorage *s = new ColumnStorage();
+    // column added to the filled table (if any) consists of nulls
+    for (int i = 0; i < _rowCount; ++i)
+        s->appendNull();
+    _storages.append(s);
 }
 
-DataRow& DataTable::addRow()
+void DataTable::removeRows()
 {
-    DataRow* new_row = new DataRow(this);
-    _rows.append(new_row);
-    return *new_row;
+    for (ColumnStorage *s: _storages)
+        s->clear();
+    _rowCount = 0;
 }
 
-void DataTable::addColumn(DataColumn *column)
+qint64 DataTable::residentBytes() const noexcept
 {
-    _columns.append(column);
+    qint64 bytes = qint64(sizeof(DataTable) + _columns.size() * sizeof(DataColumn));
+    for (const ColumnStorage *s: _storages)
+        bytes += s->residentBytes();
+    return bytes;
+}
+
+qint64 DataTable::spill(const std::shared_ptr<SpillFile> &file, qint64 bytes)
+{
+    size_t chunks = 0;
+    for (const ColumnStorage *s: _storages)
+        chunks = std::max(chunks, s->chunkCount());
+    qint64 released = 0;
+    for (size_t i = 0; i < chunks && released < bytes; ++i)
+    {
+        for (ColumnStorage *s: _storages)
+        {
+            if (released >= bytes)
+                break;
+            released += s->spillChunk(file, i);
+        }
+    }
+    return released;
 }
 
-void DataTable::addRow(DataRow *row)
+void DataTable::appendRow(const QVector<QVariant> &row)
 {
     // mutex lock is removed in favoir of outermost usage
-    row->_table = this;
-    _rows.append(row);
+    for (int i = 0; i < _storages.size(); ++i)
+    {
+        if (i < row.size())
+            _storages[i]->appendVariant(row[i]);
+        else
+            _storages[i]->appendNull();
+    }
+    ++_rowCount;
 }
 
 DataTable* DataTable::takeRows(DataTable *source)
@@ -84,11 +124,13 @@ DataTable* DataTable::takeRows(DataTable *source)
     if (_columns.isEmpty())
     {
         for (const DataColumn *c: source->_columns)
-            _columns.append(new DataColumn(*c));
+            addColumn(new DataColumn(*c));
     }
 
-    _rows.append(source->_rows);
-    source->_rows.clear();
+    for (int i = 0; i < _storages.size() && i < source->_storages.size(); ++i)
+        _storages[i]->take(*source->_storages[i]);
+    _rowCount += source->_rowCount;
+    source->_rowCount = 0;
     return this;
 }
 
@@ -102,26 +144,6 @@ DataColumn& DataTable::getColumn(QString column_name) const
     return *_columns.at(getColumnOrd(column_name));
 }
 
-DataRow::DataRow(const DataRow &row)
-{
-    _table = row._table;
-    _row = row._row;
-}
-
-DataRow::DataRow(DataTable* table)
-{
-    _table = table;
-    for (int i = 0; i < table->columnCount(); ++i)
-	{
-        _row.append(QVariant());
-	}
-}
-
-DataRow::~DataRow()
-{
-    _row.clear();
-}
-
 int DataTable::getColumnOrd(QString column_name) const
 {
     for (int i = 0; i < columnCount(); ++i)
@@ -132,16 +154,6 @@ int DataTable::getColumnOrd(QString column_name) const
 	return -1;
 }
 
-QVariant& DataRow::operator [](QString column_name)
-{
-    return _row[_table->getColumnOrd(column_name)];
-}
-
-QVariant& DataRow::operator [](int index)
-{
-    return _row[index];
-}
-
 DataColumn::DataColumn(const QString &name, const QString &typeName, QMetaType::Type type, int sqlType, int length, int16_t decDigits, int8_t nullableDesc, Qt::AlignmentFlag hAlignment, int arrayElementType) :
     _name(name), _typeName(typeName), _varType(type), _sqlType(sqlType), _length(length), _decDigits(decDigits), _nullableDesc(nullableDesc), _hAlignment(hAlignment), _arrayElementType(arrayElementType)
 {
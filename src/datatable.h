@@ -6,6 +6,7 @@
 #include <QVector>
 #include <QMetaType>
 #include <QMutex>
+#include "columnstorage.h"
 
 class DataTable;
 // TODO
@@ -50,20 +51,6 @@ private:
     int _arrayElementType = -1;
 };
 
-class DataRow
-{
-    friend class DataTable;
-public:
-    DataRow(const DataRow &row);
-    DataRow(DataTable* _table);
-    ~DataRow();
-    QVariant& operator[](QString column_name);
-    QVariant& operator[](int index);
-private:
-    QVector<QVariant> _row;
-    DataTable* _table;
-};
-
 class DataTable : public QObject
 {
     Q_OBJECT
@@ -72,13 +59,30 @@ public:
     DataTable(QObject *parent = nullptr);
     ~DataTable();
 	void clear();
-    DataRow& addRow();
     void addColumn(DataColumn *column);
-    void addRow(DataRow *row);
     DataColumn& getColumn(QString column_name) const;
     DataColumn& getColumn(int ord) const;
     int getColumnOrd(QString column_name) const;
-    DataRow& getRow(int ind) const;
+    bool isNull(int row, int column) const;
+    /*!
+     * \brief raw column values; fill every column with one value, then commitRow()
+     */
+    ColumnStorage& storage(int column) const { return *_storages.at(column); }
+    void commitRow(int count = 1) noexcept { _rowCount += count; }
+    void appendRow(const QVector<QVariant> &row);
+    /*!
+     * \brief drop all the rows keeping the columns
+     */
+    void removeRows();
+    qint64 residentBytes() const noexcept;
+    /*!
+     * \brief move sealed chunks of text into the file until bytes are released
+     * \return bytes released
+     *
+     * The first chunks of every column go first, so the text of the oldest rows is spilled
+     * before the newer. Numbers, offsets of the values and the chunks being filled stay in memory.
+     */
+    qint64 spill(const std::shared_ptr<SpillFile> &file, qint64 bytes);
     mutable QMutex mutex;
 public slots:
     int columnCount() const;
@@ -88,7 +92,8 @@ public slots:
     DataTable* takeRows(DataTable *source);
 private:
     QVector<DataColumn*> _columns;
-    QVector<DataRow*> _rows;
+    QVector<ColumnStorage*> _storages;
+    int _rowCount = 0;
 };
 
 Q_DECLARE_METATYPE(DataTable)
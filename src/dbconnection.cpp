@@ -1,6 +1,10 @@
 #include "dbconnection.h"
 #include <QVector>
 #include <QVariant>
+#include "resultwriter.h"
+#include "executionservice.h"
+#include "scriptcursor.h"
+#include <QQmlEngine>
 
 DbConnection::DbConnection() :
     QObject(nullptr)
@@ -10,9 +14,17 @@ DbConnection::DbConnection() :
 
 DbConnection::~DbConnection()
 {
+    ExecutionService::instance().forget(this);
+    ScriptCursor::forget(this);
     clearResultsets();
 }
 
+void DbConnection::closeCursors()
+{
+    for (ScriptCursor *cursor: findChildren<ScriptCursor*>(QString(), Qt::FindDirectChildrenOnly))
+        delete cursor;
+}
+
 QString DbConnection::dbmsScriptingID() const noexcept
 {
     return _dbmsScriptingID;
@@ -73,17 +85,207 @@ DataTable* DbConnection::execute(const QString &query, const QVariantList &param
     return nullptr;
 }
 
+bool DbConnection::executePipeline(const QStringList &queries, const QList<QVector<QVariant>> &params)
+{
+    // no pipelining by default, just one by one
+    QList<DataTable*> tables;
+    bool res = true;
+    for (int i = 0; res && i < queries.size(); ++i)
+    {
+        res = execute(queries.at(i), i < params.size() ? &params.at(i) : nullptr);
+        // * synchronous usage only - no need to use _resultsetsGuard
+        tables.append(_resultsets);
+        _resultsets.clear();
+    }
+    _resultsets = tables;
+    return res;
+}
+
+bool DbConnection::executeBatch(const QString &query, const QList<QVector<QVariant>> &rows)
+{
+    // no bulk execution by default, just one by one
+    bool res = true;
+    for (int i = 0; res && i < rows.size(); ++i)
+    {
+        res = execute(query, &rows.at(i));
+        clearResultsets();
+    }
+    return res;
+}
+
+bool DbConnection::execBatch(const QString &query, const QVariantList &rows)
+{
+    QList<QVector<QVariant>> params;
+    params.reserve(rows.size());
+    for (const QVariant &row: rows)
+        params.append(row.toList().toVector());
+    return executeBatch(query, params);
+}
+
+QObject* DbConnection::openCursor(const QString &query, const QVariantList &params)
+{
+    std::unique_ptr<ScriptCursor> cursor(new ScriptCursor(this));
+    if (!cursor->open(query, params.toVector()))
+        return nullptr;
+    // the connection owns its cursors, so they are closed while it is alive
+    QQmlEngine::setObjectOwnership(cursor.get(), QQmlEngine::CppOwnership);
+    return cursor.release();
+}
+
+QVariantList DbConnection::executeStatements(const QVariantList &statements)
+{
+    QStringList queries;
+    QList<QVector<QVariant>> params;
+    for (const QVariant &statement: statements)
+    {
+        QVariantList items = (statement.type() == QVariant::List ? statement.toList() : QVariantList{statement});
+        queries.append(items.value(0).toString());
+        params.append(items.mid(1).toVector());
+    }
+
+    // errors are reported by signals, so return what has been fetched
+    executePipeline(queries, params);
+    // script takes ownership of the pointers (unlike a returned pointer, list items are not owned by default)
+    QVariantList res;
+    for (DataTable *table: _resultsets)
+    {
+        QQmlEngine::setObjectOwnership(table, QQmlEngine::JavaScriptOwnership);
+        res.append(QVariant::fromValue<QObject*>(table));
+    }
+    _resultsets.clear();
+    return res;
+}
+
 void DbConnection::setQueryState(QueryState state)
 {
     if (_query_state != state)
     {
         _query_state = state;
         if (state == QueryState::Inactive)
+        {
             _elapsed_ms = _timer.elapsed();
+            if (_timings_timer.isValid())
+                markTiming(_timings.finished);
+            if (_export)
+            {
+                if (_export->finish())
+                    emit message(tr("%1 rows exported to %2").
+                                 arg(_export->rowsWritten()).
+                                 arg(_export->filesWritten() > 1 ?
+                                         tr("%1 files").arg(_export->filesWritten()) :
+                                         _export->fileName()));
+                else if (!_export_failed)
+                    emit error(tr("export failed: %1").arg(_export->errorString()));
+                _export.reset();
+            }
+        }
         emit queryStateChanged(state);
     }
 }
 
+void DbConnection::startTimings() noexcept
+{
+    _timings = QueryTimings();
+    _timings_timer.start();
+}
+
+void DbConnection::markTiming(qint64 &stage) noexcept
+{
+    if (stage < 0)
+        stage = _timings_timer.nsecsElapsed() / 1000;
+}
+
+QString QueryTimings::csvHeader()
+{
+    return "acquire_us,sent_us,first_result_us,finished_us,server_us,receive_us,decode_us,model_us,view_us,bytes,rows";
+}
+
+QString QueryTimings::toCsv() const
+{
+    QStringList values;
+    for (qint64 v: {acquire, sent, firstResult, finished, server(), receive, decode, model, view, bytes, rows})
+        values.append(QString::number(v));
+    return values.join(',');
+}
+
+QString QueryTimings::toString() const
+{
+    auto ms = [](qint64 us) { return us < 0 ? QString("-") : QString::number(us / 1000.0, 'f', 1); };
+    QString res = QObject::tr("timings, ms: acquire %1, sent %2, first result %3, server %4, "
+                              "receive %5, decode %6, model %7, view %8, total %9").
+            arg(ms(acquire), ms(sent), ms(firstResult), ms(server()),
+                ms(receive), ms(decode), ms(model), ms(view), ms(finished));
+    if (rows)
+    {
+        double sec = finished / 1000000.0;
+        res += QObject::tr("; %1 rows, %2 KB").arg(rows).arg(bytes / 1024);
+        if (sec > 0)
+            res += QObject::tr(", %1 rows/sec").arg(qRound64(rows / sec));
+    }
+    return res;
+}
+
+void DbConnection::setExportWriter(ResultWriter *writer) noexcept
+{
+    _export.reset(writer);
+    _export_failed = false;
+}
+
+void DbConnection::setCopyInData(std::shared_ptr<CopyPipe> data) noexcept
+{
+    _copy_in_data = data;
+}
+
+void DbConnection::setPrepareNext() noexcept
+{
+    _prepare_next = true;
+}
+
+bool DbConnection::exportRows(DataTable &table)
+{
+    if (!_export)
+        return false;
+    if (!_export->take(table) && !_export_failed)
+    {
+        // report once, the rest of rows are discarded
+        _export_failed = true;
+        emit error(tr("export failed: %1").arg(_export->errorString()));
+        cancel();
+    }
+    return true;
+}
+
+void DbConnection::startFetchNotifications() noexcept
+{
+    _fetch_timer.start();
+    _fetch_unnotified = 0;
+    _fetch_notified = false;
+}
+
+bool DbConnection::fetchNotificationDue(const DataTable &table, int rowsAppended) noexcept
+{
+    _fetch_unnotified += rowsAppended;
+    // the first portion is shown as soon as possible
+    if (!_fetch_notified ?
+            _fetch_unnotified < FETCH_COUNT_NOTIFY && _fetch_timer.elapsed() < FETCH_NOTIFY_INTERVAL :
+            _fetch_timer.elapsed() < FETCH_NOTIFY_INTERVAL)
+        return false;
+    // previous notification still waits in the queue
+    if (table.rowCount() > _fetch_unnotified)
+        return false;
+    _fetch_timer.restart();
+    _fetch_unnotified = 0;
+    _fetch_notified = true;
+    return true;
+}
+
+int DbConnection::fetchNotificationDelay() const noexcept
+{
+    if (_export || !_fetch_unnotified)
+        return -1;
+    return qMax(0, FETCH_NOTIFY_INTERVAL - int(_fetch_timer.elapsed()));
+}
+
 QString DbConnection::elapsed() const noexcept
 {
     int elapsed_ms = _elapsed_ms;
@@ -4,19 +4,67 @@
 #include <QObject>
 #include <QMutex>
 #include <QTime>
+#include <QElapsedTimer>
 #include <atomic>
 #include <QJSValueList>
 #include <QVector>
+#include <QStringList>
 #include <memory>
 #include "datatable.h"
 
+// rows enough to show the first portion of a resultset
 #define FETCH_COUNT_NOTIFY 1000
+// minimal period between fetched() notifications of a resultset, ms
+#define FETCH_NOTIFY_INTERVAL 100
 
 enum class QueryState : int { Inactive, Running, Cancelling };
 enum SocketWatchMode { None = 0, Read, Write };
 
 Q_DECLARE_METATYPE(QueryState)
 class DataTable;
+class ResultWriter;
+class CopyPipe;
+
+/*!
+ * \brief client-side breakdown of the last asynchronous query, microseconds since its start
+ *
+ * Stages not reached are -1. Durations of repeated stages (receive, decode, model, view) are sums.
+ */
+struct QueryTimings
+{
+    qint64 acquire = -1;    ///< connection (or pooled session) is ready and sending begins
+    qint64 sent = -1;       ///< the query is flushed to the server
+    qint64 firstResult = -1;
+    qint64 finished = -1;
+    qint64 receive = 0;     ///< reading the socket
+    qint64 decode = 0;      ///< converting values into resultsets
+    qint64 model = 0;       ///< taking rows into models, filled by the consumer
+    qint64 view = 0;        ///< resizing views, filled by the consumer
+    qint64 bytes = 0;       ///< size of the values received
+    qint64 rows = 0;
+
+    /*!
+     * \brief waiting for the server between sending and the first result
+     */
+    qint64 server() const noexcept { return sent >= 0 && firstResult >= 0 ? firstResult - sent : -1; }
+    static QString csvHeader();
+    QString toCsv() const;
+    QString toString() const;
+};
+
+/*!
+ * \brief adds the lifetime of the scope to the counter, us
+ */
+class TimingScope
+{
+public:
+    explicit TimingScope(qint64 &counter) noexcept : _counter(counter) { _timer.start(); }
+    ~TimingScope() { _counter += _timer.nsecsElapsed() / 1000; }
+
+private:
+    qint64 &_counter;
+    QElapsedTimer _timer;
+};
 
 /*
 class ResultSets : QObject
@@ -77,8 +125,25 @@ public:
     virtual void executeAsync(const QString &query, const QVector<QVariant> *params = nullptr) noexcept = 0;
     /*!
      * \brief synchronous query execution used by objects tree and so on
+     *
+     * A multi-statement query keeps the resultset of its last statement only,
+     * executePipeline() is to get all of them.
      */
     virtual bool execute(const QString &query, const QVector<QVariant> *params = nullptr) = 0;
+    /*!
+     * \brief synchronous execution of several statements, sent back-to-back where the dbms allows
+     * \param params optional parameters of every statement
+     *
+     * Resultsets of all the statements are stored within _resultsets.
+     */
+    virtual bool executePipeline(const QStringList &queries, const QList<QVector<QVariant>> &params = QList<QVector<QVariant>>());
+    /*!
+     * \brief synchronous execution of the parameterized statement for every set of parameters
+     *
+     * Sets are sent in bulk where the dbms allows, the statement is not expected to return rows
+     * (resultsets are discarded). Execution stops at the first error.
+     */
+    virtual bool executeBatch(const QString &query, const QList<QVector<QVariant>> &rows);
 
     virtual QString escapeIdentifier(const QString &identifier);
 
@@ -96,10 +161,47 @@ public:
     QString connectionString() const noexcept;
     QueryState queryState() const noexcept;
     QString elapsed() const noexcept;
+    /*!
+     * \brief timings of the last asynchronous query, complete since queryStateChanged(Inactive)
+     */
+    const QueryTimings &timings() const noexcept { return _timings; }
+    /*!
+     * \brief stream resultsets of the next asynchronous query into the writer instead of fetched()
+     * \param writer takes ownership, the writer is released as soon as the query finishes
+     */
+    void setExportWriter(ResultWriter *writer) noexcept;
+    /*!
+     * \brief data of COPY FROM STDIN for the next asynchronous query (instead of CopySrc files)
+     */
+    void setCopyInData(std::shared_ptr<CopyPipe> data) noexcept;
+    /*!
+     * \brief prepare the next asynchronous query to be executed repeatedly (where the dbms allows)
+     */
+    void setPrepareNext() noexcept;
+    /*!
+     * \brief the connection is used by synchronous calls of worker threads only
+     *
+     * Its socket is not watched: notifiers must not be created by threads the connection does not belong to.
+     */
+    void setDetached(bool detached) noexcept { _detached = detached; }
+    bool isDetached() const noexcept { return _detached; }
     QList<DataTable*> _resultsets;
 
 public slots: // to use from QJSEngine
     virtual DataTable* execute(const QString &query, const QVariantList &params);
+    /*!
+     * \brief pipelined execution of statements, every one is either a query or an array [query, params...]
+     * \return resultsets of data returning statements
+     */
+    QVariantList executeStatements(const QVariantList &statements);
+    /*!
+     * \brief executeBatch() of the statement for every array of parameters
+     */
+    bool execBatch(const QString &query, const QVariantList &rows);
+    /*!
+     * \brief ScriptCursor of the query to fetch by portions, nullptr on error
+     */
+    QObject* openCursor(const QString &query, const QVariantList &params);
     void clearResultsets() noexcept;
     virtual bool open() = 0;
     virtual void close() noexcept = 0;
@@ -121,10 +223,63 @@ protected:
     QMutex _resultsetsGuard;
     mutable QMutex _connectionGuard;
     QString _dbmsScriptingID;
+    std::shared_ptr<CopyPipe> _copy_in_data;
+    bool _prepare_next = false;
+    bool _detached = false;
+    QueryTimings _timings;
     void setQueryState(QueryState queryState);
+    /*!
+     * \brief close script cursors left open, the first thing of destructors of derived classes
+     *
+     * Closing a cursor runs statements, which is not possible once the derived part is destroyed.
+     */
+    void closeCursors();
+    /*!
+     * \brief reset timings at the start of an asynchronous query
+     */
+    void startTimings() noexcept;
+    /*!
+     * \brief record the moment the stage is reached first
+     */
+    void markTiming(qint64 &stage) noexcept;
+    /*!
+     * \brief start coalescing fetched() notifications of a new resultset
+     */
+    void startFetchNotifications() noexcept;
+    /*!
+     * \brief account rows appended to the table, which must be locked by the caller
+     * \return true if fetched() should be emitted
+     *
+     * Notifications are throttled by FETCH_NOTIFY_INTERVAL and skipped while the
+     * consumer has not taken rows of the previous one yet: it picks up all pending rows at once.
+     */
+    bool fetchNotificationDue(const DataTable &table, int rowsAppended) noexcept;
+    /*!
+     * \brief determine if the final fetched() is needed for the resultset
+     */
+    bool fetchNotificationPending() const noexcept { return !_export && (_fetch_unnotified || !_fetch_notified); }
+    /*!
+     * \brief ms left until rows held back by fetchNotificationDue() may be notified, -1 if none are held
+     */
+    int fetchNotificationDelay() const noexcept;
+    /*!
+     * \brief resultsets of the query are streamed into the export writer
+     */
+    bool isExporting() const noexcept { return _export != nullptr; }
+    /*!
+     * \brief pass rows of the table (locked by the caller) to the export writer if any
+     * \return true if the rows are consumed by the writer
+     */
+    bool exportRows(DataTable &table);
 
 private:
     int _elapsed_ms = 0;
+    QElapsedTimer _timings_timer;
+    std::unique_ptr<ResultWriter> _export;
+    bool _export_failed = false;
+    QElapsedTimer _fetch_timer;
+    int _fetch_unnotified = 0;
+    bool _fetch_notified = false;
 };
 
 Q_DECLARE_METATYPE(DbConnection*)
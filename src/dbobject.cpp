@@ -1,23 +1,18 @@
 #include "dbobject.h"
 #include "dbconnectionfactory.h"
 #include "odbcconnection.h"
+#include <QSet>
 
 DbObject::DbObject(DbObject *parent)
 {
     _parent = parent;
-    //setData(true, DbObject::ParentRole);
-    setData(0, DbObject::CurrentSortRole);
-    setData(false, DbObject::MultiselectRole);
 }
 
 DbObject::DbObject(DbObject *parent, QString text, QString type, QFont font) : _parent(parent)
 {
     setData(text);
     setData(type, DbObject::TypeRole);
-    //setData(true, DbObject::ParentRole);
     setData(font, Qt::FontRole);
-    setData(0, DbObject::CurrentSortRole);
-    setData(false, DbObject::MultiselectRole);
 }
 
 DbObject::~DbObject()
@@ -26,42 +21,121 @@ DbObject::~DbObject()
     _conceived.clear();
     qDeleteAll(_children);
     _children.clear();
-    QString type = data(DbObject::TypeRole).toString();
-    if (type == "connection" || type == "database")
+    if (_type == "connection" || _type == "database")
     {
         QString id = QString::number(std::intptr_t(this));
         DbConnectionFactory::removeConnection(id);
     }
 }
 
+QString DbObject::intern(const QString &type)
+{
+    // node types are a few, created from the gui thread only
+    static QSet<QString> types;
+    if (type.isNull())
+        return type;
+    QSet<QString>::const_iterator it = types.constFind(type);
+    if (it == types.constEnd())
+        it = types.insert(type);
+    return *it;
+}
+
 void DbObject::setData(const QVariant &value, int role)
 {
-    _itemData[role] = value;
+    switch (role)
+    {
+    case Qt::DisplayRole:
+        _text = value.toString();
+        _sortName = _text.toLower();
+        return;
+    case DbObject::IdRole:
+        _id = value;
+        return;
+    case DbObject::NameRole:
+        _name = value.toString();
+        return;
+    case DbObject::TypeRole:
+        _type = intern(value.toString());
+        return;
+    case Qt::DecorationRole:
+        _icon = qvariant_cast<QIcon>(value);
+        return;
+    case DbObject::ParentRole:
+        _parentFlag = value.toBool();
+        return;
+    case DbObject::MultiselectRole:
+        _multiselect = value.toBool();
+        return;
+    case DbObject::CurrentSortRole:
+        _sortMode = value.toInt();
+        return;
+    case DbObject::Sort1Role:
+    case DbObject::Sort2Role:
+    {
+        SortKey &key = _sortKeys[role == DbObject::Sort1Role ? 0 : 1];
+        bool ok = false;
+        key = SortKey();
+        if (!value.isValid())
+            return;
+        key.number = value.toLongLong(&ok);
+        if (ok)
+            key.kind = SortKey::Kind::Number;
+        else
+        {
+            key.kind = SortKey::Kind::Text;
+            key.text = value.toString().toLower();
+        }
+        return;
+    }
+    }
+    if (!_itemData)
+        _itemData.reset(new QHash<int, QVariant>());
+    (*_itemData)[role] = value;
 }
 
 void DbObject::appendChild(DbObject *item)
 {
+    item->_row = _children.count();
     _children.append(item);
     item->setParent(this);
 }
 
 QVariant DbObject::data(int role) const
 {
-    QVariant defValue;
     switch (role)
     {
+    case Qt::DisplayRole:
+        return (_text.isNull() ? QVariant() : QVariant(_text));
+    case DbObject::IdRole:
+        return _id;
+    case DbObject::NameRole:
+        return (_name.isNull() ? QVariant() : QVariant(_name));
+    case DbObject::TypeRole:
+        return (_type.isNull() ? QVariant() : QVariant(_type));
+    case Qt::DecorationRole:
+        return (_icon.isNull() ? QVariant() : QVariant(_icon));
     case DbObject::ParentRole:
-        defValue = false;
-        break;
+        return _parentFlag;
+    case DbObject::MultiselectRole:
+        return _multiselect;
+    case DbObject::CurrentSortRole:
+        return _sortMode;
+    case DbObject::Sort1Role:
+    case DbObject::Sort2Role:
+    {
+        const SortKey &key = _sortKeys[role == DbObject::Sort1Role ? 0 : 1];
+        if (key.kind == SortKey::Kind::Number)
+            return key.number;
+        return (key.kind == SortKey::Kind::Text ? QVariant(key.text) : QVariant());
+    }
     }
-    return _itemData.value(role, defValue);
+    return (_itemData ? _itemData->value(role) : QVariant());
 }
 
-int DbObject::row() const
+void DbObject::renumber(int from)
 {
-    if (_parent)
-        return _parent->_children.indexOf(const_cast<DbObject*>(this));
-    return 0;
+    for (int i = from; i < _children.count(); ++i)
+        _children.at(i)->_row = i;
 }
 
 bool DbObject::insertChild(int beforeRow)
@@ -69,6 +143,7 @@ bool DbObject::insertChild(int beforeRow)
     if (beforeRow > _children.count())
         return false;
     _children.insert(beforeRow, new DbObject(this));
+    renumber(beforeRow);
     return true;
 }
 
@@ -78,5 +153,6 @@ bool DbObject::removeChild(int pos)
         return false;
     delete _children.at(pos);
     _children.removeAt(pos);
+    renumber(pos);
     return true;
 }
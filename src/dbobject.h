@@ -2,12 +2,42 @@
 #define DBOBJECT_H
 
 #include <QList>
+#include <QHash>
 #include <QVariant>
 #include <QFont>
+#include <QIcon>
+#include <memory>
 
+/*!
+ * \brief Node of the objects tree.
+ *
+ * The roles every node has are kept by fields (the type is interned, so nodes of a type share
+ * the string), the others by a hash allocated on the first use. Sort keys are computed as the
+ * sort roles and the text are set, so the tree is sorted without QVariant conversions.
+ */
 class DbObject
 {
 public:
+    /*!
+     * \brief value of a sort role, numbers are compared as numbers and anything else as lowercase text
+     */
+    struct SortKey
+    {
+        enum class Kind : quint8 { None, Number, Text };
+        Kind kind = Kind::None;
+        qint64 number = 0;
+        QString text;
+
+        bool isValid() const noexcept { return kind != Kind::None; }
+        bool operator<(const SortKey &other) const
+        {
+            if (kind == Kind::Number && other.kind == Kind::Number)
+                return number < other.number;
+            return (kind == Kind::Number ? QString::number(number) : text) <
+                    (other.kind == Kind::Number ? QString::number(other.number) : other.text);
+        }
+    };
+
     DbObject(DbObject *parent = nullptr);
     DbObject(DbObject *parent, QString text, QString type, QFont font = QFont());
     ~DbObject();
@@ -37,15 +67,40 @@ public:
     DbObject *parent() const { return _parent; }
     int childCount() const { return _children.count(); }
     QVariant data(int role = Qt::DisplayRole) const;
-    int row() const;
+    int row() const { return _parent ? _row : 0; }
     bool insertChild(int beforeRow);
     bool removeChild(int pos);
 
+    QString type() const { return _type; }
+    /*!
+     * \brief CurrentSortRole: 0 sorts children by Sort1Role, otherwise by Sort2Role
+     */
+    int sortMode() const noexcept { return _sortMode; }
+    const SortKey &sortKey(int mode) const noexcept { return _sortKeys[mode ? 1 : 0]; }
+    /*!
+     * \brief lowercase text, the order of nodes without sort keys
+     */
+    const QString &sortName() const noexcept { return _sortName; }
+
 private:
+    static QString intern(const QString &type);
+    void renumber(int from);
+
     QList<DbObject*> _children;
     QList<DbObject*> _conceived;
-    QHash<int, QVariant> _itemData;
     DbObject *_parent;
+    int _row = 0;               ///< position within the children of the parent
+    QString _text;
+    QString _sortName;
+    QString _name;
+    QString _type;
+    QVariant _id;
+    QIcon _icon;
+    SortKey _sortKeys[2];
+    int _sortMode = 0;
+    bool _parentFlag = false;
+    bool _multiselect = false;
+    std::unique_ptr<QHash<int, QVariant>> _itemData;    ///< less common roles
 };
 
 #endif // DBOBJECT_H
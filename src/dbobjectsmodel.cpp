@@ -10,21 +10,28 @@
 #include "dbconnectionfactory.h"
 #include "dbconnection.h"
 #include <memory>
+#include <vector>
 #include "datatable.h"
 #include "odbcconnection.h"
 #include <QUuid>
+#include "lambdarunnable.h"
 #include "dbosortfilterproxymodel.h"
 #include "scripting.h"
+#include "settings.h"
 
 DbObjectsModel::DbObjectsModel(QObject *parent) :
     QAbstractItemModel(parent)
 {
     _rootItem = new DbObject();
     _rootItem->setData("root", DbObject::TypeRole);
+    _workers.setMaxThreadCount(TREE_WORKERS_COUNT);
 }
 
 DbObjectsModel::~DbObjectsModel()
 {
+    // results of running scripts are dropped along with the model
+    _workers.clear();
+    _workers.waitForDone();
     delete _rootItem;
 }
 
@@ -148,9 +155,7 @@ void DbObjectsModel::fetchMore(const QModelIndex &parent)
 {
     if (!parent.isValid())
         return;
-    fillChildren(parent);
-    DbObject *item = static_cast<DbObject*>(parent.internalPointer());
-    setData(parent, item->childCount() ? true : false, DbObject::ParentRole);
+    fillChildrenAsync(parent);
 }
 
 bool DbObjectsModel::fillChildren(const QModelIndex &parent)
@@ -186,23 +191,19 @@ bool DbObjectsModel::fillChildren(const QModelIndex &parent)
     QApplication::setOverrideCursor(Qt::WaitCursor);
     ScopeGuard<void(*)()> cursorGuard(QApplication::restoreOverrideCursor);
 
-    int insertPosition = parentNode->childCount();
-    int childObjectsCount = 0;
+    std::unique_ptr<Scripting::CppConductor> c;
+    QVector<bool> parents;
     try
     {
         std::shared_ptr<DbConnection> con = dbConnection(parent);
         if (!con->open())
             throw QString("");
 
-        auto c = Scripting::execute(con, Scripting::Context::Tree, type,
-                                    [this, &parent](QString macro) -> QVariant
+        c = Scripting::execute(con, Scripting::Context::Tree, type,
+                               [this, &parent](QString macro) -> QVariant
             {
                 return parentNodeProperty(parent, macro);
             });
-        DataTable *table = (c && !c->resultsets.isEmpty() ? c->resultsets.back() : nullptr);
-
-        if (!table)
-            return true;
         /*
         // remove current node in case of error during scripting
         if (!table)
@@ -213,78 +214,199 @@ bool DbObjectsModel::fillChildren(const QModelIndex &parent)
         }
         */
 
-        // http://msdn.microsoft.com/en-us/library/ms403629(v=sql.105).aspx
-        int typeInd = table->getColumnOrd("node_type");
-        int textInd = table->getColumnOrd("ui_name");
-        int nameInd = table->getColumnOrd("name");
-        int idInd = table->getColumnOrd("id");
-        int iconInd = table->getColumnOrd("icon");
-        int sort1Ind = table->getColumnOrd("sort1");
-        int sort2Ind = table->getColumnOrd("sort2");
-        int multiselectInd = table->getColumnOrd("allow_multiselect");
-        int tagInd = table->getColumnOrd("tag");
-
-        for (int i = 0; i < table->rowCount(); ++i)
+        parents = childrenDetection(con.get(), c && !c->resultsets.isEmpty() ? c->resultsets.back() : nullptr);
+    }
+    catch (const QString &err)
+    {
+        emit error(err);
+    }
+    appendChildren(parent, c && !c->resultsets.isEmpty() ? c->resultsets.back() : nullptr, parents);
+    return true;
+}
+
+void DbObjectsModel::fillChildrenAsync(const QModelIndex &parent, bool prefetch)
+{
+    std::shared_ptr<DbConnection> con = dbConnection(parent);
+    if (!parent.isValid() || !con)
+    {
+        fillChildren(parent);
+        return;
+    }
+    DbObject *parentNode = static_cast<DbObject*>(parent.internalPointer());
+    QString type = parentNode->data(DbObject::TypeRole).toString();
+    std::function<QVariant(QString)> env = environment(parent);
+
+    // the node's own connection stays available for editors, the tree uses dedicated ones
+    QString key = con->connectionString() + '\n' + con->database();
+    std::shared_ptr<DbConnection> metadata = takeMetadataConnection(key);
+    if (!metadata)
+    {
+        // created here, so the QObject belongs to the gui thread as the pooled ones do
+        metadata.reset(con->clone());
+        metadata->setDetached(true);
+        connect(metadata.get(), &DbConnection::error, this, &DbObjectsModel::error, Qt::QueuedConnection);
+        connect(metadata.get(), &DbConnection::message, this, &DbObjectsModel::message, Qt::QueuedConnection);
+    }
+
+    int row = parentNode->childCount();
+    beginInsertRows(parent, row, row);
+    DbObject *placeholder = new DbObject(parentNode);
+    placeholder->setData(tr("loading..."), Qt::DisplayRole);
+    placeholder->setData("placeholder", DbObject::TypeRole);
+    placeholder->setData(false, DbObject::ParentRole);
+    parentNode->appendChild(placeholder);
+    endInsertRows();
+    // becomes invalid if the node is refreshed or removed meanwhile
+    QPersistentModelIndex placeholderIndex(index(row, 0, parent));
+
+    _workers.start(new LambdaRunnable([this, key, metadata, type, env, placeholderIndex, prefetch]() {
+        std::shared_ptr<Scripting::CppConductor> c;
+        QVector<bool> parents;
+        QString err;
+        std::shared_ptr<DbConnection> con = metadata;
+        try
         {
-            DataRow &r = table->getRow(i);
-            std::unique_ptr<DbObject> newItem(new DbObject(parentNode));
-            newItem->setData(r[textInd].toString(), Qt::DisplayRole);
-            if (idInd >= 0 && !r[idInd].isNull())
+            if (!con->open())
+                throw QString("");
+            c = Scripting::execute(con, Scripting::Context::Tree, type, env);
+            parents = childrenDetection(con.get(), c && !c->resultsets.isEmpty() ? c->resultsets.back() : nullptr);
+        }
+        catch (const QString &e)
+        {
+            err = e;
+        }
+        releaseMetadataConnection(key, con);
+
+        QMetaObject::invokeMethod(this, [this, c, parents, err, placeholderIndex, prefetch]() {
+            if (!placeholderIndex.isValid())
+                return;
+            QModelIndex parent = placeholderIndex.parent();
+            DbObject *parentNode = static_cast<DbObject*>(parent.internalPointer());
+            beginRemoveRows(parent, placeholderIndex.row(), placeholderIndex.row());
+            parentNode->removeChild(placeholderIndex.row());
+            endRemoveRows();
+
+            if (!err.isEmpty())
+                emit error(err);
+            int first = parentNode->childCount();
+            appendChildren(parent, c && !c->resultsets.isEmpty() ? c->resultsets.back() : nullptr, parents);
+            emit dataChanged(parent, parent);
+
+            // e.g. columns of tables within a schema
+            int last = parentNode->childCount();
+            if (!prefetch || !SqtSettings::value("treePrefetch", false).toBool() || last - first > TREE_PREFETCH_LIMIT)
+                return;
+            for (int i = first; i < last; ++i)
             {
-                newItem->setData(r[idInd].toString(), DbObject::IdRole);
-                ++childObjectsCount;
+                DbObject *item = parentNode->child(i);
+                if (item->data(DbObject::ParentRole).toBool() && !item->childCount())
+                    fillChildrenAsync(index(i, 0, parent), false);
             }
-            if (nameInd >= 0 && !r[nameInd].isNull())
-                newItem->setData(r[nameInd].toString(), DbObject::NameRole);
-            if (iconInd >= 0 && !r[iconInd].isNull())
-                newItem->setData(QIcon(QApplication::applicationDirPath() + "/decor/" + r[iconInd].toString()), Qt::DecorationRole);
-
-            // children detection
-            newItem->setData(Scripting::getScript(
-                                 dbConnection(parent).get(),
-                                 Scripting::Context::Tree,
-                                 r[typeInd].toString()) != nullptr, DbObject::ParentRole);
-
-            if (sort1Ind >= 0 && !r[sort1Ind].isNull())
-                newItem->setData(r[sort1Ind], DbObject::Sort1Role);
-            if (sort2Ind >= 0 && !r[sort2Ind].isNull())
-                newItem->setData(r[sort2Ind], DbObject::Sort2Role);
-            if (multiselectInd >= 0 && !r[multiselectInd].isNull())
-                newItem->setData(r[multiselectInd].toBool(), DbObject::MultiselectRole);
-            if (tagInd >= 0 && !r[tagInd].isNull())
-                newItem->setData(r[tagInd], DbObject::TagRole);
-            if (typeInd >= 0)
+        }, Qt::QueuedConnection);
+    }));
+}
+
+QVector<bool> DbObjectsModel::childrenDetection(DbConnection *con, DataTable *table)
+{
+    QVector<bool> res;
+    if (!table)
+        return res;
+    int typeInd = table->getColumnOrd("node_type");
+    res.reserve(table->rowCount());
+    for (int i = 0; i < table->rowCount(); ++i)
+        res.append(Scripting::getScript(con, Scripting::Context::Tree, table->value(i, typeInd).toString()) != nullptr);
+    return res;
+}
+
+void DbObjectsModel::appendChildren(const QModelIndex &parent, DataTable *table, const QVector<bool> &parents)
+{
+    DbObject *parentNode = parent.isValid() ?
+                static_cast<DbObject*>(parent.internalPointer()) :
+                _rootItem;
+    int insertPosition = parentNode->childCount();
+    int childObjectsCount = 0;
+    if (table)
+    {
+            // http://msdn.microsoft.com/en-us/library/ms403629(v=sql.105).aspx
+            int typeInd = table->getColumnOrd("node_type");
+            int textInd = table->getColumnOrd("ui_name");
+            int nameInd = table->getColumnOrd("name");
+            int idInd = table->getColumnOrd("id");
+            int iconInd = table->getColumnOrd("icon");
+            int sort1Ind = table->getColumnOrd("sort1");
+            int sort2Ind = table->getColumnOrd("sort2");
+            int multiselectInd = table->getColumnOrd("allow_multiselect");
+            int tagInd = table->getColumnOrd("tag");
+            // icons of a kind are shared by the nodes
+            QHash<QString, QIcon> icons;
+            std::vector<std::unique_ptr<DbObject>> items;
+            items.reserve(table->rowCount());
+
+            for (int i = 0; i < table->rowCount(); ++i)
             {
-                QString value = r[typeInd].toString();
-                newItem->setData(value, DbObject::TypeRole);
-                if (value == "database")
+                std::unique_ptr<DbObject> newItem(new DbObject(parentNode));
+                newItem->setData(table->value(i, textInd).toString(), Qt::DisplayRole);
+                if (idInd >= 0 && !table->value(i, idInd).isNull())
+                {
+                    newItem->setData(table->value(i, idInd).toString(), DbObject::IdRole);
+                    ++childObjectsCount;
+                }
+                if (nameInd >= 0 && !table->value(i, nameInd).isNull())
+                    newItem->setData(table->value(i, nameInd).toString(), DbObject::NameRole);
+                if (iconInd >= 0 && !table->value(i, iconInd).isNull())
                 {
-                    // find connection string donor (top-level connection)
-                    DbObject *parent = newItem->parent();
-                    while (parent && parent->data(DbObject::TypeRole).toString() != "connection")
-                        parent = parent->parent();
+                    QString icon = table->value(i, iconInd).toString();
+                    QHash<QString, QIcon>::iterator it = icons.find(icon);
+                    if (it == icons.end())
+                        it = icons.insert(icon, QIcon(QApplication::applicationDirPath() + "/decor/" + icon));
+                    newItem->setData(*it, Qt::DecorationRole);
+                }
 
-                    // initialize database-specific connection
-                    if (parent)
+                // children detection
+                newItem->setData(parents.value(i, false), DbObject::ParentRole);
+
+                if (sort1Ind >= 0 && !table->value(i, sort1Ind).isNull())
+                    newItem->setData(table->value(i, sort1Ind), DbObject::Sort1Role);
+                if (sort2Ind >= 0 && !table->value(i, sort2Ind).isNull())
+                    newItem->setData(table->value(i, sort2Ind), DbObject::Sort2Role);
+                if (multiselectInd >= 0 && !table->value(i, multiselectInd).isNull())
+                    newItem->setData(table->value(i, multiselectInd).toBool(), DbObject::MultiselectRole);
+                if (tagInd >= 0 && !table->value(i, tagInd).isNull())
+                    newItem->setData(table->value(i, tagInd), DbObject::TagRole);
+                if (typeInd >= 0)
+                {
+                    QString value = table->value(i, typeInd).toString();
+                    newItem->setData(value, DbObject::TypeRole);
+                    if (value == "database")
                     {
-                        QString cs = DbConnectionFactory::connection(QString::number(std::intptr_t(parent)))->connectionString();
-                        QString id = QString::number(std::intptr_t(newItem.get()));
-                        auto db = DbConnectionFactory::createConnection(id, cs, newItem->data(DbObject::NameRole).toString());
-                        connect(db.get(), &DbConnection::error, this, &DbObjectsModel::error);
-                        connect(db.get(), &DbConnection::message, this, &DbObjectsModel::message);
+                        // find connection string donor (top-level connection)
+                        DbObject *parent = newItem->parent();
+                        while (parent && parent->data(DbObject::TypeRole).toString() != "connection")
+                            parent = parent->parent();
+
+                        // initialize database-specific connection
+                        if (parent)
+                        {
+                            QString cs = DbConnectionFactory::connection(QString::number(std::intptr_t(parent)))->connectionString();
+                            QString id = QString::number(std::intptr_t(newItem.get()));
+                            auto db = DbConnectionFactory::createConnection(id, cs, newItem->data(DbObject::NameRole).toString());
+                            connect(db.get(), &DbConnection::error, this, &DbObjectsModel::error);
+                            connect(db.get(), &DbConnection::message, this, &DbObjectsModel::message);
+                        }
                     }
                 }
+
+                items.push_back(std::move(newItem));
             }
 
-            beginInsertRows(parent, insertPosition, insertPosition);
-            parentNode->appendChild(newItem.release());
-            endInsertRows();
-            ++insertPosition;
-        }
-    }
-    catch (const QString &err)
-    {
-        emit error(err);
+            // inserted at once, so the proxy sorts the children once
+            if (!items.empty())
+            {
+                beginInsertRows(parent, insertPosition, insertPosition + int(items.size()) - 1);
+                for (std::unique_ptr<DbObject> &item: items)
+                    parentNode->appendChild(item.release());
+                endInsertRows();
+            }
     }
 
     parentNode->setData(parentNode->childCount() > 0, DbObject::ParentRole);
@@ -292,7 +414,6 @@ bool DbObjectsModel::fillChildren(const QModelIndex &parent)
     // to show number of db objects if parent is folder or counter > 5 (it's about function.arguments, table.columns, etc)
     if (childObjectsCount && (!parentDbId.isValid() || childObjectsCount > 5))
         parentNode->setData(childObjectsCount, DbObject::ChildObjectsCountRole);
-    return true;
 }
 
 std::shared_ptr<DbConnection> DbObjectsModel::dbConnection(const QModelIndex &index)
@@ -313,6 +434,57 @@ std::shared_ptr<DbConnection> DbObjectsModel::dbConnection(const QModelIndex &in
     return con;
 }
 
+QHash<QString, QVariant> DbObjectsModel::parentNodeProperties(const QModelIndex &index)
+{
+    // the nearest node of the type having the value as parentNodeProperty() does
+    QHash<QString, QVariant> res;
+    const QPair<QString, int> roles[] = {
+        { "id", DbObject::IdRole }, { "name", DbObject::NameRole }, { "tag", DbObject::TagRole }
+    };
+    for (DbObject *item = static_cast<DbObject*>(index.internalPointer()); item; item = item->parent())
+    {
+        QString type = item->data(DbObject::TypeRole).toString();
+        for (const auto &role: roles)
+        {
+            QString key = type + '.' + role.first;
+            QVariant value = item->data(role.second);
+            if (value.isValid() && !res.contains(key))
+                res.insert(key, value);
+        }
+    }
+    return res;
+}
+
+std::function<QVariant(QString)> DbObjectsModel::environment(const QModelIndex &index)
+{
+    QHash<QString, QVariant> props = parentNodeProperties(index);
+    return [props](QString macro) -> QVariant
+    {
+        QStringList parts = macro.split('.', QString::SkipEmptyParts);
+        if (parts.size() > 2 || parts.isEmpty())
+            return QVariant();
+        return props.value(parts.at(0) + '.' + (parts.size() == 1 ? QString("id") : parts.at(1).toLower()));
+    };
+}
+
+std::shared_ptr<DbConnection> DbObjectsModel::takeMetadataConnection(const QString &key)
+{
+    QMutexLocker lk(&_metadata_mutex);
+    auto it = _metadata_connections.find(key);
+    if (it == _metadata_connections.end() || it->isEmpty())
+        return nullptr;
+    return it->takeLast();
+}
+
+void DbObjectsModel::releaseMetadataConnection(const QString &key, std::shared_ptr<DbConnection> con)
+{
+    QMutexLocker lk(&_metadata_mutex);
+    // no more connections than workers are used simultaneously
+    auto &idle = _metadata_connections[key];
+    if (idle.size() < TREE_WORKERS_COUNT)
+        idle.append(con);
+}
+
 QVariant DbObjectsModel::parentNodeProperty(const QModelIndex &index, QString type)
 {
     QVariant envValue;
@@ -3,12 +3,22 @@
 
 #include <functional>
 #include <QAbstractItemModel>
+#include <QThreadPool>
+#include <QMutex>
+#include <QHash>
+#include <QList>
+#include <QVector>
 #include <memory>
 
 class DbObject;
 class DbConnection;
 class DataTable;
 
+// threads populating the tree in background
+#define TREE_WORKERS_COUNT 4
+// max number of loaded nodes to prefetch their children
+#define TREE_PREFETCH_LIMIT 16
+
 template<class Fn>
 class ScopeGuard
 {
@@ -41,15 +51,44 @@ public:
     virtual void fetchMore(const QModelIndex & parent);
 
     bool fillChildren(const QModelIndex &parent = QModelIndex());
+    /*!
+     * \brief load children of the node in background showing a placeholder meanwhile
+     * \param prefetch load the next level of the new nodes too (if enabled by settings)
+     */
+    void fillChildrenAsync(const QModelIndex &parent, bool prefetch = true);
 
     std::shared_ptr<DbConnection> dbConnection(const QModelIndex &index);
     QVariant parentNodeProperty(const QModelIndex &index, QString type);
+    /*!
+     * \brief macro values callback of the node usable by other threads (the values are copied)
+     */
+    std::function<QVariant(QString)> environment(const QModelIndex &index);
     bool addServer(QString name, QString connectionString);
     bool removeConnection(QModelIndex &index);
     bool alterConnection(QModelIndex &index, QString name, QString connectionString);
 
 private:
+    /*!
+     * \brief which of the nodes returned by a tree script may have children
+     */
+    static QVector<bool> childrenDetection(DbConnection *con, DataTable *table);
+    void appendChildren(const QModelIndex &parent, DataTable *table, const QVector<bool> &parents);
+    /*!
+     * \brief macro values of the node and its parents (scripts are run without access to the tree)
+     */
+    QHash<QString, QVariant> parentNodeProperties(const QModelIndex &index);
+    /*!
+     * \brief idle metadata connection to the database, nullptr if none
+     *
+     * Metadata connections are detached: they are used by the workers synchronously only.
+     */
+    std::shared_ptr<DbConnection> takeMetadataConnection(const QString &key);
+    void releaseMetadataConnection(const QString &key, std::shared_ptr<DbConnection> con);
+
     DbObject *_rootItem;
+    QThreadPool _workers;
+    QMutex _metadata_mutex;
+    QHash<QString, QList<std::shared_ptr<DbConnection>>> _metadata_connections; ///< idle ones per database
 
 signals:
     void error(QString err);
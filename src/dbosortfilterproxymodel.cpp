@@ -26,27 +26,15 @@ bool DboSortFilterProxyModel::lessThan(const QModelIndex &left,
         return false;
     */
 
-    QVariant sortMode = sourceModel()->data(left.parent(), DbObject::CurrentSortRole);
-    int mode = (sortMode.isValid() ? sortMode.toInt() : 0);
-
-    QVariant leftS1 = sourceModel()->data(left, DbObject::Sort1Role);
-    QVariant leftS2 = sourceModel()->data(left, DbObject::Sort2Role);
-    QString leftN = sourceModel()->data(left, Qt::DisplayRole).toString().toLower();
-    QVariant rightS1 = sourceModel()->data(right, DbObject::Sort1Role);
-    QVariant rightS2 = sourceModel()->data(right, DbObject::Sort2Role);
-    QString rightN = sourceModel()->data(right, Qt::DisplayRole).toString().toLower();
-
-    if (mode == 0)
-    {
-        if (leftS1.isValid() && rightS1.isValid())
-            return compare(leftS1, rightS1);
-    }
-    else
-    {
-        if (leftS2.isValid() && rightS2.isValid())
-            return compare(leftS2, rightS2);
-    }
-    return leftN < rightN;
+    // indexes are of the DbObjectsModel, the keys are computed by the nodes as set
+    const DbObject *l = static_cast<const DbObject*>(left.internalPointer());
+    const DbObject *r = static_cast<const DbObject*>(right.internalPointer());
+    const int mode = (l->parent() ? l->parent()->sortMode() : 0);
+    const DbObject::SortKey &leftKey = l->sortKey(mode);
+    const DbObject::SortKey &rightKey = r->sortKey(mode);
+    if (leftKey.isValid() && rightKey.isValid())
+        return leftKey < rightKey;
+    return l->sortName() < r->sortName();
 }
 
 bool DboSortFilterProxyModel::compare(const QVariant &varl, const QVariant &varr) const
@@ -0,0 +1,205 @@
+#include "executionservice.h"
+#include "dbconnection.h"
+#include "datatable.h"
+#include "lambdarunnable.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QSet>
+#include <QThread>
+#include <algorithm>
+
+ExecutionService& ExecutionService::instance()
+{
+    static ExecutionService service;
+    return service;
+}
+
+ExecutionService::ExecutionService() :
+    _inflight_cells(0)
+{
+    // notifications are delivered on gui thread whoever asks for the service first
+    if (qApp && thread() != qApp->thread())
+        moveToThread(qApp->thread());
+    _statements.setMaxThreadCount(EXECUTION_ODBC_WORKERS);
+    _statements.setExpiryTimeout(-1);
+    _cancels.setMaxThreadCount(1);
+    _cancels.setExpiryTimeout(-1);
+}
+
+ExecutionService::~ExecutionService()
+{
+    if (_io)
+    {
+        _io->quit();
+        _io->wait();
+        delete _io;
+    }
+    _statements.waitForDone();
+    _cancels.waitForDone();
+}
+
+QThread* ExecutionService::ioThread()
+{
+    QMutexLocker lk(&_mutex);
+    if (!_io)
+    {
+        _io = new QThread();
+        _io->setObjectName("sqt io");
+        _io->start();
+    }
+    return _io;
+}
+
+void ExecutionService::runStatement(std::function<void()> fn)
+{
+    _statements.start(new LambdaRunnable(fn));
+}
+
+void ExecutionService::runCancel(std::function<void()> fn)
+{
+    _cancels.start(new LambdaRunnable(fn));
+}
+
+void ExecutionService::connectFetched(DbConnection *connection, QObject *receiver, std::function<void(DataTable*)> slot)
+{
+    QMutexLocker lk(&_mutex);
+    for (const Subscriber &s: _subscribers)
+    {
+        if (s.connection == connection && s.receiver == receiver)
+            return;
+    }
+    if (!std::any_of(_subscribers.begin(), _subscribers.end(), [connection](const Subscriber &s) { return s.connection == connection; }))
+    {
+        connect(connection, &DbConnection::fetched, this, [this, connection](DataTable *table) {
+            post(connection, table);
+        }, Qt::DirectConnection);
+    }
+    _subscribers.append({connection, receiver, slot});
+}
+
+void ExecutionService::post(DbConnection *connection, DataTable *table)
+{
+    // fetched() is emitted after the table is unlocked, the rows may be appended meanwhile
+    QMutexLocker table_lk(&table->mutex);
+    qint64 cells = qint64(table->rowCount()) * table->columnCount();
+    table_lk.unlock();
+    QMutexLocker lk(&_mutex);
+    bool found = false;
+    for (Pending &p: _pending)
+    {
+        if (p.connection == connection && p.table == table)
+        {
+            _inflight_cells += cells - p.cells;
+            p.cells = cells;
+            found = true;
+            break;
+        }
+    }
+    if (!found)
+    {
+        _pending.append({connection, table, cells});
+        _inflight_cells += cells;
+    }
+    if (!_scheduled)
+    {
+        _scheduled = true;
+        QMetaObject::invokeMethod(this, [this]() { deliver(); }, Qt::QueuedConnection);
+    }
+}
+
+void ExecutionService::deliver()
+{
+    QElapsedTimer budget;
+    budget.start();
+    for (;;)
+    {
+        // a round takes the earliest notification of every connection
+        QVector<Pending> round;
+        {
+            QMutexLocker lk(&_mutex);
+            QSet<DbConnection*> taken;
+            for (int i = 0; i < _pending.size();)
+            {
+                if (taken.contains(_pending[i].connection))
+                {
+                    ++i;
+                    continue;
+                }
+                taken.insert(_pending[i].connection);
+                round.append(_pending.takeAt(i));
+            }
+            if (round.isEmpty())
+            {
+                _scheduled = false;
+                return;
+            }
+        }
+        for (const Pending &p: round)
+            notify(p);
+        if (budget.elapsed() >= EXECUTION_DELIVERY_BUDGET)
+            break;
+    }
+    // let the gui process other events before the rest
+    QMutexLocker lk(&_mutex);
+    if (_pending.isEmpty())
+        _scheduled = false;
+    else
+        QMetaObject::invokeMethod(this, [this]() { deliver(); }, Qt::QueuedConnection);
+}
+
+void ExecutionService::notify(const Pending &pending)
+{
+    _inflight_cells -= pending.cells;
+    // the slot may subscribe or forget connections
+    _mutex.lock();
+    QList<Subscriber> subscribers = _subscribers;
+    _mutex.unlock();
+    for (const Subscriber &s: subscribers)
+    {
+        if (s.connection == pending.connection && s.receiver)
+            s.slot(pending.table);
+    }
+}
+
+void ExecutionService::flushFetched(DbConnection *connection)
+{
+    for (;;)
+    {
+        Pending next;
+        {
+            QMutexLocker lk(&_mutex);
+            auto it = std::find_if(_pending.begin(), _pending.end(), [connection](const Pending &p) {
+                return p.connection == connection;
+            });
+            if (it == _pending.end())
+                return;
+            next = *it;
+            _pending.erase(it);
+        }
+        notify(next);
+    }
+}
+
+void ExecutionService::forget(DbConnection *connection)
+{
+    QMutexLocker lk(&_mutex);
+    for (int i = _subscribers.size() - 1; i >= 0; --i)
+    {
+        if (_subscribers[i].connection == connection)
+            _subscribers.removeAt(i);
+    }
+    for (int i = _pending.size() - 1; i >= 0; --i)
+    {
+        if (_pending[i].connection == connection)
+        {
+            _inflight_cells -= _pending[i].cells;
+            _pending.removeAt(i);
+        }
+    }
+}
+
+bool ExecutionService::inflightExceeded() const noexcept
+{
+    // gui thread delivers the notifications, so it never waits for them
+    return _inflight_cells > EXECUTION_INFLIGHT_CELLS && QThread::currentThread() != thread();
+}
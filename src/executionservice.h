@@ -0,0 +1,96 @@
+#ifndef EXECUTIONSERVICE_H
+#define EXECUTIONSERVICE_H
+
+#include <QObject>
+#include <QPointer>
+#include <QThreadPool>
+#include <QMutex>
+#include <QList>
+#include <QVector>
+#include <atomic>
+#include <functional>
+
+// threads running blocking (odbc) statements of all the tabs
+#define EXECUTION_ODBC_WORKERS 8
+// gui time spent on fetched() notifications before other events are processed, ms
+#define EXECUTION_DELIVERY_BUDGET 20
+// cells fetched but not taken by views yet, drivers pause reading above the limit
+#define EXECUTION_INFLIGHT_CELLS (20 * 1000 * 1000)
+// period of checking whether the paused driver may continue, ms
+#define EXECUTION_INFLIGHT_RETRY 20
+
+class DbConnection;
+class DataTable;
+class QThread;
+
+/*!
+ * \brief Threads and delivery of results shared by queries of all the tabs.
+ *
+ * Sockets of asynchronous (libpq) queries are watched by the single I/O thread, blocking
+ * statements run on the pool of EXECUTION_ODBC_WORKERS threads. fetched() notifications
+ * are coalesced per resultset and delivered to the gui thread round-robin between connections
+ * within EXECUTION_DELIVERY_BUDGET, so a fast query doesn't starve the others.
+ */
+class ExecutionService : public QObject
+{
+    Q_OBJECT
+public:
+    static ExecutionService& instance();
+    virtual ~ExecutionService() override;
+
+    /*!
+     * \brief the thread watching sockets of asynchronous queries
+     */
+    QThread* ioThread();
+    /*!
+     * \brief run blocking statement (odbc, or a blocking libpq call kept off the I/O thread)
+     */
+    void runStatement(std::function<void()> fn);
+    /*!
+     * \brief run cancel request, separately from statements occupying the pool
+     */
+    void runCancel(std::function<void()> fn);
+
+    /*!
+     * \brief deliver fetched() of the connection to the slot on gui thread
+     */
+    void connectFetched(DbConnection *connection, QObject *receiver, std::function<void(DataTable*)> slot);
+    /*!
+     * \brief deliver pending notifications of the connection right away
+     */
+    void flushFetched(DbConnection *connection);
+    void forget(DbConnection *connection);
+    /*!
+     * \brief whether the fetching thread should pause until views take pending rows
+     */
+    bool inflightExceeded() const noexcept;
+
+private:
+    struct Subscriber
+    {
+        DbConnection *connection;
+        QPointer<QObject> receiver;
+        std::function<void(DataTable*)> slot;
+    };
+    struct Pending
+    {
+        DbConnection *connection;
+        DataTable *table;
+        qint64 cells;
+    };
+    ExecutionService();
+    void post(DbConnection *connection, DataTable *table);
+    void deliver();
+    void notify(const Pending &pending);
+
+    QThreadPool _statements;
+    QThreadPool _cancels;
+    QThread *_io = nullptr;
+    QMutex _mutex;              ///< guards _subscribers, _pending and _scheduled
+    QList<Subscriber> _subscribers;
+    QList<Pending> _pending;
+    bool _scheduled = false;
+    std::atomic<qint64> _inflight_cells;
+};
+
+#endif // EXECUTIONSERVICE_H
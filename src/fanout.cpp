@@ -0,0 +1,180 @@
+#include "fanout.h"
+#include "dbconnection.h"
+#include "datatable.h"
+#include "tablemodel.h"
+#include "trace.h"
+#include "lambdarunnable.h"
+#include <QApplication>
+#include <QHeaderView>
+#include <QLabel>
+#include <QPlainTextEdit>
+#include <QPointer>
+#include <QSplitter>
+#include <QTableView>
+#include <QThread>
+#include <QVBoxLayout>
+#include <functional>
+#include <stdexcept>
+
+FanOut::FanOut(const QString &query, const QList<QPair<QString, std::shared_ptr<DbConnection>>> &servers, QWidget *parent) :
+    QDialog(parent),
+    _query(query),
+    _servers(servers.size()),
+    _shared(std::make_shared<Shared>())
+{
+    setAttribute(Qt::WA_DeleteOnClose);
+    setWindowTitle(tr("Query of %1 servers").arg(_servers));
+
+    QVBoxLayout *layout = new QVBoxLayout();
+    QSplitter *splitter = new QSplitter(Qt::Vertical, this);
+    _model = new TableModel(this);
+    _view = new QTableView(splitter);
+    _view->setModel(_model);
+    QHeaderView *header = _view->horizontalHeader();
+    header->setSortIndicator(-1, Qt::AscendingOrder);
+    header->setSortIndicatorShown(true);
+    header->setSectionsClickable(true);
+    TableModel *m = _model;
+    connect(header, &QHeaderView::sortIndicatorChanged, m, [m](int column, Qt::SortOrder order) {
+        m->sort(column, order);
+    });
+    _log = new QPlainTextEdit(splitter);
+    _log->setReadOnly(true);
+    _log->hide();
+    splitter->addWidget(_view);
+    splitter->addWidget(_log);
+    splitter->setStretchFactor(0, 4);
+    layout->addWidget(splitter);
+    _status = new QLabel(this);
+    layout->addWidget(_status);
+    layout->setContentsMargins(0, 0, 0, 0);
+    setLayout(layout);
+    resize(800, 600);
+
+    _pool.setMaxThreadCount(FANOUT_PARALLEL);
+    for (const QPair<QString, std::shared_ptr<DbConnection>> &server: servers)
+    {
+        if (server.second)
+            start(server.first, server.second);
+        else
+            finished(server.first, nullptr, tr("not connected"));
+    }
+    finished(QString(), nullptr, QString());
+}
+
+FanOut::~FanOut()
+{
+    {
+        QMutexLocker lk(&_shared->mutex);
+        _shared->cancelled = true;
+        for (DbConnection *cn: _shared->running)
+            cn->cancel();
+    }
+    _pool.clear();
+    _pool.waitForDone();
+}
+
+void FanOut::start(const QString &server, std::shared_ptr<DbConnection> con)
+{
+    // the clone is made here, tree connections are not used by threads
+    std::shared_ptr<DbConnection> cn(con->clone());
+    cn->setDetached(true);
+    std::shared_ptr<Shared> shared = _shared;
+    QPointer<FanOut> self(this);
+    const QString query = _query;
+    _pool.start(new LambdaRunnable([self, shared, server, cn, query]() {
+        SQT_TRACE_SCOPE("FanOut::server");
+        {
+            QMutexLocker lk(&shared->mutex);
+            if (shared->cancelled)
+                return;
+            shared->running.append(cn.get());
+        }
+        QString errors;
+        QString *err = &errors;
+        // a failed cancel request reports from the gui thread
+        QThread *thread = QThread::currentThread();
+        QObject::connect(cn.get(), &DbConnection::error, [err, thread](const QString &e) {
+            if (QThread::currentThread() == thread)
+                *err += e;
+        });
+        DataTable *res = nullptr;
+        try
+        {
+            if (cn->open() && cn->execute(query) && !cn->_resultsets.isEmpty())
+            {
+                const DataTable *src = cn->_resultsets.last();
+                res = new DataTable();
+                res->addColumn(new DataColumn("server"));
+                for (int c = 0; c < src->columnCount(); ++c)
+                    res->addColumn(new DataColumn(src->getColumn(c)));
+                QVector<QVariant> row(src->columnCount() + 1);
+                row[0] = server;
+                for (int r = 0; r < src->rowCount(); ++r)
+                {
+                    for (int c = 0; c < src->columnCount(); ++c)
+                        row[c + 1] = src->value(r, c);
+                    res->appendRow(row);
+                }
+                res->moveToThread(qApp->thread());
+            }
+        }
+        catch (const QString &e)
+        {
+            errors += e;
+        }
+        catch (const std::runtime_error &e)
+        {
+            errors += QString::fromStdString(e.what());
+        }
+        {
+            QMutexLocker lk(&shared->mutex);
+            shared->running.removeOne(cn.get());
+        }
+        // the session goes back to the pool
+        cn->clearResultsets();
+        cn->close();
+        cn->disconnect();
+        QMetaObject::invokeMethod(qApp, [self, server, res, errors]() {
+            if (self)
+                self->finished(server, res, errors);
+            else
+                delete res;
+        }, Qt::QueuedConnection);
+    }));
+}
+
+void FanOut::finished(const QString &server, DataTable *table, const QString &error)
+{
+    if (!server.isNull())
+    {
+        ++_done;
+        QString e = error;
+        if (table)
+        {
+            QStringList columns;
+            for (int c = 0; c < table->columnCount(); ++c)
+                columns.append(table->getColumn(c).name());
+            if (_columns.isEmpty())
+                _columns = columns;
+            if (columns != _columns)
+                e = tr("the columns differ from the columns of the other servers: %1").arg(columns.mid(1).join(", "));
+            else
+            {
+                const bool first = (_model->columnCount() == 0);
+                _model->take(table);
+                if (first)
+                    _model->resizeColumns(_view);
+            }
+            delete table;
+        }
+        if (!e.isEmpty())
+        {
+            ++_errors;
+            _log->appendPlainText(QString("%1: %2").arg(server, e.trimmed()));
+            _log->show();
+        }
+    }
+    _status->setText(tr("%1 of %2 servers done, %3 errors, %4 rows").
+                     arg(_done).arg(_servers).arg(_errors).arg(_model->rowCount()));
+}
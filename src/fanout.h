@@ -0,0 +1,61 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <QDialog>
+#include <QMutex>
+#include <QThreadPool>
+#include <QPair>
+#include <memory>
+
+// servers queried at once
+#define FANOUT_PARALLEL 8
+
+class DbConnection;
+class DataTable;
+class QLabel;
+class QPlainTextEdit;
+class QTableView;
+class TableModel;
+
+/*!
+ * \brief Execution of one query against many servers in parallel (Query > Execute on selected connections).
+ *
+ * Every server runs on a clone of its tree connection (sessions are taken from the pools),
+ * at most FANOUT_PARALLEL at once. The last resultset of every server is appended to the
+ * merged grid as soon as the server is done, the leading "server" column tells the source.
+ * Servers returning a different set of columns than the first one are reported as errors.
+ */
+class FanOut : public QDialog
+{
+    Q_OBJECT
+public:
+    /*!
+     * \param servers names of tree connections and their connections, nullptr if the server is not connected
+     */
+    FanOut(const QString &query, const QList<QPair<QString, std::shared_ptr<DbConnection>>> &servers, QWidget *parent = nullptr);
+    virtual ~FanOut() override;
+
+private:
+    struct Shared
+    {
+        QMutex mutex;                   ///< guards running
+        QList<DbConnection*> running;
+        bool cancelled = false;
+    };
+    void start(const QString &server, std::shared_ptr<DbConnection> con);
+    void finished(const QString &server, DataTable *table, const QString &error);
+
+    QString _query;
+    int _servers;
+    int _done = 0;
+    int _errors = 0;
+    QStringList _columns;               ///< names of the columns of the first result
+    TableModel *_model;
+    QTableView *_view;
+    QLabel *_status;
+    QPlainTextEdit *_log;
+    std::shared_ptr<Shared> _shared;
+    QThreadPool _pool;
+};
+
+#endif // FANOUT_H
@@ -2,8 +2,12 @@
 #include "ui_findandreplacepanel.h"
 #include <QPlainTextEdit>
 #include <QToolTip>
+#include <QTextDocument>
 #include "querywidget.h"
 
+// delay of reindexing after a change of the text or the pattern, ms
+#define SEARCH_INDEX_DELAY 300
+
 FindAndReplacePanel::FindAndReplacePanel(QWidget *parent) :
     QWidget(parent),
     ui(new Ui::FindAndReplacePanel), _queryWidget(nullptr)
@@ -27,6 +31,18 @@ FindAndReplacePanel::FindAndReplacePanel(QWidget *parent) :
     setFocusProxy(ui->lineFind);
     ui->lineFind->installEventFilter(this);
     ui->lineReplace->installEventFilter(this);
+
+    // matches are counted in background
+    _indexTimer.setSingleShot(true);
+    _indexTimer.setInterval(SEARCH_INDEX_DELAY);
+    connect(&_indexTimer, &QTimer::timeout, this, &FindAndReplacePanel::updateIndex);
+    for (QCheckBox *cb: {ui->cbCaseSensitive, ui->cbWholeWord, ui->cbRegexp, ui->cbRegexpM, ui->cbRegexpS, ui->cbRegexpU})
+        connect(cb, &QCheckBox::toggled, &_indexTimer, static_cast<void(QTimer::*)()>(&QTimer::start));
+    connect(ui->lineFind, &QLineEdit::textChanged, &_indexTimer, static_cast<void(QTimer::*)()>(&QTimer::start));
+    connect(&_index, &SearchIndex::ready, this, [this]() {
+        ui->matchCount->setText(tr("%1 matches").arg(_index.count()));
+    });
+    connect(&_index, &SearchIndex::replaced, this, &FindAndReplacePanel::onReplaced);
 }
 
 FindAndReplacePanel::~FindAndReplacePanel()
@@ -41,10 +57,57 @@ QList<QAction *> FindAndReplacePanel::actions()
 
 void FindAndReplacePanel::setEditor(QueryWidget *qw)
 {
-    _queryWidget = qw;
+    if (_queryWidget != qw)
+    {
+        disconnect(_documentConnection);
+        _queryWidget = qw;
+        ++_revision;
+        _index.invalidate();
+        if (qw)
+        {
+            _documentConnection = connect(qw->document(), &QTextDocument::contentsChanged, this, [this]() {
+                ++_revision;
+                _index.invalidate();
+                _indexTimer.start();
+            });
+        }
+        _indexTimer.start();
+    }
     refreshActions();
 }
 
+QRegularExpression FindAndReplacePanel::expression() const
+{
+    if (ui->cbRegexp->isChecked())
+        return QRegularExpression(ui->lineFind->text(), regexpOptions());
+    QString tofind = QRegularExpression::escape(ui->lineFind->text());
+    return QRegularExpression(ui->cbWholeWord->isChecked() ? "\\b" + tofind + "\\b" : tofind,
+                              ui->cbCaseSensitive->isChecked() ?
+                                  QRegularExpression::NoPatternOption :
+                                  QRegularExpression::CaseInsensitiveOption);
+}
+
+void FindAndReplacePanel::updateIndex()
+{
+    QRegularExpression exp = expression();
+    if (!_queryWidget || !isVisible() || ui->lineFind->text().isEmpty() || !exp.isValid())
+    {
+        _index.invalidate();
+        ui->matchCount->clear();
+        return;
+    }
+    if (_index.isReady(exp, _revision))
+        return;
+    ui->matchCount->setText(tr("..."));
+    _index.build(_queryWidget->toPlainText(), exp, _revision);
+}
+
+void FindAndReplacePanel::showEvent(QShowEvent *event)
+{
+    QWidget::showEvent(event);
+    _indexTimer.start();
+}
+
 void FindAndReplacePanel::refreshActions()
 {
     bool is_ro = (_queryWidget ? _queryWidget->isReadOnly() : true);
@@ -92,8 +155,24 @@ QTextCursor FindAndReplacePanel::find(const QTextCursor &cursor, bool *nextPass,
         QRegularExpression exp(ui->lineFind->text(), regexpOptions());
         if (!exp.isValid())
             QToolTip::showText(ui->lineFind->mapToGlobal(QPoint(0, -ui->lineFind->height() * 1.5)), exp.errorString());
+        else if (mode != Check && _index.isReady(exp, _revision))
+        {
+            bool wrapped;
+            int i = (mode == Backward ? _index.previous(cur_cursor.anchor(), &wrapped) :
+                                        _index.next(cur_cursor.position(), &wrapped));
+            if (i >= 0)
+            {
+                res = true;
+                new_cursor.setPosition(_index.at(i).first);
+                new_cursor.setPosition(_index.at(i).first + _index.at(i).second, QTextCursor::KeepAnchor);
+                if (nextPass)
+                    *nextPass = wrapped;
+            }
+        }
         else
         {
+            // the index is not built yet
+            _indexTimer.start();
             QString src = _queryWidget->toPlainText();
             if (mode == Backward)
             {
@@ -191,7 +270,7 @@ QTextCursor FindAndReplacePanel::find(const QTextCursor &cursor, bool *nextPass,
     return (res ? new_cursor : QTextCursor());
 }
 
-QRegularExpression::PatternOptions FindAndReplacePanel::regexpOptions()
+QRegularExpression::PatternOptions FindAndReplacePanel::regexpOptions() const
 {
     QRegularExpression::PatternOptions opt = QRegularExpression::NoPatternOption;
     if (ui->cbCaseSensitive->checkState() != Qt::Checked)
@@ -305,57 +384,69 @@ void FindAndReplacePanel::on_btnReplace_clicked()
 void FindAndReplacePanel::on_btnReplaceAll_clicked()
 {
     QTextCursor c = _queryWidget->textCursor();
-    QString src_text = c.hasSelection() ?
-                c.selectedText() : _queryWidget->toPlainText();
+    QString src_text = (c.hasSelection() ? c.selectedText() : _queryWidget->toPlainText());
+    src_text.replace(QChar::ParagraphSeparator, '\n');
 
-    QString repl;
-    QRegularExpression exp;
+    QRegularExpression exp = expression();
+    QString repl = ui->lineReplace->text();
     if (ui->cbRegexp->isChecked())
     {
-        exp.setPattern(ui->lineFind->text());
-        exp.setPatternOptions(regexpOptions());
         bool err;
-        repl = unescape(ui->lineReplace->text(), &err);
+        repl = unescape(repl, &err);
         if (err)
         {
             QToolTip::showText(ui->lineReplace->mapToGlobal(QPoint(0, -ui->lineReplace->height() * 2)), repl);
             return;
         }
-        //^(\w+)\,[^\n]\n
-        src_text = src_text.replace(QChar::ParagraphSeparator, '\n');
-    }
-    else
-    {
-        QString tofind = ui->lineFind->text().replace(QRegularExpression(R"(([.\^$*+?()[{\\|\]\-]))"), R"(\\1)");
-        exp.setPattern(ui->cbWholeWord->isChecked() ? "\\b" + tofind + "\\b" : tofind);
-        exp.setPatternOptions(ui->cbCaseSensitive->isChecked() ?
-                                  QRegularExpression::NoPatternOption :
-                                  QRegularExpression::CaseInsensitiveOption);
-        repl = ui->lineReplace->text();
     }
+    if (!exp.isValid() || ui->lineFind->text().isEmpty())
+        return;
+
+    // matches are collected in background and replaced by a single edit
+    _replaceOffset = (c.hasSelection() ? c.selectionStart() : 0);
+    _replaceLength = (c.hasSelection() ? src_text.length() : -1);
+    ui->btnReplaceAll->setEnabled(false);
+    _index.replaceAll(src_text, exp, repl, !ui->cbRegexp->isChecked(), _revision);
+}
 
-    // just count
-    int count = 0;
-    QRegularExpressionMatchIterator i = exp.globalMatch(src_text);
-    while (i.hasNext())
+void FindAndReplacePanel::onReplaced(const QVector<SearchIndex::Replacement> &replacements, quint64 revision)
+{
+    refreshActions();
+    if (!_queryWidget)
+        return;
+    if (revision != _revision)
     {
-        i.next();
-        ++count;
+        QToolTip::showText(ui->btnReplaceAll->mapToGlobal(QPoint(0, -ui->btnReplaceAll->height() * 1.5)),
+                           tr("The text has changed, nothing is replaced"));
+        return;
     }
 
-    // replace
-    if (count)
+    if (!replacements.isEmpty())
     {
-        src_text.replace(exp, repl);
+        int delta = 0;
+        QTextCursor c(_queryWidget->document());
+        c.beginEditBlock();
+        // from the end, so positions of the rest stay valid
+        for (int i = replacements.size() - 1; i >= 0; --i)
+        {
+            const SearchIndex::Replacement &r = replacements.at(i);
+            c.setPosition(_replaceOffset + r.start);
+            c.setPosition(_replaceOffset + r.start + r.length, QTextCursor::KeepAnchor);
+            c.insertText(r.text);
+            delta += r.text.length() - r.length;
+        }
+        c.endEditBlock();
 
-        if (!c.hasSelection())
-            c.select(QTextCursor::Document);
-        c.insertText(src_text);
+        if (_replaceLength >= 0)
+        {
+            c.setPosition(_replaceOffset);
+            c.setPosition(_replaceOffset + _replaceLength + delta, QTextCursor::KeepAnchor);
+        }
         _queryWidget->setTextCursor(c);
     }
 
     QToolTip::showText(
                 ui->btnReplaceAll->mapToGlobal(QPoint(0, -ui->btnReplaceAll->height() * 1.5)),
-                tr("%1 occurences replaced").arg(count)
+                tr("%1 occurences replaced").arg(replacements.size())
                 );
 }
@@ -5,6 +5,8 @@
 #include <QLineEdit>
 #include <QTextCursor>
 #include <QRegularExpression>
+#include <QTimer>
+#include "searchindex.h"
 
 class QPlainTextEdit;
 class QueryWidget;
@@ -30,17 +32,30 @@ private slots:
     void on_cbRegexp_toggled(bool checked);
     void on_btnReplace_clicked();
     void on_btnReplaceAll_clicked();
+    void updateIndex();
+    void onReplaced(const QVector<SearchIndex::Replacement> &replacements, quint64 revision);
 
 private:
     enum FindMode {Forward, Backward, Check};
     Ui::FindAndReplacePanel *ui;
     QueryWidget *_queryWidget;
+    SearchIndex _index;
+    quint64 _revision = 0;      ///< bumped on every change of the text
+    QTimer _indexTimer;
+    QMetaObject::Connection _documentConnection;
+    int _replaceOffset = 0;     ///< start of the text being replaced
+    int _replaceLength = -1;    ///< length of the selection being replaced, -1 for the whole text
+    /*!
+     * \brief pattern of the search (plain text is escaped)
+     */
+    QRegularExpression expression() const;
     QTextCursor find(const QTextCursor &cursor = QTextCursor(), bool *nextPass = nullptr, FindMode mode = Forward);
-    QRegularExpression::PatternOptions regexpOptions();
+    QRegularExpression::PatternOptions regexpOptions() const;
     QString unescape(QString ui_string, bool *err);
 
 protected:
     bool eventFilter(QObject *target, QEvent *event);
+    void showEvent(QShowEvent *event);
 };
 
 #endif // FINDANDREPLACEPANEL_H
@@ -0,0 +1,308 @@
+#include "gridcopy.h"
+#include "tablemodel.h"
+#include "cursortablemodel.h"
+#include "datatable.h"
+#include <QDateTime>
+#include <QLocale>
+#include <QRegularExpression>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+
+GridCopy::Format GridCopy::format(const QString &name)
+{
+    if (name == "tsv")
+        return Format::Tsv;
+    if (name == "csv")
+        return Format::Csv;
+    if (name == "insert")
+        return Format::Insert;
+    return Format::Values;
+}
+
+GridCopy::GridCopy(const QAbstractItemModel *model, Format format) :
+    _model(model),
+    _format(format)
+{
+    // pages of a cursor are not within the table of the model
+    const TableModel *m = qobject_cast<const TableModel*>(model);
+    if (m && !qobject_cast<const CursorTableModel*>(model))
+    {
+        _table_model = m;
+        _table = m->table();
+    }
+    for (int c = 0; c < model->columnCount(); ++c)
+    {
+        int alignment = (_table ?
+                             int(_table->getColumn(c).hAlignment()) :
+                             model->index(0, c).data(Qt::TextAlignmentRole).toInt());
+        _quoted.append(!(alignment & Qt::AlignRight));
+    }
+}
+
+QString GridCopy::text(const QAbstractItemModel *model, const QItemSelection &selection, Format format)
+{
+    QVector<Segment> parts = segments(selection);
+    if (parts.isEmpty())
+        return QString();
+    GridCopy copy(model, format);
+    qint64 rows = 0;
+    for (const Segment &part: parts)
+        rows += part.bottom - part.top + 1;
+
+    qint64 done = 0;
+    int in_statement = 0;
+    const QVector<int> *statement_columns = nullptr;
+    for (const Segment &part: parts)
+    {
+        if ((format == Format::Tsv || format == Format::Csv) && &part == &parts.first())
+            copy.header(part.columns);
+        for (int r = part.top; r <= part.bottom; ++r)
+        {
+            if (format == Format::Insert)
+            {
+                if (in_statement && (in_statement == GRID_COPY_INSERT_ROWS || statement_columns != &part.columns))
+                {
+                    copy._buf += ";\n";
+                    in_statement = 0;
+                }
+                if (in_statement)
+                    copy._buf += ",\n";
+                else
+                {
+                    copy.header(part.columns);
+                    statement_columns = &part.columns;
+                }
+                ++in_statement;
+            }
+            else if (format == Format::Values && done)
+                copy._buf += '\n';
+            copy.row(r, part.columns);
+            if (format == Format::Tsv || format == Format::Csv)
+                copy._buf += '\n';
+
+            if (++done == GRID_COPY_SAMPLE_ROWS && done < rows)
+            {
+                qint64 estimate = copy._buf.size() * rows / done + copy._buf.size();
+                if (estimate < std::numeric_limits<int>::max() / 2)
+                    copy._buf.reserve(int(estimate));
+            }
+        }
+    }
+    if (in_statement)
+        copy._buf += ";\n";
+    return QString::fromUtf8(copy._buf);
+}
+
+QVector<GridCopy::Segment> GridCopy::segments(const QItemSelection &selection)
+{
+    std::vector<int> cuts;
+    for (const QItemSelectionRange &range: selection)
+    {
+        if (!range.isValid())
+            continue;
+        cuts.push_back(range.top());
+        cuts.push_back(range.bottom() + 1);
+    }
+    std::sort(cuts.begin(), cuts.end());
+    cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+
+    QVector<Segment> res;
+    for (size_t i = 0; i + 1 < cuts.size(); ++i)
+    {
+        int top = cuts[i];
+        int bottom = cuts[i + 1] - 1;
+        // the same ranges cover all the rows between neighbour cuts
+        QVector<int> columns;
+        for (const QItemSelectionRange &range: selection)
+        {
+            if (range.isValid() && range.top() <= top && range.bottom() >= bottom)
+            {
+                for (int c = range.left(); c <= range.right(); ++c)
+                    columns.append(c);
+            }
+        }
+        if (columns.isEmpty())
+            continue;
+        std::sort(columns.begin(), columns.end());
+        columns.erase(std::unique(columns.begin(), columns.end()), columns.end());
+        if (!res.isEmpty() && res.last().bottom + 1 == top && res.last().columns == columns)
+            res.last().bottom = bottom;
+        else
+            res.append({top, bottom, columns});
+    }
+    return res;
+}
+
+void GridCopy::header(const QVector<int> &columns)
+{
+    if (_format == Format::Insert)
+        _buf += "insert into tablename (";
+    for (int i = 0; i < columns.size(); ++i)
+    {
+        if (i)
+            _buf += (_format == Format::Tsv ? "\t" : _format == Format::Csv ? "," : ", ");
+        appendName(_model->headerData(columns[i], Qt::Horizontal, Qt::DisplayRole).toString());
+    }
+    _buf += (_format == Format::Insert ? ") values\n" : "\n");
+}
+
+void GridCopy::row(int row, const QVector<int> &columns)
+{
+    const char *separator = (_format == Format::Tsv ? "\t" : _format == Format::Insert ? ", " : ",");
+    if (_format == Format::Insert)
+        _buf += '(';
+    for (int i = 0; i < columns.size(); ++i)
+    {
+        if (i)
+            _buf += separator;
+        cell(row, columns[i]);
+    }
+    if (_format == Format::Insert)
+        _buf += ')';
+}
+
+static int formatInteger(char *end, qint64 value) noexcept
+{
+    // digits are written backward from the end of the buffer
+    quint64 u = (value < 0 ? 0 - quint64(value) : quint64(value));
+    char *p = end;
+    do
+    {
+        *--p = char('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (value < 0)
+        *--p = '-';
+    return int(end - p);
+}
+
+void GridCopy::cell(int row, int column)
+{
+    const bool quoted = _quoted[column];
+    if (!_table)
+    {
+        QVariant value = _model->index(row, column).data(Qt::EditRole);
+        if (!value.isValid())
+        {
+            if (_format == Format::Insert)
+                _buf += "null";
+            return;
+        }
+        _scratch = value.toString().toUtf8();
+        return append(_scratch.constData(), _scratch.size(), quoted);
+    }
+
+    const ColumnStorage &s = _table->storage(column);
+    const int r = _table_model->sourceRow(row);
+    if (s.isNull(r))
+    {
+        if (_format == Format::Insert)
+            _buf += "null";
+        return;
+    }
+    char digits[24];
+    char *end = digits + sizeof(digits);
+    switch (s.kind())
+    {
+    case ColumnStorage::Kind::Int32:
+    {
+        int length = formatInteger(end, s.int32At(r));
+        return append(end - length, length, quoted);
+    }
+    case ColumnStorage::Kind::Int64:
+    {
+        int length = formatInteger(end, s.int64At(r));
+        return append(end - length, length, quoted);
+    }
+    case ColumnStorage::Kind::Double:
+        _scratch = QByteArray::number(s.doubleAt(r), 'g', QLocale::FloatingPointShortest);
+        break;
+    case ColumnStorage::Kind::Bool:
+        return s.boolAt(r) ? append("true", 4, quoted) : append("false", 5, quoted);
+    case ColumnStorage::Kind::String:
+    {
+        if (s.isTruncated(r))
+        {
+            _scratch = s.wholeString(r).toUtf8();
+            break;
+        }
+        int length;
+        const char *data = s.utf8At(r, length);
+        return append(data, length, quoted);
+    }
+    case ColumnStorage::Kind::Date:
+        _scratch = QDate::fromJulianDay(s.int64At(r)).toString("yyyy-MM-dd").toLatin1();
+        break;
+    case ColumnStorage::Kind::Time:
+        _scratch = QTime::fromMSecsSinceStartOfDay(s.int32At(r)).toString("hh:mm:ss.zzz").toLatin1();
+        break;
+    case ColumnStorage::Kind::DateTime:
+        _scratch = s.value(r).toDateTime().toString("yyyy-MM-dd hh:mm:ss.zzz").toLatin1();
+        break;
+    default:
+        _scratch = s.value(r).toString().toUtf8();
+        break;
+    }
+    append(_scratch.constData(), _scratch.size(), quoted);
+}
+
+void GridCopy::append(const char *data, int length, bool quoted)
+{
+    char quote;
+    if (_format == Format::Values || _format == Format::Insert)
+    {
+        if (!quoted)
+        {
+            _buf.append(data, length);
+            return;
+        }
+        quote = '\'';
+    }
+    else
+    {
+        // delimited text is quoted only when it has to be
+        const char *special = (_format == Format::Tsv ? "\t\"\r\n" : ",\"\r\n");
+        quoted = false;
+        for (int i = 0; i < length && !quoted; ++i)
+            quoted = (strchr(special, data[i]) && data[i]);
+        if (!quoted)
+        {
+            _buf.append(data, length);
+            return;
+        }
+        quote = '"';
+    }
+    _buf += quote;
+    const char *from = data;
+    const char *end = data + length;
+    for (const char *p = data; p < end; ++p)
+    {
+        if (*p == quote)
+        {
+            // the quote is written twice
+            _buf.append(from, int(p - from + 1));
+            from = p;
+        }
+    }
+    _buf.append(from, int(end - from));
+    _buf += quote;
+}
+
+void GridCopy::appendName(const QString &name)
+{
+    if (_format != Format::Insert)
+    {
+        QByteArray utf8 = name.toUtf8();
+        return append(utf8.constData(), utf8.size(), false);
+    }
+    static const QRegularExpression plain_re("^[a-z_][a-z0-9_]*$");
+    if (plain_re.match(name).hasMatch())
+    {
+        _buf += name.toUtf8();
+        return;
+    }
+    _buf += '"';
+    _buf += QString(name).replace('"', "\"\"").toUtf8();
+    _buf += '"';
+}
@@ -0,0 +1,67 @@
+#ifndef GRIDCOPY_H
+#define GRIDCOPY_H
+
+#include <QString>
+#include <QByteArray>
+#include <QItemSelection>
+
+// rows of a single insert statement (the limit of values list of mssql)
+#define GRID_COPY_INSERT_ROWS 1000
+// rows measured to preallocate the buffer
+#define GRID_COPY_SAMPLE_ROWS 100
+
+class QAbstractItemModel;
+class DataTable;
+class TableModel;
+
+/*!
+ * \brief Text of grid selections for the clipboard.
+ *
+ * Selection ranges are walked directly: TableModel cells are read from the column storage,
+ * cells of other models by data(Qt::EditRole). The text is written as utf-8 into a buffer
+ * preallocated by the length of the first rows.
+ */
+class GridCopy
+{
+public:
+    enum class Format
+    {
+        Values,     ///< comma separated literals, text quoted unless the column is aligned right
+        Tsv,        ///< header and tab separated values, quoted by " when necessary
+        Csv,        ///< header and comma separated values (rfc 4180)
+        Insert      ///< insert statements
+    };
+    /*!
+     * \brief format by its name within settings (values, tsv, csv, insert)
+     */
+    static Format format(const QString &name);
+    static QString text(const QAbstractItemModel *model, const QItemSelection &selection, Format format);
+
+private:
+    struct Segment
+    {
+        int top;
+        int bottom;
+        QVector<int> columns;
+    };
+    GridCopy(const QAbstractItemModel *model, Format format);
+    /*!
+     * \brief rows of the selection split into parts with the same columns selected
+     */
+    static QVector<Segment> segments(const QItemSelection &selection);
+    void header(const QVector<int> &columns);
+    void row(int row, const QVector<int> &columns);
+    void cell(int row, int column);
+    void append(const char *data, int length, bool quoted);
+    void appendName(const QString &name);
+
+    const QAbstractItemModel *_model;
+    const TableModel *_table_model = nullptr;   ///< model of the storage to be read directly
+    const DataTable *_table = nullptr;
+    Format _format;
+    QVector<bool> _quoted;      ///< text columns by hAlignment
+    QByteArray _buf;
+    QByteArray _scratch;
+};
+
+#endif // GRIDCOPY_H
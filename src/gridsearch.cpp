@@ -0,0 +1,225 @@
+#include "gridsearch.h"
+#include "tablemodel.h"
+#include "datatable.h"
+#include "trace.h"
+#include "lambdarunnable.h"
+#include <QApplication>
+#include <QPointer>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+namespace
+{
+// bytes looked through for candidates at once, so rare letters are not searched far ahead
+const int SEARCH_WINDOW = 4096;
+
+inline char fold(char c) noexcept
+{
+    return (c >= 'A' && c <= 'Z' ? char(c + ('a' - 'A')) : c);
+}
+
+/*!
+ * \brief the first occurrence of the lowercase ascii needle within [p, end) ignoring case
+ *
+ * Candidates of both cases of the first letter are located by memchr (vectorized by the c library),
+ * each byte is passed by every memchr once.
+ */
+const char* findFolded(const char *p, const char *end, const QByteArray &needle) noexcept
+{
+    const int n = needle.size();
+    const char lower = needle.at(0);
+    const char upper = (lower >= 'a' && lower <= 'z' ? char(lower - ('a' - 'A')) : lower);
+    const char *rest = needle.constData() + 1;
+    if (end - p < n)
+        return nullptr;
+    const char *last = end - n + 1;     // candidates start before it
+    while (p < last)
+    {
+        const char *stop = (last - p > SEARCH_WINDOW ? p + SEARCH_WINDOW : last);
+        const char *lo = static_cast<const char*>(memchr(p, lower, size_t(stop - p)));
+        const char *up = (upper != lower ? static_cast<const char*>(memchr(p, upper, size_t(stop - p))) : nullptr);
+        while (lo || up)
+        {
+            const char *c = (!up || (lo && lo < up) ? lo : up);
+            int i = 1;
+            while (i < n && fold(c[i]) == rest[i - 1])
+                ++i;
+            if (i == n)
+                return c;
+            if (c == lo)
+                lo = (c + 1 < stop ? static_cast<const char*>(memchr(c + 1, lower, size_t(stop - c - 1))) : nullptr);
+            else
+                up = (c + 1 < stop ? static_cast<const char*>(memchr(c + 1, upper, size_t(stop - c - 1))) : nullptr);
+        }
+        p = stop;
+    }
+    return nullptr;
+}
+
+int formatInteger(char *end, qint64 value) noexcept
+{
+    // digits are written backward from the end of the buffer
+    quint64 u = (value < 0 ? 0 - quint64(value) : quint64(value));
+    char *p = end;
+    do
+    {
+        *--p = char('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (value < 0)
+        *--p = '-';
+    return int(end - p);
+}
+}
+
+GridSearch::GridSearch(QObject *parent) :
+    QObject(parent)
+{
+}
+
+GridSearch::~GridSearch()
+{
+    cancel();
+}
+
+void GridSearch::start(const QList<TableModel*> &models, const QString &text)
+{
+    cancel();
+    _text = text;
+    _hits.clear();
+    _sorted = true;
+    if (text.isEmpty())
+        return;
+
+    std::shared_ptr<Needle> needle = std::make_shared<Needle>();
+    needle->text = text;
+    needle->folded = text.toLower().toUtf8();
+    needle->ascii = std::all_of(needle->folded.cbegin(), needle->folded.cend(), [](char c) { return uchar(c) < 0x80; });
+    _cancelled = std::make_shared<std::atomic<bool>>(false);
+    std::shared_ptr<std::atomic<bool>> cancelled = _cancelled;
+    std::shared_ptr<std::atomic<int>> total = std::make_shared<std::atomic<int>>(0);
+    const int generation = _generation;
+    QPointer<GridSearch> self(this);
+
+    for (int g = 0; g < models.size(); ++g)
+    {
+        const TableModel *m = models.at(g);
+        const DataTable *table = m->table();
+        const int rows = table->rowCount();
+        for (int c = 0; c < table->columnCount(); ++c)
+        {
+            // distinct values of a dictionary are scanned by a single task
+            const int chunk = (table->storage(c).isDictionaryEncoded() ? std::max(rows, 1) : GRID_SEARCH_CHUNK);
+            for (int from = 0; from < rows; from += chunk)
+            {
+                const int to = std::min(rows, from + chunk);
+                ++_pending;
+                _pool.start(new LambdaRunnable([self, m, g, c, from, to, needle, cancelled, total, generation]() {
+                    SQT_TRACE_SCOPE("GridSearch::chunk");
+                    std::vector<int> found;
+                    if (!*cancelled && *total < GRID_SEARCH_MAX_HITS)
+                    {
+                        // rows may be dropped meanwhile (e.g. by the watch mode)
+                        QMutexLocker lk(&m->table()->mutex);
+                        find(*m, c, from, std::min(to, m->table()->rowCount()), *needle, found);
+                    }
+                    *total += int(found.size());
+                    if (*cancelled)
+                        return;
+                    QMetaObject::invokeMethod(qApp, [self, g, c, found, generation]() {
+                        if (!self || self->_generation != generation)
+                            return;
+                        for (int r: found)
+                        {
+                            if (self->_hits.size() >= GRID_SEARCH_MAX_HITS)
+                                break;
+                            self->_hits.push_back({ g, r, c });
+                        }
+                        self->_sorted = self->_sorted && found.empty();
+                        --self->_pending;
+                        if (!found.empty())
+                            emit self->found(int(self->_hits.size()));
+                        if (!self->_pending)
+                            emit self->finished(int(self->_hits.size()));
+                    }, Qt::QueuedConnection);
+                }));
+            }
+        }
+    }
+    if (!_pending)
+        emit finished(0);
+}
+
+void GridSearch::cancel()
+{
+    // the tasks read the tables, so they are waited for (a chunk at most)
+    ++_generation;
+    _pending = 0;
+    if (_cancelled)
+        *_cancelled = true;
+    _pool.clear();
+    _pool.waitForDone();
+    _cancelled.reset();
+}
+
+const std::vector<GridSearch::Hit> &GridSearch::hits()
+{
+    if (!_sorted)
+    {
+        std::sort(_hits.begin(), _hits.end());
+        _sorted = true;
+    }
+    return _hits;
+}
+
+void GridSearch::find(const TableModel &model, int column, int from, int to, const Needle &needle, std::vector<int> &rows)
+{
+    const ColumnStorage &s = model.table()->storage(column);
+    switch (s.kind())
+    {
+    case ColumnStorage::Kind::Unknown:
+        return;
+    case ColumnStorage::Kind::String:
+        if (needle.ascii)
+        {
+            const QByteArray &folded = needle.folded;
+            s.findText(from, to, folded.size(), [&folded](const char *begin, const char *end) {
+                return findFolded(begin, end, folded);
+            }, rows);
+            return;
+        }
+        for (int r = from; r < to; ++r)
+        {
+            if (!s.isNull(r) && s.wholeString(r).contains(needle.text, Qt::CaseInsensitive))
+                rows.push_back(r);
+        }
+        return;
+    case ColumnStorage::Kind::Int32:
+    case ColumnStorage::Kind::Int64:
+    {
+        // digits are never a part of a non-ascii text
+        if (!needle.ascii)
+            return;
+        const bool wide = (s.kind() == ColumnStorage::Kind::Int64);
+        char digits[24];
+        char *end = digits + sizeof(digits);
+        for (int r = from; r < to; ++r)
+        {
+            if (s.isNull(r))
+                continue;
+            int length = formatInteger(end, wide ? s.int64At(r) : s.int32At(r));
+            if (findFolded(end - length, end, needle.folded))
+                rows.push_back(r);
+        }
+        return;
+    }
+    default:
+        for (int r = from; r < to; ++r)
+        {
+            if (!s.isNull(r) && model.displayText(r, column).contains(needle.text, Qt::CaseInsensitive))
+                rows.push_back(r);
+        }
+        return;
+    }
+}
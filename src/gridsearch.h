@@ -0,0 +1,81 @@
+#ifndef GRIDSEARCH_H
+#define GRIDSEARCH_H
+
+#include <QObject>
+#include <QList>
+#include <QThreadPool>
+#include <atomic>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+// rows of a column searched by a task (the table is locked by chunks)
+#define GRID_SEARCH_CHUNK 65536
+// hits collected, the search stops beyond
+#define GRID_SEARCH_MAX_HITS 1000000
+
+class TableModel;
+
+/*!
+ * \brief Search of a text within the cells of result grids (the "find in results" box).
+ *
+ * Columns are searched by chunks of rows on a pool of threads. An ascii text is matched
+ * case-insensitively within the string arenas of ColumnStorage directly, candidates are
+ * located by memchr; other text is compared as QString. Hits are delivered by found()
+ * as chunks complete.
+ */
+class GridSearch : public QObject
+{
+    Q_OBJECT
+public:
+    struct Hit
+    {
+        int grid;       ///< index of the model within the list searched
+        int row;        ///< row of the table of the model
+        int column;
+        bool operator<(const Hit &other) const noexcept
+        {
+            return std::tie(grid, row, column) < std::tie(other.grid, other.row, other.column);
+        }
+    };
+
+    explicit GridSearch(QObject *parent = nullptr);
+    virtual ~GridSearch() override;
+    /*!
+     * \brief search the rows fetched so far, hits of the previous search are dropped
+     */
+    void start(const QList<TableModel*> &models, const QString &text);
+    /*!
+     * \brief stop the search, the models may be deleted afterwards
+     */
+    void cancel();
+    QString text() const { return _text; }
+    bool isRunning() const noexcept { return _pending > 0; }
+    /*!
+     * \brief hits found so far, ordered by grid, row and column
+     */
+    const std::vector<Hit> &hits();
+
+signals:
+    void found(int hits);
+    void finished(int hits);
+
+private:
+    struct Needle
+    {
+        QString text;
+        QByteArray folded;      ///< lowercase utf-8 of the text
+        bool ascii;
+    };
+    static void find(const TableModel &model, int column, int from, int to, const Needle &needle, std::vector<int> &rows);
+
+    QThreadPool _pool;          ///< idle threads expire, so a tab keeps none between searches
+    std::shared_ptr<std::atomic<bool>> _cancelled;
+    int _generation = 0;
+    int _pending = 0;           ///< tasks not delivered yet
+    QString _text;
+    std::vector<Hit> _hits;
+    bool _sorted = true;
+};
+
+#endif // GRIDSEARCH_H
@@ -0,0 +1,277 @@
+#include "jsonformatter.h"
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QObject>
+
+static inline bool isSpace(char c) noexcept
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static inline bool isDelimiter(char c) noexcept
+{
+    return isSpace(c) || c == ',' || c == ':' || c == ']' || c == '}' || c == '[' || c == '{' || c == '"';
+}
+
+static bool isNumber(const char *p, const char *end) noexcept
+{
+    auto digits = [&p, end]() {
+        const char *from = p;
+        while (p < end && *p >= '0' && *p <= '9')
+            ++p;
+        return p > from;
+    };
+    if (p < end && *p == '-')
+        ++p;
+    if (!digits())
+        return false;
+    if (p < end && *p == '.')
+    {
+        ++p;
+        if (!digits())
+            return false;
+    }
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        ++p;
+        if (p < end && (*p == '+' || *p == '-'))
+            ++p;
+        if (!digits())
+            return false;
+    }
+    return p == end;
+}
+
+JsonFormatter::JsonFormatter(const QByteArray &json, bool collapse, int indent) :
+    _json(json),
+    _collapse(collapse),
+    _indent(indent)
+{
+}
+
+bool JsonFormatter::next(QByteArray &chunk)
+{
+    chunk.clear();
+    if (!_error.isEmpty())
+        return false;
+    const char *data = _json.constData();
+    const int size = _json.size();
+    // collapsed items are not returned, so the portion is limited by the source too
+    const int stop = (size - _pos > JSON_CHUNK_BYTES ? _pos + JSON_CHUNK_BYTES : size);
+    while (_chunk.size() < JSON_CHUNK_BYTES && _pos < stop)
+    {
+        while (_pos < size && isSpace(data[_pos]))
+            ++_pos;
+        if (_pos == size)
+            break;
+
+        const char c = data[_pos];
+        switch (_expect)
+        {
+        case Expect::End:
+            fail(QObject::tr("garbage after the value"));
+            return false;
+        case Expect::Colon:
+            if (c != ':')
+            {
+                fail(QObject::tr("colon expected"));
+                return false;
+            }
+            ++_pos;
+            out() += ": ";
+            _expect = Expect::Value;
+            continue;
+        case Expect::Next:
+            if (c == ',')
+            {
+                ++_pos;
+                _expect = (_stack.last().object ? Expect::Key : Expect::Item);
+                continue;
+            }
+            break;
+        case Expect::Key:
+            if (c == '"')
+            {
+                beginItem();
+                if (!string(true))
+                    return false;
+                _expect = Expect::Colon;
+                continue;
+            }
+            if (c != '}' || _stack.last().items)
+            {
+                fail(QObject::tr("key expected"));
+                return false;
+            }
+            break;
+        case Expect::Item:
+            if (c == ']' && !_stack.last().items)
+                break;
+            beginItem();
+            // fall through
+        case Expect::Value:
+            if (c == '{' || c == '[')
+            {
+                open(c);
+                continue;
+            }
+            if (!(c == '"' ? string(false) : literal()))
+                return false;
+            _expect = (_stack.isEmpty() ? Expect::End : Expect::Next);
+            continue;
+        }
+
+        // the container is closed
+        if ((c != '}' && c != ']') || _stack.last().object != (c == '}'))
+        {
+            fail(QObject::tr("comma or closing bracket expected"));
+            return false;
+        }
+        ++_pos;
+        close(c);
+        _expect = (_stack.isEmpty() ? Expect::End : Expect::Next);
+    }
+    if (_pos == size && _expect != Expect::End)
+    {
+        fail(QObject::tr("unexpected end of the text"));
+        return false;
+    }
+    chunk.swap(_chunk);
+    return (!chunk.isEmpty() || _pos < size);
+}
+
+QVector<QByteArray> JsonFormatter::takeSections()
+{
+    QVector<QByteArray> res;
+    res.swap(_sections);
+    return res;
+}
+
+QByteArray JsonFormatter::format(const QByteArray &json, int indent)
+{
+    JsonFormatter formatter(json, false, indent);
+    QByteArray res;
+    QByteArray chunk;
+    while (formatter.next(chunk))
+        res += chunk;
+    return (formatter.error().isEmpty() ? res : QByteArray());
+}
+
+void JsonFormatter::indent(int depth)
+{
+    out().append(4 * (_indent + depth), ' ');
+}
+
+void JsonFormatter::beginItem()
+{
+    Level &level = _stack.last();
+    if (level.items)
+    {
+        out() += ",\n";
+        if (_collapse && _collapse_depth < 0 && level.items == JSON_COLLAPSE_ITEMS)
+        {
+            // the rest of the items is kept aside up to the closing bracket
+            _collapse_depth = _stack.size();
+            _collapsed_from = level.items;
+        }
+    }
+    else
+        out() += '\n';
+    indent(_stack.size());
+    ++level.items;
+}
+
+void JsonFormatter::open(char bracket)
+{
+    ++_pos;
+    out() += bracket;
+    _stack.append({bracket == '{', 0});
+    _expect = (bracket == '{' ? Expect::Key : Expect::Item);
+}
+
+void JsonFormatter::close(char bracket)
+{
+    const int depth = _stack.size();
+    const Level level = _stack.last();
+    if (_collapse_depth == depth)
+    {
+        _collapse_depth = -1;
+        _sections.append(QByteArray());
+        _sections.last().swap(_section);
+        indent(depth);
+        _chunk += QString("… %1 more items [#%2]").arg(level.items - _collapsed_from).arg(_section_id++).toUtf8();
+    }
+    if (level.items)
+    {
+        out() += '\n';
+        indent(depth - 1);
+    }
+    out() += bracket;
+    _stack.removeLast();
+}
+
+bool JsonFormatter::string(bool key)
+{
+    const char *data = _json.constData();
+    const int size = _json.size();
+    int end = _pos + 1;
+    while (end < size && data[end] != '"')
+        end += (data[end] == '\\' ? 2 : 1);
+    if (end >= size)
+    {
+        fail(QObject::tr("unterminated string"));
+        return false;
+    }
+    // escapes are kept as they are
+    QByteArray token = QByteArray::fromRawData(data + _pos, end + 1 - _pos);
+    _pos = end + 1;
+    out() += token;
+    if (key)
+        _key = QByteArray(token.constData(), token.size());
+    else if (!_stack.isEmpty())
+        expand(token);
+    return true;
+}
+
+bool JsonFormatter::literal()
+{
+    const char *data = _json.constData();
+    const int size = _json.size();
+    int end = _pos;
+    while (end < size && !isDelimiter(data[end]))
+        ++end;
+    const QByteArray token = QByteArray::fromRawData(data + _pos, end - _pos);
+    if (token != "true" && token != "false" && token != "null" &&
+            !isNumber(token.constData(), token.constData() + token.size()))
+    {
+        fail(QObject::tr("illegal value"));
+        return false;
+    }
+    _pos = end;
+    out() += token;
+    return true;
+}
+
+void JsonFormatter::expand(const QByteArray &token)
+{
+    // extract json object from textual escaped representation
+    if (token.size() < 4 || token.size() > JSON_EXPAND_MAX || token.at(1) != '{')
+        return;
+    const QByteArray value = QJsonDocument::fromJson("[" + token + "]").array().at(0).toString().toUtf8();
+    const QByteArray nice = format(value, _indent + _stack.size());
+    if (nice.isEmpty())
+        return;
+    out() += ",\n";
+    indent(_stack.size());
+    if (_stack.last().object)
+    {
+        out().append(_key.constData(), _key.size() - 1);
+        out() += "(nice)\": ";
+    }
+    out() += nice;
+}
+
+void JsonFormatter::fail(const QString &error)
+{
+    _error = QObject::tr("%1 at offset %2").arg(error).arg(_pos);
+}
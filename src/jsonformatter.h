@@ -0,0 +1,86 @@
+#ifndef JSONFORMATTER_H
+#define JSONFORMATTER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+// items of an array or object shown, the rest are collapsed into a single line
+#define JSON_COLLAPSE_ITEMS 1000
+// formatted text returned by next() at once, bytes
+#define JSON_CHUNK_BYTES (256 * 1024)
+// longer textual values are not checked for serialized json objects
+#define JSON_EXPAND_MAX (1024 * 1024)
+
+/*!
+ * \brief Streaming pretty-printer of json text.
+ *
+ * The text is tokenized in a single pass without building the document, the output
+ * is indented by 4 spaces like QJsonDocument::Indented and returned by chunks.
+ * Textual values holding serialized json objects are followed by the formatted objects.
+ * Items of a container beyond JSON_COLLAPSE_ITEMS are replaced by the line
+ * "… N more items [#id]", the text of the items is taken by takeSections().
+ */
+class JsonFormatter
+{
+public:
+    /*!
+     * \param collapse collapse large containers
+     * \param indent levels of indentation of the whole output
+     */
+    explicit JsonFormatter(const QByteArray &json, bool collapse = true, int indent = 0);
+    /*!
+     * \brief format the next portion of the text
+     * \return false when nothing is left or the text is not json (error() is set)
+     */
+    bool next(QByteArray &chunk);
+    QString error() const { return _error; }
+    /*!
+     * \brief bytes of the source text processed
+     */
+    int position() const noexcept { return _pos; }
+    /*!
+     * \brief text of the containers collapsed since the previous call, in order of ids
+     */
+    QVector<QByteArray> takeSections();
+    /*!
+     * \brief the whole text formatted, empty if it is not json
+     */
+    static QByteArray format(const QByteArray &json, int indent = 0);
+
+private:
+    // Item - a value of an array or its closing bracket right after the opening one
+    enum class Expect { Value, Item, Key, Colon, Next, End };
+    struct Level
+    {
+        bool object;
+        qint64 items;
+    };
+
+    QByteArray& out() { return _collapse_depth >= 0 ? _section : _chunk; }
+    void indent(int depth);
+    void beginItem();
+    void open(char bracket);
+    void close(char bracket);
+    bool string(bool key);
+    bool literal();
+    void expand(const QByteArray &token);
+    void fail(const QString &error);
+
+    const QByteArray _json;
+    const bool _collapse;
+    const int _indent;
+    int _pos = 0;
+    Expect _expect = Expect::Value;
+    QVector<Level> _stack;
+    QByteArray _chunk;
+    QByteArray _key;            ///< the last key token, quoted
+    int _collapse_depth = -1;   ///< depth of the container being collapsed
+    qint64 _collapsed_from = 0;
+    QByteArray _section;
+    QVector<QByteArray> _sections;
+    int _section_id = 0;
+    QString _error;
+};
+
+#endif // JSONFORMATTER_H
@@ -3,6 +3,8 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QPlainTextEdit>
+#include <QTextBlock>
 #include "jsonsyntaxhighlighter.h"
 
 JsonSyntaxHighlighter::JsonSyntaxHighlighter(QObject *parent) :
@@ -29,8 +31,42 @@ JsonSyntaxHighlighter::JsonSyntaxHighlighter(QObject *parent) :
     formats.append(get_format(Qt::red));                    // 5 - err literal
  }
 
+void JsonSyntaxHighlighter::setEditor(QPlainTextEdit *editor)
+{
+    _editor = editor;
+    connect(editor, &QPlainTextEdit::updateRequest, this, [this]() { highlightVisible(); }, Qt::QueuedConnection);
+}
+
+void JsonSyntaxHighlighter::highlightVisible()
+{
+    if (!_editor || !document())
+        return;
+    QTextBlock block = _editor->cursorForPosition(QPoint(0, 0)).block();
+    const QTextBlock last = _editor->cursorForPosition(QPoint(0, _editor->viewport()->height())).block();
+    _visible = true;
+    for (; block.isValid(); block = block.next())
+    {
+        // highlighted blocks are marked by user data, it is reset when the text is changed
+        if (!block.userData())
+            rehighlightBlock(block);
+        if (block == last)
+            break;
+    }
+    _visible = false;
+}
+
 void JsonSyntaxHighlighter::highlightBlock(const QString &text)
 {
+    if (_editor)
+    {
+        if (!_visible)
+        {
+            setCurrentBlockUserData(nullptr);
+            return;
+        }
+        setCurrentBlockUserData(new QTextBlockUserData());
+    }
+
     QString::ConstIterator i = text.constBegin();
     QChar prevChar;
     int mode = (previousBlockState() == -1 ? 0xFF : previousBlockState());
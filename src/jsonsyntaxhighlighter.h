@@ -3,16 +3,29 @@
 
 #include <QSyntaxHighlighter>
 
+// larger documents are highlighted only where they are shown
+#define JSON_HIGHLIGHT_ALL_CHARS (256 * 1024)
+
+class QPlainTextEdit;
+
 class JsonSyntaxHighlighter : public QSyntaxHighlighter
 {
     Q_OBJECT
 public:
     explicit JsonSyntaxHighlighter(QObject *parent = nullptr);
+    /*!
+     * \brief highlight only blocks visible in the editor, they are highlighted on scrolling
+     */
+    void setEditor(QPlainTextEdit *editor);
 
 protected:
     virtual void highlightBlock(const QString &text);
 
 private:
+    void highlightVisible();
+
+    QPlainTextEdit *_editor = nullptr;
+    bool _visible = false;      ///< highlightBlock() is called for visible blocks
     const QString delimiters = " \t\r\n\f\b\":[]{},/";
     QVector<QTextCharFormat> formats;
 };
@@ -0,0 +1,142 @@
+#include "jsonviewer.h"
+#include "jsonformatter.h"
+#include "jsonsyntaxhighlighter.h"
+#include <QApplication>
+#include <QMouseEvent>
+#include <QPlainTextEdit>
+#include <QPointer>
+#include <QRegularExpression>
+#include <QStatusBar>
+#include <QTextBlock>
+#include <QVBoxLayout>
+#include <chrono>
+
+JsonViewer::JsonViewer(const QString &text, QWidget *parent) :
+    QDialog(parent),
+    _text(text),
+    _shared(std::make_shared<Shared>())
+{
+    setObjectName("_viewer_");
+    setAttribute(Qt::WA_DeleteOnClose);
+    setWindowTitle(tr("json"));
+
+    QVBoxLayout *layout = new QVBoxLayout();
+    _editor = new QPlainTextEdit(this);
+    _editor->setObjectName("_def_wrap_");
+    _editor->setUndoRedoEnabled(false);
+    _editor->viewport()->installEventFilter(this);
+    layout->addWidget(_editor);
+
+    const QByteArray utf8 = text.trimmed().toUtf8();
+    _size = utf8.size();
+    JsonSyntaxHighlighter *hl = new JsonSyntaxHighlighter(_editor);
+    if (_size > JSON_HIGHLIGHT_ALL_CHARS)
+        hl->setEditor(_editor);
+    hl->setDocument(_editor->document());
+
+    _status = new QStatusBar(this);
+    _status->setMaximumHeight(QFontMetrics(QApplication::font()).height());
+    _status->showMessage(tr("formatting..."));
+    layout->addWidget(_status);
+    layout->setContentsMargins(0, 0, 0, 0);
+    setLayout(layout);
+    resize(800, 600);
+
+    std::shared_ptr<Shared> shared = _shared;
+    QPointer<JsonViewer> self(this);
+    _worker = std::thread([self, shared, utf8]() {
+        JsonFormatter formatter(utf8);
+        QByteArray chunk;
+        while (!shared->cancelled && formatter.next(chunk))
+        {
+            // sections are available before their placeholders are shown
+            QVector<QByteArray> sections = formatter.takeSections();
+            if (!sections.isEmpty())
+            {
+                QMutexLocker lk(&shared->mutex);
+                shared->sections += sections;
+            }
+            if (chunk.isEmpty())
+                continue;
+            ++shared->pending;
+            const int done = formatter.position();
+            QMetaObject::invokeMethod(qApp, [self, chunk, done]() {
+                if (self)
+                    self->append(chunk, done);
+            }, Qt::QueuedConnection);
+            while (shared->pending > JSON_VIEWER_PENDING && !shared->cancelled)
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        if (shared->cancelled)
+            return;
+        const QString error = formatter.error();
+        QMetaObject::invokeMethod(qApp, [self, error]() {
+            if (self)
+                self->finished(error);
+        }, Qt::QueuedConnection);
+    });
+}
+
+JsonViewer::~JsonViewer()
+{
+    _shared->cancelled = true;
+    if (_worker.joinable())
+        _worker.join();
+}
+
+void JsonViewer::append(const QByteArray &chunk, int done)
+{
+    --_shared->pending;
+    // the text is added at the end whatever the user's cursor is
+    QTextCursor cursor(_editor->document());
+    cursor.movePosition(QTextCursor::End);
+    cursor.insertText(QString::fromUtf8(chunk));
+    _status->showMessage(tr("formatting... %1%").arg(_size ? qint64(done) * 100 / _size : 100));
+}
+
+void JsonViewer::finished(const QString &error)
+{
+    if (!error.isEmpty())
+    {
+        // any textual value is viewed as it is
+        _editor->setPlainText(error + '\n' + _text);
+        _status->showMessage(error);
+    }
+    else
+        _status->showMessage(tr("%1 lines").arg(_editor->document()->blockCount()));
+    _editor->setUndoRedoEnabled(true);
+}
+
+bool JsonViewer::expand(const QTextBlock &block)
+{
+    static const QRegularExpression placeholder_re("^\\s*… \\d+ more items \\[#(\\d+)\\]$");
+    QRegularExpressionMatch m = placeholder_re.match(block.text());
+    if (!m.hasMatch())
+        return false;
+    QByteArray section;
+    {
+        QMutexLocker lk(&_shared->mutex);
+        int id = m.captured(1).toInt();
+        if (id >= _shared->sections.size())
+            return false;
+        // the placeholder is replaced once, so the text is not kept twice
+        section.swap(_shared->sections[id]);
+    }
+    if (section.isEmpty())
+        return false;
+    QTextCursor cursor(block);
+    cursor.movePosition(QTextCursor::EndOfBlock, QTextCursor::KeepAnchor);
+    cursor.insertText(QString::fromUtf8(section));
+    return true;
+}
+
+bool JsonViewer::eventFilter(QObject *obj, QEvent *event)
+{
+    if (obj == _editor->viewport() && event->type() == QEvent::MouseButtonDblClick)
+    {
+        QMouseEvent *mouseEvent = static_cast<QMouseEvent*>(event);
+        if (expand(_editor->cursorForPosition(mouseEvent->pos()).block()))
+            return true;
+    }
+    return QDialog::eventFilter(obj, event);
+}
@@ -0,0 +1,56 @@
+#ifndef JSONVIEWER_H
+#define JSONVIEWER_H
+
+#include <QDialog>
+#include <QMutex>
+#include <QVector>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+// formatted chunks posted to the gui and not appended yet, the thread waits above
+#define JSON_VIEWER_PENDING 4
+
+class QPlainTextEdit;
+class QStatusBar;
+class QTextBlock;
+
+/*!
+ * \brief Viewer of the value formatted as json (Ctrl+J).
+ *
+ * JsonFormatter runs on a thread and the editor is filled chunk by chunk, a line of
+ * collapsed items is expanded by double click. A text which is not json is shown as it is
+ * after the error.
+ */
+class JsonViewer : public QDialog
+{
+    Q_OBJECT
+public:
+    explicit JsonViewer(const QString &text, QWidget *parent = nullptr);
+    virtual ~JsonViewer() override;
+
+protected:
+    bool eventFilter(QObject *obj, QEvent *event) override;
+
+private:
+    struct Shared
+    {
+        QMutex mutex;                   ///< guards sections
+        QVector<QByteArray> sections;
+        std::atomic<bool> cancelled;
+        std::atomic<int> pending;
+        Shared(): cancelled(false), pending(0) {}
+    };
+    void append(const QByteArray &chunk, int done);
+    void finished(const QString &error);
+    bool expand(const QTextBlock &block);
+
+    QString _text;
+    int _size;
+    QPlainTextEdit *_editor;
+    QStatusBar *_status;
+    std::shared_ptr<Shared> _shared;
+    std::thread _worker;
+};
+
+#endif // JSONVIEWER_H
@@ -0,0 +1,18 @@
+#ifndef LAMBDARUNNABLE_H
+#define LAMBDARUNNABLE_H
+
+#include <QRunnable>
+#include <functional>
+
+/*!
+ * \brief QRunnable running a functor
+ */
+class LambdaRunnable : public QRunnable
+{
+    std::function<void()> _fn;
+public:
+    LambdaRunnable(std::function<void()> fn): _fn(fn) {}
+    void run() override { _fn(); }
+};
+
+#endif // LAMBDARUNNABLE_H
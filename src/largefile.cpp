@@ -0,0 +1,71 @@
+#include "largefile.h"
+#include <QObject>
+#include <QTextCodec>
+#include <cstring>
+
+bool LargeFile::open(const QString &fileName, const QString &encoding, QString &error)
+{
+    _codec = QTextCodec::codecForName(encoding.toLatin1());
+    if (!_codec)
+        _codec = QTextCodec::codecForName("UTF-8");
+    // line breaks must be single-byte
+    int mib = _codec->mibEnum();
+    if (mib == 1013 || mib == 1014 || mib == 1015 || (mib >= 1017 && mib <= 1019))
+    {
+        error = QObject::tr("%1 is not supported for large files").arg(QString(_codec->name()));
+        return false;
+    }
+
+    _file.setFileName(fileName);
+    if (!_file.open(QIODevice::ReadOnly))
+    {
+        error = _file.errorString();
+        return false;
+    }
+    _size = _file.size();
+    _data = reinterpret_cast<const char*>(_size ? _file.map(0, _size) : nullptr);
+    if (_size && !_data)
+    {
+        error = _file.errorString();
+        return false;
+    }
+    _bom = (_size >= 3 && !memcmp(_data, "\xEF\xBB\xBF", 3) ? 3 : 0);
+    return true;
+}
+
+QString LargeFile::read(qint64 &offset, qint64 maxBytes) const
+{
+    offset = qMax(offset, _bom);
+    if (offset >= _size)
+        return QString();
+    qint64 end = qMin(offset + maxBytes, _size);
+    if (end < _size)
+    {
+        const void *lf = memchr(_data + end, '\n', size_t(_size - end));
+        end = (lf ? static_cast<const char*>(lf) - _data + 1 : _size);
+    }
+    QString res = _codec->toUnicode(_data + offset, int(end - offset));
+    offset = end;
+    return res;
+}
+
+qint64 LargeFile::lineStart(qint64 offset) const noexcept
+{
+    offset = qBound(_bom, offset, _size);
+    while (offset > _bom && _data[offset - 1] != '\n')
+        --offset;
+    return offset;
+}
+
+int LargeFile::lineBreaks(qint64 from, qint64 to) const noexcept
+{
+    int res = 0;
+    const char *p = _data + qMax(from, qint64(0));
+    const char *end = _data + qMin(to, _size);
+    while (p < end && (p = static_cast<const char*>(memchr(p, '\n', size_t(end - p)))))
+    {
+        ++res;
+        ++p;
+    }
+    return res;
+}
@@ -0,0 +1,42 @@
+#ifndef LARGEFILE_H
+#define LARGEFILE_H
+
+#include <QFile>
+#include <QString>
+
+class QTextCodec;
+
+/*!
+ * \brief Read-only text file mapped into memory and decoded by pieces on demand.
+ *
+ * Pieces always end at a line break, so multibyte characters are never split
+ * (encodings with multibyte line breaks, i.e. UTF-16/32, are not supported).
+ */
+class LargeFile
+{
+public:
+    bool open(const QString &fileName, const QString &encoding, QString &error);
+    qint64 size() const noexcept { return _size; }
+    /*!
+     * \brief decode up to maxBytes starting at offset, extended to the end of the line
+     * \param offset advanced past the decoded bytes
+     */
+    QString read(qint64 &offset, qint64 maxBytes) const;
+    /*!
+     * \brief offset of the beginning of the line containing the offset
+     */
+    qint64 lineStart(qint64 offset) const noexcept;
+    /*!
+     * \brief number of line breaks within [from, to)
+     */
+    int lineBreaks(qint64 from, qint64 to) const noexcept;
+
+private:
+    QFile _file;
+    const char *_data = nullptr;
+    qint64 _size = 0;
+    qint64 _bom = 0;
+    QTextCodec *_codec = nullptr;
+};
+
+#endif // LARGEFILE_H
@@ -2,6 +2,7 @@
 #include "mainwindow.h"
 #include "appeventhandler.h"
 #include "settings.h"
+#include "sqlsyntaxhighlighter.h"
 
 int main(int argc, char *argv[])
 {
@@ -12,6 +13,9 @@ int main(int argc, char *argv[])
     QCoreApplication::setApplicationVersion("0.4.1");
     setlocale(LC_NUMERIC, "C");
 
+    // editors of the restored tabs find the rules compiled
+    SqlSyntaxHighlighter::preload();
+
     AppEventHandler appEventHandler;
     a.installEventFilter(&appEventHandler);
 
@@ -10,19 +10,27 @@
 #include "dbosortfilterproxymodel.h"
 #include "dbconnectionfactory.h"
 #include "dbconnection.h"
+#include "pgconnection.h"
 #include "querywidget.h"
 #include <QTextDocumentFragment>
+#include <QTextBlock>
 #include <QCloseEvent>
 #include <QTextEdit>
 #include <QToolButton>
+#include <QInputDialog>
 #include "tablemodel.h"
 #include "dbtreeitemdelegate.h"
 #include "findandreplacepanel.h"
 #include <memory>
 #include "scripting.h"
+#include "metadatacache.h"
+#include "resultcache.h"
+#include "objectpreview.h"
 #include "codeeditor.h"
 #include <QScrollBar>
 #include "settingsdialog.h"
+#include "trace.h"
+#include "fanout.h"
 
 struct RecentFile
 {
@@ -56,6 +64,9 @@ MainWindow::MainWindow(QWidget *parent) :
     ui(new Ui::MainWindow)
 {
     ui->setupUi(this);
+#ifndef SQT_TRACING
+    ui->actionRecord_trace->setVisible(false);
+#endif
     _proxyStyle = new MyProxyStyle();
 
     qRegisterMetaType<QueryState>();
@@ -65,12 +76,19 @@ MainWindow::MainWindow(QWidget *parent) :
     setCentralWidget(ui->splitterV);
     ui->statusBar->addPermanentWidget(&_contextLabel);
     _positionLabel.setVisible(false);
+    _aggregateLabel.setVisible(false);
+    _aggregateLabel.setTextInteractionFlags(Qt::TextSelectableByMouse);
+    ui->statusBar->addPermanentWidget(&_aggregateLabel);
     ui->statusBar->addPermanentWidget(&_positionLabel);
     ui->statusBar->addPermanentWidget(&_durationLabel);
+    _memoryLabel.setToolTip(tr("memory of the results of the tab / of all the tabs"));
+    ui->statusBar->addPermanentWidget(&_memoryLabel);
 
 #ifndef Q_OS_WIN
     _contextLabel.setFrameStyle(QFrame::StyledPanel);
     _positionLabel.setFrameStyle(QFrame::StyledPanel);
+    _aggregateLabel.setFrameStyle(QFrame::StyledPanel);
+    _memoryLabel.setFrameStyle(QFrame::StyledPanel);
 #endif
 
     _objectScript = new QueryWidget(this);
@@ -107,6 +125,14 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui->objectsView->selectionModel(), &QItemSelectionModel::selectionChanged, this, &MainWindow::selectionChanged);
     connect(ui->objectsView->selectionModel(), &QItemSelectionModel::currentChanged, this, &MainWindow::currentChanged);
 
+    _preview = new ObjectPreview(this);
+    connect(_preview, &ObjectPreview::ready, this, &MainWindow::previewReady);
+    connect(_preview, &ObjectPreview::error, this, &MainWindow::onError);
+    _previewTimer = new QTimer(this);
+    _previewTimer->setSingleShot(true);
+    _previewTimer->setInterval(PREVIEW_DEBOUNCE);
+    connect(_previewTimer, &QTimer::timeout, this, &MainWindow::scriptSelectedObjects);
+
     _durationRefreshTimer = new QTimer(this);
     connect(_durationRefreshTimer, &QTimer::timeout, this, &MainWindow::refreshConnectionState);
     _durationRefreshTimer->start(200);
@@ -301,6 +327,8 @@ MainWindow::MainWindow(QWidget *parent) :
 
 MainWindow::~MainWindow()
 {
+    // keep catalog data for the next launch
+    Scripting::MetadataCache::instance().save();
     delete _frPanel;
     delete _objectsModel;
     delete ui;
@@ -536,6 +564,9 @@ void MainWindow::on_actionRefresh_triggered()
     Scripting::refresh(cn, Scripting::Context::Autocomplete);
 
     Scripting::refresh(cn, Scripting::Context::Tree);
+    // reload catalog data even if no change has been detected
+    Scripting::MetadataCache::instance().invalidate(cn);
+    Scripting::ResultCache::instance().invalidate(cn);
 
     // clear all child nodes
     _objectsModel->removeRows(0, item->childCount(), nodeToRefresh);
@@ -591,7 +622,9 @@ void MainWindow::selectionChanged(const QItemSelection &selected, const QItemSel
            )
             selectionModel->select(i, QItemSelectionModel::Deselect);
     }
-    scriptSelectedObjects();
+    // the running preview is outdated, the next one waits for the selection to settle
+    _preview->cancel();
+    _previewTimer->start();
 }
 
 void MainWindow::currentChanged(const QModelIndex &current, const QModelIndex &previous)
@@ -625,22 +658,170 @@ void MainWindow::on_actionExecute_query_triggered()
     DbConnection *con = q->dbConnection();
     if (!con)
         return;
+    // lazily fetched resultset is read by a connection of its own
+    if (q->isCursorBusy())
+    {
+        q->cancelCursor();
+        return;
+    }
     auto qState = con->queryState();
     if (qState == QueryState::Running || qState == QueryState::Cancelling)
     {
+        q->stopScript();
+        q->stopWatch();
         con->cancel();
     }
     else if (qState == QueryState::Inactive)
     {
+        // between statements of a script
+        if (q->isScriptRunning())
+        {
+            q->stopScript();
+            return;
+        }
         q->clearResult();
+        if (q->isLargeFile() && !q->textCursor().hasSelection())
+        {
+            q->executeFile();
+            return;
+        }
         QString query = (q->textCursor().hasSelection() ?
                              q->textCursor().selection().toPlainText() :
                              q->toPlainText());
         if (query.isEmpty())
             return;
 
-        con->executeAsync(query);
+        int first_line = (q->textCursor().hasSelection() ?
+                              q->document()->findBlock(q->textCursor().selectionStart()).blockNumber() : 0);
+        if (!q->openCursor(query) && !q->executeScript(query, first_line))
+            con->executeAsync(query);
+    }
+}
+
+void MainWindow::on_actionExecute_to_file_triggered()
+{
+    QueryWidget *q = currentQueryWidget();
+    DbConnection *con = (q ? q->dbConnection() : nullptr);
+    if (!con || con->queryState() != QueryState::Inactive)
+        return;
+    QString query = (q->textCursor().hasSelection() ?
+                         q->textCursor().selection().toPlainText() :
+                         q->toPlainText());
+    if (query.isEmpty())
+        return;
+
+    _fileDialog.setAcceptMode(QFileDialog::AcceptSave);
+    _fileDialog.setFileMode(QFileDialog::AnyFile);
+    _fileDialog.setWindowTitle(tr("Execute to file"));
+    _fileDialog.setNameFilters(QStringList() << tr("CSV files (*.csv)") << tr("Arrow IPC streams (*.arrows)"));
+    _fileDialog.setHistory(_mruDirs);
+    if (!_fileDialog.exec())
+        return;
+    QString fn = _fileDialog.selectedFiles().at(0);
+    if (QFileInfo(fn).suffix().isEmpty())
+        fn += (_fileDialog.selectedNameFilter().contains("arrows") ? ".arrows" : ".csv");
+    adjustMru();
+
+    q->clearResult();
+    q->executeToFile(query, fn);
+}
+
+void MainWindow::on_actionWatch_query_triggered()
+{
+    QueryWidget *q = currentQueryWidget();
+    DbConnection *con = (q ? q->dbConnection() : nullptr);
+    if (q && q->isWatching())
+    {
+        q->stopWatch();
+        refreshActions();
+        return;
+    }
+    if (!con || con->queryState() != QueryState::Inactive || q->isScriptRunning())
+    {
+        refreshActions();
+        return;
+    }
+    QString query = (q->textCursor().hasSelection() ?
+                         q->textCursor().selection().toPlainText() :
+                         q->toPlainText());
+    bool ok = false;
+    int seconds = (query.trimmed().isEmpty() ? 0 :
+                   QInputDialog::getInt(this, tr("Watch query"), tr("Refresh every (seconds):"),
+                                        SqtSettings::value("watchInterval", 5).toInt(), 1, 86400, 1, &ok));
+    if (ok)
+    {
+        SqtSettings::setValue("watchInterval", seconds);
+        q->startWatch(query, seconds);
+    }
+    refreshActions();
+}
+
+void MainWindow::on_actionExplain_triggered()
+{
+    QueryWidget *q = currentQueryWidget();
+    DbConnection *con = (q ? q->dbConnection() : nullptr);
+    if (!con || con->queryState() != QueryState::Inactive || q->isScriptRunning())
+        return;
+    QString query = (q->textCursor().hasSelection() ?
+                         q->textCursor().selection().toPlainText() :
+                         q->toPlainText());
+    if (!query.trimmed().isEmpty())
+        q->explain(query);
+}
+
+void MainWindow::on_actionNotifications_triggered()
+{
+    if (QueryWidget *q = currentQueryWidget())
+        q->showNotifications();
+}
+
+void MainWindow::on_actionExecute_on_connections_triggered()
+{
+    QueryWidget *q = currentQueryWidget();
+    if (!q)
+        return;
+    QString query = (q->textCursor().hasSelection() ?
+                         q->textCursor().selection().toPlainText() :
+                         q->toPlainText());
+    if (query.trimmed().isEmpty())
+        return;
+    QSortFilterProxyModel *proxy = qobject_cast<QSortFilterProxyModel*>(ui->objectsView->model());
+    QList<QPair<QString, std::shared_ptr<DbConnection>>> servers;
+    for (const QModelIndex &i: ui->objectsView->selectionModel()->selectedIndexes())
+    {
+        QModelIndex index = proxy->mapToSource(i);
+        if (index.data(DbObject::TypeRole).toString() != "connection")
+            continue;
+        // connections requiring a password are used once connected from the tree
+        std::shared_ptr<DbConnection> con = _objectsModel->dbConnection(index);
+        QString cs = index.data(DbObject::DataRole).toString();
+        if (!con && !cs.contains("%pass%", Qt::CaseInsensitive))
+            con = DbConnectionFactory::createConnection(QString(), cs);
+        servers.append(qMakePair(index.data().toString(), con));
+    }
+    if (servers.isEmpty())
+    {
+        QMessageBox::information(this, tr("Execute on selected connections"), tr("Select connections in the objects tree"));
+        return;
+    }
+    FanOut *dlg = new FanOut(query, servers, this);
+    dlg->show();
+}
+
+void MainWindow::on_actionRecord_trace_triggered(bool checked)
+{
+    if (checked)
+    {
+        Trace::start();
+        return;
     }
+    Trace::stop();
+    QString fn = QFileDialog::getSaveFileName(this, tr("Save trace"), QString(), tr("Chrome trace files (*.json)"));
+    if (fn.isEmpty())
+        return;
+    QString error;
+    if (!Trace::save(fn, error))
+        QMessageBox::critical(this, tr("Error"), error);
 }
 
 bool MainWindow::eventFilter(QObject *object, QEvent *event)
@@ -728,6 +909,10 @@ void MainWindow::on_actionNew_triggered()
 
     w->highlight();
     connect(w, &QueryWidget::sqlChanged, this, &MainWindow::sqlChanged);
+    connect(w, &QueryWidget::selectionAggregated, this, [this](const QString &text) {
+        _aggregateLabel.setText(text);
+        _aggregateLabel.setVisible(!text.isEmpty());
+    });
     w->setReadOnly(false);
 
     if (ui->contentSplitter->isVisible())
@@ -890,6 +1075,8 @@ void MainWindow::refreshActions()
     QueryWidget *w = qobject_cast<QueryWidget*>(ui->tabWidget->currentWidget());
     ui->actionExecute_query->setEnabled(fw != ui->objectsView && ui->tabWidget->count() && w->dbConnection());
     QueryState qState = (w && w->dbConnection() ? w->dbConnection()->queryState() : QueryState::Inactive);
+    if (qState == QueryState::Inactive && w && w->isCursorBusy())
+        qState = QueryState::Running;
     ui->actionExecute_query->setIcon(qState == QueryState::Inactive ?
                                          QIcon(":img/control.png") :
                                          QIcon(":img/control-stop.png"));
@@ -901,6 +1088,12 @@ void MainWindow::refreshActions()
     else
         ui->actionExecute_query->setShortcuts(QKeySequence::Refresh);
 
+    ui->actionWatch_query->setEnabled(w && w->dbConnection());
+    ui->actionExplain->setEnabled(w && w->dbConnection() && qState == QueryState::Inactive);
+    ui->actionWatch_query->setChecked(w && w->isWatching());
+    ui->actionNotifications->setEnabled(w && qobject_cast<PgConnection*>(w->dbConnection()));
+    ui->actionExecute_on_connections->setEnabled(w);
+
     ui->actionRefresh->setEnabled(fw == ui->objectsView);
     ui->actionChange_sort_mode->setEnabled(fw == ui->objectsView);
 
@@ -955,10 +1148,13 @@ void MainWindow::scriptSelectedObjects()
 {
     //if (!_objectScript->isVisible() && !ui->tableView->isVisible())
     //    return;
+    _previewTimer->stop();
+    _preview->cancel();
     _tableModel->clear();
     QModelIndex srcIndex =
             static_cast<QSortFilterProxyModel*>(ui->objectsView->model())->
             mapToSource(ui->objectsView->currentIndex());
+    _previewIndex = srcIndex;
     if (!srcIndex.isValid())
     {
         _objectScript->clear();
@@ -972,109 +1168,105 @@ void MainWindow::scriptSelectedObjects()
     if  (
             !con ||
             // do not try to open closed top-level connection
-            (!con->isOpened() && srcIndex.data(DbObject::TypeRole).toString() == "connection") ||
-            // open if not opened (shoud be database-level connection - it is closed when the node is collapsed)
-            !con->open()
+            (!con->isOpened() && srcIndex.data(DbObject::TypeRole).toString() == "connection")
         )
     {
         showContent(srcIndex, nullptr);
         return;
     }
-    con->clearResultsets();
-    QApplication::setOverrideCursor(Qt::WaitCursor);
-    ScopeGuard<void(*)()> cursorGuard(QApplication::restoreOverrideCursor);
-
-    try
-    {
-        // process parent node in case of multiple selection, else process selected node
-        QModelIndex parent = (si.count() > 1 ? srcIndex.parent() : srcIndex);
-        QString type = parent.data(DbObject::TypeRole).toString();
-
-        // callback to provide values for macroses
-        auto env = [this, &parent, &si](QString macro) -> QVariant
-        {
-            // do we need children.names?!
-            if (macro == "children.ids" || macro == "children.names")
-            {
-                DbObject::ObjectRole role = (macro == "children.ids" ?
-                                                 DbObject::IdRole :
-                                                 DbObject::NameRole);
-                QString children;
-                for(const QModelIndex &i: si)
-                {
-                    if (i.data(role).isValid())
-                        children += (children.length() > 0 ? "," : "") +
-                                i.data(role).toString();
-                }
-                return children.isEmpty() || si.count() == 1 ?
-                            (role == DbObject::IdRole ? "-1" : "NULL") :
-                            children;
-            }
 
-            return _objectsModel->parentNodeProperty(parent, macro);
-        };
+    // process parent node in case of multiple selection, else process selected node
+    QModelIndex parent = (si.count() > 1 ? srcIndex.parent() : srcIndex);
+    QString type = parent.data(DbObject::TypeRole).toString();
 
-        if (si.count() > 1) // multiple selection - process parent node
+    // macro values are copied, scripts run by a thread
+    QString childrenIds, childrenNames;
+    for (const QModelIndex &i: si)
+    {
+        if (i.data(DbObject::IdRole).isValid())
+            childrenIds += (childrenIds.length() > 0 ? "," : "") + i.data(DbObject::IdRole).toString();
+        if (i.data(DbObject::NameRole).isValid())
+            childrenNames += (childrenNames.length() > 0 ? "," : "") + i.data(DbObject::NameRole).toString();
+    }
+    if (si.count() == 1)
+    {
+        childrenIds.clear();
+        childrenNames.clear();
+    }
+    std::function<QVariant(QString)> parentEnv = _objectsModel->environment(parent);
+    // do we need children.names?!
+    auto env = [parentEnv, childrenIds, childrenNames](QString macro) -> QVariant
+    {
+        if (macro == "children.ids")
+            return childrenIds.isEmpty() ? "-1" : childrenIds;
+        if (macro == "children.names")
+            return childrenNames.isEmpty() ? "NULL" : childrenNames;
+        return parentEnv(macro);
+    };
+
+    _previewMultiple = (si.count() > 1);
+    _previewType = type;
+    if (_previewMultiple) // multiple selection - content of the parent node is scripted for the selected objects
+    {
+        _previewContent = true;
+        // large selections are scripted by shards concurrently
+        QVector<QPair<QString, QString>> objects;
+        objects.reserve(si.count());
+        for (const QModelIndex &i: si)
         {
-            // always refresh content in case of multiple selection
-            auto c = Scripting::execute(con, Scripting::Context::Content, type, env);
-
-            QModelIndex tmp_index;
-            showContent(tmp_index, c.get());
+            objects.append(qMakePair(i.data(DbObject::IdRole).isValid() ? i.data(DbObject::IdRole).toString() : QString(),
+                                     i.data(DbObject::NameRole).isValid() ? i.data(DbObject::NameRole).toString() : QString()));
         }
-        else // single selection - process selected node
-        {
-            // check if script is not fetched yet
-            std::unique_ptr<Scripting::CppConductor> c;
-            if (!parent.data(DbObject::ContentRole).isValid())
-            {
-                c = Scripting::execute(con, Scripting::Context::Content, type, env);
-                // special processing of 'connection' node: display dbmsInfo
-                // if corresponding script is not found
-                if (!c && type == "connection")
-                {
-                    QString dbmsInfo = con->dbmsInfo();
-                    c = std::unique_ptr<Scripting::CppConductor>(new Scripting::CppConductor(con, env));
-                    c->texts.append(dbmsInfo);
-                }
-                showContent(srcIndex, c.get());
-            }
-            else
-                showContent(srcIndex, nullptr);
-
-            // we can show preview if there is no resultset returned from previous script already
-            if (!c || c->resultsets.empty())
-            {
-                // show preview if corresponding script exists
-                auto c = Scripting::execute(con, Scripting::Context::Preview, type,
-                                            [this, &srcIndex](QString macro) -> QVariant
-                    {
-                        return _objectsModel->parentNodeProperty(srcIndex, macro);
-                    });
+        if (!_preview->startSharded(con, type, parentEnv, objects))
+            _preview->start(con, type, env, QString(), nullptr);
+        return;
+    }
+    // single selection - check if script is not fetched yet
+    _previewContent = !parent.data(DbObject::ContentRole).isValid();
+    if (!_previewContent)
+        showContent(srcIndex, nullptr);
+    // show preview if there is no resultset returned by the content script
+    _preview->start(con, _previewContent ? type : QString(), env, type, _objectsModel->environment(srcIndex));
+}
 
-                DataTable *table = (c && !c->resultsets.isEmpty() ? c->resultsets.back() : nullptr);
-                if (table)
-                {
-                    _tableModel->take(table);
-                    ui->tableView->show();
-                    ui->tableView->resizeColumnsToContents();
-                }
-                else
-                    ui->tableView->hide();
-            }
-        }
+void MainWindow::previewReady(std::shared_ptr<Scripting::CppConductor> content, std::shared_ptr<Scripting::CppConductor> preview)
+{
+    QModelIndex srcIndex = _previewIndex;
+    if (!srcIndex.isValid())
+        return;
+    std::shared_ptr<DbConnection> con = _objectsModel->dbConnection(srcIndex);
+    if (_previewMultiple)
+    {
+        QModelIndex tmp_index;
+        showContent(tmp_index, content.get(), con);
+        return;
     }
-    catch (const QString &err)
+    if (_previewContent)
     {
-        onError(err);
+        // special processing of 'connection' node: display dbmsInfo
+        // if corresponding script is not found
+        if (!content && _previewType == "connection" && con)
+        {
+            content = std::make_shared<Scripting::CppConductor>(con, nullptr);
+            content->texts.append(con->dbmsInfo());
+        }
+        showContent(srcIndex, content.get(), con);
     }
-    catch (const std::runtime_error &e)
+    if (content && !content->resultsets.isEmpty())
+        return;
+
+    DataTable *table = (preview && !preview->resultsets.isEmpty() ? preview->resultsets.back() : nullptr);
+    if (table)
     {
-        onError(QString::fromStdString(e.what()));
+        _tableModel->take(table);
+        ui->tableView->show();
+        ui->tableView->resizeColumnsToContents();
     }
+    else
+        ui->tableView->hide();
 }
 
-void MainWindow::showContent(QModelIndex &index, const Scripting::CppConductor *content)
+void MainWindow::showContent(QModelIndex &index, const Scripting::CppConductor *content, std::shared_ptr<DbConnection> con)
 {
     /*
      * Current implementation displays only single item returned by script providing node's content.
@@ -1124,7 +1316,7 @@ void MainWindow::showContent(QModelIndex &index, const Scripting::CppConductor *
     {
         ui->tableView->hide();
         _objectScript->show();
-        showTextualContent(value, type, content ? content->connection() : nullptr);
+        showTextualContent(value, type, con ? con : (content ? content->connection() : nullptr));
         return;
     }
     _objectScript->hide();
@@ -1221,6 +1413,10 @@ void MainWindow::refreshConnectionState()
                                     "" :
                                     " <font color='red'>" + cn_status + "</font>"));
     }
+    const qint64 all = TableModel::totalResidentBytes();
+    const qint64 cap = SqtSettings::value("resultsMemoryCap", TABLE_MODEL_MEMORY_CAP).toLongLong() * 1024 * 1024;
+    QString memory = tr("%1 / %2 MB").arg((w ? w->residentBytes() : 0) / 1048576.0, 0, 'f', 1).arg(all / 1048576.0, 0, 'f', 1);
+    _memoryLabel.setText(cap > 0 && all > cap ? "<font color='red'>" + memory + "</font>" : memory);
 }
 
 void MainWindow::objectsViewAdjustColumnWidth(const QModelIndex &)
@@ -23,6 +23,7 @@ class FindAndReplacePanel;
 class DbObjectsModel;
 class CodeBlockProperties;
 class MyProxyStyle;
+class ObjectPreview;
 
 class MainWindow : public QMainWindow
 {
@@ -49,6 +50,12 @@ private slots:
     void currentChanged(const QModelIndex &current, const QModelIndex &previous);
     void viewModeActionTriggered(QAction *action);
     void on_actionExecute_query_triggered();
+    void on_actionExecute_to_file_triggered();
+    void on_actionWatch_query_triggered();
+    void on_actionExplain_triggered();
+    void on_actionNotifications_triggered();
+    void on_actionExecute_on_connections_triggered();
+    void on_actionRecord_trace_triggered(bool checked);
     void on_actionNew_triggered();
     void on_tabWidget_tabCloseRequested(int index);
     void sqlChanged();
@@ -56,7 +63,8 @@ private slots:
     void on_actionSave_triggered();
     void on_actionSave_as_triggered();
     void scriptSelectedObjects();
-    void showContent(QModelIndex &index, const Scripting::CppConductor *content);
+    void previewReady(std::shared_ptr<Scripting::CppConductor> content, std::shared_ptr<Scripting::CppConductor> preview);
+    void showContent(QModelIndex &index, const Scripting::CppConductor *content, std::shared_ptr<DbConnection> con = nullptr);
     void showTextualContent(const QVariant &value, const QVariant &type, std::shared_ptr<DbConnection> con);
     void objectsViewAdjustColumnWidth(const QModelIndex &);
     void on_actionFind_triggered();
@@ -67,7 +75,7 @@ private slots:
     void on_actionSettings_triggered();
 
 private:
-    QLabel _contextLabel, _positionLabel, _durationLabel;
+    QLabel _contextLabel, _positionLabel, _durationLabel, _memoryLabel, _aggregateLabel;
     ExtFileDialog _fileDialog;
     QStringList _mruDirs; // QFileDialog::history() keeps unused directories :(
     Ui::MainWindow *ui;
@@ -81,6 +89,12 @@ private:
     FindAndReplacePanel *_frPanel;
     QTimer *_hideTimer;
     QTimer *_durationRefreshTimer;
+    ObjectPreview *_preview;
+    QTimer *_previewTimer;
+    QPersistentModelIndex _previewIndex;    ///< node of the running preview
+    QString _previewType;
+    bool _previewMultiple = false;
+    bool _previewContent = false;           ///< content script is run (else it's shown already)
     void log(const QString &msg);
     void adjustMru();
     void addMruFile();
@@ -0,0 +1,358 @@
+#include "metadatacache.h"
+#include "scripting.h"
+#include "dbconnection.h"
+#include "datatable.h"
+#include <QFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QVector>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+
+namespace Scripting
+{
+
+// persistent cache file signature and format version
+static const quint32 cache_magic = 0x53515443; // SQTC
+static const quint16 cache_version = 1;
+
+MetadataCache& MetadataCache::instance()
+{
+    static MetadataCache cache;
+    return cache;
+}
+
+QString MetadataCache::catalogKey(DbConnection *connection)
+{
+    return connection->dbmsScriptingID() + '\n' + connection->connectionString() + '\n' + connection->database();
+}
+
+QString MetadataCache::storageFile(const QString &key, const QString &suffix)
+{
+    // connection string may contain a password, so it's hashed
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/metadata/";
+    return dir + QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex() + '.' + suffix;
+}
+
+QString MetadataCache::queryMarker(DbConnection *connection)
+{
+    QString marker;
+    try
+    {
+        auto c = Scripting::execute(connection, Context::Root, "catalog_marker", nullptr);
+        DataTable *table = (c && !c->resultsets.isEmpty() ? c->resultsets.back() : nullptr);
+        if (table && table->rowCount() > 0)
+        {
+            for (int i = 0; i < table->columnCount(); ++i)
+                marker += table->value(0, i).toString() + '\n';
+        }
+    }
+    catch (const QString &)
+    {
+        marker.clear();
+    }
+    return marker;
+}
+
+MetadataCache::Catalog* MetadataCache::validate(DbConnection *connection, const QString &key, QMutexLocker &lk, bool force)
+{
+    Catalog *catalog = &_catalogs[key];
+    if (!force && (catalog->checking || (catalog->checked.isValid() && !catalog->checked.hasExpired(METADATA_CHECK_INTERVAL))))
+        return (catalog->marker.isEmpty() ? nullptr : catalog);
+
+    catalog->checking = true;
+    lk.unlock();
+    QString marker = queryMarker(connection);
+    lk.relock();
+    // the hash may have changed meanwhile (the catalog may be even invalidated)
+    catalog = &_catalogs[key];
+    catalog->checking = false;
+
+    // the catalog has changed => drop everything
+    if (marker != catalog->marker || marker.isEmpty())
+    {
+        catalog->dirty = catalog->dirty || !catalog->entries.isEmpty();
+        catalog->entries.clear();
+        catalog->file.reset();
+        catalog->marker = marker;
+    }
+    catalog->checked.start();
+
+    // adopt entries of the previous session if the catalog is the same
+    if (!catalog->loaded && !marker.isEmpty())
+    {
+        catalog->loaded = true;
+        load(key, *catalog);
+    }
+    return (marker.isEmpty() ? nullptr : catalog);
+}
+
+void MetadataCache::load(const QString &key, Catalog &catalog)
+{
+    std::shared_ptr<QFile> file = std::make_shared<QFile>(storageFile(key, "cache"));
+    if (!file->open(QIODevice::ReadOnly) || !file->size())
+        return;
+    uchar *data = file->map(0, file->size());
+    if (!data)
+        return;
+
+    QByteArray raw = QByteArray::fromRawData(reinterpret_cast<const char*>(data), int(file->size()));
+    QDataStream in(raw);
+    quint32 magic;
+    quint16 version;
+    QString marker;
+    qint32 count;
+    in >> magic >> version;
+    if (magic != cache_magic || version != cache_version)
+        return;
+    in.setVersion(QDataStream::Qt_5_0);
+    in >> marker >> count;
+    if (marker != catalog.marker || in.status() != QDataStream::Ok)
+        return;
+
+    // index of entries refers to blobs following it
+    QVector<QPair<QString, QPair<qint64, qint32>>> index;
+    index.reserve(count);
+    for (qint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i)
+    {
+        QString entry_key;
+        qint64 offset;
+        qint32 size;
+        in >> entry_key >> offset >> size;
+        index.append({entry_key, {offset, size}});
+    }
+    qint64 body = in.device()->pos();
+    if (in.status() != QDataStream::Ok)
+        return;
+
+    for (const auto &item: index)
+    {
+        if (body + item.second.first + item.second.second > raw.size() || catalog.entries.contains(item.first))
+            continue;
+        Entry entry;
+        entry.blob = QByteArray::fromRawData(raw.constData() + body + item.second.first, item.second.second);
+        entry.decoded = false;
+        catalog.entries.insert(item.first, entry);
+    }
+    catalog.file = file;
+}
+
+QByteArray MetadataCache::encode(const Entry &entry)
+{
+    QByteArray res;
+    QDataStream out(&res, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << qint32(entry.resultsets.size());
+    for (const auto &table: entry.resultsets)
+    {
+        out << qint32(table->columnCount()) << qint32(table->rowCount());
+        for (int c = 0; c < table->columnCount(); ++c)
+        {
+            const DataColumn &column = table->getColumn(c);
+            out << column.name() << column.typeName() << qint32(column.variantType()) <<
+                   qint32(column.sqlType()) << qint32(column.length()) << qint16(column.scale()) <<
+                   qint32(column.hAlignment()) << qint32(column.arrayElementType());
+        }
+        for (int r = 0; r < table->rowCount(); ++r)
+        {
+            for (int c = 0; c < table->columnCount(); ++c)
+                out << table->value(r, c);
+        }
+    }
+    out << entry.scripts << entry.htmls << entry.texts;
+    return res;
+}
+
+void MetadataCache::decode(Entry &entry)
+{
+    entry.decoded = true;
+    QDataStream in(entry.blob);
+    in.setVersion(QDataStream::Qt_5_0);
+    qint32 tables;
+    in >> tables;
+    for (qint32 t = 0; t < tables && in.status() == QDataStream::Ok; ++t)
+    {
+        std::shared_ptr<DataTable> table = std::make_shared<DataTable>();
+        qint32 columns, rows;
+        in >> columns >> rows;
+        for (qint32 c = 0; c < columns && in.status() == QDataStream::Ok; ++c)
+        {
+            QString name, type_name;
+            qint32 var_type, sql_type, length, alignment, element_type;
+            qint16 scale;
+            in >> name >> type_name >> var_type >> sql_type >> length >> scale >> alignment >> element_type;
+            table->addColumn(new DataColumn(name, type_name, QMetaType::Type(var_type), sql_type, length,
+                                            scale, 1, Qt::AlignmentFlag(alignment), element_type));
+        }
+        QVector<QVariant> row(columns);
+        for (qint32 r = 0; r < rows && in.status() == QDataStream::Ok; ++r)
+        {
+            for (qint32 c = 0; c < columns; ++c)
+                in >> row[c];
+            table->appendRow(row);
+        }
+        entry.resultsets.append(table);
+    }
+    in >> entry.scripts >> entry.htmls >> entry.texts;
+
+    // corrupted entry acts as a miss
+    if (in.status() != QDataStream::Ok)
+    {
+        entry.resultsets.clear();
+        entry.scripts.clear();
+        entry.htmls.clear();
+        entry.texts.clear();
+        entry.blob.clear();
+    }
+}
+
+bool MetadataCache::fetch(DbConnection *connection, const QString &key, CppConductor *env)
+{
+    QString catalog_key = catalogKey(connection);
+    QMutexLocker lk(&_mutex);
+    Catalog *cat = validate(connection, catalog_key, lk);
+    if (!cat)
+        return false;
+    Catalog &catalog = *cat;
+
+    auto it = catalog.entries.find(key);
+    if (it == catalog.entries.end())
+        return false;
+
+    if (!it->decoded)
+    {
+        decode(*it);
+        if (it->blob.isEmpty())
+        {
+            catalog.entries.erase(it);
+            catalog.dirty = true;
+            return false;
+        }
+    }
+
+    it->used = ++catalog.serial;
+    for (const auto &table: it->resultsets)
+        env->appendTable(new DataTable(*table));
+    for (const QString &script: it->scripts)
+        env->appendScript(script);
+    for (const QString &html: it->htmls)
+        env->appendHtml(html);
+    for (const QString &text: it->texts)
+        env->appendText(text);
+    return true;
+}
+
+void MetadataCache::store(DbConnection *connection, const QString &key, const CppConductor &env)
+{
+    QMutexLocker lk(&_mutex);
+    auto cit = _catalogs.find(catalogKey(connection));
+    // fetch() has already checked the marker
+    if (cit == _catalogs.end() || cit->marker.isEmpty())
+        return;
+    Catalog &catalog = *cit;
+
+    // evict the least recently used entry
+    if (catalog.entries.size() >= METADATA_CACHE_SIZE)
+    {
+        auto lru = catalog.entries.begin();
+        for (auto i = catalog.entries.begin(); i != catalog.entries.end(); ++i)
+        {
+            if (i->used < lru->used)
+                lru = i;
+        }
+        catalog.entries.erase(lru);
+    }
+
+    Entry entry;
+    for (const DataTable *table: env.resultsets)
+        entry.resultsets.append(std::make_shared<const DataTable>(*table));
+    entry.scripts = env.scripts;
+    entry.htmls = env.htmls;
+    entry.texts = env.texts;
+    entry.used = ++catalog.serial;
+    catalog.entries.insert(key, entry);
+    catalog.dirty = true;
+}
+
+void MetadataCache::invalidate(DbConnection *connection)
+{
+    if (!connection)
+        return;
+    QString key = catalogKey(connection);
+    QMutexLocker lk(&_mutex);
+    _catalogs.remove(key);
+    QFile::remove(storageFile(key, "cache"));
+}
+
+QString MetadataCache::catalogState(DbConnection *connection)
+{
+    QString key = catalogKey(connection);
+    QMutexLocker lk(&_mutex);
+    Catalog *catalog = validate(connection, key, lk);
+    if (!catalog)
+        return QString();
+    return key + '\n' + catalog->marker;
+}
+
+QString MetadataCache::checkMarker(DbConnection *connection)
+{
+    QString key = catalogKey(connection);
+    QMutexLocker lk(&_mutex);
+    Catalog *catalog = validate(connection, key, lk, true);
+    return (catalog ? catalog->marker : QString());
+}
+
+void MetadataCache::save()
+{
+    QMutexLocker lk(&_mutex);
+    for (auto it = _catalogs.begin(); it != _catalogs.end(); ++it)
+    {
+        Catalog &catalog = *it;
+        if (!catalog.dirty)
+            continue;
+        catalog.dirty = false;
+
+        QString file_name = storageFile(it.key(), "cache");
+        if (catalog.marker.isEmpty() || catalog.entries.isEmpty())
+        {
+            catalog.file.reset();
+            QFile::remove(file_name);
+            continue;
+        }
+
+        QByteArray index, body;
+        QDataStream index_out(&index, QIODevice::WriteOnly);
+        index_out.setVersion(QDataStream::Qt_5_0);
+        for (auto e = catalog.entries.begin(); e != catalog.entries.end(); ++e)
+        {
+            // blob may refer to the mapped file which is about to be replaced
+            QByteArray blob = (e->decoded && e->blob.isEmpty() ? encode(*e) :
+                                                                 QByteArray(e->blob.constData(), e->blob.size()));
+            index_out << e.key() << qint64(body.size()) << qint32(blob.size());
+            body.append(blob);
+        }
+        // detach from the mapping
+        for (auto e = catalog.entries.begin(); e != catalog.entries.end(); ++e)
+        {
+            if (!e->blob.isEmpty())
+                e->blob = QByteArray(e->blob.constData(), e->blob.size());
+        }
+        catalog.file.reset();
+
+        QDir().mkpath(QFileInfo(file_name).path());
+        QSaveFile file(file_name);
+        if (!file.open(QIODevice::WriteOnly))
+            continue;
+        QDataStream out(&file);
+        out << cache_magic << cache_version;
+        out.setVersion(QDataStream::Qt_5_0);
+        out << catalog.marker << qint32(catalog.entries.size());
+        file.write(index);
+        file.write(body);
+        file.commit();
+    }
+}
+
+}
@@ -0,0 +1,117 @@
+#ifndef METADATACACHE_H
+#define METADATACACHE_H
+
+#include <QString>
+#include <QHash>
+#include <QList>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <memory>
+
+class DbConnection;
+class QFile;
+class DataTable;
+
+namespace Scripting
+{
+
+class CppConductor;
+
+// minimal period between catalog change checks, ms
+#define METADATA_CHECK_INTERVAL 2000
+// cached script results per catalog
+#define METADATA_CACHE_SIZE 512
+
+/*!
+ * \brief Results of catalog scripts (tree, preview, autocomplete) shared by all the connections to a database.
+ *
+ * Validity is checked by the root-level "catalog_marker" script returning a fingerprint
+ * of the system catalog, which changes on DDL. All the entries of the database are
+ * dropped as soon as the fingerprint changes. There is no caching for dbms without the marker script.
+ *
+ * Entries are kept between sessions within memory-mapped files (one per database), which are
+ * adopted on the first access if the stored fingerprint matches the current one. Entries are
+ * decoded lazily on the first fetch.
+ *
+ * The cache is shared by the GUI thread and the background tree workers. The marker is
+ * queried without holding the lock, so lookups of other databases (and of this one with
+ * the marker known) do not wait for it.
+ */
+class MetadataCache
+{
+public:
+    static MetadataCache& instance();
+    /*!
+     * \brief fill env with a copy of the cached results
+     * \param key script context, type and final text (incl. session fingerprint if needed)
+     */
+    bool fetch(DbConnection *connection, const QString &key, CppConductor *env);
+    void store(DbConnection *connection, const QString &key, const CppConductor &env);
+    /*!
+     * \brief drop all the results related to the connection's database
+     */
+    void invalidate(DbConnection *connection);
+    /*!
+     * \brief identity of the connection's database and its catalog fingerprint, empty if caching is not available
+     */
+    QString catalogState(DbConnection *connection);
+    /*!
+     * \brief query the catalog fingerprint right away (a single cheap row), empty if caching is not available
+     *
+     * The results of the database are dropped if the fingerprint has changed.
+     */
+    QString checkMarker(DbConnection *connection);
+    /*!
+     * \brief write changed catalogs to disk
+     */
+    void save();
+    /*!
+     * \brief file to keep persistent data related to the key (the key itself is not stored)
+     */
+    static QString storageFile(const QString &key, const QString &suffix);
+
+private:
+    MetadataCache() = default;
+    struct Entry
+    {
+        QList<std::shared_ptr<const DataTable>> resultsets;
+        QList<QString> scripts;
+        QList<QString> htmls;
+        QList<QString> texts;
+        quint64 used = 0;
+        QByteArray blob;        ///< encoded entry (may refer to the mapped file)
+        bool decoded = true;    ///< false until the blob is decoded on demand
+    };
+    struct Catalog
+    {
+        QString marker;         ///< empty if the dbms does not support caching
+        QElapsedTimer checked;
+        QHash<QString, Entry> entries;
+        quint64 serial = 0;
+        bool loaded = false;    ///< persistent entries are looked for
+        bool checking = false;  ///< the marker is being queried by a thread
+        bool dirty = false;     ///< differs from the file
+        std::shared_ptr<QFile> file; ///< mapped file backing undecoded entries
+    };
+    static QString catalogKey(DbConnection *connection);
+    /*!
+     * \brief make sure the marker of the catalog is up to date
+     * \param lk the locked _mutex, released while the marker is queried
+     * \return the catalog, nullptr if caching is not available
+     *
+     * Threads asking for the catalog being checked use the marker known meanwhile
+     * unless the check is forced.
+     */
+    Catalog* validate(DbConnection *connection, const QString &key, QMutexLocker &lk, bool force = false);
+    static QString queryMarker(DbConnection *connection);
+    void load(const QString &key, Catalog &catalog);
+    static QByteArray encode(const Entry &entry);
+    static void decode(Entry &entry);
+
+    QHash<QString, Catalog> _catalogs;
+    QMutex _mutex;
+};
+
+}
+
+#endif // METADATACACHE_H
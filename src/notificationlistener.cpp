@@ -0,0 +1,212 @@
+#include "notificationlistener.h"
+#include "executionservice.h"
+#include <QSocketNotifier>
+#include <QThread>
+#include <QTimer>
+#include <map>
+
+std::shared_ptr<NotificationListener> NotificationListener::forDatabase(const std::string &conninfo)
+{
+    static QMutex m;
+    static std::map<std::string, std::weak_ptr<NotificationListener>> listeners;
+    QMutexLocker lk(&m);
+    // listeners of closed panels are forgotten
+    for (auto it = listeners.begin(); it != listeners.end();)
+    {
+        if (it->second.expired())
+            it = listeners.erase(it);
+        else
+            ++it;
+    }
+    std::shared_ptr<NotificationListener> res = listeners[conninfo].lock();
+    if (res)
+        return res;
+    // the listener is deleted within its thread
+    res.reset(new NotificationListener(conninfo), [](NotificationListener *l) { l->deleteLater(); });
+    res->_self = res;
+    listeners[conninfo] = res;
+    std::shared_ptr<NotificationListener> l = res;
+    ExecutionService::instance().runStatement([l]() { l->connectToServer(); });
+    return res;
+}
+
+NotificationListener::NotificationListener(const std::string &conninfo) :
+    _conninfo(conninfo)
+{
+    moveToThread(ExecutionService::instance().ioThread());
+}
+
+NotificationListener::~NotificationListener()
+{
+    delete _notifier;
+    if (_conn)
+        PQfinish(_conn);
+}
+
+void NotificationListener::connectToServer()
+{
+    // connecting blocks, so it's done by a worker rather than by the I/O thread
+    PGconn *conn = PQconnectdb(_conninfo.c_str());
+    QMetaObject::invokeMethod(this, [this, conn]() {
+        _conn = conn;
+        watch();
+    }, Qt::QueuedConnection);
+}
+
+void NotificationListener::watch()
+{
+    if (PQstatus(_conn) != CONNECTION_OK)
+    {
+        reconnect(QString::fromLocal8Bit(PQerrorMessage(_conn)));
+        return;
+    }
+    _notifier = new QSocketNotifier(PQsocket(_conn), QSocketNotifier::Read);
+    connect(_notifier, &QSocketNotifier::activated, this, &NotificationListener::readSocket);
+    execute("listen", channels());
+}
+
+void NotificationListener::reconnect(const QString &message)
+{
+    emit error(tr("%1\nreconnecting in %2 s").arg(message.trimmed()).arg(NOTIFY_RECONNECT_INTERVAL / 1000));
+    delete _notifier;
+    _notifier = nullptr;
+    if (_conn)
+        PQfinish(_conn);
+    _conn = nullptr;
+    // the channels are listened to again all at once
+    _commands.clear();
+    _command_running = false;
+    std::weak_ptr<NotificationListener> self = _self;
+    QTimer::singleShot(NOTIFY_RECONNECT_INTERVAL, this, [self]() {
+        std::shared_ptr<NotificationListener> l = self.lock();
+        if (l)
+            ExecutionService::instance().runStatement([l]() { l->connectToServer(); });
+    });
+}
+
+void NotificationListener::listen(const QStringList &channels)
+{
+    QStringList added;
+    {
+        QMutexLocker lk(&_mutex);
+        for (const QString &c: channels)
+        {
+            if (!c.isEmpty() && !_channels[c]++)
+                added.append(c);
+        }
+    }
+    if (!added.isEmpty())
+        QMetaObject::invokeMethod(this, [this, added]() { execute("listen", added); }, Qt::QueuedConnection);
+}
+
+void NotificationListener::unlisten(const QStringList &channels)
+{
+    QStringList removed;
+    {
+        QMutexLocker lk(&_mutex);
+        for (const QString &c: channels)
+        {
+            auto it = _channels.find(c);
+            if (it == _channels.end() || --*it > 0)
+                continue;
+            // the channel is not used by other consumers
+            _channels.erase(it);
+            removed.append(c);
+        }
+    }
+    if (!removed.isEmpty())
+        QMetaObject::invokeMethod(this, [this, removed]() { execute("unlisten", removed); }, Qt::QueuedConnection);
+}
+
+QStringList NotificationListener::channels() const
+{
+    QMutexLocker lk(&_mutex);
+    return _channels.keys();
+}
+
+void NotificationListener::execute(const QString &command, const QStringList &channels)
+{
+    // not connected yet: the channels are listened as soon as the connection is established
+    if (!_notifier || channels.isEmpty())
+        return;
+    QString sql;
+    for (const QString &c: channels)
+    {
+        QByteArray name = c.toUtf8();
+        std::unique_ptr<char, void(*)(void*)> escaped(PQescapeIdentifier(_conn, name.data(), size_t(name.size())), PQfreemem);
+        if (escaped)
+            sql += command + ' ' + QString::fromUtf8(escaped.get()) + ';';
+    }
+    _commands.append(sql);
+    sendNext();
+}
+
+void NotificationListener::sendNext()
+{
+    if (_command_running || _commands.isEmpty() || !_notifier)
+        return;
+    // the results are read along with notifications
+    if (!PQsendQuery(_conn, _commands.takeFirst().toUtf8().constData()))
+    {
+        reconnect(QString::fromLocal8Bit(PQerrorMessage(_conn)));
+        return;
+    }
+    _command_running = true;
+}
+
+void NotificationListener::readSocket()
+{
+    if (!PQconsumeInput(_conn))
+    {
+        reconnect(QString::fromLocal8Bit(PQerrorMessage(_conn)));
+        return;
+    }
+    while (_command_running && !PQisBusy(_conn))
+    {
+        std::unique_ptr<PGresult, decltype(&PQclear)> res(PQgetResult(_conn), PQclear);
+        if (!res)
+        {
+            _command_running = false;
+            sendNext();
+            break;
+        }
+        if (PQresultStatus(res.get()) != PGRES_COMMAND_OK)
+            emit error(QString::fromUtf8(PQresultErrorMessage(res.get())));
+    }
+    QDateTime now = QDateTime::currentDateTime();
+    PGnotify *notify;
+    QMutexLocker lk(&_mutex);
+    while ((notify = PQnotifies(_conn)))
+    {
+        std::unique_ptr<PGnotify, void(*)(void*)> n_guard(notify, PQfreemem);
+        Notification n { now, n_guard->be_pid, QString::fromUtf8(n_guard->relname), QString::fromUtf8(n_guard->extra) };
+        ++_counters[n.channel];
+        if (_ring.size() < NOTIFY_RING_SIZE)
+            _ring.push_back(n);
+        else
+            _ring[_serial % NOTIFY_RING_SIZE] = n;
+        ++_serial;
+    }
+}
+
+QVector<Notification> NotificationListener::take(quint64 &serial, quint64 &dropped) const
+{
+    QMutexLocker lk(&_mutex);
+    dropped = 0;
+    if (_serial - serial > NOTIFY_RING_SIZE)
+    {
+        dropped = _serial - serial - NOTIFY_RING_SIZE;
+        serial = _serial - NOTIFY_RING_SIZE;
+    }
+    QVector<Notification> res;
+    res.reserve(int(_serial - serial));
+    for (; serial < _serial; ++serial)
+        res.append(_ring[serial % NOTIFY_RING_SIZE]);
+    return res;
+}
+
+QHash<QString, quint64> NotificationListener::counters() const
+{
+    QMutexLocker lk(&_mutex);
+    return _counters;
+}
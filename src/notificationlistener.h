@@ -0,0 +1,98 @@
+#ifndef NOTIFICATIONLISTENER_H
+#define NOTIFICATIONLISTENER_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QStringList>
+#include <QVector>
+#include <memory>
+#include <string>
+#include <vector>
+#include <libpq-fe.h>
+
+// notifications kept by a listener, older ones are dropped
+#define NOTIFY_RING_SIZE 10000
+// delay of reconnecting a dropped listener connection, ms
+#define NOTIFY_RECONNECT_INTERVAL 5000
+
+class QSocketNotifier;
+
+struct Notification
+{
+    QDateTime received;
+    int pid;
+    QString channel;
+    QString payload;
+};
+
+/*!
+ * \brief LISTEN connection of a database shared by notification panels.
+ *
+ * The connection is separate from the query connections, so busy channels don't interfere
+ * with queries. Its socket is watched by the I/O thread of ExecutionService, notifications
+ * are stored within the ring buffer and counted by channels; consumers poll them at their own rate.
+ *
+ * Channels are counted by the consumers listening to them, LISTEN and UNLISTEN are sent without
+ * waiting for the server. A dropped connection is reestablished after NOTIFY_RECONNECT_INTERVAL
+ * and listens to the channels again.
+ */
+class NotificationListener : public QObject
+{
+    Q_OBJECT
+public:
+    /*!
+     * \brief the listener of the database, created on demand
+     */
+    static std::shared_ptr<NotificationListener> forDatabase(const std::string &conninfo);
+    virtual ~NotificationListener() override;
+    /*!
+     * \brief add a consumer of the channels, a channel is listened to while it has any
+     */
+    void listen(const QStringList &channels);
+    void unlisten(const QStringList &channels);
+    /*!
+     * \brief channels listened to by any consumer
+     */
+    QStringList channels() const;
+    /*!
+     * \brief notifications received since the serial
+     * \param serial advanced past the notifications returned
+     * \param dropped notifications overwritten within the ring before being taken
+     */
+    QVector<Notification> take(quint64 &serial, quint64 &dropped) const;
+    QHash<QString, quint64> counters() const;
+
+signals:
+    void error(const QString &msg) const;
+
+private:
+    explicit NotificationListener(const std::string &conninfo);
+    void connectToServer();
+    void watch();
+    void readSocket();
+    void execute(const QString &command, const QStringList &channels);
+    /*!
+     * \brief send the next queued command unless one is running
+     */
+    void sendNext();
+    /*!
+     * \brief drop the broken connection and connect again later
+     */
+    void reconnect(const QString &message);
+
+    std::string _conninfo;
+    std::weak_ptr<NotificationListener> _self;
+    PGconn *_conn = nullptr;    ///< used within the I/O thread once connected
+    QSocketNotifier *_notifier = nullptr;
+    QStringList _commands;      ///< waiting for the running one, I/O thread only
+    bool _command_running = false;
+    mutable QMutex _mutex;      ///< guards the channels, ring and counters
+    QHash<QString, int> _channels;  ///< consumers of a channel
+    std::vector<Notification> _ring;
+    quint64 _serial = 0;        ///< notifications received
+    QHash<QString, quint64> _counters;
+};
+
+#endif // NOTIFICATIONLISTENER_H
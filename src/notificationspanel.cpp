@@ -0,0 +1,104 @@
+#include "notificationspanel.h"
+#include "notificationlistener.h"
+#include <QLineEdit>
+#include <QLabel>
+#include <QPlainTextEdit>
+#include <QTimer>
+#include <QVBoxLayout>
+#include <QRegularExpression>
+#include <algorithm>
+
+NotificationsPanel::NotificationsPanel(std::shared_ptr<NotificationListener> listener, QWidget *parent) :
+    QWidget(parent),
+    _listener(listener)
+{
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->setSpacing(0);
+    layout->setMargin(0);
+    _channels = new QLineEdit(this);
+    _channels->setPlaceholderText(tr("channels to listen to, comma separated"));
+    connect(_channels, &QLineEdit::returnPressed, this, &NotificationsPanel::applyChannels);
+    layout->addWidget(_channels);
+    _counters = new QLabel(this);
+    _counters->setTextInteractionFlags(Qt::TextSelectableByMouse);
+    layout->addWidget(_counters);
+    _log = new QPlainTextEdit(this);
+    _log->setReadOnly(true);
+    _log->setMaximumBlockCount(NOTIFY_SHOWN_LINES);
+    _log->setLineWrapMode(QPlainTextEdit::NoWrap);
+    layout->addWidget(_log);
+
+    _timer = new QTimer(this);
+    _timer->setInterval(NOTIFY_UI_INTERVAL);
+    connect(_timer, &QTimer::timeout, this, &NotificationsPanel::refresh);
+    connect(_listener.get(), &NotificationListener::error, this, [this](const QString &msg) {
+        _log->appendPlainText(tr("error: %1").arg(msg.trimmed()));
+    }, Qt::QueuedConnection);
+}
+
+NotificationsPanel::~NotificationsPanel()
+{
+    _listener->unlisten(_listened);
+}
+
+void NotificationsPanel::showEvent(QShowEvent *event)
+{
+    QWidget::showEvent(event);
+    refresh();
+    _timer->start();
+}
+
+void NotificationsPanel::hideEvent(QHideEvent *event)
+{
+    // notifications are kept by the listener meanwhile
+    _timer->stop();
+    QWidget::hideEvent(event);
+}
+
+void NotificationsPanel::applyChannels()
+{
+    QStringList wanted = _channels->text().split(QRegularExpression("[,\\s]+"), QString::SkipEmptyParts);
+    wanted.removeDuplicates();
+    QStringList added, removed;
+    for (const QString &c: _listened)
+    {
+        if (!wanted.contains(c))
+            removed.append(c);
+    }
+    for (const QString &c: wanted)
+    {
+        if (!_listened.contains(c))
+            added.append(c);
+    }
+    _listened = wanted;
+    _listener->unlisten(removed);
+    _listener->listen(added);
+}
+
+void NotificationsPanel::refresh()
+{
+    quint64 dropped;
+    QVector<Notification> received = _listener->take(_serial, dropped);
+    if (received.isEmpty() && !dropped)
+        return;
+    // the lines of the portion are appended at once
+    int from = std::max(0, received.size() - NOTIFY_SHOWN_LINES);
+    QStringList lines;
+    if (dropped || from)
+        lines.append(tr("... %1 notifications skipped").arg(dropped + quint64(from)));
+    for (int i = from; i < received.size(); ++i)
+    {
+        const Notification &n = received[i];
+        lines.append(QString("%1  %2  [%3]  %4").
+                     arg(n.received.toString("HH:mm:ss.zzz")).arg(n.channel).arg(n.pid).arg(n.payload));
+    }
+    _log->appendPlainText(lines.join('\n'));
+
+    QHash<QString, quint64> counters = _listener->counters();
+    QStringList channels = counters.keys();
+    channels.sort();
+    QStringList text;
+    for (const QString &c: channels)
+        text.append(QString("%1: %2").arg(c).arg(counters.value(c)));
+    _counters->setText(text.join("   "));
+}
@@ -0,0 +1,48 @@
+#ifndef NOTIFICATIONSPANEL_H
+#define NOTIFICATIONSPANEL_H
+
+#include <QWidget>
+#include <QStringList>
+#include <memory>
+
+// period of showing the notifications received, ms
+#define NOTIFY_UI_INTERVAL 250
+// lines of notifications shown
+#define NOTIFY_SHOWN_LINES 2000
+
+class NotificationListener;
+class QLineEdit;
+class QLabel;
+class QPlainTextEdit;
+class QTimer;
+
+/*!
+ * \brief Channels listened to and the latest notifications with counters by channels.
+ *
+ * Notifications are taken from the listener at NOTIFY_UI_INTERVAL and appended at once.
+ */
+class NotificationsPanel : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit NotificationsPanel(std::shared_ptr<NotificationListener> listener, QWidget *parent = nullptr);
+    virtual ~NotificationsPanel() override;
+
+protected:
+    virtual void showEvent(QShowEvent *event) override;
+    virtual void hideEvent(QHideEvent *event) override;
+
+private:
+    void applyChannels();
+    void refresh();
+
+    std::shared_ptr<NotificationListener> _listener;
+    QLineEdit *_channels;
+    QStringList _listened;          ///< channels of the panel (the listener is shared by panels)
+    QLabel *_counters;
+    QPlainTextEdit *_log;
+    QTimer *_timer;
+    quint64 _serial = 0;
+};
+
+#endif // NOTIFICATIONSPANEL_H
@@ -0,0 +1,251 @@
+#include "objectpreview.h"
+#include "resultcache.h"
+#include "dbconnection.h"
+#include "datatable.h"
+#include "settings.h"
+#include "lambdarunnable.h"
+#include <QThread>
+#include <stdexcept>
+
+ObjectPreview::ObjectPreview(QObject *parent) :
+    QObject(parent),
+    _generation(0)
+{
+    _worker.setMaxThreadCount(1);
+    _worker.setExpiryTimeout(-1);
+    _shards.setMaxThreadCount(PREVIEW_SHARDS);
+}
+
+ObjectPreview::~ObjectPreview()
+{
+    cancel();
+    _worker.clear();
+    _shards.clear();
+    _worker.waitForDone();
+    _shards.waitForDone();
+}
+
+void ObjectPreview::start(std::shared_ptr<DbConnection> con,
+                          const QString &contentType, std::function<QVariant(QString)> contentEnv,
+                          const QString &previewType, std::function<QVariant(QString)> previewEnv)
+{
+    cancel();
+    const int generation = _generation;
+    QString key = con->connectionString() + '\n' + con->database();
+    setPoolSize(key, SqtSettings::value("contentScriptShards", PREVIEW_SHARDS).toInt());
+    std::shared_ptr<DbConnection> fresh(con->clone());
+    fresh->setDetached(true);
+    // previews queued behind the running one are outdated
+    _worker.clear();
+    _shards.clear();
+    _worker.start(new LambdaRunnable([this, generation, key, fresh, contentType, contentEnv, previewType, previewEnv]() {
+        if (_generation != generation)
+            return;
+        std::shared_ptr<QString> errors = std::make_shared<QString>();
+        std::shared_ptr<Scripting::CppConductor> content;
+        std::shared_ptr<Scripting::CppConductor> preview;
+        runScripts(key, fresh, *errors, [&](std::shared_ptr<DbConnection> cn) {
+            if (!contentType.isEmpty())
+                content = Scripting::ResultCache::instance().execute(cn, Scripting::Context::Content, contentType, contentEnv);
+            if (!previewType.isEmpty() && (!content || content->resultsets.isEmpty()) && _generation == generation)
+                preview = Scripting::ResultCache::instance().execute(cn, Scripting::Context::Preview, previewType, previewEnv);
+        });
+
+        QMetaObject::invokeMethod(this, [this, generation, content, preview, errors]() {
+            if (_generation != generation)
+                return;
+            if (!errors->isEmpty())
+                emit error(*errors);
+            emit ready(content, preview);
+        }, Qt::QueuedConnection);
+    }));
+}
+
+bool ObjectPreview::startSharded(std::shared_ptr<DbConnection> con, const QString &contentType,
+                                 std::function<QVariant(QString)> parentEnv,
+                                 const QVector<QPair<QString, QString>> &objects)
+{
+    const int shards = qMin(SqtSettings::value("contentScriptShards", PREVIEW_SHARDS).toInt(),
+                            (objects.size() + PREVIEW_SHARD_OBJECTS - 1) / PREVIEW_SHARD_OBJECTS);
+    if (shards < 2)
+        return false;
+
+    cancel();
+    const int generation = _generation;
+    QString key = con->connectionString() + '\n' + con->database();
+    _worker.clear();
+    _shards.clear();
+    _shards.setMaxThreadCount(shards);
+    setPoolSize(key, shards);
+
+    struct Merge
+    {
+        QMutex mutex;
+        std::vector<std::shared_ptr<Scripting::CppConductor>> parts;
+        int left;
+        QString errors;
+    };
+    std::shared_ptr<Merge> m = std::make_shared<Merge>();
+    m->parts.resize(size_t(shards));
+    m->left = shards;
+    for (int shard = 0; shard < shards; ++shard)
+    {
+        QString ids, names;
+        for (int i = objects.size() * shard / shards; i < objects.size() * (shard + 1) / shards; ++i)
+        {
+            if (!objects.at(i).first.isNull())
+                ids += (ids.length() > 0 ? "," : "") + objects.at(i).first;
+            if (!objects.at(i).second.isNull())
+                names += (names.length() > 0 ? "," : "") + objects.at(i).second;
+        }
+        std::function<QVariant(QString)> env = [parentEnv, ids, names](QString macro) -> QVariant
+        {
+            if (macro == "children.ids")
+                return ids.isEmpty() ? "-1" : ids;
+            if (macro == "children.names")
+                return names.isEmpty() ? "NULL" : names;
+            return parentEnv(macro);
+        };
+        std::shared_ptr<DbConnection> fresh(con->clone());
+        fresh->setDetached(true);
+        _shards.start(new LambdaRunnable([this, generation, key, fresh, contentType, env, m, shard]() {
+            if (_generation != generation)
+                return;
+            QString errors;
+            std::shared_ptr<Scripting::CppConductor> part;
+            // shards are not cached, every one is a distinct set of objects
+            runScripts(key, fresh, errors, [&](std::shared_ptr<DbConnection> cn) {
+                part = Scripting::execute(cn, Scripting::Context::Content, contentType, env);
+            });
+
+            QMutexLocker lk(&m->mutex);
+            m->parts[size_t(shard)] = part;
+            m->errors += errors;
+            if (--m->left)
+                return;
+            std::shared_ptr<Scripting::CppConductor> content = merge(m->parts, m->errors);
+            m->parts.clear();
+            std::shared_ptr<QString> all_errors = std::make_shared<QString>(m->errors);
+            lk.unlock();
+            QMetaObject::invokeMethod(this, [this, generation, content, all_errors]() {
+                if (_generation != generation)
+                    return;
+                if (!all_errors->isEmpty())
+                    emit error(*all_errors);
+                emit ready(content, nullptr);
+            }, Qt::QueuedConnection);
+        }));
+    }
+    return true;
+}
+
+void ObjectPreview::cancel()
+{
+    ++_generation;
+    QList<std::shared_ptr<DbConnection>> running;
+    {
+        QMutexLocker lk(&_mutex);
+        running = _running;
+    }
+    for (const std::shared_ptr<DbConnection> &cn: running)
+        cn->cancel();
+}
+
+void ObjectPreview::runScripts(const QString &key, std::shared_ptr<DbConnection> fresh, QString &errors,
+                               std::function<void(std::shared_ptr<DbConnection>)> scripts)
+{
+    std::shared_ptr<DbConnection> cn = takeConnection(key, fresh);
+    QString *err = &errors;
+    // a failed cancel request reports from the gui thread
+    QThread *thread = QThread::currentThread();
+    QMetaObject::Connection guard = connect(cn.get(), &DbConnection::error, [err, thread](const QString &e) {
+        if (QThread::currentThread() == thread)
+            *err += e;
+    });
+    {
+        QMutexLocker lk(&_mutex);
+        _running.append(cn);
+    }
+    try
+    {
+        if (cn->open())
+            scripts(cn);
+    }
+    catch (const QString &e)
+    {
+        errors += e;
+    }
+    catch (const std::runtime_error &e)
+    {
+        errors += QString::fromStdString(e.what());
+    }
+    disconnect(guard);
+    QMutexLocker lk(&_mutex);
+    _running.removeOne(cn);
+    // a session beyond the number of shards is closed with cn (after the lock)
+    if (_connections.count(key) < _pool_size)
+        _connections.insert(key, cn);
+}
+
+std::shared_ptr<Scripting::CppConductor> ObjectPreview::merge(const std::vector<std::shared_ptr<Scripting::CppConductor>> &parts, QString &errors)
+{
+    std::shared_ptr<Scripting::CppConductor> res;
+    // the n-th item of a kind of every shard makes the n-th item of the content
+    auto join = [](QList<QString> &dst, const QList<QString> &src) {
+        for (int i = 0; i < src.size(); ++i)
+        {
+            if (i < dst.size())
+                dst[i] += '\n' + src.at(i);
+            else
+                dst.append(src.at(i));
+        }
+    };
+    for (const std::shared_ptr<Scripting::CppConductor> &part: parts)
+    {
+        if (!part)
+            continue;
+        if (!res)
+            res = std::make_shared<Scripting::CppConductor>(part->connection(), nullptr);
+        join(res->scripts, part->scripts);
+        join(res->htmls, part->htmls);
+        join(res->texts, part->texts);
+        for (int i = 0; i < part->resultsets.size(); ++i)
+        {
+            if (i == res->resultsets.size())
+                res->resultsets.append(new DataTable());
+            DataTable *dst = res->resultsets.at(i);
+            DataTable *src = part->resultsets.at(i);
+            bool same_columns = (!dst->columnCount() || dst->columnCount() == src->columnCount());
+            for (int c = 0; c < dst->columnCount() && same_columns; ++c)
+                same_columns = (dst->getColumn(c).name() == src->getColumn(c).name());
+            if (!same_columns)
+            {
+                errors += tr("resultset %1 of the shards has different columns\n").arg(i + 1);
+                return nullptr;
+            }
+            dst->takeRows(src);
+        }
+    }
+    return res;
+}
+
+void ObjectPreview::setPoolSize(const QString &key, int size)
+{
+    QList<std::shared_ptr<DbConnection>> dropped;
+    QMutexLocker lk(&_mutex);
+    _pool_size = qMax(size, 1);
+    while (_connections.count(key) > _pool_size)
+        dropped.append(_connections.take(key));
+    lk.unlock();
+}
+
+std::shared_ptr<DbConnection> ObjectPreview::takeConnection(const QString &key, std::shared_ptr<DbConnection> fresh)
+{
+    QMutexLocker lk(&_mutex);
+    auto it = _connections.find(key);
+    if (it == _connections.end())
+        return fresh;
+    std::shared_ptr<DbConnection> res = *it;
+    _connections.erase(it);
+    return res;
+}
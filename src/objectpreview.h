@@ -0,0 +1,93 @@
+#ifndef OBJECTPREVIEW_H
+#define OBJECTPREVIEW_H
+
+#include <QObject>
+#include <QThreadPool>
+#include <QMutex>
+#include <QMultiHash>
+#include <QPair>
+#include <QVariant>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include "scripting.h"
+
+class DbConnection;
+
+// delay of the preview after the tree selection is changed, ms
+#define PREVIEW_DEBOUNCE 150
+// default number of concurrent shards of a multiple selection content ("contentScriptShards")
+#define PREVIEW_SHARDS 4
+// fewer selected objects per shard are not worth a separate connection
+#define PREVIEW_SHARD_OBJECTS 100
+
+/*!
+ * \brief Content and preview scripts of the selected db tree node run in background.
+ *
+ * Scripts are executed by a single thread over a metadata connection (a clone of the node's
+ * one) kept per database, so the gui and editors' connections are never blocked. A new start()
+ * or cancel() drops the results of the previous preview and cancels its query.
+ *
+ * Content of a large multiple selection is scripted by shards of the selected objects
+ * concurrently, each shard over a connection and a script engine of its own.
+ */
+class ObjectPreview : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ObjectPreview(QObject *parent = nullptr);
+    virtual ~ObjectPreview() override;
+    /*!
+     * \brief run the content script, then the preview one if the content has no resultsets
+     * \param contentType empty if the content is not needed
+     * \param previewType empty if the preview is not needed
+     */
+    void start(std::shared_ptr<DbConnection> con,
+               const QString &contentType, std::function<QVariant(QString)> contentEnv,
+               const QString &previewType, std::function<QVariant(QString)> previewEnv);
+    /*!
+     * \brief run the content script of the parent node over the selected objects split into shards
+     * \param objects ids and names of the selected objects (null if absent) in order of the selection
+     * \return false if the selection is too small to be split (nothing is started)
+     *
+     * Children.ids and children.names of every shard are its own objects. The n-th script, html and
+     * text of the shards are joined and the n-th resultsets united in order of the shards.
+     */
+    bool startSharded(std::shared_ptr<DbConnection> con, const QString &contentType,
+                      std::function<QVariant(QString)> parentEnv,
+                      const QVector<QPair<QString, QString>> &objects);
+    void cancel();
+
+signals:
+    /*!
+     * \brief results of the latest start(), nullptr if the script does not exist
+     */
+    void ready(std::shared_ptr<Scripting::CppConductor> content, std::shared_ptr<Scripting::CppConductor> preview);
+    void error(const QString &err);
+
+private:
+    std::shared_ptr<DbConnection> takeConnection(const QString &key, std::shared_ptr<DbConnection> fresh);
+    /*!
+     * \brief run the scripts over a pooled connection of the key, errors are appended
+     */
+    void runScripts(const QString &key, std::shared_ptr<DbConnection> fresh, QString &errors,
+                    std::function<void(std::shared_ptr<DbConnection>)> scripts);
+    /*!
+     * \brief unite the results of the shards, errors are appended (nullptr is returned if the resultsets differ)
+     */
+    static std::shared_ptr<Scripting::CppConductor> merge(const std::vector<std::shared_ptr<Scripting::CppConductor>> &parts, QString &errors);
+    /*!
+     * \brief sessions kept per database (as many as the shards), idle ones beyond are closed
+     */
+    void setPoolSize(const QString &key, int size);
+
+    QThreadPool _worker;
+    QThreadPool _shards;
+    std::atomic<int> _generation;
+    QMutex _mutex;      ///< guards _running and _connections
+    QList<std::shared_ptr<DbConnection>> _running;
+    QMultiHash<QString, std::shared_ptr<DbConnection>> _connections;
+    int _pool_size = PREVIEW_SHARDS;    ///< idle connections kept per database
+};
+
+#endif // OBJECTPREVIEW_H
@@ -10,6 +10,8 @@
 #include "datatable.h"
 #include <memory>
 #include "scripting.h"
+#include "executionservice.h"
+#include "trace.h"
 
 OdbcConnection::OdbcConnection() :
     DbConnection()
@@ -19,10 +21,16 @@ OdbcConnection::OdbcConnection() :
     _hstmt = nullptr;
     _query_state = QueryState::Inactive;
 
+    // let driver manager keep physical connections for reuse by further environments
+    static bool pooling_enabled = (SQLSetEnvAttr(SQL_NULL_HANDLE, SQL_ATTR_CONNECTION_POOLING,
+                                                 reinterpret_cast<SQLPOINTER>(std::intptr_t(SQL_CP_ONE_PER_DRIVER)), 0) == SQL_SUCCESS);
+
     retcode = SQLAllocHandle(SQL_HANDLE_ENV, SQL_NULL_HANDLE, &_henv);
     if (check(retcode, _henv, SQL_HANDLE_ENV))
     {
         retcode = SQLSetEnvAttr(_henv, SQL_ATTR_ODBC_VERSION, reinterpret_cast<SQLPOINTER>(std::intptr_t(SQL_OV_ODBC3)), 0);
+        if (pooling_enabled && SQL_SUCCEEDED(retcode))
+            SQLSetEnvAttr(_henv, SQL_ATTR_CP_MATCH, reinterpret_cast<SQLPOINTER>(std::intptr_t(SQL_CP_RELAXED_MATCH)), 0);
         if (check(retcode, _henv, SQL_HANDLE_ENV))
         {
             retcode = SQLAllocHandle(SQL_HANDLE_DBC, _henv, &_hdbc);
@@ -39,6 +47,7 @@ OdbcConnection::OdbcConnection() :
 
 OdbcConnection::~OdbcConnection()
 {
+    closeCursors();
     close();
     if (_hdbc)
         SQLFreeHandle(SQL_HANDLE_DBC, _hdbc);
@@ -211,8 +220,64 @@ QMetaType::Type OdbcConnection::sqlTypeToVariant(int sqlType) const noexcept
     return var_type;
 }
 
+namespace
+{
+
+/*!
+ * \brief buffer size of a column fetched by SQLGetData() according to its metadata
+ */
+size_t longDataBuffer(const DataColumn &column, SQLSMALLINT cType) noexcept
+{
+    const qint64 length = column.length();
+    const qint64 size = (cType == SQL_C_WCHAR ? (length + 1) * qint64(sizeof(SQLWCHAR)) : length * 4 + 4);
+    return size_t(qBound(qint64(1024), size, qint64(ODBC_LONG_DATA_BUFFER)));
+}
+
+/*!
+ * \brief fetch the whole value of the column into the buffer kept between rows
+ * \param length bytes of the value without null terminator or SQL_NULL_DATA
+ */
+RETCODE getLongData(SQLHSTMT hstmt, SQLUSMALLINT column, SQLSMALLINT cType, std::vector<char> &buf, SQLLEN &length)
+{
+    const size_t terminator = (cType == SQL_C_WCHAR ? sizeof(SQLWCHAR) : sizeof(SQLCHAR));
+    size_t used = 0;
+    for (;;)
+    {
+        SQLLEN avail = SQLLEN(buf.size() - used);
+        SQLLEN cb = 0;
+        RETCODE retcode = SQLGetData(hstmt, column, cType, buf.data() + used, avail, &cb);
+        if (retcode == SQL_NO_DATA && used)
+        {
+            // the rest was empty
+            length = SQLLEN(used);
+            return SQL_SUCCESS;
+        }
+        if (!SQL_SUCCEEDED(retcode))
+            return retcode;
+        if (cb == SQL_NULL_DATA)
+        {
+            length = SQL_NULL_DATA;
+            return retcode;
+        }
+        // sql_variant returns SQL_SUCCESS_WITH_INFO even if the value fits
+        if (retcode == SQL_SUCCESS_WITH_INFO && (cb == SQL_NO_TOTAL || cb >= avail))
+        {
+            // every pass is null-terminated
+            used += size_t(avail) - terminator;
+            size_t need = (cb == SQL_NO_TOTAL ? buf.size() * 2 : used + size_t(cb - avail) + 2 * terminator);
+            buf.resize(qMax(need, buf.size() + buf.size() / 2));
+            continue;
+        }
+        length = SQLLEN(used) + cb;
+        return retcode;
+    }
+}
+
+}
+
 bool OdbcConnection::execute(const QString &query, const QVector<QVariant> *params)
 {
+    SQT_TRACE_SCOPE("odbc execute");
     // TODO implement params to use in js-scripts
     Q_UNUSED(params)
 
@@ -239,6 +304,7 @@ bool OdbcConnection::execute(const QString &query, const QVector<QVariant> *para
     });
 
     setQueryState(QueryState::Running);
+    markTiming(_timings.acquire);
 
     _timer.start();
     for (QString &q: queries)
@@ -251,7 +317,10 @@ bool OdbcConnection::execute(const QString &query, const QVector<QVariant> *para
         1) in case of SQL_CURSOR_STATIC mode SQLRowCount always returns -1 (FreeTDS), and SQLFetch acts very slow
         2) prepared statement incompatible with several features (including showplan)
         */
-        retcode = SQLExecDirectA(hstmt_local, reinterpret_cast<SQLCHAR*>(q.toLocal8Bit().data()), SQL_NTS);
+        // the driver sends the statement and waits for the server within the call
+        markTiming(_timings.sent);
+        retcode = execDirect(hstmt_local, q.toLocal8Bit());
+        markTiming(_timings.firstResult);
         if (retcode == SQL_NO_DATA)
             continue;
 
@@ -266,6 +335,9 @@ bool OdbcConnection::execute(const QString &query, const QVector<QVariant> *para
                 QMutexLocker lk(&_resultsetsGuard);
                 _resultsets.append(table);
                 lk.unlock();
+                startFetchNotifications();
+                // the driver receives and converts values within the same calls
+                TimingScope receiving(_timings.receive);
 
                 SQLULEN col_size;
                 SQLCHAR buf[512];
@@ -319,11 +391,20 @@ bool OdbcConnection::execute(const QString &query, const QVector<QVariant> *para
                                      );
                 }
 
-                while (/*(limit == -1 || rowcount < limit) &&*/ (retcode = SQLFetch(hstmt_local)) != SQL_NO_DATA)
+                // long data columns require row by row fetching by means of SQLGetData()
+                int fetched_by_blocks = fetchBlocks(hstmt_local, table);
+                if (fetched_by_blocks >= 0)
+                    rowcount = fetched_by_blocks;
+
+                QVector<QVariant> row(col_count);
+                // textual values are fetched into per column buffers reused by the rows
+                std::vector<std::vector<char>> buffers(fetched_by_blocks < 0 ? size_t(col_count) : 0);
+                while (/*(limit == -1 || rowcount < limit) &&*/ fetched_by_blocks < 0 &&
+                       (retcode = SQLFetch(hstmt_local)) != SQL_NO_DATA)
                 {
                     if (!checkStmt(retcode, hstmt_local))
                         break;
-                    std::unique_ptr<DataRow> row(new DataRow(table));
+                    row.fill(QVariant());
                     for (SQLUSMALLINT i = 0; i < col_count; ++i)
                     {
                         cb = SQL_NULL_DATA;
@@ -336,7 +417,7 @@ bool OdbcConnection::execute(const QString &query, const QVector<QVariant> *para
                             retcode = SQLGetData(hstmt_local, i + 1, SQL_C_SSHORT, &num, 0, &cb);
                             if (!checkStmt(retcode, hstmt_local) || cb == SQL_NULL_DATA)
                                 break;
-                            (*row)[i] = num;
+                            row[i] = num;
                             break;
                         }
                         case SQL_BIGINT:
@@ -345,7 +426,7 @@ bool OdbcConnection::execute(const QString &query, const QVector<QVariant> *para
                             retcode = SQLGetData(hstmt_local, i + 1, SQL_C_SBIGINT, &num, 0, &cb);
                             if (!checkStmt(retcode, hstmt_local) || cb == SQL_NULL_DATA)
                                 break;
-                            (*row)[i] = num;
+                            row[i] = num;
                             break;
                         }
                         case SQL_INTEGER:
@@ -354,7 +435,7 @@ bool OdbcConnection::execute(const QString &query, const QVector<QVariant> *para
                             retcode = SQLGetData(hstmt_local, i + 1, SQL_C_SLONG, &num, 0, &cb);
                             if (!checkStmt(retcode, hstmt_local) || cb == SQL_NULL_DATA)
                                 break;
-                            (*row)[i] = num;
+                            row[i] = num;
                             break;
                         }
                         case SQL_REAL:
@@ -363,7 +444,7 @@ bool OdbcConnection::execute(const QString &query, const QVector<QVariant> *para
                             retcode = SQLGetData(hstmt_local, i + 1, SQL_C_FLOAT, &num, 0, &cb);
                             if (!checkStmt(retcode, hstmt_local) || cb == SQL_NULL_DATA)
                                 break;
-                            (*row)[i] = num;
+                            row[i] = num;
                             break;
                         }
                         case SQL_FLOAT:
@@ -373,7 +454,7 @@ bool OdbcConnection::execute(const QString &query, const QVector<QVariant> *para
                             retcode = SQLGetData(hstmt_local, i + 1, SQL_C_DOUBLE, &num, 0, &cb);
                             if (!checkStmt(retcode, hstmt_local) || cb == SQL_NULL_DATA)
                                 break;
-                            (*row)[i] = num;
+                            row[i] = num;
                             break;
                         }
                         case SQL_BIT:
@@ -382,7 +463,7 @@ bool OdbcConnection::execute(const QString &query, const QVector<QVariant> *para
                             retcode = SQLGetData(hstmt_local, i + 1, SQL_C_BIT, &bit, 0, &cb);
                             if (!checkStmt(retcode, hstmt_local) || cb == SQL_NULL_DATA)
                                 break;
-                            (*row)[i] = (bit ? true : false);
+                            row[i] = (bit ? true : false);
                             break;
                         }
                         case SQL_TINYINT:
@@ -391,7 +472,7 @@ bool OdbcConnection::execute(const QString &query, const QVector<QVariant> *para
                             retcode = SQLGetData(hstmt_local, i + 1, SQL_C_UTINYINT, &bit, 0, &cb);
                             if (!checkStmt(retcode, hstmt_local) || cb == SQL_NULL_DATA)
                                 break;
-                            (*row)[i] = bit;
+                            row[i] = bit;
                             break;
                         }
                         case SQL_TYPE_DATE:
@@ -400,7 +481,7 @@ bool OdbcConnection::execute(const QString &query, const QVector<QVariant> *para
                             retcode = SQLGetData(hstmt_local, i + 1, SQL_C_TYPE_DATE, &date, sizeof(DATE_STRUCT), &cb);
                             if (!checkStmt(retcode, hstmt_local) || cb == SQL_NULL_DATA)
                                 break;
-                            (*row)[i] = QDate(date.year, date.month, date.day);
+                            row[i] = QDate(date.year, date.month, date.day);
                             break;
                         }
                         case SQL_SS_TIME2:
@@ -411,13 +492,13 @@ bool OdbcConnection::execute(const QString &query, const QVector<QVariant> *para
                             retcode = SQLGetData(hstmt, i + 1, SQL_C_TYPE_TIME, &time, sizeof(TIME_STRUCT), &cb);
                             if (!check(retcode, hstmt, SQL_HANDLE_STMT) || cb == SQL_NULL_DATA)
                                 break;
-                            (*row)[i] = QTime(time.hour, time.minute, time.second);
+                            row[i] = QTime(time.hour, time.minute, time.second);
                             */
                             TIMESTAMP_STRUCT dt;
                             retcode = SQLGetData(hstmt_local, i + 1, SQL_C_TYPE_TIMESTAMP, &dt, sizeof(TIMESTAMP_STRUCT), &cb);
                             if (!checkStmt(retcode, hstmt_local) || cb == SQL_NULL_DATA)
                                 break;
-                            (*row)[i] = QTime(dt.hour, dt.minute, dt.second, dt.fraction / 1000000);
+                            row[i] = QTime(dt.hour, dt.minute, dt.second, dt.fraction / 1000000);
                             break;
                         }
                         case SQL_TYPE_TIMESTAMP:
@@ -426,71 +507,32 @@ bool OdbcConnection::execute(const QString &query, const QVector<QVariant> *para
                             retcode = SQLGetData(hstmt_local, i + 1, SQL_C_TYPE_TIMESTAMP, &dt, sizeof(TIMESTAMP_STRUCT), &cb);
                             if (!checkStmt(retcode, hstmt_local) || cb == SQL_NULL_DATA)
                                 break;
-                            (*row)[i] = QDateTime(QDate(dt.year, dt.month, dt.day), QTime(dt.hour, dt.minute, dt.second, dt.fraction / 1000000));
+                            row[i] = QDateTime(QDate(dt.year, dt.month, dt.day), QTime(dt.hour, dt.minute, dt.second, dt.fraction / 1000000));
                             break;
                         }
                         case SQL_WCHAR:
                         case SQL_WVARCHAR:
                         case SQL_WLONGVARCHAR:
                         {
-                            size_t buf_size = 1024;
-                            std::vector<char> buf_storage(buf_size);
-                            char *buf = buf_storage.data();
-                            char *ptr = buf;
-                            size_t res_len = 0;
-                            do
-                            {
-                                retcode = SQLGetData(hstmt_local, i + 1, SQL_C_WCHAR, ptr, SQLLEN(buf_size - size_t(ptr - buf)), &cb);
-                                if (!SQL_SUCCEEDED(retcode) || cb == SQL_NULL_DATA)
-                                    break;
-                                if (retcode == SQL_SUCCESS_WITH_INFO)
-                                {
-                                    res_len = buf_size - sizeof(SQLWCHAR); // every pass null-terminated
-                                    buf_storage.resize(buf_size + size_t(cb));
-                                    buf = buf_storage.data();
-                                    ptr = buf + res_len;
-                                    buf_size = buf_size + size_t(cb);
-                                }
-                                else
-                                    res_len += size_t(cb);
-                            }
-                            while (retcode == SQL_SUCCESS_WITH_INFO);
-                            if (retcode == SQL_ERROR)
+                            std::vector<char> &buf = buffers[i];
+                            if (buf.empty())
+                                buf.resize(longDataBuffer(table->getColumn(i), SQL_C_WCHAR));
+                            retcode = getLongData(hstmt_local, i + 1, SQL_C_WCHAR, buf, cb);
+                            if (!SQL_SUCCEEDED(retcode) || cb == SQL_NULL_DATA)
                                 break;
-                            if (cb != SQL_NULL_DATA)
-                                (*row)[i] = QString::fromUtf16(reinterpret_cast<ushort*>(buf), int(res_len / sizeof(SQLWCHAR)));
-                            //(*row)[i] = QTextCodec::codecForMib(1015)->toUnicode(val); // 1015 is UTF-16, 1014 UTF-16LE, 1013 UTF-16LE
+                            // the value is copied once, into the string of the row
+                            row[i] = QString::fromUtf16(reinterpret_cast<const ushort*>(buf.data()), int(size_t(cb) / sizeof(SQLWCHAR)));
                             break;
                         }
                         default:
                         {
-                            size_t buf_size = 1024;
-                            std::vector<char> buf_storage(buf_size);
-                            char *buf = buf_storage.data();
-                            char *ptr = buf;
-                            size_t res_len = 0;
-                            do
-                            {
-                                SQLLEN arg_len = static_cast<SQLLEN>(buf_size - size_t(ptr - buf));
-                                retcode = SQLGetData(hstmt_local, i + 1, SQL_C_CHAR, ptr, arg_len, &cb);
-                                if (!SQL_SUCCEEDED(retcode) || cb == SQL_NULL_DATA)
-                                    break;
-                                if (retcode == SQL_SUCCESS_WITH_INFO && cb > arg_len) // workaround for sql_variant (always SQL_SUCCESS_WITH_INFO)
-                                {
-                                    res_len = buf_size - sizeof(SQLCHAR); // every pass null-terminated
-                                    buf_storage.resize(buf_size * 2);
-                                    buf = buf_storage.data();
-                                    ptr = buf + res_len;
-                                    buf_size = buf_size * 2;
-                                }
-                                else
-                                    break;
-                            }
-                            while (retcode == SQL_SUCCESS_WITH_INFO);
-                            if (retcode == SQL_ERROR)
+                            std::vector<char> &buf = buffers[i];
+                            if (buf.empty())
+                                buf.resize(longDataBuffer(table->getColumn(i), SQL_C_CHAR));
+                            retcode = getLongData(hstmt_local, i + 1, SQL_C_CHAR, buf, cb);
+                            if (!SQL_SUCCEEDED(retcode) || cb == SQL_NULL_DATA)
                                 break;
-                            if (cb != SQL_NULL_DATA)
-                                (*row)[i] = QString::fromLocal8Bit(buf);
+                            row[i] = QString::fromLocal8Bit(buf.data(), int(cb));
                         }
                         }  // end of switch
 
@@ -499,17 +541,27 @@ bool OdbcConnection::execute(const QString &query, const QVector<QVariant> *para
                     }
 
                     QMutexLocker lk(&table->mutex);
-                    table->addRow(row.release());
+                    table->appendRow(row);
+                    bool notify = !exportRows(*table) && fetchNotificationDue(*table, 1);
                     lk.unlock();
 
                     ++rowcount;
-                    if (rowcount % FETCH_COUNT_NOTIFY == 0)
+                    if (notify)
+                    {
                         emit fetched(table);
+                        // views have not taken enough of fetched rows yet
+                        while (ExecutionService::instance().inflightExceeded() && _query_state == QueryState::Running)
+                            QThread::msleep(EXECUTION_INFLIGHT_RETRY);
+                    }
                 }
-                if (rowcount == 0 || rowcount % FETCH_COUNT_NOTIFY != 0)
+                if (fetchNotificationPending())
                     emit fetched(table);
+                // empty resultset gets its (header only) file too
+                QMutexLocker lk_export(&table->mutex);
+                exportRows(*table);
             }
 
+            _timings.rows += rowcount;
             if (col_count)
                 emit message(tr("%1 rows fetched").arg(rowcount));
             else
@@ -528,6 +580,374 @@ bool OdbcConnection::execute(const QString &query, const QVector<QVariant> *para
     return true;
 }
 
+namespace
+{
+
+/*!
+ * \brief converts a bound (not null) value into the storage
+ */
+typedef void (*BlockDecoder)(ColumnStorage &dst, const char *value, SQLLEN indicator, SQLLEN elementSize);
+
+template <typename T>
+void blockInt32(ColumnStorage &dst, const char *value, SQLLEN, SQLLEN)
+{
+    dst.appendInt32(*reinterpret_cast<const T*>(value));
+}
+
+void blockInt64(ColumnStorage &dst, const char *value, SQLLEN, SQLLEN)
+{
+    dst.appendInt64(*reinterpret_cast<const qint64*>(value));
+}
+
+void blockFloat(ColumnStorage &dst, const char *value, SQLLEN, SQLLEN)
+{
+    dst.appendFloat(*reinterpret_cast<const float*>(value));
+}
+
+void blockDouble(ColumnStorage &dst, const char *value, SQLLEN, SQLLEN)
+{
+    dst.appendDouble(*reinterpret_cast<const double*>(value));
+}
+
+void blockBit(ColumnStorage &dst, const char *value, SQLLEN, SQLLEN)
+{
+    dst.appendBool(*value != 0);
+}
+
+void blockDate(ColumnStorage &dst, const char *value, SQLLEN, SQLLEN)
+{
+    const DATE_STRUCT *date = reinterpret_cast<const DATE_STRUCT*>(value);
+    dst.appendVariant(QDate(date->year, date->month, date->day));
+}
+
+void blockTime(ColumnStorage &dst, const char *value, SQLLEN, SQLLEN)
+{
+    const TIMESTAMP_STRUCT *dt = reinterpret_cast<const TIMESTAMP_STRUCT*>(value);
+    dst.appendVariant(QTime(dt->hour, dt->minute, dt->second, int(dt->fraction / 1000000)));
+}
+
+void blockTimestamp(ColumnStorage &dst, const char *value, SQLLEN, SQLLEN)
+{
+    const TIMESTAMP_STRUCT *dt = reinterpret_cast<const TIMESTAMP_STRUCT*>(value);
+    dst.appendVariant(QDateTime(QDate(dt->year, dt->month, dt->day),
+                                QTime(dt->hour, dt->minute, dt->second, int(dt->fraction / 1000000))));
+}
+
+void blockWChar(ColumnStorage &dst, const char *value, SQLLEN indicator, SQLLEN elementSize)
+{
+    SQLLEN len = qMin(indicator, elementSize - SQLLEN(sizeof(SQLWCHAR)));
+    dst.appendString(QString::fromUtf16(reinterpret_cast<const ushort*>(value), int(len / SQLLEN(sizeof(SQLWCHAR)))));
+}
+
+void blockChar(ColumnStorage &dst, const char *value, SQLLEN indicator, SQLLEN elementSize)
+{
+    SQLLEN len = qMin(indicator, elementSize - 1);
+    dst.appendString(QString::fromLocal8Bit(value, int(len)));
+}
+
+}
+
+bool OdbcConnection::executeBatch(const QString &query, const QList<QVector<QVariant>> &rows)
+{
+    clearResultsets();
+    if (rows.isEmpty())
+        return true;
+    if (!open())
+        return false;
+
+    SQLHSTMT hstmt_local;
+    RETCODE retcode = SQLAllocHandle(SQL_HANDLE_STMT, _hdbc, &hstmt_local);
+    if (!check(retcode, _hdbc, SQL_HANDLE_DBC))
+        return false;
+    _hstmt = hstmt_local;
+    std::unique_ptr<SQLHSTMT, std::function<void(SQLHSTMT*)>> hstmt_guard(&hstmt_local, [this](SQLHSTMT *hstmt)
+    {
+        _hstmt = nullptr;
+        SQLFreeHandle(SQL_HANDLE_STMT, *hstmt);
+        setQueryState(QueryState::Inactive);
+    });
+    setQueryState(QueryState::Running);
+    _timer.start();
+
+    QByteArray text = query.toLocal8Bit();
+    if (!checkStmt(SQLPrepareA(hstmt_local, reinterpret_cast<SQLCHAR*>(text.data()), SQL_NTS), hstmt_local))
+        return false;
+
+    // every parameter is bound as an array of texts, the server converts them
+    struct BoundParam
+    {
+        std::vector<char> data;
+        std::vector<SQLLEN> indicators;
+    };
+    const int param_count = rows.first().size();
+    std::vector<BoundParam> params(size_t(param_count));
+    SQLULEN processed = 0;
+    SQLSetStmtAttr(hstmt_local, SQL_ATTR_PARAM_BIND_TYPE, reinterpret_cast<SQLPOINTER>(SQL_PARAM_BIND_BY_COLUMN), 0);
+    SQLSetStmtAttr(hstmt_local, SQL_ATTR_PARAMS_PROCESSED_PTR, &processed, 0);
+    // the driver may substitute the size (down to a single set if it lacks parameter arrays)
+    SQLULEN array_size = SQLULEN(qMin(ODBC_BATCH_ROWS, rows.size()));
+    SQLSetStmtAttr(hstmt_local, SQL_ATTR_PARAMSET_SIZE, reinterpret_cast<SQLPOINTER>(array_size), 0);
+    SQLGetStmtAttr(hstmt_local, SQL_ATTR_PARAMSET_SIZE, &array_size, 0, nullptr);
+    const int portion = int(qMax(array_size, SQLULEN(1)));
+
+    qint64 affected = 0;
+    for (int from = 0; from < rows.size() && _query_state == QueryState::Running; from += portion)
+    {
+        const int count = qMin(portion, rows.size() - from);
+        SQLSetStmtAttr(hstmt_local, SQL_ATTR_PARAMSET_SIZE, reinterpret_cast<SQLPOINTER>(SQLULEN(count)), 0);
+        for (int p = 0; p < param_count; ++p)
+        {
+            // element size is the longest value of the portion, buffers are kept for the next one
+            SQLLEN longest = 1;
+            for (int r = from; r < from + count; ++r)
+                longest = qMax(longest, SQLLEN(rows.at(r).value(p).toString().size()));
+            const SQLLEN element = (longest + 1) * SQLLEN(sizeof(SQLWCHAR));
+            BoundParam &b = params[size_t(p)];
+            b.data.resize(size_t(element) * size_t(count));
+            b.indicators.resize(size_t(count));
+            for (int r = 0; r < count; ++r)
+            {
+                const QVariant v = rows.at(from + r).value(p);
+                if (!v.isValid() || v.isNull())
+                {
+                    b.indicators[size_t(r)] = SQL_NULL_DATA;
+                    continue;
+                }
+                const QString s = v.toString();
+                char *dst = b.data.data() + size_t(element) * size_t(r);
+                memcpy(dst, s.utf16(), size_t(s.size() + 1) * sizeof(SQLWCHAR));
+                b.indicators[size_t(r)] = SQLLEN(s.size()) * SQLLEN(sizeof(SQLWCHAR));
+            }
+            retcode = SQLBindParameter(hstmt_local, SQLUSMALLINT(p + 1), SQL_PARAM_INPUT, SQL_C_WCHAR, SQL_WVARCHAR,
+                                       SQLULEN(longest), 0, b.data.data(), element, b.indicators.data());
+            if (!checkStmt(retcode, hstmt_local))
+                return false;
+        }
+
+        retcode = SQLExecute(hstmt_local);
+        if (retcode != SQL_NO_DATA && !checkStmt(retcode, hstmt_local))
+            return false;
+        // results of the sets are discarded
+        while (SQL_SUCCEEDED(retcode))
+        {
+            SQLLEN cb = -1;
+            if (SQL_SUCCEEDED(SQLRowCount(hstmt_local, &cb)) && cb > 0)
+                affected += cb;
+            retcode = SQLMoreResults(hstmt_local);
+        }
+        if (retcode != SQL_NO_DATA && !checkStmt(retcode, hstmt_local))
+            return false;
+        SQLFreeStmt(hstmt_local, SQL_CLOSE);
+    }
+    emit message(tr("%1 rows affected").arg(affected));
+    return _query_state == QueryState::Running;
+}
+
+RETCODE OdbcConnection::execDirect(SQLHSTMT hstmt, QByteArray query)
+{
+    SQLCHAR *text = reinterpret_cast<SQLCHAR*>(query.data());
+    // fetching functions are called synchronously, so the mode is enabled for the call only
+    if (!_async_exec ||
+            !SQL_SUCCEEDED(SQLSetStmtAttr(hstmt, SQL_ATTR_ASYNC_ENABLE, reinterpret_cast<SQLPOINTER>(SQL_ASYNC_ENABLE_ON), 0)))
+        return SQLExecDirectA(hstmt, text, SQL_NTS);
+
+    {
+        QMutexLocker lk(&_polling_mutex);
+        _polling = true;
+    }
+    bool cancelled = false;
+    unsigned long pause = 100;
+    RETCODE retcode;
+    while ((retcode = SQLExecDirectA(hstmt, text, SQL_NTS)) == SQL_STILL_EXECUTING)
+    {
+        if (_query_state == QueryState::Cancelling && !cancelled)
+        {
+            // the next call returns the error of the cancelled statement
+            SQLCancel(hstmt);
+            cancelled = true;
+            continue;
+        }
+        QThread::usleep(pause);
+        pause = qMin(pause * 2, 1000ul * ODBC_ASYNC_POLL_MAX);
+    }
+    {
+        QMutexLocker lk(&_polling_mutex);
+        _polling = false;
+    }
+    SQLSetStmtAttr(hstmt, SQL_ATTR_ASYNC_ENABLE, reinterpret_cast<SQLPOINTER>(SQL_ASYNC_ENABLE_OFF), 0);
+    if (_query_state == QueryState::Cancelling && !cancelled && SQL_SUCCEEDED(retcode))
+    {
+        // cancel() came after the last poll, the results are discarded instead
+        SQLFreeStmt(hstmt, SQL_CLOSE);
+        emit message(tr("cancelled"));
+        return SQL_NO_DATA;
+    }
+    return retcode;
+}
+
+int OdbcConnection::fetchBlocks(SQLHSTMT hstmt, DataTable *table)
+{
+    // column-wise bound buffer and its decoder chosen once per resultset
+    struct BoundColumn
+    {
+        SQLSMALLINT cType;
+        SQLLEN elementSize;
+        BlockDecoder decode;
+        std::vector<char> data;
+        std::vector<SQLLEN> indicators;
+    };
+
+    const int col_count = table->columnCount();
+    std::vector<BoundColumn> columns(size_t(col_count));
+    SQLLEN row_size = 0;
+    for (int i = 0; i < col_count; ++i)
+    {
+        const DataColumn &c = table->getColumn(i);
+        BoundColumn &b = columns[size_t(i)];
+        SQLLEN col_size = c.length();
+        switch (c.sqlType())
+        {
+        case SQL_SMALLINT:
+            b = { SQL_C_SSHORT, sizeof(short), &blockInt32<short>, {}, {} };
+            break;
+        case SQL_INTEGER:
+            b = { SQL_C_SLONG, sizeof(qint32), &blockInt32<qint32>, {}, {} };
+            break;
+        case SQL_BIGINT:
+            b = { SQL_C_SBIGINT, sizeof(qint64), &blockInt64, {}, {} };
+            break;
+        case SQL_REAL:
+            b = { SQL_C_FLOAT, sizeof(float), &blockFloat, {}, {} };
+            break;
+        case SQL_FLOAT:
+        case SQL_DOUBLE:
+            b = { SQL_C_DOUBLE, sizeof(double), &blockDouble, {}, {} };
+            break;
+        case SQL_BIT:
+            b = { SQL_C_BIT, sizeof(unsigned char), &blockBit, {}, {} };
+            break;
+        case SQL_TINYINT:
+            b = { SQL_C_UTINYINT, sizeof(unsigned char), &blockInt32<unsigned char>, {}, {} };
+            break;
+        case SQL_TYPE_DATE:
+            b = { SQL_C_TYPE_DATE, sizeof(DATE_STRUCT), &blockDate, {}, {} };
+            break;
+        case SQL_SS_TIME2:
+        case SQL_TYPE_TIME:
+            b = { SQL_C_TYPE_TIMESTAMP, sizeof(TIMESTAMP_STRUCT), &blockTime, {}, {} };
+            break;
+        case SQL_TYPE_TIMESTAMP:
+            b = { SQL_C_TYPE_TIMESTAMP, sizeof(TIMESTAMP_STRUCT), &blockTimestamp, {}, {} };
+            break;
+        case SQL_WLONGVARCHAR:
+        case SQL_LONGVARCHAR:
+        case SQL_LONGVARBINARY:
+        case SQL_VARIANT:
+            return -1;
+        case SQL_WCHAR:
+        case SQL_WVARCHAR:
+            if (col_size <= 0 || col_size > 4000)
+                return -1;
+            b = { SQL_C_WCHAR, SQLLEN((col_size + 1) * sizeof(SQLWCHAR)), &blockWChar, {}, {} };
+            break;
+        default:
+            // (max) types and so on
+            if (col_size <= 0 || col_size > 8000)
+                return -1;
+            // room for multibyte characters, hex representation of binaries,
+            // sign and decimal point of numerics
+            b = { SQL_C_CHAR, SQLLEN(col_size * 4 + 4), &blockChar, {}, {} };
+        }
+        row_size += b.elementSize + SQLLEN(sizeof(SQLLEN));
+    }
+
+    // keep the buffers within reasonable size
+    SQLULEN array_size = SQLULEN(qBound(SQLLEN(1), SQLLEN(64 * 1024 * 1024) / qMax(row_size, SQLLEN(1)), SQLLEN(FETCH_COUNT_NOTIFY)));
+    if (!SQL_SUCCEEDED(SQLSetStmtAttr(hstmt, SQL_ATTR_ROW_BIND_TYPE, reinterpret_cast<SQLPOINTER>(SQL_BIND_BY_COLUMN), 0)) ||
+            !SQL_SUCCEEDED(SQLSetStmtAttr(hstmt, SQL_ATTR_ROW_ARRAY_SIZE, reinterpret_cast<SQLPOINTER>(array_size), 0)))
+        return -1;
+    // the driver may substitute the value
+    SQLGetStmtAttr(hstmt, SQL_ATTR_ROW_ARRAY_SIZE, &array_size, 0, nullptr);
+    if (array_size < 2)
+    {
+        SQLSetStmtAttr(hstmt, SQL_ATTR_ROW_ARRAY_SIZE, reinterpret_cast<SQLPOINTER>(1), 0);
+        return -1;
+    }
+
+    SQLULEN rows_fetched = 0;
+    std::vector<SQLUSMALLINT> row_status(array_size);
+    SQLSetStmtAttr(hstmt, SQL_ATTR_ROWS_FETCHED_PTR, &rows_fetched, 0);
+    SQLSetStmtAttr(hstmt, SQL_ATTR_ROW_STATUS_PTR, row_status.data(), 0);
+
+    // buffers must not be used by the driver after return
+    std::unique_ptr<SQLHSTMT, std::function<void(SQLHSTMT*)>> binding_guard(&hstmt, [](SQLHSTMT *hstmt)
+    {
+        SQLFreeStmt(*hstmt, SQL_UNBIND);
+        SQLSetStmtAttr(*hstmt, SQL_ATTR_ROWS_FETCHED_PTR, nullptr, 0);
+        SQLSetStmtAttr(*hstmt, SQL_ATTR_ROW_STATUS_PTR, nullptr, 0);
+        SQLSetStmtAttr(*hstmt, SQL_ATTR_ROW_ARRAY_SIZE, reinterpret_cast<SQLPOINTER>(1), 0);
+    });
+
+    for (int i = 0; i < col_count; ++i)
+    {
+        BoundColumn &b = columns[size_t(i)];
+        b.data.resize(size_t(b.elementSize) * array_size);
+        b.indicators.resize(array_size);
+        RETCODE retcode = SQLBindCol(hstmt, SQLUSMALLINT(i + 1), b.cType, b.data.data(), b.elementSize, b.indicators.data());
+        if (!checkStmt(retcode, hstmt))
+            return -1;
+    }
+
+    int rowcount = 0;
+    std::vector<SQLULEN> rows;
+    rows.reserve(array_size);
+    RETCODE retcode;
+    while ((retcode = SQLFetch(hstmt)) != SQL_NO_DATA)
+    {
+        if (!checkStmt(retcode, hstmt))
+            break;
+
+        // rows the driver failed to fetch are skipped
+        rows.clear();
+        for (SQLULEN r = 0; r < rows_fetched; ++r)
+        {
+            if (row_status[r] != SQL_ROW_ERROR && row_status[r] != SQL_ROW_NOROW)
+                rows.push_back(r);
+        }
+        int block_rows = int(rows.size());
+        QMutexLocker lk(&table->mutex);
+        // column by column, so the loop calls the same decoder over the same buffer
+        for (int i = 0; i < col_count; ++i)
+        {
+            const BoundColumn &b = columns[size_t(i)];
+            const BlockDecoder decode = b.decode;
+            const char *const data = b.data.data();
+            const SQLLEN *const indicators = b.indicators.data();
+            ColumnStorage &col = table->storage(i);
+            for (SQLULEN r: rows)
+            {
+                if (indicators[r] == SQL_NULL_DATA)
+                    col.appendNull();
+                else
+                    decode(col, data + size_t(b.elementSize) * r, indicators[r], b.elementSize);
+            }
+        }
+        table->commitRow(block_rows);
+        rowcount += block_rows;
+        bool notify = !exportRows(*table) && fetchNotificationDue(*table, block_rows);
+        lk.unlock();
+
+        if (notify)
+        {
+            emit fetched(table);
+            // views have not taken enough of fetched rows yet
+            while (ExecutionService::instance().inflightExceeded() && _query_state == QueryState::Running)
+                QThread::msleep(EXECUTION_INFLIGHT_RETRY);
+        }
+    }
+    return rowcount;
+}
+
 void OdbcConnection::clarifyTableStructure(DataTable &)
 {
     // TODO
@@ -535,16 +955,12 @@ void OdbcConnection::clarifyTableStructure(DataTable &)
 
 void OdbcConnection::executeAsync(const QString &query, const QVector<QVariant> *params) noexcept
 {
-    QThread* thread = new QThread();
-    connect(thread, &QThread::started, thread, [this, query, thread, params]() {
+    startTimings();
+    // statements of all the tabs share the pool of workers
+    ExecutionService::instance().runStatement([this, query, params]() {
         execute(query, params);
-        thread->quit();
-    });
-    connect(thread, &QThread::finished, [this, thread]() {
-        thread->deleteLater();
         emit queryFinished();
     });
-    thread->start();
 }
 
 bool OdbcConnection::open()
@@ -567,6 +983,9 @@ bool OdbcConnection::open()
                                 1024, &swStrLen, SQL_DRIVER_NOPROMPT);
     if (check(retcode, _hdbc, SQL_HANDLE_DBC))
     {
+        SQLUINTEGER async_mode = SQL_AM_NONE;
+        SQLGetInfoA(_hdbc, SQL_ASYNC_MODE, &async_mode, sizeof(async_mode), nullptr);
+        _async_exec = (async_mode == SQL_AM_STATEMENT);
         _dbmsScriptingID = dbmsName() + dbmsVersion() + "_odbc";
         return true;
     }
@@ -724,14 +1143,14 @@ void OdbcConnection::cancel() noexcept
         setQueryState(QueryState::Cancelling);
         emit message(tr("cancelling..."));
 
-        QThread* thread = new QThread;
-        connect(thread, &QThread::started, [this, hstmt_local]() {
+        {
+            QMutexLocker lk(&_polling_mutex);
+            if (_polling)
+                return;
+        }
+        ExecutionService::instance().runCancel([this, hstmt_local]() {
             checkStmt(SQLCancel(hstmt_local), hstmt_local);
         });
-        connect(thread, &QThread::finished, [thread]() {
-            thread->deleteLater();
-        });
-        thread->start();
     }
 }
 
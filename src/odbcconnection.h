@@ -4,6 +4,13 @@
 #define SQL_VARIANT (-150)  // windows only?
 #define SQL_SS_TIME2 (-154) // windows only?
 
+// initial size of the buffer of a long data column, the buffer grows up to the longest value
+#define ODBC_LONG_DATA_BUFFER (64 * 1024)
+// longest pause between polls of a statement executed asynchronously, ms
+#define ODBC_ASYNC_POLL_MAX 20
+// parameter sets of a batch bound as arrays and executed at once
+#define ODBC_BATCH_ROWS 1000
+
 #include <QtGlobal>
 
 #ifdef Q_OS_WIN32
@@ -14,6 +21,7 @@
 
 #include <sql.h>
 #include <sqlext.h>
+#include <QMutex>
 #include <QString>
 #include <QThread>
 #include "dbconnection.h"
@@ -43,14 +51,29 @@ public:
     virtual QMetaType::Type sqlTypeToVariant(int sqlType) const noexcept override;
     virtual void executeAsync(const QString &query, const QVector<QVariant> *params = nullptr) noexcept override;
     virtual bool execute(const QString &query, const QVector<QVariant> *params = nullptr) override;
+    virtual bool executeBatch(const QString &query, const QList<QVector<QVariant>> &rows) override;
     virtual void clarifyTableStructure(DataTable &table) override;
 
 private:
     SQLHENV _henv;
     SQLHDBC _hdbc;
     std::atomic<SQLHSTMT> _hstmt; // to cancel query from another thread
+    bool _async_exec = false;     ///< the driver executes statements asynchronously (SQL_AM_STATEMENT)
+    QMutex _polling_mutex;
+    bool _polling = false;        ///< the worker polls the statement and cancels it itself
     bool checkStmt(RETCODE retcode, SQLHSTMT handle);
     bool check(RETCODE retcode, SQLHANDLE handle, SQLSMALLINT handle_type) const;
+    /*!
+     * \brief fetch resultset by blocks of rows into column-wise bound buffers
+     * \return number of rows fetched or -1 if the resultset must be fetched row by row
+     */
+    int fetchBlocks(SQLHSTMT hstmt, DataTable *table);
+    /*!
+     * \brief SQLExecDirect polled by the worker if the driver supports asynchronous execution
+     *
+     * The statement is cancelled right from the polling thread, so cancel() starts nothing.
+     */
+    RETCODE execDirect(SQLHSTMT hstmt, QByteArray query);
     std::string finalConnectionString() const noexcept;
 };
 
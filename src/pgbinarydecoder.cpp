@@ -0,0 +1,475 @@
+#include "pgbinarydecoder.h"
+#include "columnstorage.h"
+#include "pgtypes.h"
+#include <QtEndian>
+#include <QDateTime>
+#include <QLocale>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <limits>
+
+static const int POSTGRES_EPOCH_JDATE = 2451545; // 2000-01-01
+static const qint64 POSTGRES_EPOCH_MSECS = 946684800000LL; // 2000-01-01 since unix epoch
+static const qint64 USECS_PER_DAY = 86400000000LL;
+
+template <typename T>
+static inline T be(const char *data)
+{
+    return qFromBigEndian<T>(reinterpret_cast<const uchar*>(data));
+}
+
+// julian day to gregorian date (from postgres' j2date())
+static void j2date(int jd, int &year, int &month, int &day)
+{
+    unsigned int julian = unsigned(jd) + 32044;
+    unsigned int quad = julian / 146097;
+    unsigned int extra = (julian - quad * 146097) * 4 + 3;
+    julian += 60 + quad * 3 + extra / 146097;
+    quad = julian / 1461;
+    julian -= quad * 1461;
+    int y = int(julian * 4 / 1461);
+    julian = ((y != 0) ? ((julian + 305) % 365) : ((julian + 306) % 366)) + 123;
+    y += int(quad * 4);
+    year = y - 4800;
+    quad = julian * 2141 / 65536;
+    day = int(julian - 7834 * quad / 256);
+    month = int((quad + 10) % 12 + 1);
+}
+
+// returns true for BC dates
+static bool appendDate(QByteArray &out, int jd)
+{
+    int y, m, d;
+    j2date(jd, y, m, d);
+    bool bc = (y <= 0);
+    char buf[32];
+    int len = std::snprintf(buf, sizeof(buf), "%04d-%02d-%02d", bc ? 1 - y : y, m, d);
+    out.append(buf, len);
+    return bc;
+}
+
+static void appendTime(QByteArray &out, qint64 usecs)
+{
+    int frac = int(usecs % 1000000);
+    qint64 secs = usecs / 1000000;
+    char buf[32];
+    int len = std::snprintf(buf, sizeof(buf), "%02d:%02d:%02d",
+                            int(secs / 3600), int(secs / 60 % 60), int(secs % 60));
+    out.append(buf, len);
+    if (frac)
+    {
+        len = std::snprintf(buf, sizeof(buf), ".%06d", frac);
+        while (buf[len - 1] == '0')
+            --len;
+        out.append(buf, len);
+    }
+}
+
+static QByteArray floatToText(double value, bool isFloat4)
+{
+    if (std::isnan(value))
+        return "NaN";
+    if (std::isinf(value))
+        return value > 0 ? "Infinity" : "-Infinity";
+    QLocale c = QLocale::c();
+    return (isFloat4 ?
+                c.toString(float(value), 'g', QLocale::FloatingPointShortest) :
+                c.toString(value, 'g', QLocale::FloatingPointShortest)).toLatin1();
+}
+
+void PgBinaryDecoder::reset(const char *timeZone, const char *integerDatetimes)
+{
+    _integerDatetimes = (!integerDatetimes || std::strcmp(integerDatetimes, "on") == 0);
+    QByteArray tzName(timeZone);
+    if (tzName != _tzName)
+    {
+        _tzName = tzName;
+        _tz = (tzName.isEmpty() ? QTimeZone() : QTimeZone(tzName));
+    }
+}
+
+int PgBinaryDecoder::arrayElementType(int sqlType) noexcept
+{
+    switch (sqlType)
+    {
+    case BOOLARRAYOID: return BOOLOID;
+    case BYTEAARRAYOID: return BYTEAOID;
+    case CHARARRAYOID: return CHAROID;
+    case NAMEARRAYOID: return NAMEOID;
+    case INT2ARRAYOID: return INT2OID;
+    case INT4ARRAYOID: return INT4OID;
+    case INT8ARRAYOID: return INT8OID;
+    case TEXTARRAYOID: return TEXTOID;
+    case OIDARRAYOID: return OIDOID;
+    case FLOAT4ARRAYOID: return FLOAT4OID;
+    case FLOAT8ARRAYOID: return FLOAT8OID;
+    case BPCHARARRAYOID: return BPCHAROID;
+    case VARCHARARRAYOID: return VARCHAROID;
+    case DATEARRAYOID: return DATEOID;
+    case TIMEARRAYOID: return TIMEOID;
+    case TIMESTAMPARRAYOID: return TIMESTAMPOID;
+    case TIMESTAMPTZARRAYOID: return TIMESTAMPTZOID;
+    case NUMERICARRAYOID: return NUMERICOID;
+    case UUIDARRAYOID: return UUIDOID;
+    case JSONARRAYOID: return JSONOID;
+    case JSONBARRAYOID: return JSONBOID;
+    }
+    return -1;
+}
+
+bool PgBinaryDecoder::canDecode(int sqlType) const noexcept
+{
+    switch (sqlType)
+    {
+    case BOOLOID:
+    case BYTEAOID:
+    case CHAROID:
+    case NAMEOID:
+    case INT2OID:
+    case INT4OID:
+    case INT8OID:
+    case OIDOID:
+    case XIDOID:
+    case CIDOID:
+    case TEXTOID:
+    case JSONOID:
+    case JSONBOID:
+    case XMLOID:
+    case UNKNOWNOID:
+    case FLOAT4OID:
+    case FLOAT8OID:
+    case BPCHAROID:
+    case VARCHAROID:
+    case NUMERICOID:
+    case UUIDOID:
+    case DATEOID:
+        return true;
+    case TIMEOID:
+    case TIMESTAMPOID:
+        return _integerDatetimes;
+    case TIMESTAMPTZOID:
+        // the value is sent in UTC, we have to convert it to the session's time zone
+        return _integerDatetimes && _tz.isValid();
+    }
+    int elementType = arrayElementType(sqlType);
+    return elementType > 0 && canDecode(elementType);
+}
+
+void PgBinaryDecoder::append(ColumnStorage &dst, int sqlType, const char *data, int length) const
+{
+    switch (sqlType)
+    {
+    case INT2OID:
+        dst.appendInt32(be<qint16>(data));
+        break;
+    case INT4OID:
+        dst.appendInt32(be<qint32>(data));
+        break;
+    case INT8OID:
+        dst.appendInt64(be<qint64>(data));
+        break;
+    case OIDOID:
+    case XIDOID:
+    case CIDOID:
+        dst.appendInt64(be<quint32>(data));
+        break;
+    case FLOAT4OID:
+    {
+        quint32 bits = be<quint32>(data);
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        dst.appendFloat(value);
+        break;
+    }
+    case FLOAT8OID:
+    {
+        quint64 bits = be<quint64>(data);
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        dst.appendDouble(value);
+        break;
+    }
+    case BOOLOID:
+        dst.appendBool(length > 0 && data[0]);
+        break;
+    case CHAROID:
+        dst.appendVariant(length > 0 ? QChar(QLatin1Char(data[0])) : QChar(0));
+        break;
+    case TEXTOID:
+    case NAMEOID:
+    case BPCHAROID:
+    case VARCHAROID:
+    case JSONOID:
+    case XMLOID:
+    case UNKNOWNOID:
+        dst.appendString(data, length);
+        break;
+    case JSONBOID:
+        // the first byte is a format version
+        dst.appendString(data + 1, length - 1);
+        break;
+    default:
+    {
+        QByteArray text = toText(sqlType, data, length);
+        dst.appendString(text.constData(), text.size());
+    }
+    }
+}
+
+QByteArray PgBinaryDecoder::toText(int sqlType, const char *data, int length) const
+{
+    switch (sqlType)
+    {
+    case INT2OID:
+        return QByteArray::number(be<qint16>(data));
+    case INT4OID:
+        return QByteArray::number(be<qint32>(data));
+    case INT8OID:
+        return QByteArray::number(be<qint64>(data));
+    case OIDOID:
+    case XIDOID:
+    case CIDOID:
+        return QByteArray::number(be<quint32>(data));
+    case FLOAT4OID:
+    {
+        quint32 bits = be<quint32>(data);
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return floatToText(double(value), true);
+    }
+    case FLOAT8OID:
+    {
+        quint64 bits = be<quint64>(data);
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return floatToText(value, false);
+    }
+    case BOOLOID:
+        return (length > 0 && data[0]) ? "t" : "f";
+    case JSONBOID:
+        return QByteArray(data + 1, length - 1);
+    case BYTEAOID:
+        return "\\x" + QByteArray::fromRawData(data, length).toHex();
+    case NUMERICOID:
+        return numericToText(data, length);
+    case UUIDOID:
+    {
+        QByteArray hex = QByteArray::fromRawData(data, length).toHex();
+        if (hex.size() == 32)
+            hex.insert(20, '-').insert(16, '-').insert(12, '-').insert(8, '-');
+        return hex;
+    }
+    case DATEOID:
+    {
+        qint32 value = be<qint32>(data);
+        if (value == std::numeric_limits<qint32>::max())
+            return "infinity";
+        if (value == std::numeric_limits<qint32>::min())
+            return "-infinity";
+        QByteArray out;
+        if (appendDate(out, value + POSTGRES_EPOCH_JDATE))
+            out += " BC";
+        return out;
+    }
+    case TIMEOID:
+    {
+        QByteArray out;
+        appendTime(out, be<qint64>(data));
+        return out;
+    }
+    case TIMESTAMPOID:
+        return timestampToText(be<qint64>(data), false);
+    case TIMESTAMPTZOID:
+        return timestampToText(be<qint64>(data), true);
+    }
+    if (arrayElementType(sqlType) > 0)
+        return arrayToText(data, length);
+    // text, varchar, char, name, json, xml and so on
+    return QByteArray(data, length);
+}
+
+QByteArray PgBinaryDecoder::numericToText(const char *data, int length) const
+{
+    if (length < 8)
+        return QByteArray();
+    int ndigits = be<qint16>(data);
+    int weight = be<qint16>(data + 2);
+    quint16 sign = be<quint16>(data + 4);
+    int dscale = be<qint16>(data + 6);
+    const char *digits = data + 8;
+    if (length < 8 + ndigits * 2)
+        return QByteArray();
+
+    switch (sign)
+    {
+    case 0xC000:
+        return "NaN";
+    case 0xD000:
+        return "Infinity";
+    case 0xF000:
+        return "-Infinity";
+    }
+
+    // every digit is 0..9999 (NBASE = 10000)
+    auto digit = [digits, ndigits](int i) -> int {
+        return (i >= 0 && i < ndigits ? be<qint16>(digits + i * 2) : 0);
+    };
+    auto append4 = [](QByteArray &out, int dig, int count) {
+        const char d[4] = { char('0' + dig / 1000), char('0' + dig / 100 % 10),
+                            char('0' + dig / 10 % 10), char('0' + dig % 10) };
+        out.append(d, count);
+    };
+
+    QByteArray out;
+    out.reserve((weight + 1) * 4 + dscale + 3);
+    if (sign == 0x4000)
+        out += '-';
+    if (weight < 0)
+        out += '0';
+    else
+    {
+        for (int d = 0; d <= weight; ++d)
+        {
+            if (d)
+                append4(out, digit(d), 4);
+            else
+                out += QByteArray::number(digit(d));
+        }
+    }
+    if (dscale > 0)
+    {
+        out += '.';
+        for (int d = weight + 1, written = 0; written < dscale; ++d, written += 4)
+            append4(out, digit(d), qMin(4, dscale - written));
+    }
+    return out;
+}
+
+QByteArray PgBinaryDecoder::timestampToText(qint64 value, bool withTimeZone) const
+{
+    if (value == std::numeric_limits<qint64>::max())
+        return "infinity";
+    if (value == std::numeric_limits<qint64>::min())
+        return "-infinity";
+
+    int offset = 0;
+    if (withTimeZone)
+    {
+        QDateTime utc = QDateTime::fromMSecsSinceEpoch(value / 1000 + POSTGRES_EPOCH_MSECS, Qt::UTC);
+        offset = _tz.offsetFromUtc(utc);
+        value += qint64(offset) * 1000000;
+    }
+
+    qint64 days = value / USECS_PER_DAY;
+    qint64 time = value % USECS_PER_DAY;
+    if (time < 0)
+    {
+        time += USECS_PER_DAY;
+        --days;
+    }
+
+    QByteArray out;
+    bool bc = appendDate(out, int(days + POSTGRES_EPOCH_JDATE));
+    out += ' ';
+    appendTime(out, time);
+    if (withTimeZone)
+    {
+        // +hh[:mm[:ss]] like the server does
+        int abs = qAbs(offset);
+        char buf[16];
+        int len = std::snprintf(buf, sizeof(buf), "%c%02d", offset < 0 ? '-' : '+', abs / 3600);
+        if (abs % 3600)
+        {
+            len += std::snprintf(buf + len, sizeof(buf) - size_t(len), ":%02d", abs / 60 % 60);
+            if (abs % 60)
+                len += std::snprintf(buf + len, sizeof(buf) - size_t(len), ":%02d", abs % 60);
+        }
+        out.append(buf, len);
+    }
+    if (bc)
+        out += " BC";
+    return out;
+}
+
+QByteArray PgBinaryDecoder::arrayToText(const char *data, int length) const
+{
+    // ndim, has null flag, element type, (dimension size, lower bound) for every dimension
+    if (length < 12)
+        return "{}";
+    const char *end = data + length;
+    int ndim = be<qint32>(data);
+    int elementType = be<qint32>(data + 8);
+    const char *p = data + 12;
+    if (ndim <= 0 || end - p < ndim * 8)
+        return "{}";
+
+    std::vector<int> dims(size_t(ndim), 0);
+    QByteArray bounds;
+    bool defaultBounds = true;
+    for (size_t i = 0; i < dims.size(); ++i, p += 8)
+    {
+        dims[i] = be<qint32>(p);
+        int lbound = be<qint32>(p + 4);
+        bounds += '[' + QByteArray::number(lbound) + ':' + QByteArray::number(lbound + dims[i] - 1) + ']';
+        defaultBounds = defaultBounds && lbound == 1;
+    }
+
+    QByteArray out;
+    // bounds are printed out only if any of them differs from the default one
+    if (!defaultBounds)
+        out = bounds + '=';
+    appendArrayLevel(out, elementType, 0, dims, p, end);
+    return out;
+}
+
+void PgBinaryDecoder::appendArrayLevel(QByteArray &out, int elementType, size_t level,
+                                       const std::vector<int> &dims, const char *&data, const char *end) const
+{
+    out += '{';
+    for (int i = 0; i < dims[level]; ++i)
+    {
+        if (i)
+            out += ',';
+        if (level + 1 < dims.size())
+        {
+            appendArrayLevel(out, elementType, level + 1, dims, data, end);
+            continue;
+        }
+        if (end - data < 4)
+            break;
+        int len = be<qint32>(data);
+        data += 4;
+        if (len < 0)
+        {
+            out += "NULL";
+            continue;
+        }
+        if (end - data < len)
+            break;
+        QByteArray value = toText(elementType, data, len);
+        data += len;
+
+        bool quote = value.isEmpty() || qstricmp(value.constData(), "NULL") == 0;
+        for (int k = 0; !quote && k < value.size(); ++k)
+        {
+            char c = value.at(k);
+            quote = (c == '"' || c == '\\' || c == '{' || c == '}' || c == ',' ||
+                     c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f');
+        }
+        if (!quote)
+        {
+            out += value;
+            continue;
+        }
+        out += '"';
+        for (char c: value)
+        {
+            if (c == '"' || c == '\\')
+                out += '\\';
+            out += c;
+        }
+        out += '"';
+    }
+    out += '}';
+}
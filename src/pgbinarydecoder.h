@@ -0,0 +1,46 @@
+#ifndef PGBINARYDECODER_H
+#define PGBINARYDECODER_H
+
+#include <QByteArray>
+#include <QTimeZone>
+#include <vector>
+
+class ColumnStorage;
+
+/*!
+ * \brief Decoder of PostgreSQL binary result format.
+ * Numeric and boolean values are stored natively, others are converted
+ * to the same textual representation the server would send in text mode.
+ */
+class PgBinaryDecoder
+{
+public:
+    /*!
+     * \brief takes into account session parameters affecting values representation
+     */
+    void reset(const char *timeZone, const char *integerDatetimes);
+    /*!
+     * \brief determine if values of sqlType may be requested in binary format
+     */
+    bool canDecode(int sqlType) const noexcept;
+    void append(ColumnStorage &dst, int sqlType, const char *data, int length) const;
+    /*!
+     * \brief utf-8 textual representation of a value
+     */
+    QByteArray toText(int sqlType, const char *data, int length) const;
+
+    static int arrayElementType(int sqlType) noexcept;
+
+private:
+    bool _integerDatetimes = true;
+    QByteArray _tzName;
+    QTimeZone _tz;
+
+    QByteArray numericToText(const char *data, int length) const;
+    QByteArray timestampToText(qint64 value, bool withTimeZone) const;
+    QByteArray arrayToText(const char *data, int length) const;
+    void appendArrayLevel(QByteArray &out, int elementType, size_t level,
+                          const std::vector<int> &dims, const char *&data, const char *end) const;
+};
+
+#endif // PGBINARYDECODER_H
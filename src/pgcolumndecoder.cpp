@@ -0,0 +1,194 @@
+#include "pgcolumndecoder.h"
+#include "pgbinarydecoder.h"
+#include "columnstorage.h"
+#include "datatable.h"
+#include "pgtypes.h"
+#include "pgconnection.h"
+#include <QtEndian>
+#include <QChar>
+#include <QVariant>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+
+typedef const PgColumnDecoder Self;
+
+inline void store(ColumnStorage &dst, qint32 value) { dst.appendInt32(value); }
+inline void store(ColumnStorage &dst, qint64 value) { dst.appendInt64(value); }
+inline void store(ColumnStorage &dst, float value) { dst.appendFloat(value); }
+inline void store(ColumnStorage &dst, double value) { dst.appendDouble(value); }
+
+/*!
+ * \brief integer of the server's textual representation (the length is known, so no delimiter is looked for)
+ */
+template <typename T>
+inline T parseInteger(const char *data, int length) noexcept
+{
+    // the sign is applied without branching: (v ^ -1) + 1 == -v
+    const quint64 negative = (length > 0 && data[0] == '-');
+    const char *p = data + negative;
+    const char *end = data + length;
+    quint64 value = 0;
+    while (p < end)
+        value = value * 10 + quint64(*p++ - '0');
+    return T(qint64((value ^ (0 - negative)) + negative));
+}
+
+template <typename T>
+void textInteger(Self &, int, ColumnStorage &dst, const char *data, int length)
+{
+    store(dst, parseInteger<T>(data, length));
+}
+
+template <typename T>
+void textFloat(Self &, int, ColumnStorage &dst, const char *data, int)
+{
+    // NaN, Infinity and so on are parsed too
+    store(dst, T(std::atof(data)));
+}
+
+void textBool(Self &, int, ColumnStorage &dst, const char *data, int)
+{
+    dst.appendBool(data[0] == 't');
+}
+
+void textChar(Self &, int, ColumnStorage &dst, const char *data, int)
+{
+    if (!data[0])
+        dst.appendVariant(QChar(0));
+    else
+        dst.appendVariant(QString::fromUtf8(data).at(0));
+}
+
+void textString(Self &, int, ColumnStorage &dst, const char *data, int length)
+{
+    dst.appendString(data, length);
+}
+
+template <typename T>
+inline T be(const char *data) noexcept
+{
+    return qFromBigEndian<T>(reinterpret_cast<const uchar*>(data));
+}
+
+template <typename Wire, typename T>
+void binaryInteger(Self &, int, ColumnStorage &dst, const char *data, int)
+{
+    store(dst, T(be<Wire>(data)));
+}
+
+template <typename Bits, typename T>
+void binaryFloat(Self &, int, ColumnStorage &dst, const char *data, int)
+{
+    Bits bits = be<Bits>(data);
+    T value;
+    static_assert(sizeof(bits) == sizeof(value), "float size mismatch");
+    std::memcpy(&value, &bits, sizeof(value));
+    store(dst, value);
+}
+
+void binaryBool(Self &, int, ColumnStorage &dst, const char *data, int length)
+{
+    dst.appendBool(length > 0 && data[0]);
+}
+
+void binaryJsonb(Self &, int, ColumnStorage &dst, const char *data, int length)
+{
+    // the first byte is a format version
+    dst.appendString(data + 1, length - 1);
+}
+
+}
+
+PgColumnDecoder::DecodeFn PgColumnDecoder::textDecoder(int sqlType, bool truncated) noexcept
+{
+    switch (sqlType)
+    {
+    case INT2OID:
+    case INT4OID:
+        return &textInteger<qint32>;
+    case INT8OID:
+        return &textInteger<qint64>;
+    case FLOAT4OID:
+    case FLOAT8OID:
+        return &textFloat<double>;
+    case BOOLOID:
+        return &textBool;
+    case CHAROID:
+        return &textChar;
+    }
+    // QDate/QTime/QDateTime lack special values and microseconds, so dates and times
+    // keep their original textual representation like any other type
+    return (truncated ? &PgColumnDecoder::textLong : &textString);
+}
+
+PgColumnDecoder::DecodeFn PgColumnDecoder::binaryDecoder(int sqlType) noexcept
+{
+    switch (sqlType)
+    {
+    case INT2OID:
+        return &binaryInteger<qint16, qint32>;
+    case INT4OID:
+        return &binaryInteger<qint32, qint32>;
+    case INT8OID:
+        return &binaryInteger<qint64, qint64>;
+    case OIDOID:
+    case XIDOID:
+    case CIDOID:
+        return &binaryInteger<quint32, qint64>;
+    case FLOAT4OID:
+        return &binaryFloat<quint32, float>;
+    case FLOAT8OID:
+        return &binaryFloat<quint64, double>;
+    case BOOLOID:
+        return &binaryBool;
+    case TEXTOID:
+    case NAMEOID:
+    case BPCHAROID:
+    case VARCHAROID:
+    case JSONOID:
+    case XMLOID:
+    case UNKNOWNOID:
+        return &textString;
+    case JSONBOID:
+        return &binaryJsonb;
+    }
+    return &PgColumnDecoder::binaryAny;
+}
+
+void PgColumnDecoder::prepare(const DataTable &table, bool binary, const PgBinaryDecoder *binaryDecoder,
+                              int longValue, std::function<std::shared_ptr<SpillFile>()> longValues)
+{
+    _table = &table;
+    _binary = binary;
+    _binary_decoder = binaryDecoder;
+    _long_value = longValue;
+    _long_values = longValues;
+    _columns.resize(size_t(table.columnCount()));
+    for (int i = 0; i < table.columnCount(); ++i)
+    {
+        int type = table.getColumn(i).sqlType();
+        _columns[size_t(i)] = { binary ? PgColumnDecoder::binaryDecoder(type) : textDecoder(type, longValue > 0), type };
+    }
+}
+
+void PgColumnDecoder::textLong(const PgColumnDecoder &self, int, ColumnStorage &dst, const char *data, int length)
+{
+    if (length > self._long_value)
+    {
+        std::shared_ptr<SpillFile> file = self._long_values();
+        if (file)
+        {
+            dst.appendTruncated(data, length, PG_LONG_VALUE_PREFIX, file);
+            return;
+        }
+    }
+    dst.appendString(data, length);
+}
+
+void PgColumnDecoder::binaryAny(const PgColumnDecoder &self, int sqlType, ColumnStorage &dst, const char *data, int length)
+{
+    self._binary_decoder->append(dst, sqlType, data, length);
+}
@@ -0,0 +1,64 @@
+#ifndef PGCOLUMNDECODER_H
+#define PGCOLUMNDECODER_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+class ColumnStorage;
+class DataTable;
+class PgBinaryDecoder;
+class SpillFile;
+
+/*!
+ * \brief Decoders of the columns of a resultset chosen once per resultset.
+ *
+ * Every column gets a function specialized for its type and the result format,
+ * so the fetch loop calls it for the cells without looking at the types.
+ * Types without a specialized decoder are passed to PgBinaryDecoder (binary format)
+ * or kept as text.
+ */
+class PgColumnDecoder
+{
+public:
+    /*!
+     * \param longValue textual values longer than that are truncated, 0 to keep them whole
+     * \param longValues temporary file for the whole values, nullptr if it can't be created
+     */
+    void prepare(const DataTable &table, bool binary, const PgBinaryDecoder *binaryDecoder,
+                 int longValue, std::function<std::shared_ptr<SpillFile>()> longValues);
+    /*!
+     * \brief the table prepare() is called for (the decoders are valid for its resultset)
+     */
+    const DataTable* table() const noexcept { return _table; }
+    bool binary() const noexcept { return _binary; }
+    /*!
+     * \brief append not null value of the column to dst
+     */
+    void decode(int column, ColumnStorage &dst, const char *data, int length) const
+    {
+        const Column &c = _columns[size_t(column)];
+        c.decode(*this, c.sqlType, dst, data, length);
+    }
+
+private:
+    typedef void (*DecodeFn)(const PgColumnDecoder &self, int sqlType, ColumnStorage &dst, const char *data, int length);
+    struct Column
+    {
+        DecodeFn decode;
+        int sqlType;
+    };
+    static DecodeFn textDecoder(int sqlType, bool truncated) noexcept;
+    static DecodeFn binaryDecoder(int sqlType) noexcept;
+    static void textLong(const PgColumnDecoder &self, int sqlType, ColumnStorage &dst, const char *data, int length);
+    static void binaryAny(const PgColumnDecoder &self, int sqlType, ColumnStorage &dst, const char *data, int length);
+
+    const DataTable *_table = nullptr;
+    bool _binary = false;
+    const PgBinaryDecoder *_binary_decoder = nullptr;
+    int _long_value = 0;
+    std::function<std::shared_ptr<SpillFile>()> _long_values;
+    std::vector<Column> _columns;
+};
+
+#endif // PGCOLUMNDECODER_H
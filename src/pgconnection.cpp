@@ -5,8 +5,15 @@
 #include <QTextStream>
 #include <QSocketNotifier>
 #include <QRegularExpression>
-#include <QThread>
+#include <QTimer>
+#include <cstring>
 #include "settings.h"
+#include "sqlparser.h"
+#include "pgsessionpool.h"
+#include "pgtypemap.h"
+#include "executionservice.h"
+#include "spillfile.h"
+#include "trace.h"
 
 PgConnection::PgConnection() :
     DbConnection(), _readNotifier(nullptr), _writeNotifier(nullptr), _temp_result(nullptr), _temp_result_rowcount(0)
@@ -17,6 +24,7 @@ PgConnection::PgConnection() :
 
 PgConnection::~PgConnection()
 {
+    closeCursors();
     if (_temp_result)
     {
         delete _temp_result;
@@ -46,7 +54,15 @@ bool PgConnection::open()
         close();
     }
 
-    _conn = PQconnectdb(finalConnectionString().c_str());
+    QString pool_error;
+    _pool_conninfo = finalConnectionString();
+    if (!PgSessionPool::instance().acquire(_pool_conninfo, _connection_string, _conn, pool_error))
+    {
+        emit error(pool_error);
+        return false;
+    }
+    if (!_conn)
+        _conn = PQconnectdb(_pool_conninfo.c_str());
     if (PQstatus(_conn) != CONNECTION_OK)
     {
         // man: "...a nonempty PQerrorMessage result can consist of multiple lines, and will include a trailing newline.
@@ -54,10 +70,12 @@ bool PgConnection::open()
         emit error(PQerrorMessage(_conn));
         PQfinish(_conn);
         _conn = nullptr;
+        PgSessionPool::instance().discard(_connection_string);
         return false;
     }
 
     _dbmsScriptingID = dbmsName() + dbmsVersion();
+    types()->preload(_pool_conninfo, _connection_string);
 
     // _database is initially empty within 'connection' node
     // (used to display current context (no need to set it in async method)
@@ -96,7 +114,23 @@ void PgConnection::openAsync() noexcept
     //time(&_connection_start_moment);
     //_last_try = _connection_start_moment;
 
-    _conn = PQconnectStart(finalConnectionString().c_str());
+    QString pool_error;
+    _pool_conninfo = finalConnectionString();
+    if (!PgSessionPool::instance().acquire(_pool_conninfo, _connection_string, _conn, pool_error))
+    {
+        setQueryState(QueryState::Inactive);
+        emit error(pool_error);
+        return;
+    }
+    // warm session from the pool needs no handshake
+    if (_conn)
+    {
+        lk.unlock();
+        connectionEstablished();
+        return;
+    }
+
+    _conn = PQconnectStart(_pool_conninfo.c_str());
     if (PQstatus(_conn) == CONNECTION_BAD)
     {
         // connection failed
@@ -107,6 +141,7 @@ void PgConnection::openAsync() noexcept
             PQfinish(_conn);
             _conn = nullptr;
         }
+        PgSessionPool::instance().discard(_connection_string);
         return;
     }
     _async_stage = async_stage::connecting;
@@ -124,7 +159,12 @@ void PgConnection::close() noexcept
     if (!_conn)
         return;
 
-    PQfinish(_conn);
+    // statements are deallocated along with the session (or by DISCARD ALL within the pool)
+    _prepared.clear();
+    // the database may be changed before the next connection
+    _types.reset();
+    // broken or busy session is closed by the pool, otherwise it's reset for reuse
+    PgSessionPool::instance().release(_conn, _pool_conninfo, _connection_string);
     _conn = nullptr;
 }
 
@@ -252,6 +292,23 @@ int PgConnection::dbmsComparableVersion()
     return res ? res : 0x7fffffff;
 }
 
+bool PgConnection::longValues()
+{
+    if (_long_values)
+        return true;
+    std::shared_ptr<SpillFile> file = std::make_shared<SpillFile>();
+    QString error;
+    if (!file->open(error))
+        return false;
+    _long_values = file;
+    return true;
+}
+
+std::string PgConnection::conninfo() const noexcept
+{
+    return finalConnectionString();
+}
+
 std::string PgConnection::finalConnectionString() const noexcept
 {
     QString res = "application_name=sqt " + _connection_string;
@@ -345,26 +402,75 @@ void PgConnection::executeAsync(const QString &query, const QVector<QVariant> *p
         return;
     }
 
-    auto run_query = [this, query, params]()
+    auto run_query = [this]()
     {
         QMutexLocker lk(&_connectionGuard);
         bool was_in_transaction = (PQtransactionStatus(_conn) == PQTRANS_INTRANS);
         _async_stage = async_stage::sending_query;
+        // values truncated by the previous query stay with its grids
+        _long_values.reset();
+        markTiming(_timings.acquire);
         setQueryState(QueryState::Running);
 
-        if (!query.isEmpty())
+        int async_sent_ok = 0;
+        bool sent = false;
+        if (!_send_error.isEmpty())
         {
-            _query_tmp = query;
-            _params_tmp.clear();
-            if (params)
-            {
-                for (const QVariant &v: *params)
-                    _params_tmp.add(v);
-            }
+            // the transaction is aborted already, so report the reason
+            QString message = _send_error;
+            _send_error.clear();
+            _send_prepared = false;
+            lk.unlock();
+            _async_stage = async_stage::none;
+            emit error(message);
+            setQueryState(QueryState::Inactive);
+            return;
+        }
+        if (_conn && _send_prepared)
+        {
+            async_sent_ok = PQsendQueryPrepared(_conn, _send_statement.c_str(),
+                                                static_cast<int>(_params_tmp.count()),
+                                                _params_tmp.values(),
+                                                _params_tmp.lengths(),
+                                                nullptr,
+                                                _send_format);
+            sent = true;
         }
+        _send_prepared = false;
+        _prepare_next = false;
+
+        int chunk_size = SqtSettings::value("pgChunkSize", 0).toInt();
+        // an export is always streamed, the whole resultset is never buffered by libpq
+        bool exporting = isExporting();
+#ifdef LIBPQ_HAS_CHUNK_MODE
+        if (exporting && chunk_size <= 1)
+            chunk_size = PG_EXPORT_CHUNK_ROWS;
+#endif
+        _cursor_stage = cursor_stage::none;
+#ifndef LIBPQ_HAS_CHUNK_MODE
+        // Chunked rows mode is not available before libpq 17, so use server-side cursor
+        // to fetch a plain select by chunks.
+        int statement_length;
+        QString keyword;
+        if (_conn && !sent && chunk_size > 1 && !_params_tmp.count() &&
+                SqlParser::isSingleDataStatement(_query_tmp, &statement_length, &keyword) &&
+                keyword != "insert" && keyword != "update" && keyword != "delete")
+        {
+            QString chunked_query = (was_in_transaction ? "" : "begin;\n") +
+                    QString("declare sqt_chunked no scroll cursor for\n") +
+                    _query_tmp.left(statement_length) +
+                    QString("\n;fetch forward %1 from sqt_chunked").arg(chunk_size);
+            async_sent_ok = PQsendQuery(_conn, chunked_query.toStdString().c_str());
+            sent = true;
+            _cursor_stage = cursor_stage::fetching;
+            _cursor_chunk_size = chunk_size;
+            _cursor_own_transaction = !was_in_transaction;
+            _cursor_failed = false;
+            _cursor_last_rows = 0;
+        }
+#endif
 
-        int async_sent_ok = 0;
-        if (_conn)
+        if (_conn && !sent)
         {
             async_sent_ok = _params_tmp.count() ?
                         PQsendQueryParams(_conn,
@@ -377,11 +483,20 @@ void PgConnection::executeAsync(const QString &query, const QVector<QVariant> *p
                                           0) :
                         PQsendQuery(_conn, _query_tmp.toStdString().c_str());
 
+            //_last_action_moment = chrono::system_clock::now();
+        }
+
+        if (async_sent_ok && _cursor_stage == cursor_stage::none)
+        {
+#ifdef LIBPQ_HAS_CHUNK_MODE
+            // chunked rows mode supersedes single row mode
+            if (chunk_size > 1)
+                PQsetChunkedRowsMode(_conn, chunk_size);
+            else
+#endif
             // Single row mode prevents resultset from being discarded on error during fetching.
-            if (async_sent_ok && SqtSettings::value("pgSingleRowMode", false).toBool())
+            if (exporting || SqtSettings::value("pgSingleRowMode", false).toBool())
                 PQsetSingleRowMode(_conn);
-
-            //_last_action_moment = chrono::system_clock::now();
         }
 
         // disconnected or connection broken => reconnect and try again
@@ -416,6 +531,7 @@ void PgConnection::executeAsync(const QString &query, const QVector<QVariant> *p
                 if (!res)
                 {
                     _async_stage = async_stage::wait_ready_read;
+                    markTiming(_timings.sent);
                     watchSocket(SocketWatchMode::Read);
                 }
                 else
@@ -435,63 +551,179 @@ void PgConnection::executeAsync(const QString &query, const QVector<QVariant> *p
         return;
     }
 
+    _connectionGuard.lock();
+    _query_tmp = query;
+    _params_tmp.clear();
+    if (params)
+    {
+        for (const QVariant &v: *params)
+            _params_tmp.add(v);
+    }
+    // statements are prepared by the blocking libpq api, so not on the shared I/O thread
+    bool prepare = (_conn && (_prepare_next || SqtSettings::value("pgBinaryFormat", false).toBool()) &&
+                    SqlParser::isSingleDataStatement(_query_tmp));
+    _connectionGuard.unlock();
+
     clearResultsets();
     // delete listeners before switch to another thread
     watchSocket(SocketWatchMode::None);
 
     // Massively data fetching query freezes ui, so we want to run it in
     // separate thread. Asynchronous libpq API is used for the sake of
-    // opportunities it provides.
-    QThread* thread = new QThread();
-    connect(thread, &QThread::started, thread, [this, run_query, thread]() {
-        // kill query by means of appropriate signal
-        connect(this, &PgConnection::closeConnectionWanted, thread, [this]() {
-            QMutexLocker lk(&_connectionGuard);
-            if (!_conn)
-                return;
-            close();
-            emit error(tr("connection closed"));
-            setQueryState(QueryState::Inactive);
-        }, Qt::QueuedConnection);
-
-        // stop event loop on inactive query state
-        connect(this, &PgConnection::queryStateChanged, thread, [this, thread](QueryState state) {
-            if (state == QueryState::Inactive)
+    // opportunities it provides: sockets of all the queries are watched by the shared I/O thread.
+    // Handlers must be invoked within the thread, so socket notifiers are created there
+    // and libpq results are decoded there.
+    QObject *worker = new QObject();
+    worker->moveToThread(ExecutionService::instance().ioThread());
+    // the query may finish either right away or by the queued state change
+    std::shared_ptr<bool> finished = std::make_shared<bool>(false);
+    auto finish = [this, worker, finished]() {
+        if (*finished)
+            return;
+        *finished = true;
+        worker->deleteLater();
+        auto complete = [this]() {
+            // read socket on gui thread to receive notifications
+            QMetaObject::invokeMethod(this, "watchSocket", Qt::QueuedConnection, Q_ARG(int, SocketWatchMode::Read));
+
+            // https://www.postgresql.org/message-id/CAOYf6ec-TmRYjKBXLLaGaB-jrd=mjG1Hzn1a1wufUAR39PQYhw@mail.gmail.com
+
+            emit queryFinished();
+        };
+        _connectionGuard.lock();
+        bool aborted = (PQtransactionStatus(_conn) == PQTRANS_INERROR);
+        _connectionGuard.unlock();
+        if (!aborted)
+        {
+            complete();
+            return;
+        }
+        // autorollback waits for the server, so not on the shared I/O thread
+        ExecutionService::instance().runStatement([this, complete]() {
             {
-                for (auto res: _resultsets)
-                    clarifyTableStructure(*res);
-                // delete listeners before switch to another thread
                 QMutexLocker lk(&_connectionGuard);
-                watchSocket(SocketWatchMode::None);
-                thread->quit();
+                if (PQtransactionStatus(_conn) == PQTRANS_INERROR)
+                    PQclear(PQexec(_conn, "rollback"));
             }
-        }, Qt::QueuedConnection);
+            complete();
+        });
+    };
+    _timer.start();
+    startTimings();
+    auto start = [this, run_query, worker, finish]() {
+        QMetaObject::invokeMethod(worker, [this, run_query, worker, finish]() {
+            // kill query by means of appropriate signal
+            connect(this, &PgConnection::closeConnectionWanted, worker, [this]() {
+                QMutexLocker lk(&_connectionGuard);
+                if (!_conn)
+                    return;
+                close();
+                emit error(tr("connection closed"));
+                setQueryState(QueryState::Inactive);
+            }, Qt::QueuedConnection);
 
-        run_query();
+            // stop watching on inactive query state
+            connect(this, &PgConnection::queryStateChanged, worker, [this, finish](QueryState state) {
+                if (state == QueryState::Inactive)
+                {
+                    for (auto res: _resultsets)
+                        clarifyTableStructure(*res);
+                    // delete listeners before switch to another thread
+                    {
+                        QMutexLocker lk(&_connectionGuard);
+                        watchSocket(SocketWatchMode::None);
+                    }
+                    finish();
+                }
+            }, Qt::QueuedConnection);
 
-        if (_query_state == QueryState::Inactive)
-            // man: If the eventloop in QThread::exec() is not running then
-            // the next call to QThread::exec() will also return immediately.
-            // (next to this handler Qt will call exec())
-            thread->exit();
-    });
-    connect(thread, &QThread::finished, [this, thread]() {
-        thread->deleteLater();
-        // autorollback
-        QMutexLocker lk(&_connectionGuard);
-        if (PQtransactionStatus(_conn) == PQTRANS_INERROR)
-            PQclear(PQexec(_conn, "rollback"));
-        // read socket on gui thread to receive notifications
-        QMetaObject::invokeMethod(this, "watchSocket", Qt::QueuedConnection, Q_ARG(int, SocketWatchMode::Read));
+            run_query();
 
-        // https://www.postgresql.org/message-id/CAOYf6ec-TmRYjKBXLLaGaB-jrd=mjG1Hzn1a1wufUAR39PQYhw@mail.gmail.com
+            if (_query_state == QueryState::Inactive)
+                finish();
+        }, Qt::QueuedConnection);
+    };
 
-        emit queryFinished();
+    if (!prepare)
+    {
+        start();
+        return;
+    }
+    setQueryState(QueryState::Running);
+    ExecutionService::instance().runStatement([this, start]() {
+        prepareAsyncQuery();
+        start();
     });
-    _timer.start();
-    thread->start();
 }
 
+void PgConnection::prepareAsyncQuery()
+{
+    QMutexLocker lk(&_connectionGuard);
+    bool was_in_transaction = (PQtransactionStatus(_conn) == PQTRANS_INTRANS);
+    _send_prepared = false;
+    _send_error.clear();
+    std::string query_str = _query_tmp.toStdString();
+    int params_count = static_cast<int>(_params_tmp.count());
+    if (SqtSettings::value("pgBinaryFormat", false).toBool())
+    {
+        // Binary format is requested only if every column of the resultset may be decoded,
+        // so the statement is prepared first to find out the columns types.
+        std::unique_ptr<PGresult,decltype(&PQclear)> prepared(
+                    PQprepare(_conn, "", query_str.c_str(), params_count, nullptr), PQclear);
+        if (PQresultStatus(prepared.get()) == PGRES_COMMAND_OK)
+        {
+            std::unique_ptr<PGresult,decltype(&PQclear)> descr(PQdescribePrepared(_conn, ""), PQclear);
+            int nfields = PQresultStatus(descr.get()) == PGRES_COMMAND_OK ? PQnfields(descr.get()) : 0;
+            _binary_decoder.reset(PQparameterStatus(_conn, "TimeZone"),
+                                  PQparameterStatus(_conn, "integer_datetimes"));
+            _send_format = nfields ? 1 : 0;
+            for (int i = 0; i < nfields && _send_format; ++i)
+            {
+                if (!_binary_decoder.canDecode(int(PQftype(descr.get(), i))))
+                    _send_format = 0;
+            }
+            _send_statement.clear();
+            _send_prepared = true;
+            return;
+        }
+        if (was_in_transaction && PQstatus(_conn) != CONNECTION_BAD)
+        {
+            _send_error = PQresultErrorMessage(prepared.get());
+            return;
+        }
+        // otherwise let the server report the error in a regular way
+    }
+
+    if (_prepare_next)
+    {
+        // repeatedly executed (watched) query is parsed and planned once per session
+        PGresult *prepare_error = nullptr;
+        std::string name = preparedStatement(_query_tmp, params_count, prepare_error);
+        if (!name.empty())
+        {
+            _send_statement = name;
+            _send_format = 0;
+            _send_prepared = true;
+        }
+        else
+            // let the server report the error in a regular way
+            PQclear(prepare_error);
+    }
+}
+
+#ifdef LIBPQ_HAS_PIPELINING
+// COPY is not allowed within a pipeline
+static bool pipelineAllowed(const QStringList &queries)
+{
+    for (const QString &query: queries)
+    {
+        if (SqlParser::firstKeyword(query) == "copy")
+            return false;
+    }
+    return true;
+}
+#endif
+
 bool PgConnection::execute(const QString &query, const QVector<QVariant> *params)
 {
     // save transaction status to avoid reconnects within transaction
@@ -503,6 +735,9 @@ bool PgConnection::execute(const QString &query, const QVector<QVariant> *params
     }
 
     bool was_in_transaction = (initial_state == PQTRANS_INTRANS);
+    // cancel request of the previous synchronous query is over, the next one may be cancelled again
+    if (_query_state == QueryState::Cancelling)
+        setQueryState(QueryState::Inactive);
     clearResultsets();
     _temp_result_rowcount = 0;
     // suspend external socket watcher
@@ -521,16 +756,28 @@ bool PgConnection::execute(const QString &query, const QVector<QVariant> *params
         PGresult *raw_tmp_res = nullptr;
         if (_conn)
         {
-            raw_tmp_res = _params_tmp.count() ?
-                        PQexecParams(_conn,
-                                     query.toStdString().c_str(),
-                                     static_cast<int>(_params_tmp.count()),
-                                     nullptr,
-                                     _params_tmp.values(),
-                                     _params_tmp.lengths(),
-                                     nullptr,
-                                     0) :
-                        PQexec(_conn, query.toStdString().c_str());
+            if (_params_tmp.count())
+            {
+                // repeated catalogue queries are parsed and planned once per session
+                int params_count = static_cast<int>(_params_tmp.count());
+                std::string name = preparedStatement(query, params_count, raw_tmp_res);
+                if (!name.empty())
+                {
+                    raw_tmp_res = PQexecPrepared(_conn, name.c_str(), params_count,
+                                                 _params_tmp.values(), _params_tmp.lengths(), nullptr, 0);
+                    // statement deallocated by the user (DEALLOCATE, DISCARD) => prepare it again
+                    const char *state = PQresultErrorField(raw_tmp_res, PG_DIAG_SQLSTATE);
+                    if (state && !strcmp(state, "26000") && !was_in_transaction)
+                    {
+                        PQclear(raw_tmp_res);
+                        raw_tmp_res = nullptr;
+                        _prepared.clear();
+                        continue;
+                    }
+                }
+            }
+            else
+                raw_tmp_res = PQexec(_conn, query.toStdString().c_str());
             //_last_action_moment = chrono::system_clock::now();
         }
         std::unique_ptr<PGresult,decltype(&PQclear)> tmp_res(raw_tmp_res, PQclear);
@@ -566,8 +813,9 @@ bool PgConnection::execute(const QString &query, const QVector<QVariant> *params
             QMutexLocker lk(&_resultsetsGuard);
             _resultsets.append(table);
             lk.unlock();
-            int rows_fetched = appendRawDataToTable(*table, raw_tmp_res);
-            if (!rows_fetched || rows_fetched % FETCH_COUNT_NOTIFY != 0)
+            startFetchNotifications();
+            appendRawDataToTable(*table, raw_tmp_res);
+            if (fetchNotificationPending())
                 emit fetched(table);
         }
 
@@ -580,6 +828,248 @@ bool PgConnection::execute(const QString &query, const QVector<QVariant> *params
     return true;
 }
 
+bool PgConnection::executePipeline(const QStringList &queries, const QList<QVector<QVariant>> &params)
+{
+#ifdef LIBPQ_HAS_PIPELINING
+    if (queries.size() < 2 || !pipelineAllowed(queries))
+        return DbConnection::executePipeline(queries, params);
+
+    // save transaction status to avoid reconnects within transaction
+    PGTransactionStatusType initial_state = PQtransactionStatus(_conn);
+    if (initial_state == PQTRANS_ACTIVE)
+    {
+        emit message(tr("another command is already in progress\n"));
+        return false;
+    }
+
+    bool was_in_transaction = (initial_state == PQTRANS_INTRANS);
+    clearResultsets();
+    _temp_result_rowcount = 0;
+    // suspend external socket watcher
+    watchSocket(SocketWatchMode::None);
+
+    _timer.start();
+    do
+    {
+        // all the statements are sent before the server is asked to reply
+        bool sent = (_conn && PQenterPipelineMode(_conn));
+        for (int i = 0; sent && i < queries.size(); ++i)
+        {
+            _params_tmp.clear();
+            if (i < params.size())
+            {
+                for (const QVariant &v: params.at(i))
+                    _params_tmp.add(v);
+            }
+            sent = PQsendQueryParams(_conn,
+                                     queries.at(i).toStdString().c_str(),
+                                     static_cast<int>(_params_tmp.count()),
+                                     nullptr,
+                                     _params_tmp.values(),
+                                     _params_tmp.lengths(),
+                                     nullptr,
+                                     0);
+        }
+        sent = sent && PQpipelineSync(_conn);
+
+        QString error_message;
+        if (sent)
+        {
+            // results of every statement are terminated by nullptr,
+            // statements following the failed one are reported as PGRES_PIPELINE_ABORTED
+            for (int i = 0; i < queries.size(); ++i)
+            {
+                while (PGresult *raw_tmp_res = PQgetResult(_conn))
+                {
+                    std::unique_ptr<PGresult,decltype(&PQclear)> tmp_res(raw_tmp_res, PQclear);
+                    ExecStatusType status = PQresultStatus(raw_tmp_res);
+                    if (status == PGRES_TUPLES_OK)
+                    {
+                        DataTable *table = new DataTable();
+                        QMutexLocker lk(&_resultsetsGuard);
+                        _resultsets.append(table);
+                        lk.unlock();
+                        startFetchNotifications();
+                        appendRawDataToTable(*table, raw_tmp_res);
+                        if (fetchNotificationPending())
+                            emit fetched(table);
+                    }
+                    else if (status == PGRES_FATAL_ERROR && error_message.isEmpty())
+                        error_message = PQresultErrorMessage(raw_tmp_res);
+                }
+            }
+            // PGRES_PIPELINE_SYNC
+            PQclear(PQgetResult(_conn));
+            PQexitPipelineMode(_conn);
+        }
+
+        // disconnected or connection broken => reconnect and try again
+        if (PQstatus(_conn) == CONNECTION_BAD)
+        {
+            if (_conn)
+            {
+                emit error(PQerrorMessage(_conn));
+                close();
+            }
+            clearResultsets();
+            if (was_in_transaction || !open())
+                return false;
+            continue;
+        }
+
+        // unable to leave pipeline mode in a consistent state
+        if (!sent)
+        {
+            emit error(PQerrorMessage(_conn));
+            close();
+            return false;
+        }
+
+        fetchNotifications();
+
+        // restore watching socket to receive notifications
+        watchSocket(SocketWatchMode::Read);
+        if (!error_message.isEmpty())
+        {
+            emit error(error_message);
+            return false;
+        }
+        break;
+    }
+    while (true);
+
+    return true;
+#else
+    return DbConnection::executePipeline(queries, params);
+#endif
+}
+
+bool PgConnection::executeBatch(const QString &query, const QList<QVector<QVariant>> &rows)
+{
+#ifdef LIBPQ_HAS_PIPELINING
+    if (rows.size() < 2 || !pipelineAllowed(QStringList(query)) || !_conn)
+        return DbConnection::executeBatch(query, rows);
+
+    if (PQtransactionStatus(_conn) == PQTRANS_ACTIVE)
+    {
+        emit message(tr("another command is already in progress\n"));
+        return false;
+    }
+    clearResultsets();
+    // suspend external socket watcher
+    watchSocket(SocketWatchMode::None);
+    _timer.start();
+
+    PGresult *prepare_error = nullptr;
+    const std::string name = preparedStatement(query, rows.first().size(), prepare_error);
+    QString error_message;
+    if (prepare_error)
+    {
+        error_message = PQresultErrorMessage(prepare_error);
+        PQclear(prepare_error);
+    }
+
+    // every portion is a round trip, the sets before the sync make an implicit transaction
+    // unless the batch is executed within an explicit one
+    qint64 affected = 0;
+    for (int from = 0; error_message.isEmpty() && from < rows.size(); from += PG_BATCH_ROWS)
+    {
+        const int to = qMin(from + PG_BATCH_ROWS, rows.size());
+        bool sent = PQenterPipelineMode(_conn);
+        for (int i = from; sent && i < to; ++i)
+        {
+            _params_tmp.clear();
+            for (const QVariant &v: rows.at(i))
+                _params_tmp.add(v);
+            sent = PQsendQueryPrepared(_conn, name.c_str(),
+                                       static_cast<int>(_params_tmp.count()),
+                                       _params_tmp.values(),
+                                       _params_tmp.lengths(),
+                                       nullptr,
+                                       0);
+        }
+        sent = sent && PQpipelineSync(_conn);
+        if (!sent)
+        {
+            // unable to leave pipeline mode in a consistent state
+            emit error(PQerrorMessage(_conn));
+            close();
+            return false;
+        }
+        for (int i = from; i < to; ++i)
+        {
+            while (PGresult *raw_tmp_res = PQgetResult(_conn))
+            {
+                std::unique_ptr<PGresult,decltype(&PQclear)> tmp_res(raw_tmp_res, PQclear);
+                ExecStatusType status = PQresultStatus(raw_tmp_res);
+                if (status == PGRES_COMMAND_OK || status == PGRES_TUPLES_OK)
+                    affected += QByteArray(PQcmdTuples(raw_tmp_res)).toLongLong();
+                else if (status == PGRES_FATAL_ERROR && error_message.isEmpty())
+                    error_message = PQresultErrorMessage(raw_tmp_res);
+            }
+        }
+        // PGRES_PIPELINE_SYNC
+        PQclear(PQgetResult(_conn));
+        PQexitPipelineMode(_conn);
+    }
+
+    // the batch is not repeated after reconnect, some of the sets may be committed
+    if (PQstatus(_conn) == CONNECTION_BAD)
+    {
+        emit error(PQerrorMessage(_conn));
+        close();
+        return false;
+    }
+    fetchNotifications();
+    // restore watching socket to receive notifications
+    watchSocket(SocketWatchMode::Read);
+    if (!error_message.isEmpty())
+    {
+        emit error(error_message);
+        return false;
+    }
+    emit message(tr("%1 rows affected").arg(affected));
+    return true;
+#else
+    return DbConnection::executeBatch(query, rows);
+#endif
+}
+
+std::string PgConnection::preparedStatement(const QString &query, int paramsCount, PGresult *&error)
+{
+    error = nullptr;
+    auto it = _prepared.find(query);
+    if (it != _prepared.end())
+    {
+        it->used = ++_prepared_serial;
+        return it->name;
+    }
+
+    // evict the least recently used statement
+    if (_prepared.size() >= PG_PREPARED_CACHE_SIZE)
+    {
+        auto lru = _prepared.begin();
+        for (auto i = _prepared.begin(); i != _prepared.end(); ++i)
+        {
+            if (i->used < lru->used)
+                lru = i;
+        }
+        PQclear(PQexec(_conn, ("deallocate " + lru->name).c_str()));
+        _prepared.erase(lru);
+    }
+
+    PreparedStatement statement { "sqt_" + std::to_string(++_prepared_serial), _prepared_serial };
+    PGresult *res = PQprepare(_conn, statement.name.c_str(), query.toStdString().c_str(), paramsCount, nullptr);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK)
+    {
+        error = res;
+        return std::string();
+    }
+    PQclear(res);
+    _prepared.insert(query, statement);
+    return statement.name;
+}
+
 QString PgConnection::escapeIdentifier(const QString &identifier)
 {
     QByteArray tmp = identifier.toUtf8();
@@ -589,43 +1079,60 @@ QString PgConnection::escapeIdentifier(const QString &identifier)
     return QString::fromUtf8(res.get());
 }
 
-QPair<QString,int> PgConnection::typeInfo(int sqlType)
+std::shared_ptr<PgTypeMap> PgConnection::types()
 {
-    auto it = _data_types.constFind(sqlType);
-    if (it != _data_types.constEnd())
-        return it.value();
+    if (!_types)
+        _types = PgTypeMap::get(finalConnectionString());
+    return _types;
+}
 
-    QPair<QString,int> tInfo("unknown", -1);
+void PgConnection::resolveTypes(const QVector<int> &oids)
+{
+    QVector<int> missing = types()->missing(oids);
+    if (missing.isEmpty())
+        return;
+
+    // all the unknown types at once
+    QStringList list;
+    for (int oid: missing)
+        list.append(QString::number(uint(oid)));
     std::unique_ptr<DbConnection> cn{clone()};
-    QVariantList params;
-    QString query =
-            "select t.oid, t.typname, el.oid "
-            "from pg_type t "
-            "   left join pg_type el on t.typelem = el.oid ";
-    if (!_data_types.empty())
+    QVariantList params { '{' + list.join(',') + '}' };
+    std::unique_ptr<DataTable> res { cn->execute(
+                    "select t.oid, t.typname, el.oid "
+                    "from pg_type t "
+                    "   left join pg_type el on t.typelem = el.oid "
+                    "where t.oid = any($1::oid[])", params) };
+    if (!res)
+        return;
+    for (int i = 0; i < res->rowCount(); ++i)
     {
-        query += "where t.oid = $1::oid";
-        params.append(QVariant(sqlType));
+        _types->insert(int(res->value(i, 0).toUInt()), {
+                           res->value(i, 1).toString(),
+                           res->isNull(i, 2) ? -1 : int(res->value(i, 2).toUInt())
+                       });
     }
+}
 
-    if (DataTable *res = cn->execute(query, params))
+QPair<QString,int> PgConnection::typeInfo(int sqlType)
+{
+    QPair<QString,int> tInfo("unknown", -1);
+    if (!types()->find(sqlType, tInfo))
     {
-        for (int i = 0; i < res->rowCount(); ++i)
-        {
-            auto r = res->getRow(i);
-            _data_types[r[0].toInt()] = {
-                    r[1].toString(),
-                    r[2].isValid() ? r[2].toInt() : -1
-                };
-            if (sqlType == r[0].toInt())
-                tInfo = _data_types[sqlType];
-        }
+        resolveTypes({sqlType});
+        _types->find(sqlType, tInfo);
     }
     return tInfo;
 }
 
 void PgConnection::clarifyTableStructure(DataTable &table)
 {
+    // single round trip for all the unknown types of the resultset
+    QVector<int> oids;
+    for (int i = 0; i < table.columnCount(); ++i)
+        oids.append(table.getColumn(i).sqlType());
+    resolveTypes(oids);
+
     for (int i = 0; i < table.columnCount(); ++i)
     {
         DataColumn &c = table.getColumn(i);
@@ -690,7 +1197,7 @@ void PgConnection::noticeReceiver(void *arg, const PGresult *res)
     {
         DataTable *t = new DataTable();
         t->addColumn(new DataColumn(hint, "", QMetaType::QString, TEXTOID, -1, -1, 1, Qt::AlignLeft));
-        t->addRow()[0] = QString(PQresultErrorField(res, PG_DIAG_MESSAGE_PRIMARY));
+        t->appendRow({ QString(PQresultErrorField(res, PG_DIAG_MESSAGE_PRIMARY)) });
         // synchronous usage only - no need to use _resultsetsGuard
         cn->_resultsets.push_back(t);
     }
@@ -701,25 +1208,51 @@ void PgConnection::noticeReceiver(void *arg, const PGresult *res)
 void PgConnection::fetchNotifications()
 {
     // the caller must lock _connectionGuard when needed
+    // notifications received at once are logged by a single message
     PGnotify *notify;
+    QStringList logged;
+    int skipped = 0;
     while ((notify = PQnotifies(_conn)))
     {
         std::unique_ptr<PGnotify, void(*)(void*)> n_guard(notify, PQfreemem);
-        emit message(tr("* notification received:\n  server process id: %1\n  channel: %2\n  payload: %3").
-                     arg(n_guard->be_pid).arg(n_guard->relname).arg(n_guard->extra));
+        if (logged.size() == PG_NOTIFICATIONS_LOGGED)
+        {
+            ++skipped;
+            continue;
+        }
+        logged.append(tr("* notification received:\n  server process id: %1\n  channel: %2\n  payload: %3").
+                      arg(n_guard->be_pid).arg(n_guard->relname).arg(n_guard->extra));
     }
+    if (skipped)
+        logged.append(tr("* %1 more notifications (see Query > Notifications)").arg(skipped));
+    if (!logged.isEmpty())
+        emit message(logged.join('\n'));
 }
 
 void PgConnection::fetch() noexcept
 {
+    SQT_TRACE_SCOPE("pg fetch");
     _connectionGuard.lock();
     bool is_notification = isIdle();
     _connectionGuard.unlock();
+    if (!is_notification && _readNotifier && ExecutionService::instance().inflightExceeded())
+    {
+        // views have not taken enough of fetched rows yet, the socket is read later
+        QSocketNotifier *sn = _readNotifier;
+        sn->setEnabled(false);
+        QTimer::singleShot(EXECUTION_INFLIGHT_RETRY, sn, [sn]() { sn->setEnabled(true); });
+        return;
+    }
     do
     {
         QMutexLocker lk(&_connectionGuard);
         //_last_action_moment = chrono::system_clock::now();
-        if (!PQconsumeInput(_conn))
+        int consumed;
+        {
+            TimingScope receiving(_timings.receive);
+            consumed = PQconsumeInput(_conn);
+        }
+        if (!consumed)
         {
             // disconnection detects here
             if (PQstatus(_conn) == CONNECTION_BAD)
@@ -749,10 +1282,15 @@ void PgConnection::fetch() noexcept
         std::unique_ptr<PGresult,decltype(&PQclear)> tmp_res(PQgetResult(_conn), PQclear);
         fetchNotifications();
         lk.unlock();
+        if (tmp_res)
+            markTiming(_timings.firstResult);
 
         if (!tmp_res)   // query processing finished
         {
+            if (_cursor_stage != cursor_stage::none && proceedCursor())
+                return;
             _copy_context.clear();
+            _copy_in_data.reset();
             _async_stage = async_stage::none;
             setQueryState(QueryState::Inactive);
             break;
@@ -761,6 +1299,9 @@ void PgConnection::fetch() noexcept
         ExecStatusType status = PQresultStatus(tmp_res.get());
         if (status == PGRES_COMMAND_OK)
         {
+            // auxiliary commands of chunked fetching
+            if (_cursor_stage != cursor_stage::none)
+                continue;
             char *tuplesAffected = PQcmdTuples(tmp_res.get());
             emit message(*tuplesAffected ?
                              tr("%1 rows affected").arg(tuplesAffected) :
@@ -790,7 +1331,12 @@ void PgConnection::fetch() noexcept
         {
             if (!_copy_context)
                 _copy_context.init(_query_tmp);
-            if (!_copy_context.nextSource())
+            if (_copy_in_data)
+            {
+                _copy_context.setInlineSource(_copy_in_data);
+                _copy_in_data.reset();
+            }
+            else if (!_copy_context.nextSource())
                 cancel();
             watchSocket(SocketWatchMode::Write);
             _async_stage = async_stage::copy_in;
@@ -810,38 +1356,113 @@ void PgConnection::fetch() noexcept
             _resultsets.append(_temp_result);
             lk.unlock();
             _temp_result_rowcount = 0;
+            startFetchNotifications();
+            TimingScope decoding(_timings.decode);
             appendRawDataToTable(*_temp_result, tmp_res.get());
         }
         else if (status != PGRES_FATAL_ERROR && PQnfields(tmp_res.get()))
         {
             // append rows to resultset
+            TimingScope decoding(_timings.decode);
             appendRawDataToTable(*_temp_result, tmp_res.get());
         }
 
         // resultset completely fetched
         if (status == PGRES_FATAL_ERROR || status == PGRES_TUPLES_OK)
         {
-            // final message if not sent within appendRawDataToTable()
-            if ((!_temp_result_rowcount && PQnfields(tmp_res.get())) ||
-                    _temp_result_rowcount % FETCH_COUNT_NOTIFY != 0)
-                emit fetched(_temp_result);
-
-            if (status == PGRES_FATAL_ERROR) // erroneous resultset
-                emit error(PQresultErrorMessage(tmp_res.get()));
-            else if (_temp_result->columnCount())
-                emit message(tr("%1 rows fetched").arg(_temp_result_rowcount));
-
-            // invalidate intermediate resultset pointer
-            if (_temp_result)
+            if (_cursor_stage == cursor_stage::fetching)
             {
-                // do not delete - it is in _resultsets already
-                _temp_result = nullptr;
+                // the next chunk is requested within proceedCursor()
+                if (status == PGRES_TUPLES_OK)
+                {
+                    _cursor_last_rows = PQntuples(tmp_res.get());
+                    continue;
+                }
+                _cursor_failed = true;
             }
+            completeResultset(status == PGRES_FATAL_ERROR ? PQresultErrorMessage(tmp_res.get()) : nullptr);
         }
     }
     while (true);
 }
 
+void PgConnection::completeResultset(const char *errorMessage)
+{
+    if (!_temp_result)
+        return;
+
+    // final message if not sent within appendRawDataToTable()
+    if (_temp_result->columnCount() && fetchNotificationPending())
+        emit fetched(_temp_result);
+    // empty resultset gets its (header only) file too
+    if (_temp_result->columnCount())
+    {
+        QMutexLocker lk(&_temp_result->mutex);
+        exportRows(*_temp_result);
+    }
+
+    if (errorMessage) // erroneous resultset
+        emit error(errorMessage);
+    else if (_temp_result->columnCount())
+        emit message(tr("%1 rows fetched").arg(_temp_result_rowcount));
+
+    // invalidate intermediate resultset pointer
+    // (do not delete - it is in _resultsets already)
+    _temp_result = nullptr;
+}
+
+bool PgConnection::proceedCursor()
+{
+    QByteArray command;
+    if (_cursor_stage == cursor_stage::fetching)
+    {
+        if (!_cursor_failed && _cursor_last_rows >= _cursor_chunk_size && queryState() == QueryState::Running)
+            command = "fetch forward " + QByteArray::number(_cursor_chunk_size) + " from sqt_chunked";
+        else
+        {
+            completeResultset(nullptr);
+            _cursor_stage = cursor_stage::closing;
+            if (_cursor_own_transaction)
+                command = (_cursor_failed ? "rollback" : "close sqt_chunked; commit");
+            else if (!_cursor_failed)
+                command = "close sqt_chunked";
+        }
+    }
+
+    if (command.isEmpty())
+    {
+        _cursor_stage = cursor_stage::none;
+        return false;
+    }
+
+    QMutexLocker lk(&_connectionGuard);
+    _cursor_last_rows = 0;
+    if (!PQsendQuery(_conn, command.constData()))
+    {
+        emit error(PQerrorMessage(_conn));
+        _cursor_stage = cursor_stage::none;
+        return false;
+    }
+
+    _async_stage = async_stage::flush;
+    int res = PQflush(_conn);
+    if (res < 0)
+    {
+        _async_stage = async_stage::none;
+        emit error(PQerrorMessage(_conn));
+        _cursor_stage = cursor_stage::none;
+        return false;
+    }
+    if (!res)
+    {
+        _async_stage = async_stage::wait_ready_read;
+        watchSocket(SocketWatchMode::Read);
+    }
+    else
+        watchSocket(SocketWatchMode::Read | SocketWatchMode::Write);
+    return true;
+}
+
 void PgConnection::asyncConnectionProceed()
 {
     QMutexLocker lk(&_connectionGuard);
@@ -865,23 +1486,30 @@ void PgConnection::asyncConnectionProceed()
     default:    // PGRES_POLLING_OK
         // successful connection
         _async_stage = async_stage::none;
+        lk.unlock();
+        connectionEstablished();
+    }
+}
 
-        // set notice and warning messages handler
-        PQsetNoticeReceiver(_conn, noticeReceiver, this);
-        // prevent PQsendQuery to block execution
-        PQsetnonblocking(_conn, 1);
+void PgConnection::connectionEstablished()
+{
+    QMutexLocker lk(&_connectionGuard);
+    types()->preload(_pool_conninfo, _connection_string);
+    // set notice and warning messages handler
+    PQsetNoticeReceiver(_conn, noticeReceiver, this);
+    // prevent PQsendQuery to block execution
+    PQsetnonblocking(_conn, 1);
 
-        emit message(tr("connection established\n"));
+    emit message(tr("connection established\n"));
 
-        // connection restored during query execution
-        if (queryState() == QueryState::Running)
-        {
-            lk.unlock();
-            executeAsync("");
-        }
-        else
-            watchSocket(SocketWatchMode::None);
+    // connection restored during query execution
+    if (queryState() == QueryState::Running)
+    {
+        lk.unlock();
+        executeAsync("");
     }
+    else
+        watchSocket(SocketWatchMode::None);
 }
 
 void PgConnection::getCopyData()
@@ -906,6 +1534,7 @@ void PgConnection::getCopyData()
 
         if (len == -1) // done
         {
+            _copy_context.finishDestination();
             _async_stage = async_stage::wait_ready_read;
             fetch();
         }
@@ -924,11 +1553,22 @@ void PgConnection::putCopyData()
 {
     do
     {
+        if (_query_state != QueryState::Cancelling && !_copy_in_buf.size() && !_copy_context.readable())
+        {
+            // inline data is not written yet, the I/O thread does not wait for it
+            QSocketNotifier *sn = _writeNotifier;
+            if (sn)
+            {
+                sn->setEnabled(false);
+                QTimer::singleShot(COPY_PIPE_RETRY, sn, [sn]() { sn->setEnabled(true); });
+            }
+            return;
+        }
         // read data if buffer is empty
         // (buffer may stay non-empty if last write opertion failed because of overflowed internal buffer)
         if (    _query_state != QueryState::Cancelling &&
                 !_copy_in_buf.size() &&
-                !_copy_context.read(_copy_in_buf, 1024 * 512))
+                !_copy_context.read(_copy_in_buf))
         {
             cancel();
             continue;
@@ -1029,6 +1669,7 @@ void PgConnection::readyWriteSocket()
             if (!res)
             {
                 _async_stage = async_stage::wait_ready_read;
+                markTiming(_timings.sent);
                 watchSocket(SocketWatchMode::Read);
             }
             // current mode is rw
@@ -1045,8 +1686,8 @@ void PgConnection::watchSocket(int mode)
 {
     // the caller must lock _connectionGuard when needed
     int socket_handle = (_conn ? PQsocket(_conn) : -1);
-    // force disabling socket watcher in case of incorrect handle
-    if (socket_handle == -1)
+    // force disabling socket watcher in case of incorrect handle or a detached connection
+    if (socket_handle == -1 || _detached)
         mode = SocketWatchMode::None;
 
     // PQconnectStart may reuse connection freed by previous PQfinish() call (considering object address),
@@ -1058,6 +1699,7 @@ void PgConnection::watchSocket(int mode)
         if (_readNotifier)
             delete _readNotifier;
         _readNotifier = nullptr;
+        _fetch_flush_armed = false;
 
         if (_writeNotifier)
             delete _writeNotifier;
@@ -1078,15 +1720,20 @@ void PgConnection::watchSocket(int mode)
             {
                 delete sn;
                 sn = nullptr;
+                if (type == QSocketNotifier::Read)
+                    _fetch_flush_armed = false;
             }
 
             if (!sn)
             {
                 sn = new QSocketNotifier(socket_handle, type);
-                connect(sn, &QSocketNotifier::activated, this,
-                        type == QSocketNotifier::Read ?
-                            &PgConnection::readyReadSocket :
-                            &PgConnection::readyWriteSocket);
+                // the notifier is the context: socket is processed by the thread it is watched from
+                connect(sn, &QSocketNotifier::activated, sn, [this, type]() {
+                    if (type == QSocketNotifier::Read)
+                        readyReadSocket();
+                    else
+                        readyWriteSocket();
+                });
             }
 
             sn->setEnabled(true);
@@ -1102,11 +1749,13 @@ void PgConnection::watchSocket(int mode)
 
 int PgConnection::appendRawDataToTable(DataTable &dst, PGresult *src) noexcept
 {
+    SQT_TRACE_SCOPE("pg appendRawDataToTable");
     int dst_columns_count = dst.columnCount();
     int src_columns_count = PQnfields(src);
     int rows_count = PQntuples(src);
+    bool new_resultset = !dst_columns_count;
 
-    if (!dst_columns_count)
+    if (new_resultset)
     {
         for (int i = 0; i < src_columns_count; ++i)
         {
@@ -1129,71 +1778,79 @@ int PgConnection::appendRawDataToTable(DataTable &dst, PGresult *src) noexcept
         emit error(tr("source and destiation resultsets do not match"));
     else if (rows_count)
     {
+        // decoders are chosen once per resultset (the format is requested for the whole of it)
+        if (new_resultset || _decoder.table() != &dst)
+        {
+            bool binary = (PQfformat(src, 0) == 1);
+            // long values shown by grids are truncated (exported values are written as they are)
+            int long_value = (&dst == _temp_result && !isExporting() && !binary ?
+                                  SqtSettings::value("longValueThreshold", PG_LONG_VALUE_THRESHOLD).toInt() * 1024 : 0);
+            _decoder.prepare(dst, binary, &_binary_decoder, long_value, [this]() {
+                return (longValues() ? _long_values : std::shared_ptr<SpillFile>());
+            });
+        }
+        const bool count_bytes = (&dst == _temp_result);
+        // rows are decoded into the batch without locking the destination,
+        // the consumer may take rows meanwhile
+        std::vector<ColumnStorage> batch(size_t(src_columns_count));
+        int batch_rows = 0;
         for (int r = 0; r < rows_count; ++r)
         {
-            std::unique_ptr<DataRow> row(new DataRow(&dst));
             for (int i = 0; i < src_columns_count; ++i)
             {
+                ColumnStorage &col = batch[size_t(i)];
                 if (PQgetisnull(src, r, i))
-                    continue;
-                const char *val = PQgetvalue(src, r, i);
-                int type = dst.getColumn(i).sqlType();
-                switch (type)
                 {
-                case INT2OID:
-                case INT4OID:
-                    (*row)[i] = std::atoi(val);
-                    break;
-                case INT8OID:
-                    (*row)[i] = std::atoll(val);
-                    break;
-                case FLOAT4OID:
-                case FLOAT8OID:
-                    (*row)[i] = std::atof(val);
-                    break;
-                case BOOLOID:
-                    (*row)[i] = (val[0] == 't');
-                    break;
-                case CHAROID:
-                    if (!val[0])
-                        (*row)[i] = QChar(0);
-                    else
-                        (*row)[i] = QString::fromStdString(val).at(0);
-                    break;
-
-                // QDate is lack of special values support, lack of precision to keep huge dates
-                /*
-                case DATEOID:
-                    (*row)[i] = QDate::fromString(val, Qt::ISODate);
-                    break;
-                */
-
-                // QTime/QDateTime aren't support microseconds, so qt object as a storage will loose
-                // precision. As far as sqt does not interpret values returned from data source,
-                // we would prefer to keep their original textual representation.
-
-                /*
-                case TIMEOID:
-                    (*row)[i] = QTime::fromString(val, Qt::ISODateWithMs);
-                    break;
-                case TIMESTAMPOID:
-                    (*row)[i] = QDateTime::fromString(val, Qt::ISODateWithMs);
-                    break;
-                */
-                // TIMESTAMPTZOID, TIMETZOID goes here untill timezone printing out implemented
-                default:
-                    (*row)[i] = QString::fromStdString(val);
-                }  // end of switch
+                    col.appendNull();
+                    continue;
+                }
+                int length = PQgetlength(src, r, i);
+                if (count_bytes)
+                    _timings.bytes += length;
+                _decoder.decode(i, col, PQgetvalue(src, r, i), length);
             }
-
-            QMutexLocker lk(&dst.mutex);
-            dst.addRow(row.release());
-            lk.unlock();
-
+            ++batch_rows;
             ++_temp_result_rowcount;
-            if (_temp_result_rowcount % FETCH_COUNT_NOTIFY == 0)
-                emit fetched(&dst);
+            if (&dst == _temp_result)
+                ++_timings.rows;
+
+            if (batch_rows == FETCH_COUNT_NOTIFY || r == rows_count - 1)
+            {
+                QMutexLocker lk(&dst.mutex);
+                for (int i = 0; i < src_columns_count; ++i)
+                    dst.storage(i).take(batch[size_t(i)]);
+                dst.commitRow(batch_rows);
+                // synchronous queries (type info and so on) are never exported
+                bool exported = (&dst == _temp_result && exportRows(dst));
+                bool notify = !exported && fetchNotificationDue(dst, batch_rows);
+                lk.unlock();
+                batch_rows = 0;
+                if (notify)
+                    emit fetched(&dst);
+                else if (&dst == _temp_result)
+                    scheduleFetchFlush();
+            }
         }
     }
     return rows_count;
 }
+
+void PgConnection::scheduleFetchFlush() noexcept
+{
+    int delay = fetchNotificationDelay();
+    // the notifier lives on the thread decoding rows, the timer is dropped with it
+    if (delay < 0 || _fetch_flush_armed || !_readNotifier)
+        return;
+    _fetch_flush_armed = true;
+    QTimer::singleShot(delay + 1, _readNotifier, [this]() {
+        _fetch_flush_armed = false;
+        if (!_temp_result)
+            return;
+        QMutexLocker lk(&_temp_result->mutex);
+        bool notify = fetchNotificationDue(*_temp_result, 0);
+        lk.unlock();
+        // otherwise the previous notification is not taken yet, it picks up the rows
+        if (notify)
+            emit fetched(_temp_result);
+    });
+}
@@ -7,8 +7,26 @@
 #include <libpq-fe.h>
 #include "pgparams.h"
 #include "copycontext.h"
+#include "pgbinarydecoder.h"
+#include "pgcolumndecoder.h"
+
+// named prepared statements kept by a connection for parameterized queries
+#define PG_PREPARED_CACHE_SIZE 64
+// notifications logged at once by a query connection, the rest are counted
+#define PG_NOTIFICATIONS_LOGGED 10
+// textual values of grids longer than that (KB, longValueThreshold setting) are truncated,
+// the whole values are kept within a temporary file
+#define PG_LONG_VALUE_THRESHOLD 64
+// bytes of a truncated value kept in memory
+#define PG_LONG_VALUE_PREFIX 1024
+// parameter sets of a batch sent within one pipeline sync
+#define PG_BATCH_ROWS 1000
+// rows of a chunk of an export to a file when pgChunkSize setting doesn't give one
+#define PG_EXPORT_CHUNK_ROWS 1000
 
 class QSocketNotifier;
+class PgTypeMap;
+class SpillFile;
 
 class PgConnection : public DbConnection
 {
@@ -34,10 +52,16 @@ public:
     virtual QMetaType::Type sqlTypeToVariant(int sqlType) const noexcept override;
     virtual void executeAsync(const QString &query, const QVector<QVariant> *params = nullptr) noexcept override;
     virtual bool execute(const QString &query, const QVector<QVariant> *params = nullptr) override;
+    virtual bool executePipeline(const QStringList &queries, const QList<QVector<QVariant>> &params = QList<QVector<QVariant>>()) override;
+    virtual bool executeBatch(const QString &query, const QList<QVector<QVariant>> &rows) override;
 
     virtual QString escapeIdentifier(const QString &identifier) override;
     virtual QPair<QString,int> typeInfo(int sqlType) override;
     virtual void clarifyTableStructure(DataTable &table) override;
+    /*!
+     * \brief libpq connection string of the session (for separate connections to the database)
+     */
+    std::string conninfo() const noexcept;
 
 private:
     enum class async_stage
@@ -51,24 +75,55 @@ private:
         copy_out,
         copy_in
     };
+    /*!
+     * \brief server-side cursor based chunked fetching (if libpq lacks chunked rows mode)
+     */
+    enum class cursor_stage
+    {
+        none,
+        fetching,
+        closing
+    };
     QSocketNotifier *_readNotifier, *_writeNotifier;
     PGconn *_conn = nullptr;
+    std::string _pool_conninfo; ///< pool key of the current session
     async_stage _async_stage = async_stage::none;
+    cursor_stage _cursor_stage = cursor_stage::none;
+    int _cursor_chunk_size = 0;
+    int _cursor_last_rows = 0;
+    bool _cursor_own_transaction = false;
+    bool _cursor_failed = false;
     DataTable* _temp_result; ///< temporary resultset for asynchronous processing
     QString _query_tmp; ///< query storage during asynchronous connection if needed
     PgParams _params_tmp;
+    // statement of the asynchronous query prepared off the I/O thread (the unnamed one is empty)
+    std::string _send_statement;
+    int _send_format = 0;       ///< result format of _send_statement
+    bool _send_prepared = false;
+    QString _send_error;        ///< preparing failed within a transaction, so it is aborted
+    PgBinaryDecoder _binary_decoder;
+    PgColumnDecoder _decoder;
     int _temp_result_rowcount;
+    bool _fetch_flush_armed = false;  ///< scheduleFetchFlush() timer is running
     PgCopyContext _copy_context;
     std::vector<char> _copy_in_buf;
+    std::shared_ptr<SpillFile> _long_values;   ///< whole values of the cells truncated by the query
+    struct PreparedStatement
+    {
+        std::string name;
+        quint64 used;
+    };
+    QHash<QString, PreparedStatement> _prepared; ///< LRU cache of parameterized queries, query text is the key
+    quint64 _prepared_serial = 0;
     /*!
-    * \brief <oid, <name, element oid>>
+    * \brief <oid, <name, element oid>> shared by connections to the database
     *
     * Although pg's Oid is unsigned int, it's small values let us use signed int to
     * support both ms sql and postgresql. Or may be we should not spare bits and switch
     * to int64_t? Then it's necessary to change sqlType in DbConnection interface
     * (and fix DataTable).
     */
-    QHash<int, QPair<QString, int>> _data_types; ///< non-static, not version-specific storage because of db-level user types
+    std::shared_ptr<PgTypeMap> _types; ///< not version-specific storage because of db-level user types
 
     virtual void openAsync() noexcept;
     bool isIdle() const noexcept;
@@ -76,12 +131,43 @@ private:
     void fetchNotifications();
     void fetch() noexcept;
     void asyncConnectionProceed();
+    /*!
+     * \brief finish asynchronous connection (either handshake completed or pooled session taken)
+     */
+    void connectionEstablished();
     void getCopyData();
     void putCopyData();
     void readyReadSocket();
     void readyWriteSocket();
     int appendRawDataToTable(DataTable &dst, PGresult *src) noexcept;
+    /*!
+     * \brief notify rows of the current resultset held back by the throttling once it's due,
+     * even if no more data arrives meanwhile
+     */
+    void scheduleFetchFlush() noexcept;
+    /*!
+     * \brief make sure the file of truncated values exists
+     */
+    bool longValues();
+    void completeResultset(const char *errorMessage);
+    bool proceedCursor();
     std::string finalConnectionString() const noexcept;
+    std::shared_ptr<PgTypeMap> types();
+    /*!
+     * \brief look up all the unknown types by a single query
+     */
+    void resolveTypes(const QVector<int> &oids);
+    /*!
+     * \brief name of the prepared statement for the query, prepared on demand
+     * \param error result of failed preparation (the caller takes ownership), if the name is empty
+     */
+    std::string preparedStatement(const QString &query, int paramsCount, PGresult *&error);
+    /*!
+     * \brief prepare _query_tmp if needed (binary format, setPrepareNext()) by the blocking api
+     *
+     * Runs on a pool thread before the query is sent by the I/O thread.
+     */
+    void prepareAsyncQuery();
 
 private slots:
     void watchSocket(int mode);
@@ -1,14 +1,14 @@
 #include "pgparams.h"
+#include <cstring>
 
 PgParams &PgParams::add(std::string &&param)
 {
-    _temps.push_back(param);
-    return addref(_temps.back().data(), static_cast<int>(_temps.back().size()));
+    return add(param.data(), static_cast<int>(param.size()));
 }
 
 PgParams &PgParams::add(const std::string &param)
 {
-    return add(std::string(param));
+    return add(param.data(), static_cast<int>(param.size()));
 }
 
 PgParams &PgParams::add(const char *param, int size)
@@ -17,9 +17,12 @@ PgParams &PgParams::add(const char *param, int size)
         return addref(nullptr, 0);
 
     if (size == -1)
-        return add(std::string(param));
-
-    return add(std::string(param, static_cast<size_t>(size)));
+        size = static_cast<int>(strlen(param));
+    _offsets.push_back(static_cast<int>(_buffer.size()));
+    _buffer.append(param, static_cast<size_t>(size));
+    _param_pointers.push_back(nullptr);
+    _param_lengths.push_back(size);
+    return *this;
 }
 
 PgParams &PgParams::operator<<(std::string &&param)
@@ -49,6 +52,7 @@ PgParams &PgParams::addref(const std::string &param)
 
 PgParams &PgParams::addref(const char *param, int size)
 {
+    _offsets.push_back(-1);
     _param_pointers.push_back(param);
     _param_lengths.push_back(size);
     return *this;
@@ -58,20 +62,32 @@ PgParams &PgParams::add(const QString &param)
 {
     if (param.isNull())
         return add(nullptr);
-    return add(param.toStdString());
+    QByteArray utf8 = param.toUtf8();
+    return add(utf8.constData(), utf8.size());
 }
 
 PgParams &PgParams::add(const QVariant &param)
 {
     if (!param.isValid() || param.isNull())
         return add(nullptr);
-    return add(param.toString().toStdString());
+    return add(param.toString());
+}
+
+const char* const* PgParams::values() const
+{
+    for (size_t i = 0; i < _offsets.size(); ++i)
+    {
+        if (_offsets[i] >= 0)
+            _param_pointers[i] = _buffer.data() + _offsets[i];
+    }
+    return _param_pointers.data();
 }
 
 PgParams &PgParams::clear()
 {
     _param_pointers.clear();
     _param_lengths.clear();
-    _temps.clear();
+    _offsets.clear();
+    _buffer.clear();
     return *this;
 }
@@ -6,6 +6,12 @@
 #include <QString>
 #include <QVariant>
 
+/*!
+ * \brief Values of query parameters for libpq.
+ *
+ * Copied values share a single buffer, which keeps its capacity after clear(), so a
+ * batch of parameter sets does not allocate per value.
+ */
 class PgParams
 {
 public:
@@ -24,15 +30,17 @@ public:
     PgParams& add(const QString &param);
     PgParams& add(const QVariant &param);
 
-    const char* const* values() const { return _param_pointers.data(); }
+    const char* const* values() const;
     const int* lengths() const { return _param_lengths.data(); }
     size_t count() const { return _param_lengths.size(); }
     PgParams& clear();
 
 private:
-    std::vector<const char*> _param_pointers;
+    // pointers of the copied values are resolved by values(), the buffer may be reallocated meanwhile
+    mutable std::vector<const char*> _param_pointers;
     std::vector<int> _param_lengths;
-    std::vector<std::string> _temps;
+    std::vector<int> _offsets;  ///< within _buffer, -1 for referenced values and nulls
+    std::string _buffer;
 };
 
 
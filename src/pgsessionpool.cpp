@@ -0,0 +1,173 @@
+#include "pgsessionpool.h"
+#include <QObject>
+#include <thread>
+#include "settings.h"
+
+PgSessionPool& PgSessionPool::instance()
+{
+    // never destroyed: background threads may outlive static objects at exit
+    static PgSessionPool *pool = new PgSessionPool();
+    return *pool;
+}
+
+bool PgSessionPool::healthy(PGconn *conn) noexcept
+{
+    // broken socket is detected without round trip
+    return PQstatus(conn) == CONNECTION_OK &&
+            PQtransactionStatus(conn) == PQTRANS_IDLE &&
+            PQconsumeInput(conn) &&
+            PQstatus(conn) == CONNECTION_OK;
+}
+
+bool PgSessionPool::hasRoom(const QString &server) const
+{
+    int limit = SqtSettings::value("pgPoolMaxPerServer", 0).toInt();
+    return limit <= 0 || _sessions.value(server) + _pending.value(server) < limit;
+}
+
+bool PgSessionPool::acquire(const std::string &conninfo, const QString &server, PGconn *&conn, QString &error)
+{
+    std::vector<PGconn*> expired;
+    conn = nullptr;
+    {
+        QMutexLocker lk(&_mutex);
+        for (auto it = _idle.begin(); it != _idle.end(); )
+        {
+            if (it->since.elapsed() > PG_POOL_IDLE_TIMEOUT || (!conn && it->conninfo == conninfo && !healthy(it->conn)))
+            {
+                expired.push_back(it->conn);
+                --_sessions[it->server];
+                it = _idle.erase(it);
+            }
+            else if (!conn && it->conninfo == conninfo)
+            {
+                conn = it->conn;
+                it = _idle.erase(it);
+            }
+            else
+                ++it;
+        }
+
+        if (!conn && !hasRoom(server))
+        {
+            // sessions of other databases give way
+            for (auto it = _idle.begin(); it != _idle.end(); ++it)
+            {
+                if (it->server == server)
+                {
+                    expired.push_back(it->conn);
+                    --_sessions[server];
+                    _idle.erase(it);
+                    break;
+                }
+            }
+        }
+
+        if (!conn)
+        {
+            if (!hasRoom(server))
+                error = QObject::tr("the limit of %1 connections per server is reached").
+                        arg(SqtSettings::value("pgPoolMaxPerServer", 0).toInt());
+            else
+                ++_sessions[server];
+        }
+    }
+
+    for (PGconn *c: expired)
+        PQfinish(c);
+    if (!error.isEmpty())
+        return false;
+    standby(conninfo, server);
+    return true;
+}
+
+void PgSessionPool::release(PGconn *conn, const std::string &conninfo, const QString &server) noexcept
+{
+    if (!conn)
+        return;
+    PQsetNoticeReceiver(conn, ignoreNotice, nullptr);
+    PGTransactionStatusType status = PQtransactionStatus(conn);
+    if (PQstatus(conn) != CONNECTION_OK || status == PQTRANS_ACTIVE || status == PQTRANS_UNKNOWN)
+    {
+        PQfinish(conn);
+        discard(server);
+        return;
+    }
+
+    // reset session state without blocking the caller
+    std::thread([this, conn, conninfo, server, status]() {
+        bool ok = true;
+        if (status != PQTRANS_IDLE)
+        {
+            PGresult *res = PQexec(conn, "rollback");
+            ok = (PQresultStatus(res) == PGRES_COMMAND_OK);
+            PQclear(res);
+        }
+        if (ok)
+        {
+            PGresult *res = PQexec(conn, "discard all");
+            ok = (PQresultStatus(res) == PGRES_COMMAND_OK);
+            PQclear(res);
+        }
+        if (ok && healthy(conn))
+            keep(conn, conninfo, server);
+        else
+        {
+            PQfinish(conn);
+            discard(server);
+        }
+    }).detach();
+}
+
+void PgSessionPool::discard(const QString &server) noexcept
+{
+    QMutexLocker lk(&_mutex);
+    if (_sessions.value(server) > 0)
+        --_sessions[server];
+}
+
+void PgSessionPool::keep(PGconn *conn, const std::string &conninfo, const QString &server)
+{
+    Idle idle { conn, conninfo, server, QElapsedTimer() };
+    idle.since.start();
+    QMutexLocker lk(&_mutex);
+    _idle.push_back(idle);
+}
+
+void PgSessionPool::standby(const std::string &conninfo, const QString &server)
+{
+    {
+        QMutexLocker lk(&_mutex);
+        for (const Idle &idle: _idle)
+        {
+            if (idle.conninfo == conninfo)
+                return;
+        }
+        // one standby session per server is being opened at a time
+        if (_pending.value(server) || !hasRoom(server))
+            return;
+        ++_pending[server];
+    }
+
+    std::thread([this, conninfo, server]() {
+        PGconn *conn = PQconnectdb(conninfo.c_str());
+        bool ok = (PQstatus(conn) == CONNECTION_OK);
+        if (ok)
+        {
+            PQsetNoticeReceiver(conn, ignoreNotice, nullptr);
+            PQsetnonblocking(conn, 1);
+        }
+        else
+            PQfinish(conn);
+
+        QMutexLocker lk(&_mutex);
+        --_pending[server];
+        if (ok)
+        {
+            ++_sessions[server];
+            Idle idle { conn, conninfo, server, QElapsedTimer() };
+            idle.since.start();
+            _idle.push_back(idle);
+        }
+    }).detach();
+}
@@ -0,0 +1,61 @@
+#ifndef PGSESSIONPOOL_H
+#define PGSESSIONPOOL_H
+
+#include <QMutex>
+#include <QHash>
+#include <QElapsedTimer>
+#include <vector>
+#include <string>
+#include <libpq-fe.h>
+
+// idle sessions older than this are closed, ms
+#define PG_POOL_IDLE_TIMEOUT 300000
+
+/*!
+ * \brief Process-wide pool of physical PostgreSQL sessions.
+ * Sessions are keyed by the final connection string (database included).
+ * Returned sessions are reset by DISCARD ALL in background, a warm standby
+ * session is kept for every key in use. Total number of sessions per
+ * server is limited by "pgPoolMaxPerServer" setting (0 - unlimited).
+ */
+class PgSessionPool
+{
+public:
+    static PgSessionPool& instance();
+    /*!
+     * \brief take idle session or reserve a slot for a new one
+     * \param conn healthy idle session or nullptr if the caller must connect by itself
+     * \return false if the limit of sessions per server is reached
+     */
+    bool acquire(const std::string &conninfo, const QString &server, PGconn *&conn, QString &error);
+    /*!
+     * \brief return the session to the pool (broken or busy sessions are closed)
+     */
+    void release(PGconn *conn, const std::string &conninfo, const QString &server) noexcept;
+    /*!
+     * \brief free the slot reserved by acquire() if the caller failed to connect
+     */
+    void discard(const QString &server) noexcept;
+
+private:
+    PgSessionPool() = default;
+    struct Idle
+    {
+        PGconn *conn;
+        std::string conninfo;
+        QString server;
+        QElapsedTimer since;
+    };
+    void standby(const std::string &conninfo, const QString &server);
+    void keep(PGconn *conn, const std::string &conninfo, const QString &server);
+    bool hasRoom(const QString &server) const;
+    static bool healthy(PGconn *conn) noexcept;
+    static void ignoreNotice(void *, const PGresult *) {}
+
+    QMutex _mutex;
+    std::vector<Idle> _idle;
+    QHash<QString, int> _sessions;  ///< used and idle sessions per server
+    QHash<QString, int> _pending;   ///< standby sessions being opened per server
+};
+
+#endif // PGSESSIONPOOL_H
@@ -0,0 +1,152 @@
+#include "pgtypemap.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDataStream>
+#include <thread>
+#include <cstdlib>
+#include <libpq-fe.h>
+#include "pgsessionpool.h"
+#include "metadatacache.h"
+
+std::shared_ptr<PgTypeMap> PgTypeMap::get(const std::string &conninfo)
+{
+    // never destroyed: preloading threads may outlive static objects at exit
+    static QMutex *mutex = new QMutex();
+    static auto *maps = new QHash<QString, std::shared_ptr<PgTypeMap>>();
+    QMutexLocker lk(mutex);
+    auto &map = (*maps)[QString::fromStdString(conninfo)];
+    if (!map)
+        map = std::make_shared<PgTypeMap>();
+    return map;
+}
+
+void PgTypeMap::preload(const std::string &conninfo, const QString &server)
+{
+    QMutexLocker lk(&_mutex);
+    if (_preload_started)
+        return;
+    _preload_started = true;
+    lk.unlock();
+
+    std::shared_ptr<PgTypeMap> self = get(conninfo);
+    std::thread([self, conninfo, server]() {
+        self->load(conninfo, server);
+    }).detach();
+}
+
+void PgTypeMap::load(const std::string &conninfo, const QString &server)
+{
+    PGconn *conn = nullptr;
+    QString error;
+    if (!PgSessionPool::instance().acquire(conninfo, server, conn, error))
+        return;
+    if (!conn)
+        conn = PQconnectdb(conninfo.c_str());
+    if (PQstatus(conn) != CONNECTION_OK)
+    {
+        PQfinish(conn);
+        PgSessionPool::instance().discard(server);
+        return;
+    }
+    // pooled sessions are nonblocking
+    PQsetnonblocking(conn, 0);
+
+    auto query = [conn](const char *sql) {
+        return std::unique_ptr<PGresult, decltype(&PQclear)>(PQexec(conn, sql), PQclear);
+    };
+
+    QString file_name = Scripting::MetadataCache::storageFile(QString::fromStdString(conninfo), "types");
+    QString marker;
+    auto res = query("select count(*) || ':' || max(xmin::text::bigint) from pg_type");
+    if (PQresultStatus(res.get()) == PGRES_TUPLES_OK && PQntuples(res.get()) == 1)
+        marker = QString::fromUtf8(PQgetvalue(res.get(), 0, 0));
+
+    QHash<int, QPair<QString, int>> types;
+    QFile file(file_name);
+    if (!marker.isEmpty() && file.open(QIODevice::ReadOnly))
+    {
+        QDataStream in(&file);
+        in.setVersion(QDataStream::Qt_5_0);
+        QString stored_marker;
+        in >> stored_marker;
+        if (stored_marker == marker)
+        {
+            in >> types;
+            if (in.status() != QDataStream::Ok)
+                types.clear();
+        }
+    }
+
+    if (types.isEmpty())
+    {
+        res = query("select t.oid, t.typname, el.oid "
+                    "from pg_type t "
+                    "   left join pg_type el on t.typelem = el.oid");
+        if (PQresultStatus(res.get()) == PGRES_TUPLES_OK)
+        {
+            int rows = PQntuples(res.get());
+            types.reserve(rows);
+            for (int i = 0; i < rows; ++i)
+            {
+                types.insert(int(strtoul(PQgetvalue(res.get(), i, 0), nullptr, 10)), {
+                                 QString::fromUtf8(PQgetvalue(res.get(), i, 1)),
+                                 PQgetisnull(res.get(), i, 2) ? -1 : int(strtoul(PQgetvalue(res.get(), i, 2), nullptr, 10))
+                             });
+            }
+        }
+
+        if (!marker.isEmpty() && !types.isEmpty())
+        {
+            QDir().mkpath(QFileInfo(file_name).path());
+            QSaveFile out_file(file_name);
+            if (out_file.open(QIODevice::WriteOnly))
+            {
+                QDataStream out(&out_file);
+                out.setVersion(QDataStream::Qt_5_0);
+                out << marker << types;
+                out_file.commit();
+            }
+        }
+    }
+    res.reset();
+    PQsetnonblocking(conn, 1);
+    PgSessionPool::instance().release(conn, conninfo, server);
+
+    // types resolved meanwhile are not overwritten
+    QMutexLocker lk(&_mutex);
+    for (auto it = types.constBegin(); it != types.constEnd(); ++it)
+    {
+        if (!_types.contains(it.key()))
+            _types.insert(it.key(), it.value());
+    }
+}
+
+bool PgTypeMap::find(int oid, QPair<QString, int> &info) const
+{
+    QMutexLocker lk(&_mutex);
+    auto it = _types.constFind(oid);
+    if (it == _types.constEnd())
+        return false;
+    info = it.value();
+    return true;
+}
+
+QVector<int> PgTypeMap::missing(const QVector<int> &oids) const
+{
+    QVector<int> res;
+    QMutexLocker lk(&_mutex);
+    for (int oid: oids)
+    {
+        if (!_types.contains(oid) && !res.contains(oid))
+            res.append(oid);
+    }
+    return res;
+}
+
+void PgTypeMap::insert(int oid, const QPair<QString, int> &info)
+{
+    QMutexLocker lk(&_mutex);
+    _types.insert(oid, info);
+}
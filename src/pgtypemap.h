@@ -0,0 +1,47 @@
+#ifndef PGTYPEMAP_H
+#define PGTYPEMAP_H
+
+#include <QMutex>
+#include <QHash>
+#include <QPair>
+#include <QVector>
+#include <QString>
+#include <memory>
+#include <string>
+
+/*!
+ * \brief Names and array element types of pg_type, shared by all the connections to a database.
+ *
+ * The whole pg_type is preloaded once in background as soon as the first connection
+ * to the database is established. It is also kept on disk between sessions and
+ * versioned by pg_type fingerprint (count and max xmin), so a warm start costs one query.
+ * Types unknown at the moment are resolved by the caller in bulk.
+ */
+class PgTypeMap
+{
+public:
+    /*!
+     * \brief map of the database identified by the final connection string
+     */
+    static std::shared_ptr<PgTypeMap> get(const std::string &conninfo);
+    /*!
+     * \brief start background preloading unless it was started already
+     * \param server connection string without database (session pool key)
+     */
+    void preload(const std::string &conninfo, const QString &server);
+    bool find(int oid, QPair<QString, int> &info) const;
+    /*!
+     * \brief oids not known yet (without duplicates)
+     */
+    QVector<int> missing(const QVector<int> &oids) const;
+    void insert(int oid, const QPair<QString, int> &info);
+
+private:
+    void load(const std::string &conninfo, const QString &server);
+
+    mutable QMutex _mutex;
+    QHash<int, QPair<QString, int>> _types; ///< <oid, <name, element oid>>
+    bool _preload_started = false;
+};
+
+#endif // PGTYPEMAP_H
@@ -46,6 +46,22 @@
 #define FLOAT4ARRAYOID      1021
 #define ACLITEMOID          1033
 #define CSTRINGARRAYOID     1263
+#define BOOLARRAYOID        1000
+#define BYTEAARRAYOID       1001
+#define CHARARRAYOID        1002
+#define NAMEARRAYOID        1003
+#define BPCHARARRAYOID      1014
+#define VARCHARARRAYOID     1015
+#define INT8ARRAYOID        1016
+#define FLOAT8ARRAYOID      1022
+#define TIMESTAMPARRAYOID   1115
+#define DATEARRAYOID        1182
+#define TIMEARRAYOID        1183
+#define TIMESTAMPTZARRAYOID 1185
+#define NUMERICARRAYOID     1231
+#define UUIDARRAYOID        2951
+#define JSONARRAYOID        199
+#define JSONBARRAYOID       3807
 #define BPCHAROID           1042
 #define VARCHAROID          1043
 #define DATEOID             1082
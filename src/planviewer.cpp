@@ -0,0 +1,404 @@
+#include "planviewer.h"
+#include <QHeaderView>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLabel>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+#include <QXmlStreamReader>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace
+{
+enum Column { Operation, Self, Share, Total, Rows, ActualRows, Loops, Reads, Hits, Details, ColumnCount };
+
+QString number(double value)
+{
+    if (value < 0)
+        return QString();
+    return QString::number(value, 'f', value == std::floor(value) ? 0 : 2);
+}
+}
+
+PlanViewer::PlanViewer(QWidget *parent) :
+    QWidget(parent)
+{
+    QVBoxLayout *layout = new QVBoxLayout();
+    _summary = new QLabel(this);
+    _summary->setTextInteractionFlags(Qt::TextSelectableByMouse);
+    layout->addWidget(_summary);
+    _tree = new QTreeWidget(this);
+    _tree->setUniformRowHeights(true);
+    _tree->setColumnCount(ColumnCount);
+    _tree->setHeaderLabels(QStringList() << tr("operation") << tr("self") << tr("%") << tr("total") << tr("rows") <<
+                           tr("actual rows") << tr("loops") << tr("reads") << tr("hits") << tr("details"));
+    layout->addWidget(_tree);
+    layout->setContentsMargins(0, 0, 0, 0);
+    setLayout(layout);
+}
+
+bool PlanViewer::setPlan(const QStringList &documents, QString &error)
+{
+    _nodes.clear();
+    _totals.clear();
+    _actual = false;
+    bool found = false;
+    for (const QString &document: documents)
+    {
+        const QString text = document.trimmed();
+        if (text.isEmpty())
+            continue;
+        QString e;
+        if (text.startsWith('<') ? parseShowplan(text, e) : parsePg(text.toUtf8(), e))
+            found = true;
+        else
+            error = e;
+    }
+    if (!found && error.isEmpty())
+        error = tr("the result is not a query plan");
+    analyze();
+    fill();
+    return found;
+}
+
+bool PlanViewer::parsePg(const QByteArray &json, QString &error)
+{
+    QJsonParseError e;
+    QJsonDocument doc = QJsonDocument::fromJson(json, &e);
+    if (doc.isNull())
+    {
+        error = tr("%1 at offset %2").arg(e.errorString()).arg(e.offset);
+        return false;
+    }
+    QJsonArray statements = (doc.isArray() ? doc.array() : QJsonArray() << doc.object());
+    bool found = false;
+    for (const QJsonValue &v: statements)
+    {
+        const QJsonObject statement = v.toObject();
+        if (!statement.contains("Plan"))
+            continue;
+        found = true;
+        const int first = _nodes.size();
+        parsePgNode(statement.value("Plan").toObject(), -1);
+        if (statement.contains("Planning Time"))
+            _totals.append(tr("planning %1 ms").arg(statement.value("Planning Time").toDouble()));
+        if (statement.contains("Execution Time"))
+            _totals.append(tr("execution %1 ms").arg(statement.value("Execution Time").toDouble()));
+
+        // buffers of a node include the buffers of its children
+        QVector<qint64> reads(_nodes.size() - first, 0);
+        QVector<qint64> hits(_nodes.size() - first, 0);
+        for (int i = first; i < _nodes.size(); ++i)
+        {
+            const Node &n = _nodes.at(i);
+            if (n.parent < first)
+                continue;
+            reads[n.parent - first] += std::max<qint64>(n.reads, 0);
+            hits[n.parent - first] += std::max<qint64>(n.hits, 0);
+        }
+        for (int i = first; i < _nodes.size(); ++i)
+        {
+            Node &n = _nodes[i];
+            if (n.reads >= 0)
+                n.reads = std::max<qint64>(n.reads - reads.at(i - first), 0);
+            if (n.hits >= 0)
+                n.hits = std::max<qint64>(n.hits - hits.at(i - first), 0);
+        }
+    }
+    if (!found)
+        error = tr("no \"Plan\" within the document");
+    return found;
+}
+
+void PlanViewer::parsePgNode(const QJsonObject &plan, int parent)
+{
+    Node n;
+    n.parent = parent;
+    // the way EXPLAIN names the nodes in text format
+    QString operation = plan.value("Node Type").toString();
+    const QString join = plan.value("Join Type").toString();
+    if (!join.isEmpty() && join != "Inner")
+    {
+        if (operation.endsWith(" Join"))
+            operation.insert(operation.size() - 5, ' ' + join);
+        else
+            operation += ' ' + join + " Join";
+    }
+    if (plan.contains("Index Name"))
+        operation += " using " + plan.value("Index Name").toString();
+    if (plan.contains("Relation Name"))
+    {
+        operation += " on " + plan.value("Relation Name").toString();
+        const QString alias = plan.value("Alias").toString();
+        if (!alias.isEmpty() && alias != plan.value("Relation Name").toString())
+            operation += ' ' + alias;
+    }
+    else if (plan.contains("CTE Name"))
+        operation += " on " + plan.value("CTE Name").toString();
+    else if (plan.contains("Function Name"))
+        operation += " on " + plan.value("Function Name").toString();
+    if (plan.contains("Subplan Name"))
+        operation = plan.value("Subplan Name").toString() + " -> " + operation;
+    n.operation = operation;
+
+    QStringList details;
+    static const char *conditions[] = {
+        "Index Cond", "Recheck Cond", "Hash Cond", "Merge Cond", "Join Filter", "Filter",
+        "Sort Key", "Group Key", "Sort Method", "Rows Removed by Filter", "Rows Removed by Index Recheck"
+    };
+    for (const char *key: conditions)
+    {
+        const QJsonValue v = plan.value(key);
+        if (v.isUndefined())
+            continue;
+        QString text;
+        if (v.isArray())
+        {
+            QStringList items;
+            for (const QJsonValue &item: v.toArray())
+                items.append(item.toVariant().toString());
+            text = items.join(", ");
+        }
+        else
+            text = v.toVariant().toString();
+        details.append(QString("%1: %2").arg(key, text));
+    }
+
+    n.rows = plan.value("Plan Rows").toDouble(-1);
+    n.cost = plan.value("Total Cost").toDouble(-1);
+    if (plan.contains("Actual Loops"))
+    {
+        n.loops = plan.value("Actual Loops").toDouble();
+        n.actualRows = plan.value("Actual Rows").toDouble();
+        if (n.loops == 0)
+            details.prepend(tr("never executed"));
+        // TIMING OFF leaves rows only
+        if (plan.contains("Actual Total Time"))
+        {
+            _actual = true;
+            n.time = plan.value("Actual Total Time").toDouble() * n.loops;
+        }
+    }
+    if (plan.contains("Shared Read Blocks"))
+    {
+        n.reads = plan.value("Shared Read Blocks").toVariant().toLongLong() +
+                plan.value("Local Read Blocks").toVariant().toLongLong() +
+                plan.value("Temp Read Blocks").toVariant().toLongLong();
+        n.hits = plan.value("Shared Hit Blocks").toVariant().toLongLong() +
+                plan.value("Local Hit Blocks").toVariant().toLongLong();
+    }
+    n.details = details.join("; ");
+
+    _nodes.append(n);
+    const int index = _nodes.size() - 1;
+    for (const QJsonValue &child: plan.value("Plans").toArray())
+        parsePgNode(child.toObject(), index);
+}
+
+bool PlanViewer::parseShowplan(const QString &xml, QString &error)
+{
+    QXmlStreamReader r(xml);
+    QVector<int> stack;             ///< RelOp elements being read
+    bool predicate = false;         ///< the text of the predicate is expected
+    bool found = false;
+    while (!r.atEnd())
+    {
+        r.readNext();
+        if (r.isStartElement())
+        {
+            const QXmlStreamAttributes a = r.attributes();
+            if (r.name() == QLatin1String("RelOp"))
+            {
+                Node n;
+                n.parent = (stack.isEmpty() ? -1 : stack.last());
+                n.operation = a.value("PhysicalOp").toString();
+                const QString logical = a.value("LogicalOp").toString();
+                if (!logical.isEmpty() && logical != n.operation)
+                    n.operation += " (" + logical + ')';
+                n.rows = a.value("EstimateRows").toDouble();
+                n.cost = a.value("EstimatedTotalSubtreeCost").toDouble();
+                stack.append(_nodes.size());
+                _nodes.append(n);
+                found = true;
+            }
+            else if (stack.isEmpty())
+            {
+                if (r.name() == QLatin1String("QueryTimeStats"))
+                    _totals.append(tr("elapsed %1 ms, cpu %2 ms").
+                                   arg(a.value("ElapsedTime").toString(), a.value("CpuTime").toString()));
+            }
+            else if (r.name() == QLatin1String("RunTimeCountersPerThread"))
+            {
+                // counters of the threads are summed, the threads run at once
+                Node &n = _nodes[stack.last()];
+                if (n.loops < 0)
+                {
+                    n.loops = n.actualRows = 0;
+                    n.reads = n.hits = 0;
+                }
+                const qint64 physical = a.value("ActualPhysicalReads").toLongLong() + a.value("ActualReadAheads").toLongLong();
+                n.loops += a.value("ActualExecutions").toDouble();
+                n.actualRows += a.value("ActualRows").toDouble();
+                n.reads += physical;
+                n.hits += std::max<qint64>(a.value("ActualLogicalReads").toLongLong() - physical, 0);
+                if (a.hasAttribute("ActualElapsedms"))
+                {
+                    _actual = true;
+                    n.time = std::max(n.time, a.value("ActualElapsedms").toDouble());
+                }
+            }
+            else if (r.name() == QLatin1String("Object") && !_nodes.at(stack.last()).operation.contains(" on "))
+            {
+                QStringList names;
+                for (const char *part: { "Database", "Schema", "Table" })
+                {
+                    if (a.hasAttribute(part))
+                        names.append(a.value(part).toString());
+                }
+                Node &n = _nodes[stack.last()];
+                if (!names.isEmpty())
+                    n.operation += " on " + names.join('.');
+                if (a.hasAttribute("Index"))
+                    n.operation += " using " + a.value("Index").toString();
+            }
+            else if (r.name() == QLatin1String("Predicate"))
+                predicate = true;
+            else if (predicate && r.name() == QLatin1String("ScalarOperator"))
+            {
+                // the outermost operator holds the whole expression
+                Node &n = _nodes[stack.last()];
+                n.details += (n.details.isEmpty() ? "" : "; ") + tr("Predicate: %1").arg(a.value("ScalarString").toString());
+                predicate = false;
+            }
+        }
+        else if (r.isEndElement() && r.name() == QLatin1String("RelOp"))
+        {
+            // estimates are per execution, so are actual rows shown
+            Node &n = _nodes[stack.last()];
+            if (n.loops > 0)
+                n.actualRows /= n.loops;
+            stack.removeLast();
+        }
+    }
+    if (r.hasError())
+    {
+        error = tr("%1 at line %2").arg(r.errorString()).arg(r.lineNumber());
+        return false;
+    }
+    if (!found)
+        error = tr("no RelOp within the document");
+    return found;
+}
+
+void PlanViewer::analyze()
+{
+    QVector<double> children(_nodes.size(), 0);
+    for (const Node &n: _nodes)
+    {
+        if (n.parent >= 0)
+            children[n.parent] += std::max(_actual ? n.time : n.cost, 0.0);
+    }
+    for (int i = 0; i < _nodes.size(); ++i)
+    {
+        Node &n = _nodes[i];
+        n.self = std::max((_actual ? n.time : n.cost) - children.at(i), 0.0);
+    }
+}
+
+void PlanViewer::fill()
+{
+    _tree->clear();
+    _tree->headerItem()->setText(Self, _actual ? tr("self, ms") : tr("self cost"));
+    _tree->headerItem()->setText(Total, _actual ? tr("total, ms") : tr("total cost"));
+    double whole = 0;
+    qint64 all_reads = 0;
+    for (const Node &n: _nodes)
+    {
+        whole += n.self;
+        all_reads += std::max<qint64>(n.reads, 0);
+    }
+
+    // the heaviest nodes having a noticeable share
+    QVector<int> by_time(_nodes.size());
+    std::iota(by_time.begin(), by_time.end(), 0);
+    QVector<int> by_reads = by_time;
+    std::stable_sort(by_time.begin(), by_time.end(), [this](int a, int b) {
+        return _nodes.at(a).self > _nodes.at(b).self;
+    });
+    std::stable_sort(by_reads.begin(), by_reads.end(), [this](int a, int b) {
+        return _nodes.at(a).reads > _nodes.at(b).reads;
+    });
+    QVector<double> time_share(_nodes.size(), 0);
+    QVector<double> reads_share(_nodes.size(), 0);
+    for (int i = 0; i < std::min(PLAN_HOT_NODES, int(_nodes.size())); ++i)
+    {
+        double share = (whole > 0 ? _nodes.at(by_time.at(i)).self * 100 / whole : 0);
+        if (share >= PLAN_HOT_SHARE)
+            time_share[by_time.at(i)] = share;
+        share = (all_reads > 0 ? double(_nodes.at(by_reads.at(i)).reads) * 100 / all_reads : 0);
+        if (share >= PLAN_HOT_SHARE)
+            reads_share[by_reads.at(i)] = share;
+    }
+
+    int misestimated = 0;
+    QVector<QTreeWidgetItem*> items;
+    for (int i = 0; i < _nodes.size(); ++i)
+    {
+        const Node &n = _nodes.at(i);
+        QTreeWidgetItem *item = (n.parent < 0 ? new QTreeWidgetItem(_tree) : new QTreeWidgetItem(items.at(n.parent)));
+        items.append(item);
+        item->setText(Operation, n.operation);
+        item->setText(Self, number(n.self));
+        item->setText(Share, whole > 0 ? QString::number(n.self * 100 / whole, 'f', 1) : QString());
+        item->setText(Total, number(_actual ? n.time : n.cost));
+        item->setText(Rows, number(n.rows));
+        item->setText(ActualRows, number(n.actualRows));
+        item->setText(Loops, number(n.loops));
+        item->setText(Reads, n.reads < 0 ? QString() : QString::number(n.reads));
+        item->setText(Hits, n.hits < 0 ? QString() : QString::number(n.hits));
+        item->setText(Details, n.details);
+        item->setToolTip(Details, n.details);
+        for (int c = Self; c < Details; ++c)
+            item->setTextAlignment(c, Qt::AlignRight | Qt::AlignVCenter);
+
+        if (time_share.at(i) > 0)
+        {
+            QColor color(255, 80, 0, int(40 + time_share.at(i) * 1.5));
+            for (int c: { Operation, Self, Share })
+                item->setBackground(c, color);
+        }
+        if (reads_share.at(i) > 0)
+            item->setBackground(Reads, QColor(0, 120, 255, int(40 + reads_share.at(i) * 1.5)));
+        if (n.rows >= 0 && n.actualRows >= 0 && n.loops > 0)
+        {
+            double ratio = std::max(n.actualRows, 1.0) / std::max(n.rows, 1.0);
+            if (ratio < 1)
+                ratio = 1 / ratio;
+            if (ratio >= PLAN_MISESTIMATE_RATIO)
+            {
+                ++misestimated;
+                const QString tip = (n.actualRows > n.rows ? tr("underestimated %1 times") : tr("overestimated %1 times")).
+                        arg(QString::number(ratio, 'f', 0));
+                for (int c: { Rows, ActualRows })
+                {
+                    item->setBackground(c, QColor(255, 200, 0, 110));
+                    item->setToolTip(c, tip);
+                }
+            }
+        }
+    }
+    _tree->expandAll();
+    for (int c = Operation; c < Details; ++c)
+        _tree->resizeColumnToContents(c);
+
+    QStringList summary = _totals;
+    if (!by_time.isEmpty() && time_share.at(by_time.first()) > 0)
+        summary.append(tr("hottest: %1 (%2%)").arg(_nodes.at(by_time.first()).operation).
+                       arg(QString::number(time_share.at(by_time.first()), 'f', 1)));
+    if (misestimated)
+        summary.append(tr("%1 misestimated nodes").arg(misestimated));
+    _summary->setText(summary.join(", "));
+}
@@ -0,0 +1,65 @@
+#ifndef PLANVIEWER_H
+#define PLANVIEWER_H
+
+#include <QWidget>
+#include <QVector>
+
+// nodes marked as hot by exclusive time (cost if the plan is not executed) and by reads
+#define PLAN_HOT_NODES 3
+// nodes below this share of the whole plan are not marked hot, %
+#define PLAN_HOT_SHARE 10
+// estimated and actual rows differing more than that times are marked
+#define PLAN_MISESTIMATE_RATIO 10
+
+class QJsonObject;
+class QLabel;
+class QTreeWidget;
+
+/*!
+ * \brief Tree of a query plan within the "plan" tab of the results (Query > Explain analyze).
+ *
+ * Plans are postgres EXPLAIN (FORMAT JSON) documents or ms sql SHOWPLAN_XML ones (actual
+ * counters of STATISTICS XML plans are shown too). Exclusive time of a node is its time less
+ * the time of its children. The nodes taking most of the time, the nodes reading most of
+ * the pages and the nodes whose row estimates are off by PLAN_MISESTIMATE_RATIO are highlighted.
+ */
+class PlanViewer : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit PlanViewer(QWidget *parent = nullptr);
+    /*!
+     * \brief show the plans (a document per statement), the format is detected by the text
+     * \return false if no document is a plan
+     */
+    bool setPlan(const QStringList &documents, QString &error);
+
+private:
+    struct Node
+    {
+        int parent = -1;
+        QString operation;
+        QString details;
+        double rows = -1;           ///< estimated rows per loop
+        double actualRows = -1;     ///< actual rows per loop
+        double loops = -1;
+        double cost = -1;           ///< estimated cost including children
+        double time = -1;           ///< actual time including children, ms of all loops
+        qint64 reads = -1;          ///< pages read from disk by the node itself
+        qint64 hits = -1;           ///< pages found in cache by the node itself
+        double self = 0;            ///< exclusive time, or cost if the time is unknown
+    };
+    bool parsePg(const QByteArray &json, QString &error);
+    void parsePgNode(const QJsonObject &plan, int parent);
+    bool parseShowplan(const QString &xml, QString &error);
+    void analyze();
+    void fill();
+
+    QVector<Node> _nodes;
+    QStringList _totals;            ///< statement level timings
+    bool _actual = false;           ///< the plan is executed, times are known
+    QLabel *_summary;
+    QTreeWidget *_tree;
+};
+
+#endif // PLANVIEWER_H
@@ -13,9 +13,11 @@
 #include <QTextStream>
 #include <QMenu>
 #include <QVBoxLayout>
+#include <QHBoxLayout>
 #include "findandreplacepanel.h"
 #include <QKeyEvent>
 #include <memory>
+#include <algorithm>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
@@ -31,6 +33,22 @@
 #include <QTimer>
 #include "sqlparser.h"
 #include "datatable.h"
+#include "cursortablemodel.h"
+#include "pgconnection.h"
+#include "resultwriter.h"
+#include "largefile.h"
+#include "statementsplitter.h"
+#include "copystreams.h"
+#include "completionindex.h"
+#include "executionservice.h"
+#include <QFileDialog>
+#include <QLineEdit>
+#include "selectionaggregate.h"
+#include "notificationlistener.h"
+#include "notificationspanel.h"
+#include "planviewer.h"
+#include "gridsearch.h"
+#include "trace.h"
 
 QueryWidget::QueryWidget(QWidget *parent) : QueryWidget(nullptr, parent)
 {
@@ -41,6 +59,25 @@ QueryWidget::QueryWidget(DbConnection *connection, QWidget *parent) :
 {
     _messages = nullptr;
     _highlighter = nullptr;
+    _aggregate = new SelectionAggregate(this);
+    connect(_aggregate, &SelectionAggregate::ready, this, [this](const SelectionAggregateResult &res) {
+        emit selectionAggregated(res.cells > 1 ? res.toString() : QString());
+    });
+    _search = new GridSearch(this);
+    connect(_search, &GridSearch::found, this, [this]() {
+        if (_find_pending)
+            _find_pending = !showHit(_find_forward);
+    });
+    connect(_search, &GridSearch::finished, this, [this]() {
+        if (!_find_pending)
+            return;
+        _find_pending = false;
+        if (!showHit(_find_forward))
+            QToolTip::showText(_find->mapToGlobal(QPoint(0, _find->height())), tr("not found"), _find);
+    });
+    _watch_timer = new QTimer(this);
+    _watch_timer->setSingleShot(true);
+    connect(_watch_timer, &QTimer::timeout, this, &QueryWidget::refreshWatch);
     _editorLayout = new QVBoxLayout(this);
     _editorLayout->setSpacing(0);
     _editorLayout->setMargin(0);
@@ -52,6 +89,9 @@ QueryWidget::QueryWidget(DbConnection *connection, QWidget *parent) :
 
 QueryWidget::~QueryWidget()
 {
+    // the connection thread may wait for COPY data
+    if (_copy_pipe)
+        _copy_pipe->abort();
     clearResult();
     if (_editorLayout->count() > 1)
     {
@@ -77,6 +117,36 @@ bool QueryWidget::openFile(const QString &fileName, const QString &encoding)
     }
     _fn = fileName;
     _encoding = encoding;
+    if (_large_file)
+    {
+        _large_file.reset();
+        qobject_cast<CodeEditor*>(_editor)->setReadOnly(false);
+    }
+
+    // huge dumps are not loaded into the editor
+    qint64 threshold = SqtSettings::value("largeFileThreshold", 50).toLongLong() * 1024 * 1024;
+    if (threshold > 0 && f.size() > threshold)
+    {
+        std::unique_ptr<LargeFile> large_file(new LargeFile());
+        QString err;
+        if (large_file->open(fileName, encoding, err))
+        {
+            f.close();
+            _large_file = std::move(large_file);
+            dehighlight();
+            showPage(0);
+            CodeEditor *editor = qobject_cast<CodeEditor*>(_editor);
+            editor->setLineWrapMode(QPlainTextEdit::NoWrap);
+            editor->setReadOnly(true);
+            connect(editor->verticalScrollBar(), &QScrollBar::valueChanged, this, &QueryWidget::onEditorScrolled, Qt::UniqueConnection);
+            document()->setModified(false);
+            if (_messages)
+                onMessage(tr("the file is shown by pages read-only, execution runs the whole file"));
+            return true;
+        }
+        onError(tr("Unable to map %1: %2").arg(fileName).arg(err));
+    }
+
     QTextStream read_stream(&f);
     read_stream.setCodec(QTextCodec::codecForName(_encoding.toLatin1().data()));
     if (f.size() > 1024 * 1024 * 5) // do not highlight > 5mb scripts
@@ -91,6 +161,20 @@ bool QueryWidget::openFile(const QString &fileName, const QString &encoding)
 
 bool QueryWidget::saveFile(const QString &fileName, const QString &encoding)
 {
+    // the text of a large file is not changed, so it's just copied
+    if (_large_file)
+    {
+        if (fileName == _fn)
+            return true;
+        QFile::remove(fileName);
+        if (!QFile::copy(_fn, fileName))
+        {
+            onError(tr("Unable to save %1").arg(fileName));
+            return false;
+        }
+        _fn = fileName;
+        return true;
+    }
     QFile f(fileName);
     if (!f.open(QIODevice::WriteOnly))
     {
@@ -117,6 +201,9 @@ void QueryWidget::setDbConnection(DbConnection *connection)
     {
         dbConnectionChanged = true;
         _connection.reset(connection);
+        // notifications of another database
+        delete _notifications;
+        _notifications = nullptr;
     }
 
     if (connection)
@@ -129,25 +216,84 @@ void QueryWidget::setDbConnection(DbConnection *connection)
             _resSplitter = new QSplitter(res);
             _messages = new QPlainTextEdit(res);
             _messages->setTextInteractionFlags(Qt::TextSelectableByMouse | Qt::TextSelectableByKeyboard);
+            _messages->setContextMenuPolicy(Qt::CustomContextMenu);
+            connect(_messages, &QPlainTextEdit::customContextMenuRequested, this, [this](const QPoint &pos) {
+                std::unique_ptr<QMenu> menu(_messages->createStandardContextMenu());
+                menu->addSeparator();
+                menu->addAction(tr("Export timings..."), this, &QueryWidget::exportTimings)->setEnabled(!_timings.isEmpty());
+                menu->exec(_messages->mapToGlobal(pos));
+            });
             res->addTab(_messages, tr("messages"));
+            _filter = new QLineEdit(res);
+            _filter->setPlaceholderText(tr("filter rows"));
+            _filter->setToolTip(tr("text within any column or conditions like: id > 10 and name ~ 'text' and note is null"));
+            _filter->setClearButtonEnabled(true);
+            connect(_filter, &QLineEdit::returnPressed, this, &QueryWidget::applyFilter);
+            connect(_filter, &QLineEdit::textChanged, this, [this](const QString &text) {
+                if (text.isEmpty())
+                    applyFilter();
+            });
+            _find = new QLineEdit(res);
+            _find->setPlaceholderText(tr("find in results"));
+            _find->setToolTip(tr("Enter - the next cell holding the text, Shift+Enter - the previous one"));
+            _find->setClearButtonEnabled(true);
+            connect(_find, &QLineEdit::returnPressed, this, [this]() {
+                findInResults(!(QApplication::keyboardModifiers() & Qt::ShiftModifier));
+            });
+            connect(_find, &QLineEdit::textChanged, this, [this]() {
+                _search->cancel();
+                _search_stale = true;
+                _find_pending = false;
+            });
+            QWidget *corner = new QWidget(res);
+            QHBoxLayout *cornerLayout = new QHBoxLayout(corner);
+            cornerLayout->setContentsMargins(0, 0, 0, 0);
+            cornerLayout->addWidget(_find);
+            cornerLayout->addWidget(_filter);
+            res->setCornerWidget(corner);
             addWidget(res);
             setSizes(QList<int>() << 1 << 0);
             setOrientation(Qt::Vertical);
         }
-        connect(connection, &DbConnection::fetched, this, &QueryWidget::fetched, Qt::QueuedConnection);
+        ExecutionService::instance().connectFetched(connection, this, [this](DataTable *table) { fetched(table); });
         connect(connection, &DbConnection::message, this, &QueryWidget::onMessage, Qt::QueuedConnection);
         connect(connection, &DbConnection::error, this, &QueryWidget::onError, Qt::QueuedConnection);
 
         connect(connection, &DbConnection::queryStateChanged, this, [this](QueryState queryState) {
             // actual query execution time before post-processing
             if (queryState == QueryState::Inactive)
-                onMessage(tr("%1: done in %2").arg(QTime::currentTime().toString("HH:mm:ss")).arg(_connection->elapsed()));
+            {
+                ExecutionService::instance().flushFetched(_connection.get());
+                if (!_watch_refreshing)
+                    onMessage(tr("%1: done in %2").arg(QTime::currentTime().toString("HH:mm:ss")).arg(_connection->elapsed()));
+                // fetched() of the query are handled already and the next query is not started yet
+                QueryTimings timings = _connection->timings();
+                timings.model = _model_us;
+                timings.view = _view_us;
+                _model_us = _view_us = 0;
+                _timings.append(QTime::currentTime().toString("HH:mm:ss.zzz") + ',' + timings.toCsv());
+                if (_timings.size() > QUERY_TIMINGS_KEPT)
+                    _timings.removeFirst();
+                if (SqtSettings::value("queryTimings", false).toBool())
+                    onMessage(timings.toString());
+            }
 
             if (MainWindow *mainWindow = qobject_cast<MainWindow*>(window()))
                 mainWindow->queryStateChanged(this, queryState);
         }, Qt::QueuedConnection);
 
         connect(connection, &DbConnection::queryFinished, this, [this]() {
+            ExecutionService::instance().flushFetched(_connection.get());
+            if (_watch_refreshing)
+            {
+                watchRefreshed();
+                return;
+            }
+            if (_explaining || _explain_rollback)
+            {
+                showPlan();
+                return;
+            }
             // print all resultsets structure ready to be used in 'create function returning table(...)'
             QColor resultsetStructureColor = _messages->palette().text().color();
             resultsetStructureColor.setAlphaF(0.6);
@@ -175,11 +321,18 @@ void QueryWidget::setDbConnection(DbConnection *connection)
                 log('(' + structure + ')', resultsetStructureColor);
             }
 
+            showMemory();
+
             // scroll down and left
             auto cursor = _messages->textCursor();
             cursor.movePosition(QTextCursor::End);
             cursor.movePosition(QTextCursor::StartOfLine);
             _messages->setTextCursor(cursor);
+
+            if (_script)
+                executeNextBatch();
+            else if (isWatching())
+                _watch_timer->start();
         }, Qt::QueuedConnection);
 
         connection->open();
@@ -206,26 +359,13 @@ void QueryWidget::highlight(std::shared_ptr<DbConnection> con)
     {
         if (con)
             _connection = con;
-        QJsonDocument settingsDocument;
-        QJsonObject settings;
+        // rules are compiled once per process and shared by the tabs
+        QString confFile;
         if (_connection)
         {
             try
             {
-                QFile file(Scripting::dbmsScriptPath(_connection.get()) + "hl.conf");
-                if (file.open(QIODevice::ReadOnly | QIODevice::Text))
-                {
-                    auto text_data = file.readAll();
-                    if (!text_data.isEmpty())
-                    {
-                        QJsonParseError error;
-                        settingsDocument = QJsonDocument::fromJson(text_data, &error);
-                        if (settingsDocument.isNull())
-                            throw error.errorString();
-                        settings = settingsDocument.object();
-                    }
-                    file.close();
-                }
+                confFile = Scripting::dbmsScriptPath(_connection.get()) + "hl.conf";
             }
             catch (const QString &err)
             {
@@ -241,10 +381,17 @@ void QueryWidget::highlight(std::shared_ptr<DbConnection> con)
         }
 
         if (_editor)
-            _highlighter = new SqlSyntaxHighlighter(settings, _editor);
+        {
+            QString err;
+            _highlighter = new SqlSyntaxHighlighter(confFile, err, _editor);
+            if (!err.isEmpty())
+                emit error(err);
+            if (QPlainTextEdit *plain = qobject_cast<QPlainTextEdit*>(_editor))
+                _highlighter->setViewportMode(plain);
+        }
     }
 
-    if (_highlighter)
+    if (_highlighter && !_large_file)
         _highlighter->setDocument(document());
 }
 
@@ -467,22 +614,309 @@ void QueryWidget::onMessage(const QString &text)
 void QueryWidget::onError(const QString &text)
 {
     log(text, Qt::red);
+    // the rest of script is not executed
+    if (_script)
+        _script_failed = true;
+    if (isWatching())
+    {
+        stopWatch();
+        log(tr("watching stopped"), Qt::red);
+    }
 }
 
-void QueryWidget::fetched(DataTable *table)
+void QueryWidget::showResultsetsTab()
 {
     if (widget(1)->height() == 0)
         setSizes(QList<int>() << 400 << 100);
 
-    // second widget within splitter is a tabwidget with persistent log tab
-    // and optional (leading) resultsets tab
+    // second widget within splitter is a tabwidget with persistent log tab,
+    // optional (leading) resultsets tab and optional notifications tab
     QTabWidget *res_tw = qobject_cast<QTabWidget*>(widget(1));
     Q_ASSERT(res_tw != nullptr);
-    if (res_tw->count() == 1) // only log tab exists
+    if (res_tw->indexOf(_resSplitter) < 0)
     {
         res_tw->insertTab(0, _resSplitter, tr("resultsets"));
         res_tw->setCurrentIndex(0);
     }
+}
+
+bool QueryWidget::openCursor(const QString &query)
+{
+    int pageSize = SqtSettings::value("pgLazyPageSize", 0).toInt();
+    int length;
+    QString keyword;
+    // the cursor uses separate connection, so it can't see changes of current transaction
+    if (pageSize <= 0 ||
+            !qobject_cast<PgConnection*>(_connection.get()) ||
+            !_connection->transactionStatus().isEmpty() ||
+            !SqlParser::isSingleDataStatement(query, &length, &keyword) ||
+            (keyword != "select" && keyword != "with" && keyword != "values" && keyword != "table"))
+        return false;
+
+    CursorTableModel *m = new CursorTableModel(_connection->clone(), _resSplitter);
+    showResultsetsTab();
+    QTableView *tv = new QTableView(_resSplitter);
+    tv->horizontalHeader()->viewport()->setMouseTracking(true);
+    tv->setObjectName("cursor");
+    tv->setModel(m);
+    _resSplitter->addWidget(tv);
+    tv->horizontalHeader()->setResizeContentsPrecision(20);
+    _cursorModel = m;
+    connect(m, &CursorTableModel::error, this, &QueryWidget::onError);
+    connect(m, &CursorTableModel::opened, this, [this, tv]() {
+        tv->resizeColumnsToContents();
+        onMessage(tr("%1: the rest of rows will be fetched while scrolling").
+                  arg(QTime::currentTime().toString("HH:mm:ss")));
+    });
+    connect(m, &CursorTableModel::busyChanged, this, [this](bool busy) {
+        if (MainWindow *mainWindow = qobject_cast<MainWindow*>(window()))
+            mainWindow->queryStateChanged(this, busy ? QueryState::Running : QueryState::Inactive);
+    });
+    m->open(query.left(length), pageSize);
+    return true;
+}
+
+bool QueryWidget::isCursorBusy() const
+{
+    return _cursorModel && _cursorModel->isBusy();
+}
+
+void QueryWidget::cancelCursor()
+{
+    if (_cursorModel)
+        _cursorModel->cancel();
+}
+
+void QueryWidget::executeToFile(const QString &query, const QString &fileName)
+{
+    if (!_connection)
+        return;
+    _connection->setExportWriter(ResultWriter::create(fileName));
+    onMessage(tr("%1: exporting to %2").
+              arg(QTime::currentTime().toString("HH:mm:ss")).
+              arg(fileName));
+    _connection->executeAsync(query);
+}
+
+void QueryWidget::executeFile()
+{
+    if (!_large_file || !_connection || _script)
+        return;
+    startScript(0, SqtSettings::value("scriptBatchStatements", 0).toInt());
+    _stream_offset = 0;
+    executeNextBatch();
+}
+
+bool QueryWidget::executeScript(const QString &script, int firstLine)
+{
+    int per_batch = SqtSettings::value("scriptBatchStatements", 0).toInt();
+    if (per_batch <= 0 || !_connection || _script)
+        return false;
+    startScript(firstLine, per_batch);
+    _script->feed(script);
+    _script->finish();
+    executeNextBatch();
+    return true;
+}
+
+void QueryWidget::stopScript()
+{
+    if (!_script)
+        return;
+    _script_failed = true;
+    // otherwise the script is finished as soon as the current batch is
+    if (_connection->queryState() == QueryState::Inactive)
+        executeNextBatch();
+}
+
+void QueryWidget::startScript(int firstLine, int statementsPerBatch)
+{
+    // T-SQL batches are separated by GO and may not be joined
+    bool tsql = _connection->dbmsName().contains("Microsoft SQL", Qt::CaseInsensitive);
+    _script.reset(new StatementSplitter(tsql ? StatementSplitter::Dialect::Go : StatementSplitter::Dialect::Semicolon, firstLine));
+    _script_batch = (tsql ? 1 : qMax(statementsPerBatch, 0));
+    _script_statements = 0;
+    _script_failed = false;
+    _stream_offset = -1;
+}
+
+void QueryWidget::feedScript()
+{
+    // the large file is read on demand
+    if (_stream_offset >= 0 && _stream_offset < _large_file->size())
+        _script->feed(_large_file->read(_stream_offset, LARGE_FILE_BATCH));
+    else
+        _script->finish();
+}
+
+void QueryWidget::pumpCopyData()
+{
+    if (!_copy_pipe || !_script)
+        return;
+    QByteArray data;
+    while (_copy_pipe->writable())
+    {
+        if (!_script->nextCopyData(data))
+        {
+            feedScript();
+            continue;
+        }
+        if (data.isNull())
+        {
+            _copy_pipe->finish();
+            _copy_pipe.reset();
+            return;
+        }
+        _copy_pipe->write(data);
+    }
+}
+
+void QueryWidget::executeNextBatch()
+{
+    // the rest of COPY data not taken by the server is skipped
+    if (_copy_pipe)
+    {
+        _copy_pipe->abort();
+        _copy_pipe.reset();
+    }
+    QStringList batch;
+    int batch_length = 0;
+    int first_line = 0, last_line = 0;
+    bool copy_in = false;
+    StatementSplitter::Statement statement;
+    while (!_script_failed)
+    {
+        if (!_script->next(statement))
+        {
+            if (_script->isFinished())
+                break;
+            feedScript();
+            continue;
+        }
+        // COPY is sent alone, its data is streamed while the statement runs
+        if (statement.copyIn)
+        {
+            if (!batch.isEmpty())
+            {
+                _script->putBack(statement);
+                break;
+            }
+            copy_in = true;
+        }
+        if (batch.isEmpty())
+            first_line = statement.line;
+        last_line = statement.line;
+        batch.append(statement.text);
+        batch_length += statement.text.length();
+        if (copy_in || batch.size() == _script_batch || batch_length >= LARGE_FILE_BATCH)
+            break;
+    }
+
+    QString now = QTime::currentTime().toString("HH:mm:ss");
+    if (batch.isEmpty())
+    {
+        onMessage(_script_failed ?
+                      tr("%1: the script is stopped after %2 statements").arg(now).arg(_script_statements) :
+                      tr("%1: %2 statements executed").arg(now).arg(_script_statements));
+        _script.reset();
+        _stream_offset = -1;
+        return;
+    }
+    _script_statements += batch.size();
+
+    QString progress;
+    if (batch.size() == 1)
+    {
+        QString head = batch.front().left(200).simplified();
+        if (head.length() > 80)
+            head = head.left(77) + "...";
+        progress = tr("%1: line %2: %3").arg(now).arg(first_line + 1).arg(head);
+    }
+    else
+        progress = tr("%1: lines %2-%3, %4 statements").arg(now).arg(first_line + 1).arg(last_line + 1).arg(batch.size());
+    if (_stream_offset >= 0)
+        progress += tr(" (%1 of %2 MB)").
+                arg(_stream_offset / 1048576.0, 0, 'f', 1).
+                arg(_large_file->size() / 1048576.0, 0, 'f', 1);
+    onMessage(progress);
+
+    if (copy_in)
+    {
+        // chunks are taken by the connection thread, the pipe is refilled here
+        QPointer<QueryWidget> self(this);
+        _copy_pipe = std::make_shared<CopyPipe>([self]() {
+            QMetaObject::invokeMethod(qApp, [self]() {
+                if (self)
+                    self->pumpCopyData();
+            }, Qt::QueuedConnection);
+        });
+        pumpCopyData();
+        _connection->setCopyInData(_copy_pipe);
+    }
+    // a statement may end with a line comment
+    _connection->executeAsync(batch.join("\n;\n"));
+}
+
+void QueryWidget::showPage(qint64 offset)
+{
+    _paging = true;
+    _page_offset = _large_file->lineStart(offset);
+    _page_end = _page_offset;
+    setPlainText(_large_file->read(_page_end, LARGE_FILE_PAGE));
+    _paging = false;
+}
+
+void QueryWidget::onEditorScrolled(int value)
+{
+    CodeEditor *editor = qobject_cast<CodeEditor*>(_editor);
+    if (!_large_file || _paging || !editor)
+        return;
+
+    QScrollBar *bar = editor->verticalScrollBar();
+    // the page is moved by a half to keep the context
+    if (value == bar->maximum() && _page_end < _large_file->size())
+    {
+        qint64 next = _large_file->lineStart(_page_offset + (_page_end - _page_offset) / 2);
+        int dropped = _large_file->lineBreaks(_page_offset, next);
+        showPage(next);
+        bar->setValue(qMax(0, value - dropped));
+    }
+    else if (value == bar->minimum() && _page_offset > 0)
+    {
+        qint64 prev = _large_file->lineStart(_page_offset - LARGE_FILE_PAGE / 2);
+        int added = _large_file->lineBreaks(prev, _page_offset);
+        showPage(prev);
+        bar->setValue(added);
+    }
+}
+
+void QueryWidget::fetched(DataTable *table)
+{
+    SQT_TRACE_SCOPE("QueryWidget::fetched");
+    if (_watch_refreshing)
+    {
+        // rows of the first resultset are merged into the grid once the refresh is complete
+        if (!_watch_source)
+            _watch_source = table;
+        if (table != _watch_source)
+            return;
+        if (!_watch_rows)
+            _watch_rows.reset(new DataTable());
+        TimingScope taking(_model_us);
+        QMutexLocker lk(&table->mutex);
+        _watch_rows->takeRows(table);
+        return;
+    }
+    if (_explaining)
+    {
+        // the plan is shown once the query is finished
+        if (!_plan_rows)
+            _plan_rows.reset(new DataTable());
+        QMutexLocker lk(&table->mutex);
+        _plan_rows->takeRows(table);
+        return;
+    }
+    showResultsetsTab();
 
     QString tname = QString::number(std::intptr_t(table));
     QTableView *tv = nullptr;
@@ -502,25 +936,357 @@ void QueryWidget::fetched(DataTable *table)
 
         m = new TableModel(_resSplitter);
         m->setObjectName("m" + tname);
+        connect(m, &TableModel::spillFailed, this, [this](const QString &error) {
+            log(tr("results beyond the memory budget are kept in memory, the spill file is not available: %1").arg(error), Qt::red);
+        });
         _tables.append(m);
         tv->setModel(m);
         _resSplitter->addWidget(tv);
-        m->take(table);
-        // prevent autoresize overhead when big resultset is fetched at once
-        tv->horizontalHeader()->setResizeContentsPrecision(20);
-        tv->resizeColumnsToContents();
+        {
+            TimingScope taking(_model_us);
+            m->take(table);
+            if (_filter && !_filter->text().isEmpty())
+            {
+                QString error;
+                m->setFilter(_filter->text(), error);
+            }
+        }
+        // ascending, descending, then the fetch order again
+        QHeaderView *header = tv->horizontalHeader();
+        header->setSortIndicator(-1, Qt::AscendingOrder);
+        header->setSortIndicatorShown(true);
+        header->setSectionsClickable(true);
+        connect(tv->selectionModel(), &QItemSelectionModel::selectionChanged, this, [this, tv]() {
+            _aggregate->start(tv->model(), tv->selectionModel()->selection());
+        });
+        connect(header, &QHeaderView::sortIndicatorChanged, m, [header, m](int column, Qt::SortOrder order) {
+            if (column >= 0 && column == m->sortColumn() &&
+                    m->sortOrder() == Qt::DescendingOrder && order == Qt::AscendingOrder)
+            {
+                header->setSortIndicator(-1, Qt::AscendingOrder);
+                return;
+            }
+            m->sort(column, order);
+        });
+        // widths are known from decoding, cells are not measured
+        TimingScope resizing(_view_us);
+        m->resizeColumns(tv);
     }
     else
     {
         m = qobject_cast<TableModel*>(tv->model());
+        TimingScope taking(_model_us);
         m->take(table);
     }
+    _search_stale = true;
+    if (!TableModel::keepWithinCap() && !_cap_warned)
+    {
+        _cap_warned = true;
+        log(tr("results of all the tabs take %1 MB, beyond the limit set in the settings").
+            arg(TableModel::totalResidentBytes() / 1048576.0, 0, 'f', 1), Qt::red);
+    }
+}
+
+qint64 QueryWidget::residentBytes() const
+{
+    qint64 bytes = 0;
+    for (const TableModel *m: _tables)
+        bytes += m->residentBytes();
+    if (_cursorModel)
+        bytes += _cursorModel->residentBytes();
+    return bytes;
+}
+
+void QueryWidget::findInResults(bool forward)
+{
+    if (_find->text().isEmpty() || _tables.isEmpty())
+        return;
+    _find_forward = forward;
+    if (_search_stale || _search->text() != _find->text())
+    {
+        // the hit is shown by found() or finished()
+        _search_stale = false;
+        _hit_grid = -1;
+        _find_pending = true;
+        _search->start(_tables, _find->text());
+        return;
+    }
+    if (!showHit(forward) && !_search->isRunning())
+        QToolTip::showText(_find->mapToGlobal(QPoint(0, _find->height())), tr("not found"), _find);
+}
+
+bool QueryWidget::showHit(bool forward)
+{
+    const std::vector<GridSearch::Hit> &hits = _search->hits();
+    if (hits.empty())
+        return false;
+    // the search goes on from the current cell of the grid of the last hit
+    GridSearch::Hit at = { _hit_grid, _hit_row, _hit_column };
+    if (_hit_grid >= 0 && _hit_grid < _tables.size())
+    {
+        QTableView *tv = gridView(_tables.at(_hit_grid));
+        QModelIndex current = (tv ? tv->currentIndex() : QModelIndex());
+        if (current.isValid())
+            at = { _hit_grid, _tables.at(_hit_grid)->sourceRow(current.row()), current.column() };
+    }
+    auto it = (at.grid < 0 ?
+                   (forward ? hits.cbegin() : hits.cend()) :
+                   (forward ? std::upper_bound(hits.cbegin(), hits.cend(), at) : std::lower_bound(hits.cbegin(), hits.cend(), at)));
+    // hits within rows filtered out are passed
+    for (size_t step = 0; step < hits.size(); ++step)
+    {
+        if (forward && it == hits.cend())
+            it = hits.cbegin();
+        if (!forward)
+        {
+            if (it == hits.cbegin())
+                it = hits.cend();
+            --it;
+        }
+        TableModel *m = _tables.value(it->grid);
+        QTableView *tv = (m ? gridView(m) : nullptr);
+        int row = (m ? m->viewRow(it->row) : -1);
+        if (tv && row >= 0)
+        {
+            _hit_grid = it->grid;
+            _hit_row = it->row;
+            _hit_column = it->column;
+            QModelIndex index = m->index(row, it->column);
+            tv->setCurrentIndex(index);
+            tv->scrollTo(index);
+            QToolTip::showText(_find->mapToGlobal(QPoint(0, _find->height())),
+                               tr("%1 of %2%3").arg(it - hits.cbegin() + 1).arg(hits.size()).
+                               arg(_search->isRunning() ? tr(", searching...") : QString()), _find);
+            return true;
+        }
+        if (forward)
+            ++it;
+    }
+    return false;
+}
+
+QTableView* QueryWidget::gridView(const TableModel *model) const
+{
+    for (int i = 0; i < _resSplitter->count(); ++i)
+    {
+        QTableView *tv = qobject_cast<QTableView*>(_resSplitter->widget(i));
+        if (tv && tv->model() == model)
+            return tv;
+    }
+    return nullptr;
+}
+
+void QueryWidget::showMemory()
+{
+    QTabWidget *res_tw = qobject_cast<QTabWidget*>(count() > 1 ? widget(1) : nullptr);
+    int tab = (res_tw ? res_tw->indexOf(_resSplitter) : -1);
+    if (tab < 0)
+        return;
+    QStringList resultsets;
+    for (int i = 0; i < _tables.size(); ++i)
+        resultsets.append(tr("%1: %2 rows, %3 MB").arg(i + 1).arg(_tables.at(i)->rowCount()).
+                          arg(_tables.at(i)->residentBytes() / 1048576.0, 0, 'f', 1));
+    res_tw->setTabText(tab, tr("resultsets (%1 MB)").arg(residentBytes() / 1048576.0, 0, 'f', 1));
+    res_tw->setTabToolTip(tab, resultsets.join('\n'));
+}
+
+void QueryWidget::showNotifications()
+{
+    PgConnection *pg = qobject_cast<PgConnection*>(_connection.get());
+    QTabWidget *res_tw = qobject_cast<QTabWidget*>(count() > 1 ? widget(1) : nullptr);
+    if (!pg || !res_tw)
+        return;
+    if (!_notifications)
+    {
+        _notifications = new NotificationsPanel(NotificationListener::forDatabase(pg->conninfo()), res_tw);
+        res_tw->addTab(_notifications, tr("notifications"));
+    }
+    if (widget(1)->height() == 0)
+        setSizes(QList<int>() << 400 << 100);
+    res_tw->setCurrentWidget(_notifications);
+}
+
+void QueryWidget::explain(const QString &query)
+{
+    if (!_connection || _connection->queryState() != QueryState::Inactive || _script)
+        return;
+    clearResult();
+    if (qobject_cast<PgConnection*>(_connection.get()))
+    {
+        // the options prefix a single statement, an incomplete one is left to the server to complain
+        QStringList statements = SqlParser::splitStatements(query);
+        if (statements.size() > 1)
+        {
+            onError(tr("explain needs a single statement, select the one to explain"));
+            return;
+        }
+        const QString statement = (statements.isEmpty() ? query : statements.front());
+        // analyze executes the statement, so its changes are rolled back
+        if (_connection->transactionStatus().isEmpty())
+        {
+            _explain_rollback = _connection->execute("begin");
+            if (!_explain_rollback)
+                return;
+        }
+        else
+        {
+            static const QStringList read_only = { "select", "values", "table", "show" };
+            if (!read_only.contains(SqlParser::firstKeyword(statement)))
+            {
+                onError(tr("explain analyze would execute the statement within the current transaction, "
+                           "finish the transaction to have the statement rolled back"));
+                return;
+            }
+        }
+        _explaining = true;
+        _connection->executeAsync("explain (analyze, buffers, format json) " + statement);
+        return;
+    }
+    _explaining = true;
+    // the option must be the only statement of its batch
+    _showplan = _connection->execute("set showplan_xml on");
+    if (!_showplan)
+    {
+        _explaining = false;
+        return;
+    }
+    _connection->executeAsync(query);
+}
+
+void QueryWidget::showPlan()
+{
+    _explaining = false;
+    std::unique_ptr<DataTable> rows(std::move(_plan_rows));
+    if (_showplan)
+    {
+        _showplan = false;
+        _connection->execute("set showplan_xml off");
+    }
+    if (_explain_rollback)
+    {
+        _explain_rollback = false;
+        _connection->execute("rollback");
+    }
+    QTabWidget *res_tw = qobject_cast<QTabWidget*>(count() > 1 ? widget(1) : nullptr);
+    // errors of the query are within the messages
+    if (!rows || !rows->columnCount() || !res_tw)
+        return;
+    QStringList documents;
+    for (int r = 0; r < rows->rowCount(); ++r)
+        documents.append(rows->storage(0).wholeString(r));
+    if (!_plan)
+    {
+        _plan = new PlanViewer(res_tw);
+        res_tw->addTab(_plan, tr("plan"));
+    }
+    QString error;
+    if (!_plan->setPlan(documents, error))
+        onError(error);
+    if (widget(1)->height() == 0)
+        setSizes(QList<int>() << 400 << 100);
+    res_tw->setCurrentWidget(_plan);
+}
+
+void QueryWidget::startWatch(const QString &query, int seconds)
+{
+    if (!_connection || _connection->queryState() != QueryState::Inactive || _script)
+        return;
+    // the key is chosen by the current cell of the previous result
+    _watch_key.clear();
+    if (_resSplitter->count())
+    {
+        QTableView *tv = qobject_cast<QTableView*>(_resSplitter->widget(0));
+        int column = (tv && tv->currentIndex().isValid() ? tv->currentIndex().column() : 0);
+        if (tv && tv->model() && column < tv->model()->columnCount())
+            _watch_key = tv->model()->headerData(column, Qt::Horizontal).toString();
+    }
+    clearResult();
+    _watch_query = query;
+    _watch_timer->setInterval(seconds * 1000);
+    onMessage(tr("watching every %1 s by %2").arg(seconds).
+              arg(_watch_key.isEmpty() ? tr("the first column") : _watch_key));
+    _connection->setPrepareNext();
+    _connection->executeAsync(query);
+}
+
+void QueryWidget::stopWatch()
+{
+    // the refresh being executed (if any) is dropped
+    _watch_query.clear();
+    _watch_timer->stop();
+}
+
+void QueryWidget::refreshWatch()
+{
+    if (!isWatching())
+        return;
+    if (!_connection || _connection->queryState() != QueryState::Inactive)
+    {
+        _watch_timer->start();
+        return;
+    }
+    _messages->clear();
+    _watch_refreshing = true;
+    _connection->setPrepareNext();
+    _connection->executeAsync(_watch_query);
+}
+
+void QueryWidget::watchRefreshed()
+{
+    _watch_refreshing = false;
+    _watch_source = nullptr;
+    std::unique_ptr<DataTable> rows(std::move(_watch_rows));
+    if (!isWatching())
+        return;
+    if (rows && !_tables.isEmpty())
+    {
+        TableModel *m = _tables.first();
+        // the delta may remove rows being searched or aggregated
+        _aggregate->cancel();
+        _search->cancel();
+        _search_stale = true;
+        TimingScope taking(_model_us);
+        m->applyDelta(rows.get(), std::max(0, rows->getColumnOrd(_watch_key)));
+    }
+    else if (rows)
+        // the first execution has not returned rows
+        fetched(rows.get());
+    _watch_timer->start();
+}
+
+void QueryWidget::applyFilter()
+{
+    // every grid the expression suits is filtered
+    QString error;
+    bool suits = _tables.isEmpty();
+    for (TableModel *m: _tables)
+        suits = m->setFilter(_filter->text(), error) || suits;
+    if (!suits)
+        QToolTip::showText(_filter->mapToGlobal(QPoint(0, _filter->height())), error, _filter);
+}
+
+void QueryWidget::exportTimings()
+{
+    QString fn = QFileDialog::getSaveFileName(this, tr("Export timings"), QString(), tr("CSV files (*.csv)"));
+    if (fn.isEmpty())
+        return;
+    QFile f(fn);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    {
+        onError(tr("Unable to save %1: %2").arg(fn).arg(f.errorString()));
+        return;
+    }
+    QTextStream out(&f);
+    out << "time," << QueryTimings::csvHeader() << '\n';
+    for (const QString &row: _timings)
+        out << row << '\n';
 }
 
 void QueryWidget::clearResult()
 {
     if (!_connection)
         return;
+    stopWatch();
 
     if (_messages) // it was nullptr once.. can't reproduce
         _messages->clear();
@@ -528,18 +1294,57 @@ void QueryWidget::clearResult()
     if (count() > 1) // TabWidget exists (false on destruction)
     {
         QTabWidget *res_tw = qobject_cast<QTabWidget*>(widget(1));
-        if (res_tw && res_tw->count() > 1)
+        if (res_tw && res_tw->indexOf(_resSplitter) >= 0)
         {
             // remove resultsets tab, _resSplitter stays alive
-            res_tw->removeTab(0);
+            res_tw->removeTab(res_tw->indexOf(_resSplitter));
             // delete QTableView widgets (current shown resultsets)
             // (it looks like simple delete works ok instead of setParent(nullptr) and deleteLater())
             for (int i = _resSplitter->count() - 1; i >= 0; --i)
                 delete _resSplitter->widget(i);
         }
+        // the plan belongs to the previous query
+        delete _plan;
+        _plan = nullptr;
     }
+    // the aggregated selection and the grids being searched may be read by threads
+    _aggregate->cancel();
+    _search->cancel();
+    _search_stale = true;
+    _find_pending = false;
+    _hit_grid = -1;
+    emit selectionAggregated(QString());
     qDeleteAll(_tables);
     _tables.clear();
+    delete _cursorModel;
+    _cursorModel = nullptr;
+    _explaining = false;
+    _plan_rows.reset();
+    _cap_warned = false;
+}
+
+const SqlParser::TokenStream &QueryWidget::sqlTokens(CodeEditor *editor)
+{
+    QTextDocument *doc = editor->document();
+    if (!_sql_tokens || _sql_tokens_document != doc)
+    {
+        disconnect(_sql_tokens_connection);
+        _sql_tokens = std::make_shared<SqlParser::TokenStream>(editor->text());
+        _sql_tokens_document = doc;
+        // the stream is shared with the handler as the document may outlive the widget members
+        std::shared_ptr<SqlParser::TokenStream> tokens = _sql_tokens;
+        _sql_tokens_connection = connect(doc, &QTextDocument::contentsChange, this,
+                                         [tokens, doc](int pos, int removed, int added) {
+            QTextCursor c(doc);
+            c.setPosition(pos);
+            c.setPosition(pos + added, QTextCursor::KeepAnchor);
+            tokens->update(pos, removed, c.selectedText());
+        });
+    }
+    // changes of the whole document are reported inexactly
+    if (_sql_tokens->text().length() != doc->characterCount() - 1)
+        _sql_tokens->reset(editor->text());
+    return *_sql_tokens;
 }
 
 void QueryWidget::onCompleterRequest()
@@ -625,8 +1430,8 @@ void QueryWidget::onCompleterRequest()
     if (words.isEmpty() || words.count() > 3 || !_connection || !_connection->open())
         return;
 
-    std::unique_ptr<Scripting::CppConductor> c;
-    auto exec = [this, &c, &words](const QString &objectType)
+    QString prefix = words.last();
+    auto exec = [this, &words](const QString &objectType) -> std::shared_ptr<const CompletionIndex>
     {
         auto env = [&words, &objectType](const QString &macro) -> QVariant
         {
@@ -643,77 +1448,95 @@ void QueryWidget::onCompleterRequest()
             return QVariant();
         };
 
+        // the source is indexed once while the catalog (and the session if needed) stays the same
+        auto lookup = [&objectType, &env](DbConnection *connection) -> std::shared_ptr<const CompletionIndex>
+        {
+            QString key = Scripting::resultKey(connection, Scripting::Context::Autocomplete, objectType, env);
+            std::shared_ptr<const CompletionIndex> index = CompletionIndex::cached(key);
+            if (index)
+                return index;
+            auto c = Scripting::execute(connection, Scripting::Context::Autocomplete, objectType, env);
+            if (!c || c->resultsets.isEmpty())
+                return nullptr;
+            index = std::make_shared<const CompletionIndex>(*c->resultsets.last());
+            CompletionIndex::cache(key, index);
+            return index;
+        };
+
         if (_connection->queryState() == QueryState::Inactive)
         {
             // disconnect all slots
+            ExecutionService::instance().forget(_connection.get());
             disconnect(_connection.get(), nullptr, nullptr, nullptr);
             auto localErrHandler = connect(_connection.get(), &DbConnection::error, this, &QueryWidget::onError);
-            c = Scripting::execute(_connection.get(), Scripting::Context::Autocomplete, objectType, env);
+            auto index = lookup(_connection.get());
             disconnect(localErrHandler);
             setDbConnection(_connection.get());
+            return index;
         }
-        else
-        {
-            // this option does not use current search_path, so you'd better avoid using
-            // autocompletion while query is being executed
 
-            std::unique_ptr<DbConnection> tmp_cn(_connection->clone());
-            c = Scripting::execute(tmp_cn.get(), Scripting::Context::Autocomplete, objectType, env);
-        }
+        // this option does not use current search_path, so you'd better avoid using
+        // autocompletion while query is being executed
+        std::unique_ptr<DbConnection> tmp_cn(_connection->clone());
+        return lookup(tmp_cn.get());
     };
 
     auto cmpl = completer();
     std::unique_ptr<TableModel> m(new TableModel(cmpl));
+    // only a few candidates are passed to the completer
+    auto take = [&m, &prefix](std::shared_ptr<const CompletionIndex> index) {
+        if (!index)
+            return;
+        std::unique_ptr<DataTable> candidates(index->filter(prefix));
+        m->take(candidates.get());
+    };
 
     switch (words.count())
     {
     case 1:
-        exec("objects");
+        take(exec("objects"));
         break;
     case 2:
     {
-        auto expl = SqlParser::explainAlias(words[0], ed->text(), ed->textCursor().position());
+        auto expl = SqlParser::explainAlias(words[0], sqlTokens(ed), ed->textCursor().position());
         switch (expl.first)
         {
         case SqlParser::AliasSearchStatus::NotParsed:
             return;
         case SqlParser::AliasSearchStatus::NotFound:
             // previous word may be both table and schema, so we should support both of them
-            exec("columns");
-            if (c && !c->resultsets.isEmpty())
-                m->take(c->resultsets.last());
-            exec("objects");
+            take(exec("columns"));
+            take(exec("objects"));
             break;
         case SqlParser::AliasSearchStatus::Name:
         {
-            QString prefix = words.last();
             words.swap(expl.second);
             words.append(prefix);
-            exec("columns");
+            take(exec("columns"));
             break;
         }
         case SqlParser::AliasSearchStatus::Fields:
             // model does not have a view yet, so no need to use model api
             m->table()->addColumn(new DataColumn());
             for (auto &w: expl.second)
-                m->table()->addRow()[0] = w;
+                m->table()->appendRow({ w });
         }
         break;
     }
     case 3:
-        exec("columns");
+        take(exec("columns"));
     }
 
-    if (c && !c->resultsets.isEmpty())
-        m->take(c->resultsets.last());
-
     if (!m->rowCount())
         return;
 
     ed->setCompleter(cmpl);
-    cmpl->setModelSorting(QCompleter::CaseSensitivelySortedModel);
+    // candidates are filtered already: prefix matches first, then substrings
+    cmpl->setModelSorting(QCompleter::UnsortedModel);
+    cmpl->setFilterMode(Qt::MatchContains);
+    cmpl->setCaseSensitivity(Qt::CaseInsensitive);
     cmpl->setModel(m.release());
-    cmpl->setCompletionPrefix(words.last());
+    cmpl->setCompletionPrefix(prefix);
     int cmplCount = cmpl->completionCount();
     if (!cmplCount)
         return;
@@ -16,6 +16,25 @@ class QVBoxLayout;
 class DataTable;
 class CodeEditor;
 class QCompleter;
+class CursorTableModel;
+class LargeFile;
+class StatementSplitter;
+class CopyPipe;
+class QLineEdit;
+class SelectionAggregate;
+class QTimer;
+class NotificationsPanel;
+class PlanViewer;
+class GridSearch;
+class QTableView;
+namespace SqlParser { class TokenStream; }
+
+// shown part of a large file, bytes
+#define LARGE_FILE_PAGE (2 * 1024 * 1024)
+// portion of a large file read at once and the max length of a batch of statements
+#define LARGE_FILE_BATCH (1024 * 1024)
+// timings of the latest queries kept to be exported
+#define QUERY_TIMINGS_KEPT 10000
 
 class QueryWidget : public QSplitter
 {
@@ -46,10 +65,72 @@ public:
     QWidget* editor() const;
     void setPlainText(const QString &text);
     void setHtml(const QString &html);
+    /*!
+     * \brief display a select's result by means of server-side cursor (if enabled)
+     * \return false if the query is not suitable for lazy fetching
+     *
+     * The cursor is opened and its pages are fetched asynchronously, errors are logged (the query is not executed again).
+     */
+    bool openCursor(const QString &query);
+    /*!
+     * \brief a statement of the cursor is in progress
+     */
+    bool isCursorBusy() const;
+    void cancelCursor();
+    /*!
+     * \brief execute the query streaming its resultsets into the file (csv or arrow, by suffix)
+     */
+    void executeToFile(const QString &query, const QString &fileName);
+    /*!
+     * \brief the file is too big to be edited, it's shown by pages (read-only, not highlighted)
+     */
+    bool isLargeFile() const { return _large_file != nullptr; }
+    /*!
+     * \brief execute the whole large file by batches of statements
+     */
+    void executeFile();
+    /*!
+     * \brief execute the script statement by statement or by batches (see scriptBatchStatements setting)
+     * \param firstLine line of the script start within the editor
+     * \return false if the script is to be sent at once
+     */
+    bool executeScript(const QString &script, int firstLine = 0);
+    bool isScriptRunning() const { return _script != nullptr; }
+    /*!
+     * \brief do not execute the rest of the script
+     */
+    void stopScript();
+    /*!
+     * \brief re-execute the query every few seconds updating the grid by changed rows only
+     *
+     * Rows are matched by the column current within the grid (the first column by default).
+     */
+    void startWatch(const QString &query, int seconds);
+    void stopWatch();
+    bool isWatching() const { return !_watch_query.isEmpty(); }
+    /*!
+     * \brief show the tab of notifications of the database (postgres only)
+     */
+    void showNotifications();
+    /*!
+     * \brief execute the query showing its plan within the "plan" tab
+     *
+     * Postgres runs EXPLAIN (ANALYZE, BUFFERS, FORMAT JSON) of it (the query is executed),
+     * other dbms get the plan by SET SHOWPLAN_XML (ms sql).
+     */
+    void explain(const QString &query);
+    /*!
+     * \brief memory of the result grids of the tab
+     */
+    qint64 residentBytes() const;
 
 signals:
     void sqlChanged();
     void error(QString msg) const;
+    /*!
+     * \brief aggregates of the cells selected within a result grid, empty to clear
+     */
+    void selectionAggregated(const QString &text);
 
 public slots:
     void onMessage(const QString &text);
@@ -57,6 +138,9 @@ public slots:
     void fetched(DataTable *table);
     void clearResult();
     void onCompleterRequest();
+
+private slots:
+    void onEditorScrolled(int value);
     //void onCustomGridContextMenuRequested(const QPoint & pos);
     //void on_customEditorContextMenuRequested(const QPoint & pos);
 
@@ -70,9 +154,74 @@ private:
     SqlSyntaxHighlighter *_highlighter;
     QVBoxLayout *_editorLayout;
     QList<TableModel*> _tables;
+    CursorTableModel *_cursorModel = nullptr;
     QMenu *_resultMenu;
     QAction *_actionCopy;
+    std::unique_ptr<LargeFile> _large_file;
+    qint64 _page_offset = 0;        ///< first byte of the shown page
+    qint64 _page_end = 0;
+    bool _paging = false;
+    std::unique_ptr<StatementSplitter> _script;    ///< script being executed by statements
+    int _script_batch = 0;          ///< statements per batch, 0 - limited by length only
+    int _script_statements = 0;     ///< statements executed
+    bool _script_failed = false;
+    qint64 _stream_offset = -1;     ///< next byte of the large file to execute, -1 if the file is not executed
+    std::shared_ptr<CopyPipe> _copy_pipe;  ///< inline data of the running COPY FROM STDIN, still being read
+    std::shared_ptr<SqlParser::TokenStream> _sql_tokens;   ///< tokens of the editor text, kept while completion is used
+    QTextDocument *_sql_tokens_document = nullptr;
+    QMetaObject::Connection _sql_tokens_connection;
+    qint64 _model_us = 0;           ///< taking rows of the current query into models
+    qint64 _view_us = 0;            ///< resizing views of the current query
+    QStringList _timings;           ///< csv rows of QueryTimings of the latest queries
+    QLineEdit *_filter = nullptr;   ///< quick filter of the result grids
+    SelectionAggregate *_aggregate;
+    QTimer *_watch_timer;
+    QString _watch_query;           ///< query of the watch mode, empty if not watching
+    QString _watch_key;             ///< column matching rows of refreshes
+    bool _watch_refreshing = false; ///< the running query refreshes the grid
+    DataTable *_watch_source = nullptr;     ///< resultset of the refresh merged into the grid
+    std::unique_ptr<DataTable> _watch_rows;
+    NotificationsPanel *_notifications = nullptr;
+    PlanViewer *_plan = nullptr;
+    bool _explaining = false;       ///< the running query returns a plan
+    bool _showplan = false;         ///< showplan_xml is to be turned off after the query
+    bool _explain_rollback = false; ///< the transaction begun for explain analyze is to be rolled back
+    std::unique_ptr<DataTable> _plan_rows;
+    bool _cap_warned = false;       ///< the results of all the tabs exceed resultsMemoryCap
+    QLineEdit *_find = nullptr;     ///< text to find within the result grids
+    GridSearch *_search;
+    bool _search_stale = true;      ///< the grids changed since the search
+    bool _find_pending = false;     ///< the hit is shown as soon as found
+    bool _find_forward = true;
+    int _hit_grid = -1;             ///< the hit shown, the grid is an index within _tables
+    int _hit_row = 0;               ///< row of the table of the grid
+    int _hit_column = 0;
     void log(const QString &text, QColor color);
+    void showPage(qint64 offset);
+    void startScript(int firstLine, int statementsPerBatch);
+    void executeNextBatch();
+    /*!
+     * \brief feed the script splitter by the next part of the large file (or finish it)
+     */
+    void feedScript();
+    /*!
+     * \brief fill the pipe of the running COPY by its inline data
+     */
+    void pumpCopyData();
+    void exportTimings();
+    void applyFilter();
+    void refreshWatch();
+    void watchRefreshed();
+    void showPlan();
+    void showMemory();
+    /*!
+     * \brief show the next (previous) cell holding the text of the find box, the search is started if needed
+     */
+    void findInResults(bool forward);
+    bool showHit(bool forward);
+    QTableView* gridView(const TableModel *model) const;
+    const SqlParser::TokenStream &sqlTokens(CodeEditor *editor);
+    void showResultsetsTab();
     static QCompleter *completer();
 };
 
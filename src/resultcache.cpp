@@ -0,0 +1,146 @@
+#include "resultcache.h"
+#include "metadatacache.h"
+#include "dbconnection.h"
+#include "datatable.h"
+
+namespace Scripting
+{
+
+ResultCache& ResultCache::instance()
+{
+    static ResultCache cache;
+    return cache;
+}
+
+QString ResultCache::connectionKey(DbConnection *connection)
+{
+    return connection->dbmsScriptingID() + '\n' + connection->connectionString() + '\n' + connection->database();
+}
+
+std::unique_ptr<CppConductor> ResultCache::execute(
+        std::shared_ptr<DbConnection> connection,
+        Context context,
+        const QString &objectType,
+        std::function<QVariant(QString)> envCallback)
+{
+    QString view_key = viewKey(connection.get(), context, objectType, envCallback);
+    if (view_key.isEmpty())
+        return Scripting::execute(connection, context, objectType, envCallback);
+
+    // the results are as fresh as the catalog checked before they are taken or fetched
+    QString marker = MetadataCache::instance().checkMarker(connection.get());
+    if (marker.isEmpty())
+        return Scripting::execute(connection, context, objectType, envCallback);
+    QString key = connectionKey(connection.get()) + '\n' + view_key;
+    {
+        QMutexLocker lk(&_mutex);
+        auto it = _entries.find(key);
+        if (it != _entries.end())
+        {
+            if (it->marker == marker && !it->stored.hasExpired(RESULT_CACHE_TTL))
+            {
+                it->used = ++_serial;
+                std::unique_ptr<CppConductor> env { new CppConductor(connection, envCallback) };
+                for (const auto &table: it->resultsets)
+                    env->appendTable(new DataTable(*table));
+                for (const QString &script: it->scripts)
+                    env->appendScript(script);
+                for (const QString &html: it->htmls)
+                    env->appendHtml(html);
+                for (const QString &text: it->texts)
+                    env->appendText(text);
+                return env;
+            }
+            remove(it);
+        }
+    }
+
+    // results of failed (e.g. cancelled) scripts are not kept
+    bool failed = false;
+    QMetaObject::Connection guard = QObject::connect(connection.get(), &DbConnection::error, [&failed]() {
+        failed = true;
+    });
+    std::unique_ptr<CppConductor> env;
+    try
+    {
+        env = Scripting::execute(connection, context, objectType, envCallback);
+    }
+    catch (...)
+    {
+        QObject::disconnect(guard);
+        throw;
+    }
+    QObject::disconnect(guard);
+    // a change of the catalog meanwhile makes the entry outdated on the next check
+    if (env && !failed)
+        store(key, marker, *env);
+    return env;
+}
+
+void ResultCache::store(const QString &key, const QString &marker, const CppConductor &env)
+{
+    Entry entry;
+    for (const DataTable *table: env.resultsets)
+    {
+        entry.resultsets.append(std::make_shared<const DataTable>(*table));
+        entry.bytes += table->residentBytes();
+    }
+    entry.scripts = env.scripts;
+    entry.htmls = env.htmls;
+    entry.texts = env.texts;
+    for (const QList<QString> *list: {&env.scripts, &env.htmls, &env.texts})
+    {
+        for (const QString &s: *list)
+            entry.bytes += s.size() * sizeof(QChar);
+    }
+    // a huge result would evict everything else
+    if (entry.bytes > RESULT_CACHE_BYTES / 4)
+        return;
+    entry.marker = marker;
+    entry.stored.start();
+
+    QMutexLocker lk(&_mutex);
+    auto it = _entries.find(key);
+    if (it != _entries.end())
+        remove(it);
+    // evict the least recently used entries
+    while (!_entries.isEmpty() && (_entries.size() >= RESULT_CACHE_SIZE || _bytes + entry.bytes > RESULT_CACHE_BYTES))
+    {
+        auto lru = _entries.begin();
+        for (auto i = _entries.begin(); i != _entries.end(); ++i)
+        {
+            if (i->used < lru->used)
+                lru = i;
+        }
+        remove(lru);
+    }
+    entry.used = ++_serial;
+    _bytes += entry.bytes;
+    _entries.insert(key, entry);
+}
+
+void ResultCache::remove(QHash<QString, Entry>::iterator it)
+{
+    _bytes -= it->bytes;
+    _entries.erase(it);
+}
+
+void ResultCache::invalidate(DbConnection *connection)
+{
+    if (!connection)
+        return;
+    QString prefix = connectionKey(connection) + '\n';
+    QMutexLocker lk(&_mutex);
+    for (auto it = _entries.begin(); it != _entries.end();)
+    {
+        if (it.key().startsWith(prefix))
+        {
+            _bytes -= it->bytes;
+            it = _entries.erase(it);
+        }
+        else
+            ++it;
+    }
+}
+
+}
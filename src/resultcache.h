@@ -0,0 +1,77 @@
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <QString>
+#include <QHash>
+#include <QList>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QVariant>
+#include <functional>
+#include <memory>
+#include "scripting.h"
+
+class DbConnection;
+class DataTable;
+
+namespace Scripting
+{
+
+// object content and preview results kept
+#define RESULT_CACHE_SIZE 64
+// memory of the results kept, bytes
+#define RESULT_CACHE_BYTES (64 * 1024 * 1024)
+// results older than that are fetched again, ms
+#define RESULT_CACHE_TTL (10 * 60 * 1000)
+
+/*!
+ * \brief Results of content and preview scripts shown for db tree nodes.
+ *
+ * Only scripts marked by comment "cache: ddl" are cached: object definitions which
+ * change along with the catalog, not with data or session activity.
+ * Entries are keyed by the connection, context, object type and the script text with
+ * macros replaced, so selecting a node shown recently doesn't query the database.
+ * The catalog fingerprint is queried by MetadataCache on every lookup (a single cheap row),
+ * an entry is dropped when it's older than RESULT_CACHE_TTL or the fingerprint differs from
+ * the one it was stored with. Manual refresh of a node invalidates the connection's entries.
+ */
+class ResultCache
+{
+public:
+    static ResultCache& instance();
+    /*!
+     * \brief execute the script unless its results are cached
+     */
+    std::unique_ptr<CppConductor> execute(
+            std::shared_ptr<DbConnection> connection,
+            Context context,
+            const QString &objectType,
+            std::function<QVariant(QString)> envCallback);
+    void invalidate(DbConnection *connection);
+
+private:
+    ResultCache() = default;
+    struct Entry
+    {
+        QList<std::shared_ptr<const DataTable>> resultsets;
+        QList<QString> scripts;
+        QList<QString> htmls;
+        QList<QString> texts;
+        QString marker;
+        QElapsedTimer stored;
+        quint64 used = 0;
+        qint64 bytes = 0;
+    };
+    static QString connectionKey(DbConnection *connection);
+    void store(const QString &key, const QString &marker, const CppConductor &env);
+    void remove(QHash<QString, Entry>::iterator it);
+
+    QHash<QString, Entry> _entries;
+    qint64 _bytes = 0;
+    quint64 _serial = 0;
+    QMutex _mutex;
+};
+
+}
+
+#endif // RESULTCACHE_H
@@ -0,0 +1,655 @@
+#include "resultwriter.h"
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QLocale>
+#include <QtEndian>
+#include <memory>
+#include <string.h>
+
+#define WRITER_BUFFER_SIZE (1024 * 1024)
+// arrow record batch limits
+#define ARROW_BATCH_ROWS 65536
+#define ARROW_BATCH_BYTES (64 * 1024 * 1024)
+
+static const qint64 MSECS_PER_DAY = 86400000;
+static const qint64 UNIX_EPOCH_JULIAN_DAY = 2440588;
+
+ResultWriter* ResultWriter::create(const QString &fileName)
+{
+    if (QFileInfo(fileName).suffix().compare("arrows", Qt::CaseInsensitive) == 0)
+        return new ArrowWriter(fileName);
+    return new CsvWriter(fileName);
+}
+
+ResultWriter::ResultWriter(const QString &fileName) :
+    _fileName(fileName)
+{
+    _buf.reserve(WRITER_BUFFER_SIZE);
+}
+
+ResultWriter::~ResultWriter()
+{
+    _file.close();
+}
+
+bool ResultWriter::take(DataTable &table)
+{
+    if (_failed)
+    {
+        table.removeRows();
+        return false;
+    }
+
+    if (&table != _table)
+    {
+        if (_table && !finish())
+            return take(table);
+
+        QString fn = _fileName;
+        if (_fileNo)
+        {
+            QFileInfo fi(_fileName);
+            fn = fi.dir().filePath(fi.completeBaseName() + '_' + QString::number(_fileNo + 1) +
+                                   (fi.suffix().isEmpty() ? QString() : '.' + fi.suffix()));
+        }
+        _file.setFileName(fn);
+        if (!_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            _error = _file.errorString();
+            _failed = true;
+            table.removeRows();
+            return false;
+        }
+        _table = &table;
+        ++_fileNo;
+        if (!writeHeader(table))
+        {
+            _failed = true;
+            return take(table);
+        }
+    }
+
+    int rows = table.rowCount();
+    if (!writeRows(table))
+    {
+        table.removeRows();
+        _file.close();
+        _failed = true;
+        return false;
+    }
+    _rowsWritten += rows;
+    return true;
+}
+
+bool ResultWriter::finish()
+{
+    if (_file.isOpen())
+    {
+        if (!_failed && (!writeFooter() || !flush()))
+            _failed = true;
+        _file.close();
+    }
+    _table = nullptr;
+    return !_failed;
+}
+
+bool ResultWriter::write(const char *data, int length)
+{
+    _buf.append(data, length);
+    return _buf.size() < WRITER_BUFFER_SIZE || flush();
+}
+
+bool ResultWriter::flush()
+{
+    if (!_buf.isEmpty() && _file.write(_buf) != _buf.size())
+    {
+        _error = _file.errorString();
+        _failed = true;
+        return false;
+    }
+    _buf.resize(0);
+    return true;
+}
+
+void CsvWriter::appendField(const char *data, int length)
+{
+    bool quote = false;
+    for (int i = 0; i < length && !quote; ++i)
+        quote = (data[i] == ',' || data[i] == '"' || data[i] == '\r' || data[i] == '\n');
+    if (!quote)
+    {
+        _line.append(data, length);
+        return;
+    }
+    _line.append('"');
+    for (int i = 0; i < length; ++i)
+    {
+        if (data[i] == '"')
+            _line.append('"');
+        _line.append(data[i]);
+    }
+    _line.append('"');
+}
+
+bool CsvWriter::writeHeader(const DataTable &table)
+{
+    _line.resize(0);
+    for (int c = 0; c < table.columnCount(); ++c)
+    {
+        if (c)
+            _line.append(',');
+        QByteArray name = table.getColumn(c).name().toUtf8();
+        appendField(name.constData(), name.size());
+    }
+    _line.append("\r\n");
+    return write(_line);
+}
+
+bool CsvWriter::writeRows(DataTable &table)
+{
+    QLocale c_locale = QLocale::c();
+    int columns = table.columnCount();
+    for (int r = 0; r < table.rowCount(); ++r)
+    {
+        _line.resize(0);
+        for (int c = 0; c < columns; ++c)
+        {
+            if (c)
+                _line.append(',');
+            const ColumnStorage &s = table.storage(c);
+            // nulls are empty fields
+            if (s.isNull(r))
+                continue;
+            switch (s.kind())
+            {
+            case ColumnStorage::Kind::Int32:
+                _line.append(QByteArray::number(s.int32At(r)));
+                break;
+            case ColumnStorage::Kind::Int64:
+                _line.append(QByteArray::number(s.int64At(r)));
+                break;
+            case ColumnStorage::Kind::Float:
+                _line.append(c_locale.toString(s.floatAt(r), 'g', QLocale::FloatingPointShortest).toLatin1());
+                break;
+            case ColumnStorage::Kind::Double:
+                _line.append(c_locale.toString(s.doubleAt(r), 'g', QLocale::FloatingPointShortest).toLatin1());
+                break;
+            case ColumnStorage::Kind::Bool:
+                _line.append(s.boolAt(r) ? "true" : "false");
+                break;
+            case ColumnStorage::Kind::String:
+            {
+                int length;
+                const char *data = s.utf8At(r, length);
+                appendField(data, length);
+                break;
+            }
+            case ColumnStorage::Kind::Date:
+                _line.append(s.value(r).toDate().toString(Qt::ISODate).toLatin1());
+                break;
+            case ColumnStorage::Kind::Time:
+                _line.append(s.value(r).toTime().toString("HH:mm:ss.zzz").toLatin1());
+                break;
+            case ColumnStorage::Kind::DateTime:
+                _line.append(s.value(r).toDateTime().toString("yyyy-MM-dd HH:mm:ss.zzz").toLatin1());
+                break;
+            default:
+            {
+                QByteArray val = s.value(r).toString().toUtf8();
+                appendField(val.constData(), val.size());
+            }
+            }
+        }
+        _line.append("\r\n");
+        if (!write(_line))
+            return false;
+    }
+    table.removeRows();
+    return true;
+}
+
+namespace
+{
+
+/*!
+ * \brief Minimal flatbuffers serializer for arrow metadata.
+ * Objects are laid out parent first, so every offset points forward as the format requires.
+ */
+struct FbNode
+{
+    enum class Type { Table, String, TableVector, StructVector };
+    struct Field
+    {
+        int index;
+        int size;   // 1, 2, 4, 8 for scalars, 0 for an offset to child
+        qint64 value;
+        std::shared_ptr<FbNode> child;
+    };
+
+    Type type = Type::Table;
+    std::vector<Field> fields;
+    QByteArray bytes;   // string or raw structs (8-byte aligned)
+    int count = 0;      // structs count
+    std::vector<std::shared_ptr<FbNode>> items;
+
+    static std::shared_ptr<FbNode> table() { return std::make_shared<FbNode>(); }
+    static std::shared_ptr<FbNode> string(const QByteArray &value)
+    {
+        auto n = std::make_shared<FbNode>();
+        n->type = Type::String;
+        n->bytes = value;
+        return n;
+    }
+    static std::shared_ptr<FbNode> tables(const std::vector<std::shared_ptr<FbNode>> &items)
+    {
+        auto n = std::make_shared<FbNode>();
+        n->type = Type::TableVector;
+        n->items = items;
+        return n;
+    }
+    static std::shared_ptr<FbNode> structs(const QByteArray &bytes, int count)
+    {
+        auto n = std::make_shared<FbNode>();
+        n->type = Type::StructVector;
+        n->bytes = bytes;
+        n->count = count;
+        return n;
+    }
+    FbNode& add(int index, int size, qint64 value)
+    {
+        fields.push_back({ index, size, value, nullptr });
+        return *this;
+    }
+    FbNode& add(int index, std::shared_ptr<FbNode> child)
+    {
+        fields.push_back({ index, 0, 0, child });
+        return *this;
+    }
+};
+
+class FbSerializer
+{
+public:
+    QByteArray serialize(const FbNode &root)
+    {
+        _buf.clear();
+        put(0, 4);
+        patch(0, place(root));
+        align(8);
+        return _buf;
+    }
+
+private:
+    QByteArray _buf;
+
+    void align(int alignment)
+    {
+        while (_buf.size() % alignment)
+            _buf.append('\0');
+    }
+    void put(qint64 value, int size)
+    {
+        char le[8];
+        qToLittleEndian(value, le);
+        _buf.append(le, size);
+    }
+    void patch(int at, int target)
+    {
+        qToLittleEndian(quint32(target - at), _buf.data() + at);
+    }
+    void patch16(int at, int value)
+    {
+        qToLittleEndian(quint16(value), _buf.data() + at);
+    }
+
+    int place(const FbNode &n)
+    {
+        int pos;
+        switch (n.type)
+        {
+        case FbNode::Type::String:
+            align(4);
+            pos = _buf.size();
+            put(n.bytes.size(), 4);
+            _buf.append(n.bytes);
+            _buf.append('\0');
+            return pos;
+        case FbNode::Type::StructVector:
+            // elements follow the length and must be aligned
+            while ((_buf.size() + 4) % 8)
+                _buf.append('\0');
+            pos = _buf.size();
+            put(n.count, 4);
+            _buf.append(n.bytes);
+            return pos;
+        case FbNode::Type::TableVector:
+        {
+            align(4);
+            pos = _buf.size();
+            put(int(n.items.size()), 4);
+            int slots = _buf.size();
+            for (size_t i = 0; i < n.items.size(); ++i)
+                put(0, 4);
+            for (size_t i = 0; i < n.items.size(); ++i)
+                patch(slots + int(i) * 4, place(*n.items[i]));
+            return pos;
+        }
+        case FbNode::Type::Table:
+            break;
+        }
+
+        int field_count = 0;
+        for (const FbNode::Field &f: n.fields)
+            field_count = qMax(field_count, f.index + 1);
+        int vtable_size = 4 + 2 * field_count;
+        // the table itself is 8-byte aligned just after its vtable
+        while ((_buf.size() + vtable_size) % 8)
+            _buf.append('\0');
+        int vtable = _buf.size();
+        _buf.append(QByteArray(vtable_size, '\0'));
+        pos = _buf.size();
+        put(pos - vtable, 4);
+
+        std::vector<int> field_pos(n.fields.size());
+        for (size_t i = 0; i < n.fields.size(); ++i)
+        {
+            const FbNode::Field &f = n.fields[i];
+            int size = (f.size ? f.size : 4);
+            align(size);
+            field_pos[i] = _buf.size();
+            put(f.value, size);
+            patch16(vtable + 4 + 2 * f.index, field_pos[i] - pos);
+        }
+        patch16(vtable, vtable_size);
+        patch16(vtable + 2, _buf.size() - pos);
+
+        for (size_t i = 0; i < n.fields.size(); ++i)
+        {
+            if (n.fields[i].child)
+                patch(field_pos[i], place(*n.fields[i].child));
+        }
+        return pos;
+    }
+};
+
+// Schema.fbs / Message.fbs identities
+enum ArrowType { ArrowInt = 2, ArrowFloatingPoint = 3, ArrowUtf8 = 5, ArrowBool = 6,
+                 ArrowDate = 8, ArrowTime = 9, ArrowTimestamp = 10 };
+enum ArrowHeader { ArrowSchema = 1, ArrowRecordBatch = 3 };
+const int ARROW_METADATA_V5 = 4;
+
+std::shared_ptr<FbNode> arrowMessage(int headerType, std::shared_ptr<FbNode> header, qint64 bodyLength)
+{
+    auto msg = FbNode::table();
+    msg->add(0, 2, ARROW_METADATA_V5).add(1, 1, headerType).add(2, header).add(3, 8, bodyLength);
+    return msg;
+}
+
+std::shared_ptr<FbNode> arrowType(ColumnStorage::Kind kind, int &typeId)
+{
+    auto t = FbNode::table();
+    switch (kind)
+    {
+    case ColumnStorage::Kind::Int32:
+    case ColumnStorage::Kind::Int64:
+        typeId = ArrowInt;
+        t->add(0, 4, kind == ColumnStorage::Kind::Int32 ? 32 : 64).add(1, 1, 1);
+        break;
+    case ColumnStorage::Kind::Float:
+    case ColumnStorage::Kind::Double:
+        typeId = ArrowFloatingPoint;
+        t->add(0, 2, kind == ColumnStorage::Kind::Float ? 1 : 2);
+        break;
+    case ColumnStorage::Kind::Bool:
+        typeId = ArrowBool;
+        break;
+    case ColumnStorage::Kind::Date:
+        typeId = ArrowDate;
+        t->add(0, 2, 0);    // days
+        break;
+    case ColumnStorage::Kind::Time:
+        typeId = ArrowTime;
+        t->add(0, 2, 1).add(1, 4, 32);    // 32-bit milliseconds
+        break;
+    case ColumnStorage::Kind::DateTime:
+        typeId = ArrowTimestamp;
+        t->add(0, 2, 1);    // milliseconds, no time zone
+        break;
+    default:
+        typeId = ArrowUtf8;
+    }
+    return t;
+}
+
+// 8-byte padded body buffer
+void appendBuffer(QByteArray &body, QByteArray &buffers, const QByteArray &data)
+{
+    char le[16];
+    qToLittleEndian(qint64(body.size()), le);
+    qToLittleEndian(qint64(data.size()), le + 8);
+    buffers.append(le, 16);
+    body.append(data);
+    while (body.size() % 8)
+        body.append('\0');
+}
+
+void appendValue(QByteArray &data, qint32 value)
+{
+    char le[4];
+    qToLittleEndian(value, le);
+    data.append(le, 4);
+}
+
+void appendValue(QByteArray &data, qint64 value)
+{
+    char le[8];
+    qToLittleEndian(value, le);
+    data.append(le, 8);
+}
+
+void appendValue(QByteArray &data, float value)
+{
+    qint32 bits;
+    memcpy(&bits, &value, 4);
+    appendValue(data, bits);
+}
+
+void appendValue(QByteArray &data, double value)
+{
+    qint64 bits;
+    memcpy(&bits, &value, 8);
+    appendValue(data, bits);
+}
+
+} // namespace
+
+bool ArrowWriter::writeHeader(const DataTable &)
+{
+    // the schema is deferred until the first batch to get column kinds
+    _batch.clear();
+    _kinds.clear();
+    _batchBytes = 0;
+    _schemaWritten = false;
+    return true;
+}
+
+bool ArrowWriter::writeRows(DataTable &table)
+{
+    // rough estimation of textual data size to keep offsets within 32 bits
+    for (int c = 0; c < table.columnCount(); ++c)
+    {
+        if (table.storage(c).kind() == ColumnStorage::Kind::String)
+        {
+            int length;
+            for (int r = 0; r < table.rowCount(); ++r)
+            {
+                if (!table.storage(c).isNull(r))
+                {
+                    table.storage(c).utf8At(r, length);
+                    _batchBytes += length;
+                }
+            }
+        }
+        else
+            _batchBytes += 8 * table.rowCount();
+    }
+    _batch.takeRows(&table);
+    if (_batch.rowCount() >= ARROW_BATCH_ROWS || _batchBytes >= ARROW_BATCH_BYTES)
+        return writeBatch();
+    return true;
+}
+
+bool ArrowWriter::writeFooter()
+{
+    if ((_batch.rowCount() || !_schemaWritten) && !writeBatch())
+        return false;
+    // end of stream marker
+    const char eos[8] = { '\xff', '\xff', '\xff', '\xff', 0, 0, 0, 0 };
+    return write(eos, 8);
+}
+
+bool ArrowWriter::writeMessage(const QByteArray &metadata, const QByteArray &body)
+{
+    char prefix[8];
+    qToLittleEndian(quint32(0xFFFFFFFF), prefix);
+    qToLittleEndian(qint32(metadata.size()), prefix + 4);
+    return write(prefix, 8) && write(metadata) && write(body);
+}
+
+bool ArrowWriter::writeBatch()
+{
+    FbSerializer fb;
+    int columns = _batch.columnCount();
+    if (!_schemaWritten)
+    {
+        std::vector<std::shared_ptr<FbNode>> fields;
+        for (int c = 0; c < columns; ++c)
+        {
+            ColumnStorage::Kind kind = _batch.storage(c).kind();
+            if (kind == ColumnStorage::Kind::Unknown || kind == ColumnStorage::Kind::Variant)
+                kind = ColumnStorage::Kind::String;
+            _kinds.push_back(kind);
+            int type_id;
+            auto type = arrowType(kind, type_id);
+            auto field = FbNode::table();
+            field->add(0, FbNode::string(_batch.getColumn(c).name().toUtf8()))
+                    .add(1, 1, 1)
+                    .add(2, 1, type_id)
+                    .add(3, type)
+                    .add(5, FbNode::tables({}));
+            fields.push_back(field);
+        }
+        auto schema = FbNode::table();
+        schema->add(0, 2, 0).add(1, FbNode::tables(fields));
+        if (!writeMessage(fb.serialize(*arrowMessage(ArrowSchema, schema, 0)), QByteArray()))
+            return false;
+        _schemaWritten = true;
+    }
+
+    int rows = _batch.rowCount();
+    if (!rows)
+        return true;
+
+    QByteArray body, nodes, buffers;
+    int bitmap_size = (rows + 7) / 8;
+    for (int c = 0; c < columns; ++c)
+    {
+        const ColumnStorage &s = _batch.storage(c);
+        ColumnStorage::Kind kind = _kinds[size_t(c)];
+        // values of another kind (if the column has demoted) are converted
+        bool native = (s.kind() == kind);
+        QByteArray validity(bitmap_size, '\0');
+        QByteArray data, offsets;
+        qint64 nulls = 0;
+        if (kind == ColumnStorage::Kind::Bool)
+            data.fill('\0', bitmap_size);
+        if (kind == ColumnStorage::Kind::String)
+            appendValue(offsets, qint32(0));
+
+        for (int r = 0; r < rows; ++r)
+        {
+            QVariant v;
+            bool is_null = s.isNull(r);
+            if (!is_null && !native)
+            {
+                v = s.value(r);
+                is_null = v.isNull();
+            }
+            if (is_null)
+                ++nulls;
+            else
+                validity[r >> 3] = char(validity[r >> 3] | (1 << (r & 7)));
+
+            switch (kind)
+            {
+            case ColumnStorage::Kind::Int32:
+                appendValue(data, qint32(is_null ? 0 : native ? s.int32At(r) : v.toInt()));
+                break;
+            case ColumnStorage::Kind::Int64:
+                appendValue(data, qint64(is_null ? 0 : native ? s.int64At(r) : v.toLongLong()));
+                break;
+            case ColumnStorage::Kind::Float:
+                appendValue(data, float(is_null ? 0 : native ? s.floatAt(r) : v.toFloat()));
+                break;
+            case ColumnStorage::Kind::Double:
+                appendValue(data, double(is_null ? 0 : native ? s.doubleAt(r) : v.toDouble()));
+                break;
+            case ColumnStorage::Kind::Bool:
+                if (!is_null && (native ? s.boolAt(r) : v.toBool()))
+                    data[r >> 3] = char(data[r >> 3] | (1 << (r & 7)));
+                break;
+            case ColumnStorage::Kind::Date:
+                appendValue(data, is_null ? 0 :
+                                    qint32((native ? s.int64At(r) : v.toDate().toJulianDay()) - UNIX_EPOCH_JULIAN_DAY));
+                break;
+            case ColumnStorage::Kind::Time:
+                appendValue(data, qint32(is_null ? 0 : native ? s.int32At(r) : v.toTime().msecsSinceStartOfDay()));
+                break;
+            case ColumnStorage::Kind::DateTime:
+            {
+                qint64 ms = 0;
+                if (!is_null)
+                {
+                    QDateTime dt = (native ? QDateTime() : v.toDateTime());
+                    ms = (native ? s.int64At(r) :
+                                   dt.date().toJulianDay() * MSECS_PER_DAY + dt.time().msecsSinceStartOfDay()) -
+                            UNIX_EPOCH_JULIAN_DAY * MSECS_PER_DAY;
+                }
+                appendValue(data, ms);
+                break;
+            }
+            default:
+                if (!is_null)
+                {
+                    if (native)
+                    {
+                        int length;
+                        const char *str = s.utf8At(r, length);
+                        data.append(str, length);
+                    }
+                    else
+                        data.append(v.toString().toUtf8());
+                }
+                appendValue(offsets, qint32(data.size()));
+            }
+        }
+
+        char node[16];
+        qToLittleEndian(qint64(rows), node);
+        qToLittleEndian(nulls, node + 8);
+        nodes.append(node, 16);
+        appendBuffer(body, buffers, nulls ? validity : QByteArray());
+        if (kind == ColumnStorage::Kind::String)
+            appendBuffer(body, buffers, offsets);
+        appendBuffer(body, buffers, data);
+    }
+
+    auto batch = FbNode::table();
+    batch->add(0, 8, rows)
+            .add(1, FbNode::structs(nodes, columns))
+            .add(2, FbNode::structs(buffers, buffers.size() / 16));
+    _batch.removeRows();
+    _batchBytes = 0;
+    return writeMessage(fb.serialize(*arrowMessage(ArrowRecordBatch, batch, body.size())), body);
+}
@@ -0,0 +1,102 @@
+#ifndef RESULTWRITER_H
+#define RESULTWRITER_H
+
+#include <QFile>
+#include <QByteArray>
+#include <vector>
+#include "datatable.h"
+
+/*!
+ * \brief Streaming writer of resultsets into files.
+ * Rows are taken from the resultset as they are fetched, so the whole
+ * resultset never resides in memory. Every resultset of the query gets its
+ * own file: the second one is named <name>_2.<suffix> and so on.
+ */
+class ResultWriter
+{
+public:
+    /*!
+     * \brief writer of the format determined by the file suffix: .arrows - Arrow IPC stream, otherwise - csv
+     */
+    static ResultWriter* create(const QString &fileName);
+    virtual ~ResultWriter();
+
+    /*!
+     * \brief write and remove all the rows of the table (the caller must lock the table)
+     */
+    bool take(DataTable &table);
+    /*!
+     * \brief complete the current file
+     */
+    bool finish();
+
+    QString fileName() const { return _fileName; }
+    QString errorString() const { return _error; }
+    qint64 rowsWritten() const noexcept { return _rowsWritten; }
+    int filesWritten() const noexcept { return _fileNo; }
+
+protected:
+    explicit ResultWriter(const QString &fileName);
+    virtual bool writeHeader(const DataTable &table) = 0;
+    // must remove all the rows written (kept ones are passed again with the next call)
+    virtual bool writeRows(DataTable &table) = 0;
+    virtual bool writeFooter() = 0;
+    // buffered output
+    bool write(const char *data, int length);
+    bool write(const QByteArray &data) { return write(data.constData(), data.size()); }
+    bool flush();
+
+private:
+    QString _fileName;
+    QFile _file;
+    QByteArray _buf;
+    QString _error;
+    const DataTable *_table = nullptr;
+    qint64 _rowsWritten = 0;
+    int _fileNo = 0;
+    bool _failed = false;
+};
+
+/*!
+ * \brief RFC 4180 comma separated values, utf-8, header line with column names
+ */
+class CsvWriter : public ResultWriter
+{
+public:
+    explicit CsvWriter(const QString &fileName) : ResultWriter(fileName) {}
+
+protected:
+    virtual bool writeHeader(const DataTable &table) override;
+    virtual bool writeRows(DataTable &table) override;
+    virtual bool writeFooter() override { return true; }
+
+private:
+    void appendField(const char *data, int length);
+    QByteArray _line;
+};
+
+/*!
+ * \brief Apache Arrow IPC streaming format (uncompressed, little-endian)
+ * Column types are chosen by the storage kinds of the first rows fetched,
+ * textual columns are written as utf8.
+ */
+class ArrowWriter : public ResultWriter
+{
+public:
+    explicit ArrowWriter(const QString &fileName) : ResultWriter(fileName) {}
+
+protected:
+    virtual bool writeHeader(const DataTable &table) override;
+    virtual bool writeRows(DataTable &table) override;
+    virtual bool writeFooter() override;
+
+private:
+    bool writeBatch();
+    bool writeMessage(const QByteArray &metadata, const QByteArray &body);
+    DataTable _batch;
+    std::vector<ColumnStorage::Kind> _kinds;
+    qint64 _batchBytes = 0;
+    bool _schemaWritten = false;
+};
+
+#endif // RESULTWRITER_H
@@ -0,0 +1,557 @@
+#include "rowindex.h"
+#include "datatable.h"
+#include <QObject>
+#include <QRegularExpression>
+#include <QDateTime>
+#include <QThread>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace RowIndex
+{
+
+struct Keyed
+{
+    quint64 key;
+    int row;
+};
+
+// sortable bits of double: negative values are inverted, positive ones get the sign bit
+static quint64 doubleKey(double value) noexcept
+{
+    quint64 u;
+    memcpy(&u, &value, sizeof(u));
+    return (u >> 63) ? ~u : u | (quint64(1) << 63);
+}
+
+static int compareUtf8(const char *a, int alen, const char *b, int blen) noexcept
+{
+    // bytewise order of utf-8 is the order of code points
+    int cmp = memcmp(a, b, size_t(std::min(alen, blen)));
+    if (cmp)
+        return cmp;
+    return alen < blen ? -1 : alen > blen ? 1 : 0;
+}
+
+static int compareVariants(const QVariant &a, const QVariant &b)
+{
+    bool an, bn;
+    double x = a.toDouble(&an);
+    double y = b.toDouble(&bn);
+    if (an && bn)
+        return x < y ? -1 : x > y ? 1 : 0;
+    return QString::compare(a.toString(), b.toString());
+}
+
+static int threadsFor(size_t rows)
+{
+    return std::max(1, std::min(QThread::idealThreadCount(), int(rows / ROW_INDEX_PARALLEL_MIN_ROWS)));
+}
+
+/*!
+ * \brief stable LSD radix sort by 16-bit digits, passes over digits equal for all the keys are skipped
+ */
+static void radixSort(std::vector<Keyed> &items)
+{
+    if (items.size() < 2)
+        return;
+    quint64 any = 0;
+    quint64 all = ~quint64(0);
+    for (const Keyed &k: items)
+    {
+        any |= k.key;
+        all &= k.key;
+    }
+    quint64 differ = any ^ all;
+    std::vector<Keyed> buf(items.size());
+    std::vector<size_t> counts(65536);
+    for (int shift = 0; shift < 64; shift += 16)
+    {
+        if (!((differ >> shift) & 0xFFFF))
+            continue;
+        std::fill(counts.begin(), counts.end(), 0);
+        for (const Keyed &k: items)
+            ++counts[(k.key >> shift) & 0xFFFF];
+        size_t sum = 0;
+        for (size_t &c: counts)
+        {
+            size_t n = c;
+            c = sum;
+            sum += n;
+        }
+        for (const Keyed &k: items)
+            buf[counts[(k.key >> shift) & 0xFFFF]++] = k;
+        items.swap(buf);
+    }
+}
+
+/*!
+ * \brief stable_sort of parts by threads followed by merges of neighbours (also by threads)
+ */
+template<class Less>
+static void parallelSort(std::vector<int>::iterator first, std::vector<int>::iterator last, Less less)
+{
+    const size_t n = size_t(last - first);
+    const int threads = threadsFor(n);
+    if (threads < 2)
+    {
+        std::stable_sort(first, last, less);
+        return;
+    }
+    std::vector<size_t> bounds;
+    for (int i = 0; i <= threads; ++i)
+        bounds.push_back(n * size_t(i) / size_t(threads));
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i)
+        workers.emplace_back([=]() { std::stable_sort(first + bounds[i], first + bounds[i + 1], less); });
+    for (std::thread &t: workers)
+        t.join();
+
+    for (int width = 1; width < threads; width *= 2)
+    {
+        workers.clear();
+        for (int i = 0; i + width < threads; i += 2 * width)
+        {
+            size_t mid = bounds[size_t(i + width)];
+            size_t end = bounds[size_t(std::min(i + 2 * width, threads))];
+            workers.emplace_back([=]() {
+                std::inplace_merge(first + bounds[size_t(i)], first + mid, first + end, less);
+            });
+        }
+        for (std::thread &t: workers)
+            t.join();
+    }
+}
+
+/*!
+ * \brief radix sort keys of the non-null rows, false if the column is not suitable
+ */
+static bool keys(const ColumnStorage &s, bool numericText,
+                 std::vector<int>::const_iterator first, std::vector<int>::const_iterator last,
+                 std::vector<Keyed> &items)
+{
+    items.reserve(size_t(last - first));
+    switch (s.kind())
+    {
+    case ColumnStorage::Kind::Int32:
+    case ColumnStorage::Kind::Time:
+        for (auto it = first; it != last; ++it)
+            items.push_back({quint64(quint32(s.int32At(*it)) ^ 0x80000000u), *it});
+        return true;
+    case ColumnStorage::Kind::Int64:
+    case ColumnStorage::Kind::Date:
+    case ColumnStorage::Kind::DateTime:
+        for (auto it = first; it != last; ++it)
+            items.push_back({quint64(s.int64At(*it)) ^ (quint64(1) << 63), *it});
+        return true;
+    case ColumnStorage::Kind::Float:
+        for (auto it = first; it != last; ++it)
+            items.push_back({doubleKey(double(s.floatAt(*it))), *it});
+        return true;
+    case ColumnStorage::Kind::Double:
+        for (auto it = first; it != last; ++it)
+            items.push_back({doubleKey(s.doubleAt(*it)), *it});
+        return true;
+    case ColumnStorage::Kind::Bool:
+        for (auto it = first; it != last; ++it)
+            items.push_back({quint64(s.boolAt(*it)), *it});
+        return true;
+    case ColumnStorage::Kind::String:
+        if (numericText)
+        {
+            // textual numbers (numeric, money), values failed to parse go last
+            for (auto it = first; it != last; ++it)
+            {
+                int length;
+                const char *data = s.utf8At(*it, length);
+                bool ok;
+                double v = QByteArray::fromRawData(data, length).toDouble(&ok);
+                items.push_back({ok ? doubleKey(v) : ~quint64(0), *it});
+            }
+            return true;
+        }
+        if (s.isDictionaryEncoded())
+        {
+            // distinct values are ordered once, rows are ordered by ranks of their values
+            std::vector<int> sample;
+            for (auto it = first; it != last; ++it)
+            {
+                size_t code = s.dictionaryCode(*it);
+                if (code >= sample.size())
+                    sample.resize(code + 1, -1);
+                if (sample[code] < 0)
+                    sample[code] = *it;
+            }
+            std::vector<quint32> codes;
+            for (size_t code = 0; code < sample.size(); ++code)
+            {
+                if (sample[code] >= 0)
+                    codes.push_back(quint32(code));
+            }
+            std::sort(codes.begin(), codes.end(), [&s, &sample](quint32 a, quint32 b) {
+                int alen, blen;
+                const char *adata = s.utf8At(sample[a], alen);
+                const char *bdata = s.utf8At(sample[b], blen);
+                return compareUtf8(adata, alen, bdata, blen) < 0;
+            });
+            std::vector<quint32> rank(sample.size(), 0);
+            for (size_t i = 0; i < codes.size(); ++i)
+                rank[codes[i]] = quint32(i);
+            for (auto it = first; it != last; ++it)
+                items.push_back({rank[s.dictionaryCode(*it)], *it});
+            return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+void sort(const DataTable &table, int column, bool descending, std::vector<int> &rows)
+{
+    if (column < 0 || column >= table.columnCount())
+        return;
+    const ColumnStorage &s = table.storage(column);
+    auto middle = std::stable_partition(rows.begin(), rows.end(),
+                                        [&s, descending](int r) { return s.isNull(r) == descending; });
+    auto first = (descending ? middle : rows.begin());
+    auto last = (descending ? rows.end() : middle);
+    if (last - first < 2)
+        return;
+
+    bool numericText = (table.getColumn(column).hAlignment() == Qt::AlignRight);
+    std::vector<Keyed> items;
+    if (keys(s, numericText, first, last, items))
+    {
+        if (descending)
+        {
+            for (Keyed &k: items)
+                k.key = ~k.key;
+        }
+        radixSort(items);
+        for (size_t i = 0; i < items.size(); ++i)
+            first[i] = items[i].row;
+        return;
+    }
+
+    if (s.kind() == ColumnStorage::Kind::String)
+    {
+        parallelSort(first, last, [&s, descending](int a, int b) {
+            int alen, blen;
+            const char *adata = s.utf8At(a, alen);
+            const char *bdata = s.utf8At(b, blen);
+            int cmp = compareUtf8(adata, alen, bdata, blen);
+            return descending ? cmp > 0 : cmp < 0;
+        });
+        return;
+    }
+    parallelSort(first, last, [&s, descending](int a, int b) {
+        int cmp = compareVariants(s.value(a), s.value(b));
+        return descending ? cmp > 0 : cmp < 0;
+    });
+}
+
+// the same representation as grids show
+static QString displayText(const ColumnStorage &s, int row)
+{
+    QVariant v = s.value(row);
+    switch (QMetaType::Type(v.type()))
+    {
+    case QMetaType::QTime:
+        return v.toTime().toString("hh:mm:ss.zzz");
+    case QMetaType::QDate:
+        return v.toDate().toString("yyyy-MM-dd");
+    case QMetaType::QDateTime:
+    {
+        QDateTime dt = v.toDateTime();
+        if (dt.time().msecsTo(QTime(0, 0)) == 0)
+            return dt.toString("yyyy-MM-dd");
+        return dt.toString("yyyy-MM-dd hh:mm:ss.zzz");
+    }
+    default:
+        return v.toString();
+    }
+}
+
+static bool compared(int op, int cmp) noexcept
+{
+    switch (op)
+    {
+    case 1: return cmp == 0;
+    case 2: return cmp != 0;
+    case 3: return cmp < 0;
+    case 4: return cmp <= 0;
+    case 5: return cmp > 0;
+    case 6: return cmp >= 0;
+    default: return false;
+    }
+}
+
+template<class Getter>
+static void filterNumbers(const ColumnStorage &s, int op, double number, int from, int to,
+                          std::vector<quint8> &mask, Getter value)
+{
+    for (int r = from; r < to; ++r)
+    {
+        quint8 &m = mask[size_t(r - from)];
+        if (!m)
+            continue;
+        if (s.isNull(r))
+        {
+            m = 0;
+            continue;
+        }
+        double v = double(value(r));
+        m = compared(op, v < number ? -1 : v > number ? 1 : 0);
+    }
+}
+
+bool Filter::parse(const DataTable &table, const QString &expression, QString &error)
+{
+    _conditions.clear();
+    QString expr = expression.trimmed();
+    if (expr.isEmpty())
+        return true;
+
+    static const QRegularExpression condition_re(
+                R"(^("[^"]+"|[^\s=!<>~"]+)\s*(=|!=|<>|<=|>=|<|>|~|\bis\s+not\s+null$|\bis\s+null$)\s*(.*)$)",
+                QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression and_re(R"(\s+and\s+)", QRegularExpression::CaseInsensitiveOption);
+
+    QStringList parts = expr.split(and_re);
+    if (!condition_re.match(parts.first().trimmed()).hasMatch())
+    {
+        // plain text within any column
+        _conditions.append({-1, Op::Contains, expr, expr.toUtf8(), false, 0});
+        return true;
+    }
+
+    for (const QString &part: parts)
+    {
+        QRegularExpressionMatch m = condition_re.match(part.trimmed());
+        if (!m.hasMatch())
+        {
+            error = QObject::tr("condition expected: %1").arg(part.trimmed());
+            _conditions.clear();
+            return false;
+        }
+        QString name = m.captured(1);
+        if (name.startsWith('"'))
+            name = name.mid(1, name.length() - 2);
+        int column = -1;
+        for (int i = 0; i < table.columnCount() && column < 0; ++i)
+        {
+            if (table.getColumn(i).name() == name)
+                column = i;
+        }
+        for (int i = 0; i < table.columnCount() && column < 0; ++i)
+        {
+            if (!table.getColumn(i).name().compare(name, Qt::CaseInsensitive))
+                column = i;
+        }
+        if (column < 0)
+        {
+            error = QObject::tr("column %1 not found").arg(name);
+            _conditions.clear();
+            return false;
+        }
+
+        QString op_text = m.captured(2).simplified().toLower();
+        Op op = (op_text == "=" ? Op::Eq :
+                 op_text == "!=" || op_text == "<>" ? Op::Ne :
+                 op_text == "<" ? Op::Lt :
+                 op_text == "<=" ? Op::Le :
+                 op_text == ">" ? Op::Gt :
+                 op_text == ">=" ? Op::Ge :
+                 op_text == "~" ? Op::Contains :
+                 op_text == "is null" ? Op::IsNull : Op::NotNull);
+        QString value = m.captured(3).trimmed();
+        if (value.length() > 1 && value.startsWith('\'') && value.endsWith('\''))
+            value = value.mid(1, value.length() - 2).replace("''", "'");
+        else if (value.isEmpty() && op != Op::IsNull && op != Op::NotNull)
+        {
+            error = QObject::tr("value expected: %1").arg(part.trimmed());
+            _conditions.clear();
+            return false;
+        }
+        bool numeric;
+        double number = value.toDouble(&numeric);
+        _conditions.append({column, op, value, value.toUtf8(), numeric, number});
+    }
+    return true;
+}
+
+void Filter::evaluate(const DataTable &table, const Condition &c, int from, int to, std::vector<quint8> &mask)
+{
+    if (c.column < 0)
+    {
+        std::vector<quint8> any(mask.size(), 0);
+        for (int column = 0; column < table.columnCount(); ++column)
+        {
+            std::vector<quint8> m(mask);
+            Condition cc = c;
+            cc.column = column;
+            evaluate(table, cc, from, to, m);
+            for (size_t i = 0; i < m.size(); ++i)
+                any[i] |= m[i];
+        }
+        for (size_t i = 0; i < mask.size(); ++i)
+            mask[i] &= any[i];
+        return;
+    }
+
+    const ColumnStorage &s = table.storage(c.column);
+    if (c.op == Op::IsNull || c.op == Op::NotNull)
+    {
+        for (int r = from; r < to; ++r)
+        {
+            if (s.isNull(r) != (c.op == Op::IsNull))
+                mask[size_t(r - from)] = 0;
+        }
+        return;
+    }
+
+    const int op = int(c.op);
+    if (c.op != Op::Contains)
+    {
+        switch (s.kind())
+        {
+        case ColumnStorage::Kind::Int32:
+            if (!c.numeric)
+                break;
+            return filterNumbers(s, op, c.number, from, to, mask, [&s](int r) { return s.int32At(r); });
+        case ColumnStorage::Kind::Int64:
+            if (!c.numeric)
+                break;
+            return filterNumbers(s, op, c.number, from, to, mask, [&s](int r) { return s.int64At(r); });
+        case ColumnStorage::Kind::Float:
+            if (!c.numeric)
+                break;
+            return filterNumbers(s, op, c.number, from, to, mask, [&s](int r) { return s.floatAt(r); });
+        case ColumnStorage::Kind::Double:
+            if (!c.numeric)
+                break;
+            return filterNumbers(s, op, c.number, from, to, mask, [&s](int r) { return s.doubleAt(r); });
+        case ColumnStorage::Kind::Date:
+        case ColumnStorage::Kind::Time:
+        case ColumnStorage::Kind::DateTime:
+        {
+            // the value is encoded the same way as the column
+            QVariant target;
+            if (s.kind() == ColumnStorage::Kind::Date)
+                target = QDate::fromString(c.text, Qt::ISODate);
+            else if (s.kind() == ColumnStorage::Kind::Time)
+                target = QTime::fromString(c.text, Qt::ISODate);
+            else
+                target = QDateTime::fromString(QString(c.text).replace(' ', 'T'), Qt::ISODate);
+            ColumnStorage encoded;
+            encoded.appendVariant(target);
+            if (encoded.kind() != s.kind())
+                break;
+            if (s.kind() == ColumnStorage::Kind::Time)
+                return filterNumbers(s, op, encoded.int32At(0), from, to, mask, [&s](int r) { return s.int32At(r); });
+            return filterNumbers(s, op, double(encoded.int64At(0)), from, to, mask, [&s](int r) { return s.int64At(r); });
+        }
+        default:
+            break;
+        }
+    }
+
+    bool numericText = (c.numeric && c.op != Op::Contains && table.getColumn(c.column).hAlignment() == Qt::AlignRight);
+    auto matchText = [&c, op, numericText](const char *data, int length) -> bool {
+        if (c.op == Op::Contains)
+            return QString::fromUtf8(data, length).contains(c.text, Qt::CaseInsensitive);
+        if (numericText)
+        {
+            bool ok;
+            double v = QByteArray::fromRawData(data, length).toDouble(&ok);
+            if (!ok)
+                return c.op == Op::Ne;
+            return compared(op, v < c.number ? -1 : v > c.number ? 1 : 0);
+        }
+        return compared(op, compareUtf8(data, length, c.utf8.constData(), c.utf8.size()));
+    };
+
+    if (s.kind() == ColumnStorage::Kind::String)
+    {
+        // every distinct value is checked once
+        std::vector<quint8> verdicts;
+        bool dict = s.isDictionaryEncoded();
+        for (int r = from; r < to; ++r)
+        {
+            quint8 &m = mask[size_t(r - from)];
+            if (!m)
+                continue;
+            if (s.isNull(r))
+            {
+                m = 0;
+                continue;
+            }
+            int length;
+            const char *data = s.utf8At(r, length);
+            if (!dict)
+            {
+                m = matchText(data, length);
+                continue;
+            }
+            size_t code = s.dictionaryCode(r);
+            if (code >= verdicts.size())
+                verdicts.resize(code + 1, 2);
+            if (verdicts[code] == 2)
+                verdicts[code] = matchText(data, length);
+            m = verdicts[code];
+        }
+        return;
+    }
+
+    for (int r = from; r < to; ++r)
+    {
+        quint8 &m = mask[size_t(r - from)];
+        if (!m)
+            continue;
+        if (s.isNull(r))
+        {
+            m = 0;
+            continue;
+        }
+        QByteArray utf8 = displayText(s, r).toUtf8();
+        m = matchText(utf8.constData(), utf8.size());
+    }
+}
+
+void Filter::apply(const DataTable &table, int from, int to, std::vector<int> &rows) const
+{
+    if (to <= from)
+        return;
+    std::vector<quint8> mask(size_t(to - from), 1);
+    const int threads = threadsFor(mask.size());
+    // every thread evaluates all the conditions over its part of rows
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i)
+    {
+        int part_from = from + int(qint64(to - from) * i / threads);
+        int part_to = from + int(qint64(to - from) * (i + 1) / threads);
+        auto work = [this, &table, &mask, from, part_from, part_to]() {
+            std::vector<quint8> part(mask.begin() + (part_from - from), mask.begin() + (part_to - from));
+            for (const Condition &c: _conditions)
+                evaluate(table, c, part_from, part_to, part);
+            std::copy(part.begin(), part.end(), mask.begin() + (part_from - from));
+        };
+        if (threads == 1)
+            work();
+        else
+            workers.emplace_back(work);
+    }
+    for (std::thread &t: workers)
+        t.join();
+
+    for (int r = from; r < to; ++r)
+    {
+        if (mask[size_t(r - from)])
+            rows.push_back(r);
+    }
+}
+
+} // namespace RowIndex
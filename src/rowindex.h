@@ -0,0 +1,71 @@
+#ifndef ROWINDEX_H
+#define ROWINDEX_H
+
+#include <QString>
+#include <QVector>
+#include <vector>
+
+class DataTable;
+
+// rows per thread of a comparison sort
+#define ROW_INDEX_PARALLEL_MIN_ROWS 100000
+
+/*!
+ * \brief Orders and filters of DataTable rows computed over the column storage.
+ *
+ * Results are permutations (vectors of source rows), the table is never altered.
+ */
+namespace RowIndex
+{
+
+/*!
+ * \brief order the rows by the column, stable
+ *
+ * Nulls go last in ascending order and first in descending one (the same as postgres does).
+ * Fixed-width values, dictionary encoded strings and numeric strings are ordered by radix sort,
+ * other strings and mixed values by merge sort across cores.
+ */
+void sort(const DataTable &table, int column, bool descending, std::vector<int> &rows);
+
+/*!
+ * \brief quick filter of result grids
+ *
+ * The expression is either a text any column contains (case-insensitively), or
+ * conditions "column op value" joined by "and", where op is one of
+ * = != <> < <= > >= ~ (contains), or "column is [not] null".
+ */
+class Filter
+{
+public:
+    /*!
+     * \return false if the expression does not suit the table
+     */
+    bool parse(const DataTable &table, const QString &expression, QString &error);
+    bool isEmpty() const noexcept { return _conditions.isEmpty(); }
+    /*!
+     * \brief append rows within [from, to) matching the filter
+     */
+    void apply(const DataTable &table, int from, int to, std::vector<int> &rows) const;
+
+private:
+    enum class Op { Contains, Eq, Ne, Lt, Le, Gt, Ge, IsNull, NotNull };
+    struct Condition
+    {
+        int column;     ///< -1 to match any column
+        Op op;
+        QString text;
+        QByteArray utf8;
+        bool numeric;   ///< the value is a number
+        double number;
+    };
+    /*!
+     * \brief clear mask of rows in [from, to) not matching the condition
+     */
+    static void evaluate(const DataTable &table, const Condition &c, int from, int to, std::vector<quint8> &mask);
+
+    QVector<Condition> _conditions;
+};
+
+} // namespace RowIndex
+
+#endif // ROWINDEX_H
@@ -0,0 +1,133 @@
+#include "scriptcursor.h"
+#include "dbconnection.h"
+#include "datatable.h"
+#include "pgconnection.h"
+#include <QHash>
+#include <QMutex>
+#include <atomic>
+
+namespace
+{
+struct Transaction
+{
+    int cursors = 0;
+    bool own = false;   ///< begun for the cursors
+};
+QMutex _transactions_mutex;
+QHash<DbConnection*, Transaction> _transactions;
+std::atomic<int> _serial(0);
+}
+
+ScriptCursor::ScriptCursor(DbConnection *connection) :
+    QObject(connection),
+    _connection(connection)
+{
+}
+
+ScriptCursor::~ScriptCursor()
+{
+    close();
+}
+
+void ScriptCursor::forget(DbConnection *connection)
+{
+    QMutexLocker lk(&_transactions_mutex);
+    _transactions.remove(connection);
+}
+
+bool ScriptCursor::open(const QString &query, const QVector<QVariant> &params)
+{
+    if (!qobject_cast<PgConnection*>(_connection))
+    {
+        if (!_connection->execute(query, &params) || _connection->_resultsets.isEmpty())
+            return false;
+        // synchronous usage only - no need to use _resultsetsGuard
+        _rows.reset(_connection->_resultsets.takeLast());
+        _connection->clearResultsets();
+        _opened = true;
+        _atEnd = !_rows->rowCount();
+        return true;
+    }
+
+    // cursors without hold live within a transaction
+    QMutexLocker lk(&_transactions_mutex);
+    Transaction &t = _transactions[_connection];
+    if (!t.cursors)
+    {
+        t.own = _connection->transactionStatus().isEmpty();
+        if (t.own && !_connection->execute("begin"))
+        {
+            _transactions.remove(_connection);
+            return false;
+        }
+    }
+    ++t.cursors;
+    lk.unlock();
+
+    _name = QString("sqt_script_%1").arg(++_serial);
+    _opened = true;
+    if (!_connection->execute("declare " + _name + " no scroll cursor for\n" + query + "\n", &params))
+    {
+        close();
+        return false;
+    }
+    _atEnd = false;
+    return true;
+}
+
+DataTable* ScriptCursor::fetch(int count)
+{
+    count = qMax(count, 1);
+    if (!_opened || _atEnd)
+        return new DataTable();
+    if (_rows)
+    {
+        DataTable *res = new DataTable();
+        for (int c = 0; c < _rows->columnCount(); ++c)
+            res->addColumn(new DataColumn(_rows->getColumn(c)));
+        QVector<QVariant> row(_rows->columnCount());
+        const int end = qMin(_position + count, _rows->rowCount());
+        for (; _position < end; ++_position)
+        {
+            for (int c = 0; c < row.size(); ++c)
+                row[c] = _rows->value(_position, c);
+            res->appendRow(row);
+        }
+        _atEnd = (_position >= _rows->rowCount());
+        return res;
+    }
+
+    if (!_connection->execute(QString("fetch forward %1 from %2").arg(count).arg(_name)) ||
+            _connection->_resultsets.isEmpty())
+    {
+        _atEnd = true;
+        return new DataTable();
+    }
+    DataTable *res = _connection->_resultsets.takeLast();
+    _atEnd = (res->rowCount() < count);
+    return res;
+}
+
+void ScriptCursor::close()
+{
+    if (!_opened)
+        return;
+    _opened = false;
+    _atEnd = true;
+    _rows.reset();
+    if (_name.isEmpty())
+        return;
+
+    QMutexLocker lk(&_transactions_mutex);
+    Transaction &t = _transactions[_connection];
+    bool commit = (--t.cursors <= 0 && t.own);
+    if (t.cursors <= 0)
+        _transactions.remove(_connection);
+    lk.unlock();
+    // a failed transaction has discarded the cursor already
+    if (_connection->transactionStatus() != "inerror")
+        _connection->execute("close " + _name);
+    if (commit)
+        _connection->execute(_connection->transactionStatus() == "inerror" ? "rollback" : "commit");
+    _connection->clearResultsets();
+}
@@ -0,0 +1,52 @@
+#ifndef SCRIPTCURSOR_H
+#define SCRIPTCURSOR_H
+
+#include <QObject>
+#include <QVariant>
+#include <QVector>
+#include <memory>
+
+class DataTable;
+class DbConnection;
+
+/*!
+ * \brief Cursor of the scripting api: openCursor(query, params...), fetch(n), close().
+ *
+ * Postgres keeps the resultset within a server-side cursor, so a script holds a single
+ * portion of rows at once. The cursor is declared within the current transaction or
+ * within a transaction of its own, committed when the last cursor of the connection
+ * is closed. Other dbms fetch the whole resultset at open() and return it by portions.
+ *
+ * Cursors are children of the connection, the ones a script leaves open are closed
+ * after the script or by the destructor of the connection.
+ */
+class ScriptCursor : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ScriptCursor(DbConnection *connection);
+    virtual ~ScriptCursor() override;
+    bool open(const QString &query, const QVector<QVariant> &params);
+    /*!
+     * \brief drop the transaction state of the connection being destroyed
+     */
+    static void forget(DbConnection *connection);
+
+public slots:
+    /*!
+     * \brief the next count rows, empty table at the end (the script takes ownership)
+     */
+    DataTable* fetch(int count);
+    bool atEnd() const noexcept { return _atEnd; }
+    void close();
+
+private:
+    DbConnection *_connection;
+    QString _name;                      ///< of the server-side cursor, empty if the resultset is kept here
+    bool _opened = false;
+    bool _atEnd = true;
+    std::unique_ptr<DataTable> _rows;   ///< the whole resultset of a dbms lacking cursors
+    int _position = 0;
+};
+
+#endif // SCRIPTCURSOR_H
@@ -8,9 +8,18 @@
 #include "dbconnection.h"
 #include "odbcconnection.h"
 #include "datatable.h"
+#include "metadatacache.h"
+#include "scriptcursor.h"
+#include "trace.h"
 #include <QJSEngine>
 #include <QJSValueList>
 #include <QQmlEngine>
+#include <QThreadStorage>
+#include <QFileSystemWatcher>
+#include <QMutex>
+
+// compiled .qs script bodies per engine
+#define SCRIPT_FUNCTIONS_CACHE_SIZE 128
 
 namespace Scripting
 {
@@ -19,6 +28,72 @@ namespace Scripting
 static QHash<QString, QString> _dbms_paths;
 // key = dbms_scripting_id/context/, value = { type, script }
 static QHash<QString, QHash<QString, Script>> _scripts;
+// scripts are resolved by background tree workers as well
+static QMutex _registry_mutex(QMutex::Recursive);
+
+/*!
+ * \brief QJSEngine with api helpers installed, one per thread
+ */
+struct ScriptEngine
+{
+    ScriptEngine()
+    {
+        qmlRegisterType<DataTable>();
+        QJSValue env_fn = engine.evaluate(R"(
+                                     function(objectType) {
+                                        return __env.value(objectType);
+                                     })");
+        engine.globalObject().setProperty("env", env_fn);
+
+        QJSValue execFn = engine.evaluate(R"(
+                                     function(query) {
+                                        return __connection.execute(query, Array.prototype.slice.call(arguments, 1));
+                                     })");
+        engine.globalObject().setProperty("exec", execFn);
+
+        // independent queries are sent back-to-back: execPipeline(query1, [query2, param1, ...], ...)
+        QJSValue execPipelineFn = engine.evaluate(R"(
+                                     function() {
+                                        return __connection.executeStatements(Array.prototype.slice.call(arguments));
+                                     })");
+        engine.globalObject().setProperty("execPipeline", execPipelineFn);
+
+        // the statement is executed for every array of parameters: execBatch(query, [[p1, p2], [p1, p2], ...])
+        QJSValue execBatchFn = engine.evaluate(R"(
+                                     function(query, rows) {
+                                        return __connection.execBatch(query, rows);
+                                     })");
+        engine.globalObject().setProperty("execBatch", execBatchFn);
+
+        // rows are read by portions: var c = openCursor(query, params...); c.fetch(n); c.close()
+        QJSValue openCursorFn = engine.evaluate(R"(
+                                     function(query) {
+                                        return __connection.openCursor(query, Array.prototype.slice.call(arguments, 1));
+                                     })");
+        engine.globalObject().setProperty("openCursor", openCursorFn);
+
+        QJSValue returnTableFn = engine.evaluate(R"(
+                                        function(resultset) {
+                                            __env.appendTable(resultset);
+                                        })");
+        engine.globalObject().setProperty("returnTable", returnTableFn);
+        QJSValue returnScriptFn = engine.evaluate(R"(
+                                        function(script) {
+                                            __env.appendScript(script);
+                                        })");
+        engine.globalObject().setProperty("returnScript", returnScriptFn);
+
+        QJSValue returnTextFn = engine.evaluate(R"(
+                                        function(text) {
+                                            __env.appendText(text);
+                                        })");
+        engine.globalObject().setProperty("returnText", returnTextFn);
+    }
+    QJSEngine engine;
+    QHash<QString, QJSValue> functions; ///< compiled script bodies, key = body text
+    bool busy = false;
+};
+static QThreadStorage<ScriptEngine*> _engines;
 
 QString context2str(Context context)
 {
@@ -38,6 +113,7 @@ QString context2str(Context context)
 
 QString dbmsScriptPath(DbConnection *con, Context context)
 {
+    QMutexLocker lk(&_registry_mutex);
     if (!con || (con->dbmsScriptingID().isEmpty() && !con->open()))
         throw QObject::tr("db connection unavailable");
     OdbcConnection *odbcConnection = qobject_cast<OdbcConnection*>(con);
@@ -87,10 +163,9 @@ QString dbmsScriptPath(DbConnection *con, Context context)
 }
 
 ///
-/// \brief dbms The function extracts version specific part of script or entire content.
+/// \brief dbms The function splits script into version specific parts.
 /// \param script Content of script file.
-/// \param version Current dbms comparable version (or db-level compartibility level).
-/// \return dbms Version specific part of script.
+/// \return dbms Parts of script by minimal dbms version (empty if there are no boundaries).
 ///
 /// A script may contain comments corresponding to regexp:
 /// (?=\/\*\s*V(\d+)\+\s*\*\/)
@@ -109,15 +184,10 @@ QString dbmsScriptPath(DbConnection *con, Context context)
 /// E.g. scripts/odbc/microsoft sql/version.sql
 /// (uses compartibility_level as a comparable version).
 ///
-QString versionSpecificPart(const QString &script, int version)
+QMap<int, QString> versionParts(const QString &script)
 {
-    QRegularExpression re(R"((?=\/\*\s*V(\d+)\+\s*\*\/))");
+    static const QRegularExpression re(R"((?=\/\*\s*V(\d+)\+\s*\*\/))");
     QRegularExpressionMatchIterator i = re.globalMatch(script);
-
-    // return whole script body if boundaries are not found
-    if (!i.hasNext())
-        return script;
-
     QMap<int, QString> parts;
     while (i.hasNext())
     {
@@ -135,6 +205,22 @@ QString versionSpecificPart(const QString &script, int version)
         }
         parts[key] = value;
     }
+    return parts;
+}
+
+///
+/// \brief dbms The function selects version specific part of script or entire content.
+/// \param parts Result of versionParts().
+/// \param script Content of script file.
+/// \param version Current dbms comparable version (or db-level compartibility level).
+/// \return dbms Version specific part of script.
+///
+QString versionSpecificPart(const QMap<int, QString> &parts, const QString &script, int version)
+{
+    // return whole script body if boundaries are not found
+    if (parts.isEmpty())
+        return script;
+
     // search for the highest available version
     // (QMap is sorted by key)
     QMap<int, QString>::const_iterator mi = parts.constEnd();
@@ -148,15 +234,31 @@ QString versionSpecificPart(const QString &script, int version)
     return "";
 }
 
-void refresh(DbConnection *connection, Context context)
+/*!
+ * \brief script file pre-split into version-specific parts
+ */
+struct ScriptFile
 {
-    if (!connection)
-        return;
+    QString body;
+    QMap<int, QString> parts;
+    Script::Type type;
+    bool nocache;
+    bool sessionCache;
+    bool ddl;
+};
 
-    QString path = dbmsScriptPath(connection, context);
-    auto &bunch = _scripts[connection->dbmsScriptingID() + context2str(context)];
-    bunch.clear();
+// key = folder path, value = { script name, file }
+static QHash<QString, QHash<QString, ScriptFile>> _folders;
+static QFileSystemWatcher *_watcher = nullptr;
 
+void reloadFolder(const QString &changed);
+
+void loadFolder(const QString &path)
+{
+    auto &folder = _folders[path];
+    folder.clear();
+
+    QStringList watched;
     QFileInfoList files = QDir(path).entryInfoList({"*.*"}, QDir::Files);
     for (const auto &f : files)
     {
@@ -166,38 +268,133 @@ void refresh(DbConnection *connection, Context context)
 
         QFile scriptFile(f.filePath());
         if (!scriptFile.open(QIODevice::ReadOnly))
-            throw QObject::tr("can't open %1").arg(files.at(0).filePath());
+            throw QObject::tr("can't open %1").arg(f.filePath());
 
         QTextStream stream(&scriptFile);
         stream.setCodec("UTF-8");
-        bunch.insert(f.baseName(),
-            Scripting::Script {
-                versionSpecificPart(
-                    stream.readAll(),
-                    // prevent infinite loop - do not acquire comparable version on root level
-                    context == Context::Root ? -1 : connection->dbmsComparableVersion()),
-                suffix == "sql" ? Script::Type::SQL : Script::Type::QS
-            }
-        );
+        ScriptFile file;
+        file.body = stream.readAll();
+        file.parts = versionParts(file.body);
+        file.type = (suffix == "sql" ? Script::Type::SQL : Script::Type::QS);
+        static const QRegularExpression nocache(R"(\/\*\s*nocache\s*\*\/)");
+        static const QRegularExpression session(R"(\/\*\s*cache:\s*session\s*\*\/)");
+        static const QRegularExpression ddl(R"(\/\*\s*cache:\s*ddl\s*\*\/)");
+        file.nocache = file.body.contains(nocache);
+        file.sessionCache = file.body.contains(session);
+        file.ddl = file.body.contains(ddl);
+        folder.insert(f.baseName(), file);
+        watched.append(f.filePath());
     }
+
+    // reload changed scripts without restart (the watcher lives in the GUI thread)
+    QMetaObject::invokeMethod(qApp, [path, watched]() {
+        if (!_watcher)
+        {
+            _watcher = new QFileSystemWatcher(qApp);
+            QObject::connect(_watcher, &QFileSystemWatcher::fileChanged, reloadFolder);
+            QObject::connect(_watcher, &QFileSystemWatcher::directoryChanged, reloadFolder);
+        }
+        _watcher->addPath(path);
+        // files replaced on save are not watched anymore, so add them again
+        if (!watched.isEmpty())
+            _watcher->addPaths(watched);
+    }, Qt::QueuedConnection);
 }
 
-Script* getScript(DbConnection *connection, Context context, const QString &objectType)
+void reloadFolder(const QString &changed)
+{
+    QMutexLocker lk(&_registry_mutex);
+    QFileInfo fi(changed);
+    QString folder_path = fi.isDir() ? changed : fi.path() + '/';
+    if (!folder_path.endsWith('/'))
+        folder_path += '/';
+    if (!_folders.contains(folder_path))
+        return;
+    try
+    {
+        loadFolder(folder_path);
+    }
+    catch (const QString &)
+    {
+        _folders.remove(folder_path);
+    }
+    // versions are resolved again on demand
+    _scripts.clear();
+}
+
+/*!
+ * \brief resolve version-specific scripts of the context using disk cache
+ */
+void resolve(DbConnection *connection, Context context)
 {
+    QString path = dbmsScriptPath(connection, context);
+    if (!_folders.contains(path))
+        loadFolder(path);
+
     auto &bunch = _scripts[connection->dbmsScriptingID() + context2str(context)];
-    if (bunch.isEmpty())
+    bunch.clear();
+    // prevent infinite loop - do not acquire comparable version on root level
+    int version = (context == Context::Root ? -1 : connection->dbmsComparableVersion());
+    bool cacheable = (context == Context::Tree || context == Context::Preview || context == Context::Autocomplete);
+    const auto &folder = _folders[path];
+    for (auto it = folder.constBegin(); it != folder.constEnd(); ++it)
     {
-        refresh(connection, context);
-        bunch = _scripts[connection->dbmsScriptingID() + context2str(context)];
+        const ScriptFile &f = it.value();
+        Script::Caching caching = Script::Caching::None;
+        if (cacheable && f.type == Script::Type::SQL && !f.nocache)
+            caching = f.sessionCache ? Script::Caching::Session : Script::Caching::Catalog;
+        Script script { versionSpecificPart(f.parts, f.body, version), f.type, caching };
+        script.live = f.nocache;
+        script.ddl = (f.ddl && !f.nocache);
+        bunch.insert(it.key(), script);
     }
-    const auto it = bunch.find(objectType);
-    return (it == bunch.end() ? nullptr : &it.value());
 }
 
-void execute(
+void refresh(DbConnection *connection, Context context)
+{
+    if (!connection)
+        return;
+
+    QMutexLocker lk(&_registry_mutex);
+    // explicit refresh rereads files
+    _folders.remove(dbmsScriptPath(connection, context));
+    resolve(connection, context);
+}
+
+Script* getScript(DbConnection *connection, Context context, const QString &objectType)
+{
+    QMutexLocker lk(&_registry_mutex);
+    QString key = connection->dbmsScriptingID() + context2str(context);
+    auto it = _scripts.find(key);
+    if (it == _scripts.end() || it->isEmpty())
+    {
+        resolve(connection, context);
+        it = _scripts.find(key);
+    }
+    const auto sit = it->find(objectType);
+    return (sit == it->end() ? nullptr : &sit.value());
+}
+
+/*!
+ * \brief copy of the script, which stays valid if scripts are reloaded meanwhile
+ */
+std::unique_ptr<Script> scriptCopy(DbConnection *connection, Context context, const QString &objectType)
+{
+    QMutexLocker lk(&_registry_mutex);
+    Script *s = getScript(connection, context, objectType);
+    return std::unique_ptr<Script>(s ? new Script(*s) : nullptr);
+}
+
+/*!
+ * \brief script body with macros replaced
+ * \param cacheKey key of the cached results, empty if they are not cached
+ */
+QString prepare(
         CppConductor *env,
         DbConnection *connection,
-        Script *s)
+        Context context,
+        Script *s,
+        QString &cacheKey)
 {
     QString query = s->body;
 
@@ -221,9 +418,41 @@ void execute(
         query = query.replace("$" + macro + "$", value.isEmpty() ? "NULL" : value);
     }
 
+    // catalog scripts are shared by all the connections to the database
+    cacheKey.clear();
+    if (s->caching != Script::Caching::None)
+    {
+        cacheKey = context2str(context) + '\n' + query;
+        if (s->caching == Script::Caching::Session)
+        {
+            auto c = execute(connection, Context::Root, "session_marker", nullptr);
+            DataTable *t = (c && !c->resultsets.isEmpty() ? c->resultsets.back() : nullptr);
+            if (!t || t->rowCount() != 1 || t->columnCount() != 1)
+                cacheKey.clear();
+            else
+                cacheKey += '\n' + t->value(0, 0).toString();
+        }
+    }
+    return query;
+}
+
+void execute(
+        CppConductor *env,
+        DbConnection *connection,
+        Context context,
+        Script *s)
+{
+    SQT_TRACE_SCOPE("Scripting::execute");
+    QString cache_key;
+    QString query = prepare(env, connection, context, s, cache_key);
+    if (!cache_key.isEmpty() && MetadataCache::instance().fetch(connection, cache_key, env))
+        return;
+
     if (s->type == Scripting::Script::Type::SQL)
     {
-        connection->execute(query);
+        // failed queries are not cached
+        if (!connection->execute(query))
+            cache_key.clear();
         for (int i = connection->_resultsets.size() - 1; i >= 0; --i)
         {
             DataTable *t = connection->_resultsets.at(i);
@@ -250,49 +479,55 @@ void execute(
             if (t)
                 delete t;
         }
+        if (!cache_key.isEmpty())
+            MetadataCache::instance().store(connection, cache_key, *env);
     }
     else if (s->type == Scripting::Script::Type::QS)
     {
-        QJSEngine e;
-        qmlRegisterType<DataTable>();
-        QQmlEngine::setObjectOwnership(connection, QQmlEngine::CppOwnership);
-        QJSValue cn = e.newQObject(connection);
-        e.globalObject().setProperty("__connection", cn);
+        // nested script execution (if any) gets a temporary engine
+        std::unique_ptr<ScriptEngine> tmp_engine;
+        if (!_engines.hasLocalData())
+            _engines.setLocalData(new ScriptEngine());
+        ScriptEngine *se = _engines.localData();
+        if (se->busy)
+        {
+            tmp_engine.reset(new ScriptEngine());
+            se = tmp_engine.get();
+        }
+        QJSEngine &e = se->engine;
 
+        QQmlEngine::setObjectOwnership(connection, QQmlEngine::CppOwnership);
+        e.globalObject().setProperty("__connection", e.newQObject(connection));
         // environment access in a functional style
         QQmlEngine::setObjectOwnership(env, QQmlEngine::CppOwnership);
-        QJSValue cppEnv = e.newQObject(env);
-        e.globalObject().setProperty("__env", cppEnv);
-        QJSValue env_fn = e.evaluate(R"(
-                                     function(objectType) {
-                                        return __env.value(objectType);
-                                     })");
-        e.globalObject().setProperty("env", env_fn);
-
-        QJSValue execFn = e.evaluate(R"(
-                                     function(query) {
-                                        return __connection.execute(query, Array.prototype.slice.call(arguments, 1));
-                                     })");
-        e.globalObject().setProperty("exec", execFn);
+        e.globalObject().setProperty("__env", e.newQObject(env));
 
-        QJSValue returnTableFn = e.evaluate(R"(
-                                        function(resultset) {
-                                            __env.appendTable(resultset);
-                                        })");
-        e.globalObject().setProperty("returnTable", returnTableFn);
-        QJSValue returnScriptFn = e.evaluate(R"(
-                                        function(script) {
-                                            __env.appendScript(script);
-                                        })");
-        e.globalObject().setProperty("returnScript", returnScriptFn);
-
-        QJSValue returnTextFn = e.evaluate(R"(
-                                        function(text) {
-                                            __env.appendText(text);
-                                        })");
-        e.globalObject().setProperty("returnText", returnTextFn);
+        // the body is wrapped into a function to be compiled once (macros make a distinct body)
+        QJSValue fn = se->functions.value(query);
+        if (!fn.isCallable())
+        {
+            fn = e.evaluate("(function() {" + query + "\n})");
+            if (fn.isCallable())
+            {
+                if (se->functions.size() >= SCRIPT_FUNCTIONS_CACHE_SIZE)
+                    se->functions.clear();
+                se->functions.insert(query, fn);
+            }
+        }
 
-        QJSValue execRes = e.evaluate(query);
+        const QList<ScriptCursor*> cursors = connection->findChildren<ScriptCursor*>(QString(), Qt::FindDirectChildrenOnly);
+        se->busy = true;
+        QJSValue execRes = fn.isError() ? fn : fn.call();
+        se->busy = false;
+        // cursors left open by the script are closed (the ones of an outer script are kept)
+        for (ScriptCursor *cursor: connection->findChildren<ScriptCursor*>(QString(), Qt::FindDirectChildrenOnly))
+        {
+            if (!cursors.contains(cursor))
+                delete cursor;
+        }
+        // do not keep wrappers of objects about to be deleted
+        e.globalObject().setProperty("__connection", QJSValue());
+        e.globalObject().setProperty("__env", QJSValue());
         if (execRes.isError())
             throw QObject::tr("error at line %1: %2").arg(execRes.property("lineNumber").toInt()).arg(execRes.toString());
     }
@@ -305,10 +540,10 @@ std::unique_ptr<CppConductor> execute(
         std::function<QVariant (QString)> envCallback)
 {
     std::unique_ptr<CppConductor> env { new CppConductor(nullptr, envCallback) };
-    auto s = Scripting::getScript(connection, context, objectType);
+    auto s = scriptCopy(connection, context, objectType);
     if (!s)
         return nullptr;
-    execute(env.get(), connection, s);
+    execute(env.get(), connection, context, s.get());
     return env;
 }
 
@@ -319,13 +554,47 @@ std::unique_ptr<CppConductor> execute(
         std::function<QVariant(QString)> envCallback)
 {
     std::unique_ptr<CppConductor> env { new CppConductor(connection, envCallback) };
-    auto s = Scripting::getScript(connection.get(), context, objectType);
+    auto s = scriptCopy(connection.get(), context, objectType);
     if (!s)
         return nullptr;
-    execute(env.get(), connection.get(), s);
+    execute(env.get(), connection.get(), context, s.get());
     return env;
 }
 
+QString resultKey(
+        DbConnection *connection,
+        Context context,
+        const QString &objectType,
+        std::function<QVariant(QString)> envCallback)
+{
+    auto s = scriptCopy(connection, context, objectType);
+    if (!s || s->caching == Script::Caching::None)
+        return QString();
+    CppConductor env(nullptr, envCallback);
+    QString key;
+    prepare(&env, connection, context, s.get(), key);
+    QString state = (key.isEmpty() ? QString() : MetadataCache::instance().catalogState(connection));
+    return (state.isEmpty() ? QString() : state + '\n' + key);
+}
+
+QString viewKey(
+        DbConnection *connection,
+        Context context,
+        const QString &objectType,
+        std::function<QVariant(QString)> envCallback)
+{
+    auto s = scriptCopy(connection, context, objectType);
+    // live data (sessions, table rows, statistics) is never reused
+    if (!s || !s->ddl)
+        return QString();
+    // session marker is not queried, the key is for the connection's own results
+    s->caching = Script::Caching::None;
+    CppConductor env(nullptr, envCallback);
+    QString ignored;
+    QString query = prepare(&env, connection, context, s.get(), ignored);
+    return context2str(context) + '\n' + objectType + '\n' + query;
+}
+
 CppConductor::~CppConductor()
 {
     clear();
@@ -55,9 +55,22 @@ enum class Context { Root = 0, Tree, Content, Preview, Autocomplete };
 struct Script
 {
     enum class Type { SQL, QS };
-    Script(QString body, Type type) : body(body), type(type) {}
+    /*!
+     * \brief caching of sql script results within tree, preview and autocomplete contexts
+     *
+     * Scripts may opt out by comment "nocache" (live data) or ask to distinguish
+     * sessions by comment "cache: session" (e.g. search_path dependent results),
+     * see root-level catalog_marker and session_marker scripts.
+     * Results of content and preview scripts are reused only if the script is marked
+     * by comment "cache: ddl" (definitions depending on the catalog only, see ResultCache).
+     */
+    enum class Caching { Catalog, Session, None };
+    Script(QString body, Type type, Caching caching = Caching::None) : body(body), type(type), caching(caching) {}
     QString body;
     Type type = Type::SQL;
+    Caching caching = Caching::None;
+    bool live = false;      ///< "nocache" script, its results are never reused
+    bool ddl = false;       ///< "cache: ddl" script, its content/preview results may be reused
 };
 
 QString dbmsScriptPath(DbConnection *con, Context context = Context::Root);
@@ -74,6 +87,24 @@ std::unique_ptr<CppConductor> execute(
         Context context,
         const QString &objectType,
         std::function<QVariant(QString)> envCallback);
+/*!
+ * \brief key of the script results within the environment and the current catalog state
+ * \return empty if the results are not cached (so they may differ every time)
+ */
+QString resultKey(
+        DbConnection *connection,
+        Context context,
+        const QString &objectType,
+        std::function<QVariant(QString)> envCallback);
+/*!
+ * \brief context, type and text of the script with macros replaced by the environment values
+ * \return empty if there is no script or it is not marked by "cache: ddl"
+ */
+QString viewKey(
+        DbConnection *connection,
+        Context context,
+        const QString &objectType,
+        std::function<QVariant(QString)> envCallback);
 }
 
 #endif // SCRIPTS_H
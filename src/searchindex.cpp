@@ -0,0 +1,153 @@
+#include "searchindex.h"
+#include <QApplication>
+#include <QPointer>
+#include <thread>
+#include <algorithm>
+
+// matches between checks of cancellation
+#define SEARCH_CANCEL_CHECK 1024
+
+SearchIndex::SearchIndex(QObject *parent) :
+    QObject(parent),
+    _generation(std::make_shared<std::atomic<int>>(0))
+{
+}
+
+SearchIndex::~SearchIndex()
+{
+    ++*_generation;
+}
+
+void SearchIndex::build(const QString &text, const QRegularExpression &exp, quint64 revision)
+{
+    if ((_ready || _building) && _exp == exp && _revision == revision)
+        return;
+    int generation = ++*_generation;
+    _exp = exp;
+    _revision = revision;
+    _ready = false;
+    _building = true;
+
+    std::shared_ptr<std::atomic<int>> current = _generation;
+    QPointer<SearchIndex> self(this);
+    std::thread([self, current, generation, text, exp]() {
+        QVector<QPair<int, int>> matches;
+        QRegularExpressionMatchIterator it = exp.globalMatch(text);
+        while (it.hasNext())
+        {
+            QRegularExpressionMatch m = it.next();
+            matches.append({m.capturedStart(), m.capturedLength()});
+            if (matches.size() % SEARCH_CANCEL_CHECK == 0 && *current != generation)
+                return;
+        }
+        QMetaObject::invokeMethod(qApp, [self, current, generation, matches]() {
+            if (!self || *current != generation)
+                return;
+            self->_matches = matches;
+            self->_ready = true;
+            self->_building = false;
+            emit self->ready();
+        }, Qt::QueuedConnection);
+    }).detach();
+}
+
+void SearchIndex::invalidate()
+{
+    ++*_generation;
+    _ready = false;
+    _building = false;
+    _matches.clear();
+}
+
+bool SearchIndex::isReady(const QRegularExpression &exp, quint64 revision) const noexcept
+{
+    return _ready && _exp == exp && _revision == revision;
+}
+
+int SearchIndex::next(int pos, bool *wrapped) const noexcept
+{
+    if (wrapped)
+        *wrapped = false;
+    if (_matches.isEmpty())
+        return -1;
+    auto it = std::lower_bound(_matches.cbegin(), _matches.cend(), pos,
+                               [](const QPair<int, int> &m, int p) { return m.first < p; });
+    if (it == _matches.cend())
+    {
+        if (wrapped)
+            *wrapped = true;
+        return 0;
+    }
+    return int(it - _matches.cbegin());
+}
+
+int SearchIndex::previous(int pos, bool *wrapped) const noexcept
+{
+    if (wrapped)
+        *wrapped = false;
+    if (_matches.isEmpty())
+        return -1;
+    // matches do not overlap, so their ends are sorted as well
+    auto it = std::upper_bound(_matches.cbegin(), _matches.cend(), pos,
+                               [](int p, const QPair<int, int> &m) { return p < m.first + m.second; });
+    if (it == _matches.cbegin())
+    {
+        if (wrapped)
+            *wrapped = true;
+        return _matches.size() - 1;
+    }
+    return int(it - _matches.cbegin()) - 1;
+}
+
+void SearchIndex::replaceAll(const QString &text, const QRegularExpression &exp, const QString &replacement,
+                             bool literal, quint64 revision)
+{
+    // the result is dropped by the receiver if the text has changed meanwhile
+    QPointer<SearchIndex> self(this);
+    std::thread([self, text, exp, replacement, literal, revision]() {
+        QVector<Replacement> res;
+        QRegularExpressionMatchIterator it = exp.globalMatch(text);
+        while (it.hasNext())
+        {
+            QRegularExpressionMatch m = it.next();
+            res.append({m.capturedStart(), m.capturedLength(), literal ? replacement : expand(replacement, m)});
+        }
+        QMetaObject::invokeMethod(qApp, [self, res, revision]() {
+            if (self)
+                emit self->replaced(res, revision);
+        }, Qt::QueuedConnection);
+    }).detach();
+}
+
+QString SearchIndex::expand(const QString &replacement, const QRegularExpressionMatch &match)
+{
+    // the same syntax as QString::replace(QRegularExpression, QString)
+    QString res;
+    const int len = replacement.length();
+    for (int i = 0; i < len; ++i)
+    {
+        QChar c = replacement.at(i);
+        if (c == '\\' && i + 1 < len && replacement.at(i + 1).isDigit())
+        {
+            int group = replacement.at(i + 1).digitValue();
+            int digits = 1;
+            if (i + 2 < len && replacement.at(i + 2).isDigit())
+            {
+                int two = group * 10 + replacement.at(i + 2).digitValue();
+                if (two <= match.lastCapturedIndex())
+                {
+                    group = two;
+                    digits = 2;
+                }
+            }
+            if (group <= match.lastCapturedIndex())
+            {
+                res += match.captured(group);
+                i += digits;
+                continue;
+            }
+        }
+        res += c;
+    }
+    return res;
+}
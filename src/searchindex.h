@@ -0,0 +1,72 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QObject>
+#include <QVector>
+#include <QPair>
+#include <QRegularExpression>
+#include <atomic>
+#include <memory>
+
+/*!
+ * \brief Positions of all the matches of a pattern within a text revision, collected in background.
+ *
+ * Navigation is a binary search over the positions, so neither direction rescans the text.
+ */
+class SearchIndex : public QObject
+{
+    Q_OBJECT
+public:
+    struct Replacement
+    {
+        int start;
+        int length;
+        QString text;
+    };
+
+    explicit SearchIndex(QObject *parent = nullptr);
+    ~SearchIndex();
+    /*!
+     * \brief start collecting matches unless the index of the pattern and the revision is built or being built
+     */
+    void build(const QString &text, const QRegularExpression &exp, quint64 revision);
+    void invalidate();
+    bool isReady(const QRegularExpression &exp, quint64 revision) const noexcept;
+    int count() const noexcept { return _matches.size(); }
+    /*!
+     * \brief <start, length> of the first match starting at pos or later, wrapping around
+     * \param wrapped optional, set if the search passed the end of text
+     * \return index of the match, -1 if none
+     */
+    int next(int pos, bool *wrapped = nullptr) const noexcept;
+    /*!
+     * \brief the last match ending at pos or before, wrapping around
+     */
+    int previous(int pos, bool *wrapped = nullptr) const noexcept;
+    QPair<int, int> at(int i) const noexcept { return _matches.at(i); }
+    /*!
+     * \brief compute replacements of all the matches in background, replaced() is emitted when done
+     * \param replacement may refer to captured groups as \1..\99 unless literal
+     */
+    void replaceAll(const QString &text, const QRegularExpression &exp, const QString &replacement,
+                    bool literal, quint64 revision);
+
+signals:
+    void ready();
+    void replaced(const QVector<SearchIndex::Replacement> &replacements, quint64 revision);
+
+private:
+    static QString expand(const QString &replacement, const QRegularExpressionMatch &match);
+
+    QRegularExpression _exp;
+    quint64 _revision = 0;
+    bool _ready = false;
+    bool _building = false;
+    QVector<QPair<int, int>> _matches;
+    /*!
+     * \brief bumped to cancel the running search, shared with workers which may outlive the index
+     */
+    std::shared_ptr<std::atomic<int>> _generation;
+};
+
+#endif // SEARCHINDEX_H
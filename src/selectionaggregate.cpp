@@ -0,0 +1,671 @@
+#include "selectionaggregate.h"
+#include "tablemodel.h"
+#include "cursortablemodel.h"
+#include "datatable.h"
+#include "pgtypes.h"
+#include <QApplication>
+#include <QDateTime>
+#include <QLocale>
+#include <QPointer>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// units of fractions of DecimalSum
+#define DECIMAL_FRACTION 1000000000000000000LL
+
+static const qint64 MSECS_PER_DAY = 86400000;
+
+typedef std::vector<std::pair<int, int>> Ranges;
+
+struct SelectionAggregate::Job
+{
+    struct Column
+    {
+        int column;
+        Ranges ranges;      ///< source rows [first, second)
+        bool numericText;
+    };
+    const QAbstractItemModel *model = nullptr;
+    const DataTable *table = nullptr;   ///< nullptr if cells are read by data()
+    std::vector<Column> columns;
+    // source row of every model row if the model is sorted or filtered (ranges are model rows then)
+    const std::vector<int> *permutation = nullptr;
+    std::vector<int> rows;              ///< copy of the permutation read by a thread
+    qint64 cells = 0;
+};
+
+namespace
+{
+
+/*!
+ * \brief exact sum of decimals of up to 18 digits of integer part and fraction each
+ */
+struct DecimalSum
+{
+    qint64 units = 0;
+    qint64 fraction = 0;    ///< 1e-18 units
+
+    void add(qint64 u, qint64 f) noexcept
+    {
+        units += u;
+        fraction += f;
+        if (fraction >= DECIMAL_FRACTION || fraction <= -DECIMAL_FRACTION)
+        {
+            units += (fraction < 0 ? -1 : 1);
+            fraction -= (fraction < 0 ? -DECIMAL_FRACTION : DECIMAL_FRACTION);
+        }
+    }
+    double toDouble() const noexcept
+    {
+        return double(units) + double(fraction) / DECIMAL_FRACTION;
+    }
+    QString toString(int scale) const
+    {
+        qint64 u = units;
+        qint64 f = fraction;
+        if (u > 0 && f < 0)
+        {
+            --u;
+            f += DECIMAL_FRACTION;
+        }
+        else if (u < 0 && f > 0)
+        {
+            ++u;
+            f -= DECIMAL_FRACTION;
+        }
+        QString res = (u < 0 || f < 0 ? "-" : "");
+        res += QString::number(qAbs(u));
+        if (scale > 0)
+            res += '.' + QString::number(qAbs(f)).rightJustified(18, '0').left(scale);
+        return res;
+    }
+};
+
+/*!
+ * \brief parse decimal literal without exponent, false if it does not fit DecimalSum
+ */
+bool parseDecimal(const char *p, int length, qint64 &units, qint64 &fraction, int &scale) noexcept
+{
+    const char *end = p + length;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+    qint64 u = 0;
+    int digits = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p)
+    {
+        if (++digits > 18)
+            return false;
+        u = u * 10 + (*p - '0');
+    }
+    qint64 f = 0;
+    int s = 0;
+    if (p < end && *p == '.')
+    {
+        for (++p; p < end && *p >= '0' && *p <= '9'; ++p)
+        {
+            // the rest of digits does not affect the sum
+            if (s < 18)
+            {
+                f = f * 10 + (*p - '0');
+                ++s;
+            }
+        }
+    }
+    if (p != end || (!digits && !s))
+        return false;
+    for (int i = s; i < 18; ++i)
+        f *= 10;
+    units = (negative ? -u : u);
+    fraction = (negative ? -f : f);
+    scale = s;
+    return true;
+}
+
+// keys of distinct values of distinct kinds do not match
+quint64 distinctKey(quint64 bits, quint64 tag) noexcept
+{
+    return bits ^ (tag * 0x9E3779B97F4A7C15ULL);
+}
+
+struct Accumulator
+{
+    qint64 count = 0;
+    qint64 numbers = 0;
+    DecimalSum exact;
+    int scale = 0;
+    double floating = 0;
+    bool hasFloating = false;
+    bool hasNumber = false;
+    double min = 0;
+    double max = 0;
+    QString minText;
+    QString maxText;
+    ColumnStorage::Kind temporal = ColumnStorage::Kind::Unknown;
+    bool mixedTemporal = false;
+    qint64 temporalMin = 0;
+    qint64 temporalMax = 0;
+    std::unordered_set<quint64> fixed;
+    std::unordered_set<std::string> texts;
+    bool exceeded = false;
+
+    void extreme(double v, const QString &text)
+    {
+        if (!hasNumber || v < min)
+        {
+            min = v;
+            minText = text;
+        }
+        if (!hasNumber || v > max)
+        {
+            max = v;
+            maxText = text;
+        }
+        hasNumber = true;
+    }
+    void temporalExtreme(ColumnStorage::Kind kind, qint64 mn, qint64 mx)
+    {
+        if (temporal == ColumnStorage::Kind::Unknown)
+        {
+            temporal = kind;
+            temporalMin = mn;
+            temporalMax = mx;
+        }
+        else if (temporal != kind)
+            mixedTemporal = true;
+        else
+        {
+            temporalMin = std::min(temporalMin, mn);
+            temporalMax = std::max(temporalMax, mx);
+        }
+    }
+    void distinct(quint64 key)
+    {
+        if (exceeded)
+            return;
+        fixed.insert(key);
+        checkDistinct();
+    }
+    void distinct(const char *data, int length)
+    {
+        if (exceeded)
+            return;
+        texts.emplace(data, size_t(length));
+        checkDistinct();
+    }
+    void checkDistinct()
+    {
+        if (fixed.size() + texts.size() >= AGGREGATE_DISTINCT_MAX)
+            exceeded = true;
+    }
+    void number(const QString &text)
+    {
+        QByteArray utf8 = text.toUtf8();
+        qint64 u, f;
+        int s;
+        if (parseDecimal(utf8.constData(), utf8.size(), u, f, s))
+        {
+            exact.add(u, f);
+            scale = std::max(scale, s);
+            extreme(double(u) + double(f) / DECIMAL_FRACTION, text);
+            ++numbers;
+            return;
+        }
+        bool ok;
+        double v = text.toDouble(&ok);
+        if (ok)
+        {
+            floating += v;
+            hasFloating = true;
+            extreme(v, text);
+            ++numbers;
+        }
+    }
+};
+
+template<class Fn>
+bool forEachChunk(const DataTable &table, const Ranges &ranges, const std::atomic<bool> &cancelled, Fn fn)
+{
+    for (const auto &range: ranges)
+    {
+        for (int from = range.first; from < range.second; from += std::min(AGGREGATE_CHUNK, range.second - from))
+        {
+            if (cancelled)
+                return false;
+            // rows are appended under the lock, the buffers are not moved meanwhile
+            QMutexLocker locker(&table.mutex);
+            fn(from, std::min(range.second, from + AGGREGATE_CHUNK));
+        }
+    }
+    return true;
+}
+
+// aggregates do not depend on the order, so sorted source rows are ranges again
+Ranges sourceRanges(const std::vector<int> &permutation, const Ranges &viewRanges)
+{
+    std::vector<int> rows;
+    for (const auto &r: viewRanges)
+    {
+        for (int row = r.first; row < r.second; ++row)
+            rows.push_back(permutation[size_t(row)]);
+    }
+    std::sort(rows.begin(), rows.end());
+    Ranges ranges;
+    for (int row: rows)
+    {
+        if (!ranges.empty() && ranges.back().second == row)
+            ++ranges.back().second;
+        else
+            ranges.push_back({row, row + 1});
+    }
+    return ranges;
+}
+
+} // namespace
+
+static QString temporalText(ColumnStorage::Kind kind, qint64 key)
+{
+    if (kind == ColumnStorage::Kind::Date)
+        return QDate::fromJulianDay(key).toString("yyyy-MM-dd");
+    if (kind == ColumnStorage::Kind::Time)
+        return QTime::fromMSecsSinceStartOfDay(int(key)).toString("hh:mm:ss.zzz");
+    QDateTime dt(QDate::fromJulianDay(key / MSECS_PER_DAY), QTime::fromMSecsSinceStartOfDay(int(key % MSECS_PER_DAY)));
+    return dt.toString("yyyy-MM-dd hh:mm:ss.zzz");
+}
+
+QString SelectionAggregateResult::toString() const
+{
+    QString res = QObject::tr("count: %1").arg(count);
+    if (numbers)
+        res += QObject::tr("  sum: %1  avg: %2").arg(sum).arg(avg);
+    if (!min.isEmpty())
+        res += QObject::tr("  min: %1  max: %2").arg(min).arg(max);
+    if (count)
+        res += QObject::tr("  distinct: %1%2").arg(distinctExceeded ? "≥" : "").arg(distinct);
+    return res;
+}
+
+SelectionAggregate::SelectionAggregate(QObject *parent) :
+    QObject(parent)
+{
+}
+
+SelectionAggregate::~SelectionAggregate()
+{
+    cancel();
+}
+
+void SelectionAggregate::start(const QAbstractItemModel *model, const QItemSelection &selection)
+{
+    cancel();
+    std::shared_ptr<Job> job = prepare(model, selection);
+    if (!job->table || job->cells <= AGGREGATE_ASYNC_CELLS)
+    {
+        std::atomic<bool> cancelled(false);
+        SelectionAggregateResult res;
+        run(*job, cancelled, res);
+        emit ready(res);
+        return;
+    }
+
+    // the model may reorder its rows meanwhile
+    if (job->permutation)
+    {
+        job->rows = *job->permutation;
+        job->permutation = &job->rows;
+    }
+    int generation = _generation;
+    _cancelled = std::make_shared<std::atomic<bool>>(false);
+    std::shared_ptr<std::atomic<bool>> cancelled = _cancelled;
+    QPointer<SelectionAggregate> self(this);
+    _worker = std::thread([self, job, cancelled, generation]() {
+        SelectionAggregateResult res;
+        if (!run(*job, *cancelled, res))
+            return;
+        QMetaObject::invokeMethod(qApp, [self, res, generation]() {
+            if (self && self->_generation == generation)
+                emit self->ready(res);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void SelectionAggregate::cancel()
+{
+    // the thread reads the table, so it is waited for (a chunk at most)
+    ++_generation;
+    if (_cancelled)
+        *_cancelled = true;
+    if (_worker.joinable())
+        _worker.join();
+    _cancelled.reset();
+}
+
+SelectionAggregateResult SelectionAggregate::compute(const QAbstractItemModel *model, const QItemSelection &selection)
+{
+    std::atomic<bool> cancelled(false);
+    SelectionAggregateResult res;
+    run(*prepare(model, selection), cancelled, res);
+    return res;
+}
+
+std::shared_ptr<SelectionAggregate::Job> SelectionAggregate::prepare(const QAbstractItemModel *model,
+                                                                     const QItemSelection &selection)
+{
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->model = model;
+    const TableModel *m = qobject_cast<const TableModel*>(model);
+    if (m && !qobject_cast<const CursorTableModel*>(model))
+    {
+        job->table = m->table();
+        // rows are mapped and sorted by run()
+        if (m->isIndexed())
+            job->permutation = &m->sourceRows();
+    }
+
+    // selected rows of every column
+    std::map<int, Ranges> columns;
+    for (const QItemSelectionRange &range: selection)
+    {
+        if (!range.isValid())
+            continue;
+        for (int c = range.left(); c <= range.right(); ++c)
+            columns[c].push_back({range.top(), range.bottom() + 1});
+    }
+    for (auto &it: columns)
+    {
+        Ranges &ranges = it.second;
+        std::sort(ranges.begin(), ranges.end());
+        Ranges merged;
+        for (const auto &r: ranges)
+        {
+            if (!merged.empty() && r.first <= merged.back().second)
+                merged.back().second = std::max(merged.back().second, r.second);
+            else
+                merged.push_back(r);
+        }
+
+        // a permutation keeps the number of rows
+        Job::Column column{it.first, merged, false};
+        for (const auto &r: column.ranges)
+            job->cells += r.second - r.first;
+        if (job->table)
+        {
+            const DataColumn &dc = job->table->getColumn(it.first);
+            column.numericText = (dc.sqlType() == NUMERICOID || dc.hAlignment() == Qt::AlignRight);
+        }
+        job->columns.push_back(column);
+    }
+    return job;
+}
+
+template<class Getter>
+static bool aggregateIntegers(const DataTable &table, const Ranges &ranges, const ColumnStorage &s,
+                              const std::atomic<bool> &cancelled, Accumulator &acc, Getter value)
+{
+    qint64 sum = 0;
+    qint64 n = 0;
+    qint64 mn = std::numeric_limits<qint64>::max();
+    qint64 mx = std::numeric_limits<qint64>::min();
+    bool ok = forEachChunk(table, ranges, cancelled, [&](int from, int to) {
+        for (int r = from; r < to; ++r)
+        {
+            if (s.isNull(r))
+                continue;
+            qint64 v = value(r);
+            sum += v;
+            mn = std::min(mn, v);
+            mx = std::max(mx, v);
+            ++n;
+            acc.distinct(distinctKey(quint64(v), 1));
+        }
+    });
+    if (n)
+    {
+        acc.count += n;
+        acc.numbers += n;
+        acc.exact.add(sum, 0);
+        acc.extreme(double(mn), QString::number(mn));
+        acc.extreme(double(mx), QString::number(mx));
+    }
+    return ok;
+}
+
+template<class Getter>
+static bool aggregateFloating(const DataTable &table, const Ranges &ranges, const ColumnStorage &s,
+                              const std::atomic<bool> &cancelled, Accumulator &acc, Getter value)
+{
+    double sum = 0;
+    qint64 n = 0;
+    double mn = std::numeric_limits<double>::max();
+    double mx = std::numeric_limits<double>::lowest();
+    bool ok = forEachChunk(table, ranges, cancelled, [&](int from, int to) {
+        for (int r = from; r < to; ++r)
+        {
+            if (s.isNull(r))
+                continue;
+            double v = double(value(r));
+            sum += v;
+            mn = std::min(mn, v);
+            mx = std::max(mx, v);
+            ++n;
+            quint64 bits;
+            memcpy(&bits, &v, sizeof(bits));
+            acc.distinct(distinctKey(bits, 2));
+        }
+    });
+    if (n)
+    {
+        acc.count += n;
+        acc.numbers += n;
+        acc.floating += sum;
+        acc.hasFloating = true;
+        acc.extreme(mn, QString::number(mn, 'g', QLocale::FloatingPointShortest));
+        acc.extreme(mx, QString::number(mx, 'g', QLocale::FloatingPointShortest));
+    }
+    return ok;
+}
+
+bool SelectionAggregate::run(const Job &job, const std::atomic<bool> &cancelled, SelectionAggregateResult &result)
+{
+    Accumulator acc;
+    Ranges viewRanges, mapped;
+    for (const Job::Column &col: job.columns)
+    {
+        if (!job.table)
+        {
+            // cells of the model itself
+            for (const auto &range: col.ranges)
+            {
+                for (int r = range.first; r < range.second; ++r)
+                {
+                    QVariant v = job.model->index(r, col.column).data(Qt::EditRole);
+                    if (!v.isValid())
+                        continue;
+                    ++acc.count;
+                    QString text = v.toString();
+                    QByteArray utf8 = text.toUtf8();
+                    acc.distinct(utf8.constData(), utf8.size());
+                    acc.number(text);
+                }
+            }
+            continue;
+        }
+
+        const DataTable &table = *job.table;
+        const ColumnStorage &s = table.storage(col.column);
+        // columns of a rectangular selection share the rows
+        if (job.permutation && (viewRanges.empty() || viewRanges != col.ranges))
+        {
+            viewRanges = col.ranges;
+            mapped = sourceRanges(*job.permutation, col.ranges);
+            if (cancelled)
+                return false;
+        }
+        const Ranges &ranges = (job.permutation ? mapped : col.ranges);
+        bool ok = true;
+        switch (s.kind())
+        {
+        case ColumnStorage::Kind::Int32:
+            ok = aggregateIntegers(table, ranges, s, cancelled, acc, [&s](int r) { return qint64(s.int32At(r)); });
+            break;
+        case ColumnStorage::Kind::Int64:
+            ok = aggregateIntegers(table, ranges, s, cancelled, acc, [&s](int r) { return s.int64At(r); });
+            break;
+        case ColumnStorage::Kind::Float:
+            ok = aggregateFloating(table, ranges, s, cancelled, acc, [&s](int r) { return s.floatAt(r); });
+            break;
+        case ColumnStorage::Kind::Double:
+            ok = aggregateFloating(table, ranges, s, cancelled, acc, [&s](int r) { return s.doubleAt(r); });
+            break;
+        case ColumnStorage::Kind::Date:
+        case ColumnStorage::Kind::Time:
+        case ColumnStorage::Kind::DateTime:
+        {
+            const ColumnStorage::Kind kind = s.kind();
+            qint64 n = 0;
+            qint64 mn = std::numeric_limits<qint64>::max();
+            qint64 mx = std::numeric_limits<qint64>::min();
+            ok = forEachChunk(table, ranges, cancelled, [&](int from, int to) {
+                for (int r = from; r < to; ++r)
+                {
+                    if (s.isNull(r))
+                        continue;
+                    qint64 v = (kind == ColumnStorage::Kind::Time ? s.int32At(r) : s.int64At(r));
+                    mn = std::min(mn, v);
+                    mx = std::max(mx, v);
+                    ++n;
+                    acc.distinct(distinctKey(quint64(v), 3 + quint64(kind)));
+                }
+            });
+            if (n)
+            {
+                acc.count += n;
+                acc.temporalExtreme(kind, mn, mx);
+            }
+            break;
+        }
+        case ColumnStorage::Kind::String:
+        {
+            // distinct values of a dictionary are hashed once
+            std::vector<bool> seen;
+            const bool dict = s.isDictionaryEncoded();
+            const bool numeric = col.numericText;
+            double mn = 0;
+            double mx = 0;
+            int min_row = -1;
+            int max_row = -1;
+            ok = forEachChunk(table, ranges, cancelled, [&](int from, int to) {
+                for (int r = from; r < to; ++r)
+                {
+                    if (s.isNull(r))
+                        continue;
+                    ++acc.count;
+                    int length;
+                    const char *data = s.utf8At(r, length);
+                    if (!dict)
+                        acc.distinct(data, length);
+                    else
+                    {
+                        size_t code = s.dictionaryCode(r);
+                        if (code >= seen.size())
+                            seen.resize(code + 1);
+                        if (!seen[code])
+                        {
+                            seen[code] = true;
+                            acc.distinct(data, length);
+                        }
+                    }
+                    if (!numeric)
+                        continue;
+                    qint64 u, f;
+                    int scale;
+                    double v;
+                    if (parseDecimal(data, length, u, f, scale))
+                    {
+                        acc.exact.add(u, f);
+                        acc.scale = std::max(acc.scale, scale);
+                        v = double(u) + double(f) / DECIMAL_FRACTION;
+                    }
+                    else
+                    {
+                        bool parsed;
+                        v = QByteArray::fromRawData(data, length).toDouble(&parsed);
+                        if (!parsed)
+                            continue;
+                        acc.floating += v;
+                        acc.hasFloating = true;
+                    }
+                    ++acc.numbers;
+                    if (min_row < 0 || v < mn)
+                    {
+                        mn = v;
+                        min_row = r;
+                    }
+                    if (max_row < 0 || v > mx)
+                    {
+                        mx = v;
+                        max_row = r;
+                    }
+                }
+            });
+            if (ok && min_row >= 0)
+            {
+                QMutexLocker locker(&table.mutex);
+                acc.extreme(mn, s.stringAt(min_row));
+                acc.extreme(mx, s.stringAt(max_row));
+            }
+            break;
+        }
+        default:
+            ok = forEachChunk(table, ranges, cancelled, [&](int from, int to) {
+                for (int r = from; r < to; ++r)
+                {
+                    if (s.isNull(r))
+                        continue;
+                    ++acc.count;
+                    QString text = s.value(r).toString();
+                    QByteArray utf8 = text.toUtf8();
+                    acc.distinct(utf8.constData(), utf8.size());
+                    if (s.kind() != ColumnStorage::Kind::Bool)
+                        acc.number(text);
+                }
+            });
+            break;
+        }
+        if (!ok)
+            return false;
+    }
+
+    result.cells = job.cells;
+    result.count = acc.count;
+    result.numbers = acc.numbers;
+    if (acc.numbers)
+    {
+        if (acc.hasFloating)
+        {
+            double sum = acc.exact.toDouble() + acc.floating;
+            result.sum = QString::number(sum, 'f', std::max(acc.scale, 6));
+        }
+        else
+            result.sum = acc.exact.toString(acc.scale);
+        result.avg = QString::number((acc.exact.toDouble() + acc.floating) / acc.numbers, 'g', 15);
+    }
+    if (acc.hasNumber)
+    {
+        result.min = acc.minText;
+        result.max = acc.maxText;
+    }
+    else if (acc.temporal != ColumnStorage::Kind::Unknown && !acc.mixedTemporal)
+    {
+        result.min = temporalText(acc.temporal, acc.temporalMin);
+        result.max = temporalText(acc.temporal, acc.temporalMax);
+    }
+    result.distinct = qint64(acc.fixed.size() + acc.texts.size());
+    result.distinctExceeded = acc.exceeded;
+    return true;
+}
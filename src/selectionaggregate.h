@@ -0,0 +1,71 @@
+#ifndef SELECTIONAGGREGATE_H
+#define SELECTIONAGGREGATE_H
+
+#include <QObject>
+#include <QItemSelection>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+// larger selections are aggregated by a thread
+#define AGGREGATE_ASYNC_CELLS 100000
+// rows of a column aggregated at once (the table is locked by chunks)
+#define AGGREGATE_CHUNK 65536
+// distinct values counted exactly
+#define AGGREGATE_DISTINCT_MAX 1000000
+
+/*!
+ * \brief aggregates of selected cells, empty strings if not applicable
+ */
+struct SelectionAggregateResult
+{
+    qint64 cells = 0;
+    qint64 count = 0;       ///< not null cells
+    qint64 numbers = 0;     ///< cells summed
+    QString sum;            ///< exact for integer and numeric cells
+    QString avg;
+    QString min;
+    QString max;
+    qint64 distinct = 0;
+    bool distinctExceeded = false;
+
+    QString toString() const;
+};
+
+/*!
+ * \brief Live aggregates of a grid selection.
+ *
+ * TableModel cells are aggregated column by column over the typed buffers of ColumnStorage,
+ * numeric text (NUMERICOID and alike) is summed exactly as decimal. Selections above
+ * AGGREGATE_ASYNC_CELLS are computed by a thread, a new start() cancels the previous one.
+ */
+class SelectionAggregate : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SelectionAggregate(QObject *parent = nullptr);
+    virtual ~SelectionAggregate() override;
+    /*!
+     * \brief aggregate the selection, ready() is emitted when done
+     */
+    void start(const QAbstractItemModel *model, const QItemSelection &selection);
+    /*!
+     * \brief stop the computation, the model may be deleted afterwards
+     */
+    void cancel();
+    static SelectionAggregateResult compute(const QAbstractItemModel *model, const QItemSelection &selection);
+
+signals:
+    void ready(const SelectionAggregateResult &result);
+
+private:
+    struct Job;
+    static std::shared_ptr<Job> prepare(const QAbstractItemModel *model, const QItemSelection &selection);
+    static bool run(const Job &job, const std::atomic<bool> &cancelled, SelectionAggregateResult &result);
+
+    std::thread _worker;
+    std::shared_ptr<std::atomic<bool>> _cancelled;
+    int _generation = 0;
+};
+
+#endif // SELECTIONAGGREGATE_H
@@ -1,6 +1,9 @@
 #include "settingsdialog.h"
 #include "ui_settingsdialog.h"
 #include "settings.h"
+#include "tablemodel.h"
+#include "objectpreview.h"
+#include "pgconnection.h"
 #include <QPushButton>
 
 SettingsDialog::SettingsDialog(QWidget *parent) :
@@ -12,6 +15,19 @@ SettingsDialog::SettingsDialog(QWidget *parent) :
     ui->encodings->setText(SqtSettings::value("encodings").toString());
     ui->tabSize->setValue(SqtSettings::value("tabSize").toInt());
     ui->singleRowMode->setChecked(SqtSettings::value("pgSingleRowMode", false).toBool());
+    ui->binaryFormat->setChecked(SqtSettings::value("pgBinaryFormat", false).toBool());
+    ui->chunkSize->setValue(SqtSettings::value("pgChunkSize", 0).toInt());
+    ui->lazyPageSize->setValue(SqtSettings::value("pgLazyPageSize", 0).toInt());
+    ui->poolMaxPerServer->setValue(SqtSettings::value("pgPoolMaxPerServer", 0).toInt());
+    ui->treePrefetch->setChecked(SqtSettings::value("treePrefetch", false).toBool());
+    ui->largeFileThreshold->setValue(SqtSettings::value("largeFileThreshold", 50).toInt());
+    ui->scriptBatchStatements->setValue(SqtSettings::value("scriptBatchStatements", 0).toInt());
+    ui->queryTimings->setChecked(SqtSettings::value("queryTimings", false).toBool());
+    ui->gridCopyFormat->setCurrentIndex(qMax(0, ui->gridCopyFormat->findText(SqtSettings::value("gridCopyFormat", "values").toString())));
+    ui->resultMemoryBudget->setValue(SqtSettings::value("resultMemoryBudget", TABLE_MODEL_MEMORY_BUDGET).toInt());
+    ui->resultsMemoryCap->setValue(SqtSettings::value("resultsMemoryCap", TABLE_MODEL_MEMORY_CAP).toInt());
+    ui->longValueThreshold->setValue(SqtSettings::value("longValueThreshold", PG_LONG_VALUE_THRESHOLD).toInt());
+    ui->contentScriptShards->setValue(SqtSettings::value("contentScriptShards", PREVIEW_SHARDS).toInt());
     ui->highlightCurrentLine->setChecked(SqtSettings::value("highlightCurrentLine", false).toBool());
     ui->f1url->setText(SqtSettings::value("f1url").toString());
     ui->shiftF1url->setText(SqtSettings::value("shiftF1url").toString());
@@ -28,6 +44,19 @@ void SettingsDialog::on_okBtn_clicked()
     SqtSettings::setValue("encodings", ui->encodings->text());
     SqtSettings::setValue("tabSize", ui->tabSize->value());
     SqtSettings::setValue("pgSingleRowMode", ui->singleRowMode->isChecked());
+    SqtSettings::setValue("pgBinaryFormat", ui->binaryFormat->isChecked());
+    SqtSettings::setValue("pgChunkSize", ui->chunkSize->value());
+    SqtSettings::setValue("pgLazyPageSize", ui->lazyPageSize->value());
+    SqtSettings::setValue("pgPoolMaxPerServer", ui->poolMaxPerServer->value());
+    SqtSettings::setValue("treePrefetch", ui->treePrefetch->isChecked());
+    SqtSettings::setValue("largeFileThreshold", ui->largeFileThreshold->value());
+    SqtSettings::setValue("scriptBatchStatements", ui->scriptBatchStatements->value());
+    SqtSettings::setValue("queryTimings", ui->queryTimings->isChecked());
+    SqtSettings::setValue("gridCopyFormat", ui->gridCopyFormat->currentText());
+    SqtSettings::setValue("resultMemoryBudget", ui->resultMemoryBudget->value());
+    SqtSettings::setValue("resultsMemoryCap", ui->resultsMemoryCap->value());
+    SqtSettings::setValue("longValueThreshold", ui->longValueThreshold->value());
+    SqtSettings::setValue("contentScriptShards", ui->contentScriptShards->value());
     SqtSettings::setValue("highlightCurrentLine", ui->highlightCurrentLine->isChecked());
     SqtSettings::setValue("f1url", ui->f1url->text());
     SqtSettings::setValue("shiftF1url", ui->shiftF1url->text());
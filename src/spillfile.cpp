@@ -0,0 +1,95 @@
+#include "spillfile.h"
+#include <QDir>
+#include <iterator>
+
+bool SpillFile::open(QString &error)
+{
+    _file.setFileTemplate(QDir::tempPath() + "/sqt_spill_XXXXXX");
+    if (!_file.open())
+    {
+        error = _file.errorString();
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const char> SpillFile::append(const char *data, size_t size)
+{
+    QMutexLocker lk(&_mutex);
+    if (!_file.isOpen() || !size)
+        return nullptr;
+    const qint64 length = qint64(size);
+    // the first free range fitting the bytes
+    qint64 offset = _end;
+    for (auto it = _free.begin(); it != _free.end(); ++it)
+    {
+        if (it->second < length)
+            continue;
+        offset = it->first;
+        if (it->second > length)
+            _free.insert(std::make_pair(offset + length, it->second - length));
+        _free.erase(it);
+        break;
+    }
+    if (offset == _end)
+        _end += length;
+
+    uchar *mapped = nullptr;
+    if (_file.seek(offset) && _file.write(data, length) == length && _file.flush())
+    {
+        // unaligned offsets are handled by QFile (the mapping starts at the page boundary)
+        mapped = _file.map(offset, length);
+    }
+    if (!mapped)
+    {
+        reuse(offset, length);
+        return nullptr;
+    }
+    _used += length;
+    std::shared_ptr<SpillFile> self = shared_from_this();
+    return std::shared_ptr<const char>(reinterpret_cast<const char*>(mapped), [self, offset, length](const char *p) {
+        self->release(p, offset, length);
+    });
+}
+
+qint64 SpillFile::size() const
+{
+    QMutexLocker lk(&_mutex);
+    return _used;
+}
+
+void SpillFile::release(const char *mapped, qint64 offset, qint64 size)
+{
+    QMutexLocker lk(&_mutex);
+    _file.unmap(reinterpret_cast<uchar*>(const_cast<char*>(mapped)));
+    _used -= size;
+    reuse(offset, size);
+}
+
+void SpillFile::reuse(qint64 offset, qint64 size)
+{
+    auto next = _free.lower_bound(offset);
+    if (next != _free.end() && next->first == offset + size)
+    {
+        size += next->second;
+        next = _free.erase(next);
+    }
+    if (next != _free.begin())
+    {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset)
+        {
+            offset = prev->first;
+            size += prev->second;
+            _free.erase(prev);
+        }
+    }
+    // the free tail is given back to the file system
+    if (offset + size >= _end)
+    {
+        _end = offset;
+        _file.resize(_end);
+        return;
+    }
+    _free.insert(std::make_pair(offset, size));
+}
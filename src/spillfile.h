@@ -0,0 +1,47 @@
+#ifndef SPILLFILE_H
+#define SPILLFILE_H
+
+#include <QTemporaryFile>
+#include <QString>
+#include <QMutex>
+#include <map>
+#include <memory>
+
+/*!
+ * \brief Temporary file keeping sealed chunks of result columns out of memory.
+ *
+ * Bytes are written once and mapped back read-only, so the pages are read
+ * from the disk on access and may be dropped by the system at any time.
+ * A range of the file is unmapped and reused as soon as the last copy of its handle
+ * is released (rows removed or replaced by watch mode refreshes), the tail of the
+ * file is truncated then. The file is removed along with the last range referring to it.
+ */
+class SpillFile : public std::enable_shared_from_this<SpillFile>
+{
+public:
+    bool open(QString &error);
+    /*!
+     * \brief write the bytes into a free range of the file (the end of the file if none fits)
+     * \return mapped copy of the bytes, nullptr on failure
+     */
+    std::shared_ptr<const char> append(const char *data, size_t size);
+    /*!
+     * \brief bytes of the ranges in use
+     */
+    qint64 size() const;
+
+private:
+    void release(const char *mapped, qint64 offset, qint64 size);
+    /*!
+     * \brief add the range to the free ones (the caller locks the mutex)
+     */
+    void reuse(qint64 offset, qint64 size);
+
+    QTemporaryFile _file;
+    qint64 _end = 0;                ///< the file is used up to there
+    qint64 _used = 0;
+    std::map<qint64, qint64> _free; ///< offsets and sizes of released ranges, adjacent ones are merged
+    mutable QMutex _mutex;
+};
+
+#endif // SPILLFILE_H
@@ -1,4 +1,6 @@
 #include "sqlparser.h"
+#include <QRegularExpression>
+#include <algorithm>
 //#include <QDebug>
 
 namespace SqlParser
@@ -72,11 +74,184 @@ AliasSearchResult test(const QString &alias, const QList<Entity> &entities, int
     return {};
 }
 
-AliasSearchResult explainAlias(const QString &alias, const QString &text, int pos, bool backward) noexcept
+static bool isLineEnd(QChar c) noexcept
 {
+    return c == '\n' || c == QChar::ParagraphSeparator || c == QChar::LineSeparator;
+}
+
+/*!
+ * \brief the token starting at pos or later, skipping spaces and comments
+ */
+static bool nextToken(const QString &text, int &pos, TokenStream::Token &token) noexcept
+{
+    const int len = text.length();
+    while (pos < len)
+    {
+        QChar c = text.at(pos);
+        QChar next = (pos + 1 < len ? text.at(pos + 1) : QChar());
+        if (c.isSpace())
+            ++pos;
+        else if (c == '-' && next == '-')
+        {
+            while (pos < len && !isLineEnd(text.at(pos)))
+                ++pos;
+        }
+        else if (c == '/' && next == '*')
+        {
+            // multiline comments may be nested
+            int depth = 1;
+            for (pos += 2; pos < len && depth; ++pos)
+            {
+                if (text.at(pos) == '/' && pos + 1 < len && text.at(pos + 1) == '*')
+                    ++depth, ++pos;
+                else if (text.at(pos) == '*' && pos + 1 < len && text.at(pos + 1) == '/')
+                    --depth, ++pos;
+            }
+        }
+        else
+            break;
+    }
+    if (pos >= len)
+        return false;
+
+    const int start = pos;
+    QChar c = text.at(pos++);
+    TokenStream::Kind kind = TokenStream::Kind::Punctuation;
+    if (c.isLetter() || c == '_')
+    {
+        kind = TokenStream::Kind::Word;
+        while (pos < len && (text.at(pos).isLetterOrNumber() || text.at(pos) == '_'))
+            ++pos;
+    }
+    else if (c.isDigit())
+    {
+        kind = TokenStream::Kind::Other;
+        while (pos < len && (text.at(pos).isLetterOrNumber() || text.at(pos) == '.'))
+            ++pos;
+    }
+    else if (c == '"' || c == '\'')
+    {
+        kind = (c == '"' ? TokenStream::Kind::QuotedIdentifier : TokenStream::Kind::Literal);
+        bool escapes = (c == '\'' && start > 0 && text.at(start - 1).toLower() == 'e');
+        for (; pos < len; ++pos)
+        {
+            if (escapes && text.at(pos) == '\\')
+                ++pos;
+            else if (text.at(pos) == c)
+            {
+                // doubled quote is a part of the token
+                if (pos + 1 < len && text.at(pos + 1) == c)
+                    ++pos;
+                else
+                    break;
+            }
+        }
+        pos = qMin(pos + 1, len);
+    }
+    else if (c == '$')
+    {
+        int tag_end = pos;
+        while (tag_end < len && (text.at(tag_end).isLetterOrNumber() || text.at(tag_end) == '_'))
+            ++tag_end;
+        if (tag_end < len && text.at(tag_end) == '$' && !(pos < len && text.at(pos).isDigit()))
+        {
+            // dollar-quoted string
+            kind = TokenStream::Kind::Literal;
+            QStringRef tag(&text, start, tag_end - start + 1);
+            int close = text.indexOf(tag, tag_end + 1);
+            pos = (close < 0 ? len : close + tag.length());
+        }
+        else
+        {
+            // positional parameter
+            kind = TokenStream::Kind::Other;
+            pos = tag_end;
+        }
+    }
+    token.start = start;
+    token.length = pos - start;
+    token.kind = kind;
+    return true;
+}
+
+TokenStream::TokenStream(const QString &text)
+{
+    reset(text);
+}
+
+void TokenStream::reset(const QString &text)
+{
+    _text = text;
+    _tokens.clear();
+    Token token;
+    for (int pos = 0; nextToken(_text, pos, token); )
+        _tokens.append(token);
+}
+
+void TokenStream::update(int pos, int removed, const QString &added)
+{
+    if (pos < 0 || pos + removed > _text.length())
+    {
+        reset(QString(_text).replace(qMax(pos, 0), removed, added));
+        return;
+    }
+    _text.replace(pos, removed, added);
+    const int delta = added.length() - removed;
+
+    // the token before the edit is lexed again as it may be merged with the inserted text
+    int first = qMax(tokenAt(pos) - 1, 0);
+    int old = first;
+    QVector<Token> fresh;
+    Token token;
+    for (int p = (first < _tokens.size() ? _tokens.at(first).start : 0); nextToken(_text, p, token); )
+    {
+        // the rest of the stream is the same as soon as a token after the edit is met again
+        while (old < _tokens.size() && _tokens.at(old).start + delta < token.start)
+            ++old;
+        if (old < _tokens.size() && _tokens.at(old).start >= pos + removed &&
+                _tokens.at(old).start + delta == token.start &&
+                _tokens.at(old).length == token.length && _tokens.at(old).kind == token.kind)
+        {
+            for (int i = old; i < _tokens.size(); ++i)
+                _tokens[i].start += delta;
+            _tokens.erase(_tokens.begin() + first, _tokens.begin() + old);
+            _tokens.insert(first, fresh.size(), Token());
+            std::copy(fresh.cbegin(), fresh.cend(), _tokens.begin() + first);
+            return;
+        }
+        fresh.append(token);
+    }
+    _tokens.resize(first);
+    _tokens += fresh;
+}
+
+int TokenStream::tokenAt(int pos) const noexcept
+{
+    auto it = std::lower_bound(_tokens.cbegin(), _tokens.cend(), pos,
+                               [](const Token &t, int p) { return t.start + t.length < p; });
+    return int(it - _tokens.cbegin());
+}
+
+QString TokenStream::word(int index) const
+{
+    const Token &t = _tokens.at(index);
+    // quotes are omitted
+    if (t.kind == Kind::QuotedIdentifier)
+        return _text.mid(t.start + 1, t.length - 2).replace("\"\"", "\"");
+    return _text.mid(t.start, t.length);
+}
+
+AliasSearchResult explainAlias(const QString &alias, const TokenStream &tokens, int pos, bool backward) noexcept
+{
+    static const QStringList dividers {"select", "update", "delete", "insert", "from",
+                                       "using", "where", "group", "order", "left", "join", "on",
+                                       "and", "not", "or"}; // just to narrow down
+    // the search does not run past the start of the statement
+    static const QStringList terminators {"with", "copy", "alter", "create", "drop", "truncate", "disable", "enable",
+                                          "declare", "begin", "commit", "do", "while", "loop", "exec", "execute", "show"};
+
     QList<Entity> entities;
     Entity entity;
-
     auto addEntity = [&]() -> bool {
         if (entity.items.empty())
             return !entities.isEmpty();
@@ -87,31 +262,35 @@ AliasSearchResult explainAlias(const QString &alias, const QString &text, int po
         return true;
     };
 
-    QStringList terminators {"with", "copy", "alter", "create", "drop", "truncate", "disable", "enable",
-                             "declare", "begin", "commit", "do", "while", "loop", "exec", "execute", "show"};
-    QStringList dividers {"select", "update", "delete", "insert", "from",
-                          "using", "where", "group", "order", "left", "join", "on",
-                          "and", "not", "or"}; // just to narrow down
-
-    uint8_t mode = 0xFF;
-    int8_t commentNestLevel = 0;
-    int8_t scopeLevel = 0;
-    int8_t resultLevel = 0;
-    QChar c, prevChar;
-    QString word;
-    int last_pos = backward ? -1 : text.length();
-    int delta = 1;
+    const QVector<TokenStream::Token> &stream = tokens.tokens();
+    const QString &text = tokens.text();
+    int scopeLevel = 0;
+    int resultLevel = 0;
+    bool afterSeparator = false;    ///< the previous token is the separator of the entity
+    // tokens crossing the position are not taken into account
+    int i = tokens.tokenAt(pos);
     if (backward)
     {
-        --pos;
-        delta = -1;
+        if (i >= stream.size() || stream.at(i).start + stream.at(i).length > pos)
+            --i;
     }
-
-    auto applyWord = [&]() -> AliasSearchResult
+    else if (i < stream.size() && stream.at(i).start < pos)
+        ++i;
+    for (; i >= 0 && i < stream.size(); i += (backward ? -1 : 1))
     {
-        if (!scopeLevel)
+        const TokenStream::Token &t = stream.at(i);
+        QChar c = text.at(t.start);
+        if (t.kind == TokenStream::Kind::Punctuation && c == ';')
+            break;
+
+        if (t.kind == TokenStream::Kind::Word && terminators.contains(tokens.word(i).toLower()))
+            break;
+
+        if (t.kind == TokenStream::Kind::Word || t.kind == TokenStream::Kind::QuotedIdentifier)
         {
-            if (mode == 1 && dividers.contains(word.toLower()))
+            // words of nested scopes are skipped
+            bool divider = (t.kind == TokenStream::Kind::Word && dividers.contains(tokens.word(i).toLower()));
+            if (!scopeLevel && divider)
             {
                 if (addEntity())
                 {
@@ -122,187 +301,57 @@ AliasSearchResult explainAlias(const QString &alias, const QString &text, int po
                 }
                 entity.clear();
             }
-            else
+            else if (!scopeLevel)
             {
-                if (entity.separator.isNull())
+                if (entity.separator.isNull() || !afterSeparator)
                 {
                     addEntity();
                     entity.clear();
                 }
                 if (backward)
-                    entity.items.prepend(word);
+                    entity.items.prepend(tokens.word(i));
                 else
-                    entity.items.append(word);
+                    entity.items.append(tokens.word(i));
             }
         }
-        word.clear();
-        return {};
-    };
-
-    QString eols("\n");
-    eols += QChar::ParagraphSeparator;
-    eols += QChar::LineSeparator;
-    while (pos != last_pos)
-    {
-        c = text[pos];
-        switch (mode)
+        else if (t.kind == TokenStream::Kind::Literal)
         {
-        case 2:
-            if (c != '"')
+            if (!entity.separator.isNull() && !afterSeparator)
             {
-                word += c;
-                break;
-            }
-            //[[fallthrough]];
-        case 1:
-            if (c.isLetterOrNumber() || c == '_')
-            {
-                word += c;
-                break;
+                addEntity();
+                entity.clear();
             }
-
-            if (!word.isEmpty())
+        }
+        else if (t.kind == TokenStream::Kind::Punctuation && c == '.')
+        {
+            entity.separator = c;
+            afterSeparator = true;
+            continue;
+        }
+        else
+        {
+            if (addEntity())
             {
-                if (backward)
-                    std::reverse(word.begin(), word.end());
-
-                if (mode == 1 && terminators.contains(word.toLower()))
-                    break;
-
-                auto res = applyWord();
+                auto res = test(alias, entities, resultLevel);
                 if (res.status != AliasSearchStatus::NotFound)
                     return res;
+                entities.clear();
             }
+            entity.clear();
 
-            if (mode == 2)
+            if (c == (backward ? ')' : '('))
+                ++scopeLevel;
+            else if (c == (backward ? '(' : ')'))
             {
-                // skip quotation mark
-                prevChar = c;
-                pos += delta;
-                if (pos == last_pos)
-                    break;
-                c = text[pos];
-            }
-            mode = 0xFF;
-            //[[fallthrough]];
-        case 0xFF:
-            word.clear();
-            if (c.isLetter() || c == '_')
-            {
-                if (!entity.separator.isNull() && prevChar != entity.separator)
-                {
-                    addEntity();
-                    entity.clear();
-                }
-                mode = 1;
-                word += c;
-            }
-            else if (c == '"')
-            {
-                if (!entity.separator.isNull() && prevChar != entity.separator)
-                {
-                    addEntity();
-                    entity.clear();
-                }
-                mode = 2;
-            }
-            else if (c == '\'')
-            {
-                if (!entity.separator.isNull() && prevChar != entity.separator)
-                {
-                    addEntity();
-                    entity.clear();
-                }
-                mode = 3;
-            }
-            else if (c == '*' && prevChar == '/')
-            {
-                mode = 4;
-                commentNestLevel = 1;
-            }
-            else if (c == '-' && prevChar == '-')
-                mode = 5;
-            else if (eols.contains(c))
-            {
-                if (backward)
+                --scopeLevel;
+                if (scopeLevel < 0)
                 {
-                    // search for first '--' within current line
-                    int i = pos;
-                    int commentStart = pos;
-                    while (i--)
-                    {
-                        if (text[i] == '-' && text[i + 1] == '-')
-                            commentStart = i;
-                        else if (eols.contains(text[i])) // start of line found
-                            break;
-                    }
-                    pos = commentStart;
+                    scopeLevel = 0;
+                    --resultLevel;
                 }
             }
-            else if (!c.isSpace())
-            {
-                if (c != '.')
-                {
-                    if (addEntity())
-                    {
-                        auto res = test(alias, entities, resultLevel);
-                        if (res.status != AliasSearchStatus::NotFound)
-                            return res;
-                        entities.clear();
-                    }
-                    entity.clear();
-
-                    if (c == (backward ? ')' : '('))
-                        ++scopeLevel;
-                    else if (c == (backward ? '(' : ')'))
-                    {
-                        --scopeLevel;
-                        if (scopeLevel < 0)
-                        {
-                            scopeLevel = 0;
-                            --resultLevel;
-                        }
-                    }
-                }
-                else
-                {
-                    entity.separator = c;
-                }
-            }
-            break;
-        case 3:
-            if (c == '\'')
-                mode = 0xFF;
-            break;
-        case 4:
-            /* multiline comments may be nested */
-            if (c == '*' && prevChar == '/')
-                ++commentNestLevel;
-            else if (c == '/' && prevChar == '*')
-                --commentNestLevel;
-
-            if (!commentNestLevel)
-                mode = 0xFF;
-            break;
-        case 5:
-            if (eols.contains(c))
-                mode = 0xFF;
         }
-
-        if (c == ';')
-            break;
-        if (mode != 2 && mode != 3 && !c.isSpace() && !eols.contains(c))
-            prevChar = c;
-        pos += delta;
-    }
-
-    if (mode == 1 && !word.isEmpty())
-    {
-        if (backward)
-            std::reverse(word.begin(), word.end());
-        auto res = applyWord();
-        if (res.status != AliasSearchStatus::NotFound)
-            return res;
+        afterSeparator = false;
     }
 
     if (addEntity())
@@ -310,14 +359,14 @@ AliasSearchResult explainAlias(const QString &alias, const QString &text, int po
     return {};
 }
 
-QPair<AliasSearchStatus, QStringList> explainAlias(const QString &alias, const QString &text, int pos) noexcept
+QPair<AliasSearchStatus, QStringList> explainAlias(const QString &alias, const TokenStream &tokens, int pos) noexcept
 {
     // Do not advance one by one (up and down), because we may
     // find matches in both directions and should make a choice
     // depending on depth (or scope level) of every match.
 
-    auto resDown = explainAlias(alias, text, pos, false);
-    auto resUp = explainAlias(alias, text, pos, true);
+    auto resDown = explainAlias(alias, tokens, pos, false);
+    auto resUp = explainAlias(alias, tokens, pos, true);
 
     if (resDown.status == AliasSearchStatus::NotFound)
         return { resUp.status, resUp.words };
@@ -328,6 +377,125 @@ QPair<AliasSearchStatus, QStringList> explainAlias(const QString &alias, const Q
     return { resUp.status, resUp.words };
 }
 
+QPair<AliasSearchStatus, QStringList> explainAlias(const QString &alias, const QString &text, int pos) noexcept
+{
+    return explainAlias(alias, TokenStream(text), pos);
+}
+
+QString firstKeyword(const QString &statement) noexcept
+{
+    static const QRegularExpression firstWord(R"(^(?:\s+|--[^\n]*(?:\n|$)|/\*.*?\*/)*(\w+))",
+                                              QRegularExpression::DotMatchesEverythingOption);
+    QRegularExpressionMatch m = firstWord.match(statement);
+    return m.hasMatch() ? m.captured(1).toLower() : QString();
+}
+
+int statementEnd(const QString &query, int from, bool *blank) noexcept
+{
+    const int len = query.length();
+    if (blank)
+        *blank = true;
+    for (int i = from; i < len; ++i)
+    {
+        QChar c = query.at(i);
+        QChar next = (i + 1 < len ? query.at(i + 1) : QChar());
+        if (c == '-' && next == '-')
+        {
+            i = query.indexOf('\n', i);
+            if (i < 0)
+                break;
+            continue;
+        }
+        if (c == '/' && next == '*')
+        {
+            int depth = 1;
+            for (i += 2; i < len && depth; ++i)
+            {
+                if (query.at(i) == '/' && i + 1 < len && query.at(i + 1) == '*')
+                    ++depth, ++i;
+                else if (query.at(i) == '*' && i + 1 < len && query.at(i + 1) == '/')
+                    --depth, ++i;
+            }
+            if (depth)
+                return -1;
+            --i;
+            continue;
+        }
+        if (c.isSpace())
+            continue;
+        if (c == ';')
+            return i;
+        if (blank)
+            *blank = false;
+
+        if (c == '\'' || c == '"')
+        {
+            bool escapes = (c == '\'' && i > 0 && query.at(i - 1).toLower() == 'e');
+            for (++i; i < len && query.at(i) != c; ++i)
+            {
+                if (escapes && query.at(i) == '\\')
+                    ++i;
+            }
+            if (i >= len)
+                return -1;
+        }
+        else if (c == '$' && !next.isDigit())
+        {
+            // dollar-quoted string
+            int tagEnd = i + 1;
+            while (tagEnd < len && (query.at(tagEnd).isLetterOrNumber() || query.at(tagEnd) == '_'))
+                ++tagEnd;
+            if (tagEnd >= len || query.at(tagEnd) != '$')
+                continue;
+            QString tag = query.mid(i, tagEnd - i + 1);
+            i = query.indexOf(tag, tagEnd + 1);
+            if (i < 0)
+                return -1;
+            i += tag.length() - 1;
+        }
+    }
+    return len;
+}
+
+bool isSingleDataStatement(const QString &query, int *length, QString *keyword) noexcept
+{
+    static const QStringList dataStatements { "select", "with", "values", "table", "insert", "update", "delete" };
+    QString word = firstKeyword(query);
+    if (!dataStatements.contains(word))
+        return false;
+    if (keyword)
+        *keyword = word;
+
+    const int len = query.length();
+    int end = statementEnd(query, 0);
+    if (end < 0)
+        return false;
+    if (length)
+        *length = end;
+    if (end == len)
+        return true;
+    // nothing but comments is allowed after the terminating semicolon
+    bool blank;
+    return statementEnd(query, end + 1, &blank) == len && blank;
+}
+
+QStringList splitStatements(const QString &query) noexcept
+{
+    QStringList res;
+    const int len = query.length();
+    for (int from = 0; from <= len; )
+    {
+        bool blank;
+        int end = statementEnd(query, from, &blank);
+        if (end < 0)
+            return QStringList();
+        if (!blank)
+            res.append(query.mid(from, end - from));
+        from = end + 1;
+    }
+    return res;
+}
+
 }; // sqlparser namespace
 
 /*
@@ -3,6 +3,7 @@
 
 #include <QString>
 #include <QStringList>
+#include <QVector>
 
 namespace SqlParser
 {
@@ -15,7 +16,79 @@ enum class AliasSearchStatus
     Fields     ///< words ready to use within completer
 };
 
+/*!
+ * \brief Tokens of a text kept up to date by edits; only the edited region is lexed again.
+ *
+ * Spaces and comments are skipped, tokens are offsets into the text.
+ */
+class TokenStream
+{
+public:
+    enum class Kind : quint8
+    {
+        Word,
+        QuotedIdentifier,
+        Literal,        ///< string or dollar-quoted literal
+        Punctuation,    ///< single character
+        Other           ///< numbers and parameters
+    };
+    struct Token
+    {
+        int start;
+        int length;
+        Kind kind;
+    };
+
+    TokenStream() = default;
+    explicit TokenStream(const QString &text);
+    void reset(const QString &text);
+    /*!
+     * \brief apply the edit of the text, the same as QTextDocument::contentsChange reports it
+     */
+    void update(int pos, int removed, const QString &added);
+    const QString &text() const noexcept { return _text; }
+    const QVector<Token> &tokens() const noexcept { return _tokens; }
+    /*!
+     * \brief index of the first token ending at pos or later (tokens().size() if none)
+     */
+    int tokenAt(int pos) const noexcept;
+    /*!
+     * \brief text of the token, quoted identifiers are unquoted
+     */
+    QString word(int index) const;
+
+private:
+    QString _text;
+    QVector<Token> _tokens;
+};
+
 QPair<AliasSearchStatus, QStringList> explainAlias(const QString &alias, const QString &text, int pos) noexcept;
+QPair<AliasSearchStatus, QStringList> explainAlias(const QString &alias, const TokenStream &tokens, int pos) noexcept;
+
+/*!
+ * \brief lowercased first keyword of the statement skipping comments (empty if none)
+ */
+QString firstKeyword(const QString &statement) noexcept;
+
+/*!
+ * \brief position of the top-level semicolon terminating the statement started at from
+ * \param blank optional, set if the statement consists of spaces and comments only
+ * \return query length if the statement is not terminated, -1 if a literal or a comment is not closed
+ */
+int statementEnd(const QString &query, int from, bool *blank = nullptr) noexcept;
+
+/*!
+ * \brief determine if the query consists of a single statement returning data (any doubt leads to false)
+ * \param length optional statement length excluding terminating semicolon
+ * \param keyword optional lowercased first keyword of the statement
+ */
+bool isSingleDataStatement(const QString &query, int *length = nullptr, QString *keyword = nullptr) noexcept;
+
+/*!
+ * \brief split the script into statements (without terminating semicolons)
+ * \return empty list if the script is not complete (unclosed literal or comment)
+ */
+QStringList splitStatements(const QString &query) noexcept;
 
 }; // sqlparser namespace
 
@@ -3,10 +3,85 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QPlainTextEdit>
+#include <QScrollBar>
+#include <QDateTime>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QMutex>
+#include <QThreadPool>
+#include <algorithm>
 #include "sqlsyntaxhighlighter.h"
+#include "trace.h"
+#include "lambdarunnable.h"
 
-SqlSyntaxHighlighter::SqlSyntaxHighlighter(const QJsonObject &settings, QObject *parent) :
-    QSyntaxHighlighter(parent)
+static inline ushort lowerChar(QChar c)
+{
+    ushort uc = c.unicode();
+    if (uc >= 'A' && uc <= 'Z')
+        return uc + ('a' - 'A');
+    return (uc > 127 ? c.toLower().unicode() : uc);
+}
+
+template<class T>
+uint SqlSyntaxHighlighter::WordTable<T>::hash(const QChar *word, int len)
+{
+    // FNV-1a
+    uint h = 2166136261u;
+    for (int i = 0; i < len; ++i)
+        h = (h ^ lowerChar(word[i])) * 16777619u;
+    return h;
+}
+
+template<class T>
+void SqlSyntaxHighlighter::WordTable<T>::build(const QHash<QString, T> &words)
+{
+    // at least a half of slots is empty to keep probing short
+    uint size = 8;
+    while (size < uint(words.size()) * 2)
+        size <<= 1;
+    _mask = size - 1;
+    _slots.clear();
+    _slots.resize(int(size));
+    for (auto it = words.constBegin(); it != words.constEnd(); ++it)
+    {
+        uint i = hash(it.key().constData(), it.key().size()) & _mask;
+        while (_slots.at(int(i)).value)
+            i = (i + 1) & _mask;
+        _slots[int(i)].word = it.key();
+        _slots[int(i)].value = &it.value();
+    }
+}
+
+template<class T>
+const T* SqlSyntaxHighlighter::WordTable<T>::find(const QChar *word, int len) const
+{
+    if (_slots.isEmpty())
+        return nullptr;
+    for (uint i = hash(word, len) & _mask; ; i = (i + 1) & _mask)
+    {
+        const Slot &slot = _slots.at(int(i));
+        if (!slot.value)
+            return nullptr;
+        if (slot.word.size() != len)
+            continue;
+        const QChar *w = slot.word.constData();
+        int j = 0;
+        while (j < len && w[j].unicode() == lowerChar(word[j]))
+            ++j;
+        if (j == len)
+            return slot.value;
+    }
+}
+
+void SqlSyntaxHighlighter::buildIndex(QHash<QString, WordInfo> &words, WordTable<WordInfo> &index)
+{
+    index.build(words);
+    for (auto it = words.begin(); it != words.end(); ++it)
+        buildIndex(it.value().nextWords, it.value().next);
+}
+
+void SqlSyntaxHighlighter::Rules::build(const QJsonObject &settings)
 {
     /*
      * QTextCharFormat::setFontCapitalization does not work
@@ -104,10 +179,179 @@ SqlSyntaxHighlighter::SqlSyntaxHighlighter(const QJsonObject &settings, QObject
         }
         formats.append(get_format(p, "code", Qt::black));
     }
+
+    // the dictionaries are not changed anymore, so the tables may refer to their values
+    buildIndex(keywords, keywordIndex);
+    functionIndex.build(functions);
+}
+
+std::shared_ptr<const SqlSyntaxHighlighter::Rules> SqlSyntaxHighlighter::compiled(const QString &confFile, QString &error)
+{
+    struct Entry
+    {
+        QDateTime modified;
+        std::shared_ptr<const Rules> rules;
+        QString error;
+    };
+    static QMutex mutex;
+    static QHash<QString, Entry> cache;
+
+    QFileInfo info(confFile);
+    QDateTime modified = (confFile.isEmpty() || !info.exists() ? QDateTime() : info.lastModified());
+    // a file being compiled by preload() is waited for
+    QMutexLocker lk(&mutex);
+    auto it = cache.constFind(confFile);
+    if (it != cache.constEnd() && it->modified == modified)
+    {
+        error = it->error;
+        return it->rules;
+    }
+
+    QJsonObject settings;
+    QString err;
+    QFile file(confFile);
+    if (!confFile.isEmpty() && file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        QByteArray text_data = file.readAll();
+        if (!text_data.isEmpty())
+        {
+            QJsonParseError parse_error;
+            QJsonDocument doc = QJsonDocument::fromJson(text_data, &parse_error);
+            if (doc.isNull())
+                err = parse_error.errorString();
+            else
+                settings = doc.object();
+        }
+    }
+    std::shared_ptr<Rules> rules = std::make_shared<Rules>();
+    rules->build(settings);
+    cache.insert(confFile, { modified, rules, err });
+    error = err;
+    return rules;
+}
+
+void SqlSyntaxHighlighter::preload()
+{
+    QString path = QApplication::applicationDirPath() + "/scripts";
+    QThreadPool::globalInstance()->start(new LambdaRunnable([path]() {
+        QString error;
+        QDirIterator it(path, QStringList("hl.conf"), QDir::Files, QDirIterator::Subdirectories | QDirIterator::FollowSymlinks);
+        while (it.hasNext())
+            compiled(it.next(), error);
+    }));
+}
+
+SqlSyntaxHighlighter::SqlSyntaxHighlighter(const QString &confFile, QString &error, QObject *parent) :
+    QSyntaxHighlighter(parent),
+    _rules(compiled(confFile, error))
+{
+    _idle.setSingleShot(true);
+    _idle.setInterval(0);
+    connect(&_idle, &QTimer::timeout, this, &SqlSyntaxHighlighter::highlightPending);
+}
+
+void SqlSyntaxHighlighter::setViewportMode(QPlainTextEdit *editor)
+{
+    _editor = editor;
+    // what gets visible is highlighted first
+    connect(editor->verticalScrollBar(), &QScrollBar::valueChanged, this, [this]() {
+        if (!_pending.isEmpty())
+            _idle.start();
+    });
+}
+
+bool SqlSyntaxHighlighter::isEager(const QTextBlock &block) const
+{
+    if (!_editor || _editor->document() != document() || document()->blockCount() <= HL_EAGER_BLOCKS)
+        return true;
+    // postponed blocks are being processed
+    if (_slice.isValid() && !_slice.hasExpired(HL_IDLE_SLICE))
+        return true;
+    int first = _editor->firstVisibleBlock().blockNumber();
+    int lines = _editor->viewport()->height() / qMax(1, _editor->fontMetrics().height());
+    int n = block.blockNumber();
+    return n >= first - HL_VIEWPORT_MARGIN && n <= first + lines + HL_VIEWPORT_MARGIN;
+}
+
+void SqlSyntaxHighlighter::postpone(const QTextBlock &block)
+{
+    int end = block.position() + block.length() - 1;
+    // adjacent blocks make a single range
+    if (!_pending.isEmpty() && _pending.last().document() == document() &&
+            _pending.last().selectionEnd() + 1 == block.position())
+    {
+        _pending.last().setPosition(end, QTextCursor::KeepAnchor);
+    }
+    else
+    {
+        // cursors follow the document changes
+        QTextCursor range(document());
+        range.setPosition(block.position());
+        range.setPosition(end, QTextCursor::KeepAnchor);
+        _pending.append(range);
+    }
+    if (!_idle.isActive())
+        _idle.start();
+}
+
+void SqlSyntaxHighlighter::highlightPending()
+{
+    if (!document())
+    {
+        _pending.clear();
+        return;
+    }
+
+    // ranges on screen go first
+    if (_editor && _editor->document() == document())
+    {
+        int first = _editor->firstVisibleBlock().position();
+        int last = _editor->cursorForPosition(QPoint(0, _editor->viewport()->height())).position();
+        std::stable_partition(_pending.begin(), _pending.end(), [first, last](const QTextCursor &range) {
+            return range.selectionEnd() >= first && range.selectionStart() <= last;
+        });
+    }
+
+    _slice.start();
+    while (!_pending.isEmpty() && !_slice.hasExpired(HL_IDLE_SLICE))
+    {
+        QTextCursor range = _pending.takeFirst();
+        if (range.document() != document())
+            continue;
+        QTextBlock block = document()->findBlock(range.selectionStart());
+        int last = document()->findBlock(range.selectionEnd()).blockNumber();
+        while (block.isValid() && block.blockNumber() <= last)
+        {
+            rehighlightBlock(block);
+            // the state change may have been cascaded further
+            block = document()->findBlockByNumber(qMax(block.blockNumber(), _last_highlighted) + 1);
+            if (_slice.hasExpired(HL_IDLE_SLICE) && block.isValid() && block.blockNumber() <= last)
+            {
+                QTextCursor rest(document());
+                rest.setPosition(block.position());
+                rest.setPosition(range.selectionEnd(), QTextCursor::KeepAnchor);
+                _pending.prepend(rest);
+                break;
+            }
+        }
+    }
+    _slice.invalidate();
+    if (!_pending.isEmpty())
+        _idle.start();
 }
 
 void SqlSyntaxHighlighter::highlightBlock(const QString &text)
 {
+    SQT_TRACE_SCOPE("highlightBlock");
+    const Rules &r = *_rules;
+    if (!isEager(currentBlock()))
+    {
+        // the state is kept as is to stop cascading, formats are restored in idle time
+        postpone(currentBlock());
+        return;
+    }
+    _last_highlighted = currentBlock().blockNumber();
+
     int firstWordStartPos = -1;
     const WordInfo *lastWordInfo = nullptr;
     QString::ConstIterator i = text.constBegin();
@@ -135,7 +379,7 @@ void SqlSyntaxHighlighter::highlightBlock(const QString &text)
                 mode = 0;
             else if (*i == '"')
                 mode = 1;
-            else if (*i == '[' && tsqlBrackets)
+            else if (*i == '[' && r.tsqlBrackets)
                 mode = 2;
             else if (*i == '*' && prevChar == '/')
             {
@@ -148,14 +392,14 @@ void SqlSyntaxHighlighter::highlightBlock(const QString &text)
                 mode = 4;
                 ++len;
             }
-            else if (delimiters.contains(prevChar) || prevChar.isNull())
+            else if (r.delimiters.contains(prevChar) || prevChar.isNull())
             {
                 if ((*i).isDigit())
                     mode = 5;
                 else if (// typical start of word
                          (*i).isLetter() || *i == '_' ||
                          // tsql-like vars, temp tables and so on
-                         ((*i == '@' || *i == '$' || *i == '#') && !delimiters.contains(*i))
+                         ((*i == '@' || *i == '$' || *i == '#') && !r.delimiters.contains(*i))
                         )
                 {
                     mode = 9;
@@ -170,7 +414,7 @@ void SqlSyntaxHighlighter::highlightBlock(const QString &text)
         case 0:
             if (*i == '\'')
             {
-                setFormat(pos - len, len, formats.at(mode));
+                setFormat(pos - len, len, r.formats.at(mode));
                 mode = 0xFF;
             }
             break;
@@ -178,18 +422,18 @@ void SqlSyntaxHighlighter::highlightBlock(const QString &text)
             if (*i == '"')
             {
                 // check for data type (e.g. "char") or other quoted SINGLE word
-                auto const it = keywords.find(text.mid(pos - len, len).toLower());
-                if (it != keywords.end() && it.value().formatIndex >= 0)
-                    setFormat(pos - len, len, formats.at(it.value().formatIndex));
+                auto const it = r.keywords.find(text.mid(pos - len, len).toLower());
+                if (it != r.keywords.end() && it.value().formatIndex >= 0)
+                    setFormat(pos - len, len, r.formats.at(it.value().formatIndex));
                 else
-                    setFormat(pos - len, len, formats.at(mode));
+                    setFormat(pos - len, len, r.formats.at(mode));
                 mode = 0xFF;
             }
             break;
         case 2:
             if (*i == ']')
             {
-                setFormat(pos - len, len, formats.at(mode));
+                setFormat(pos - len, len, r.formats.at(mode));
                 mode = 0xFF;
             }
             break;
@@ -202,7 +446,7 @@ void SqlSyntaxHighlighter::highlightBlock(const QString &text)
 
             if ((static_cast<unsigned int>(mode) & 0xFFFFFF00) == 0)
             {
-                setFormat(pos - len, len, formats.at(mode));
+                setFormat(pos - len, len, r.formats.at(mode));
                 mode = 0xFF;
             }
             else
@@ -211,7 +455,7 @@ void SqlSyntaxHighlighter::highlightBlock(const QString &text)
         case 4:
             if (*i == '\n' || (*i).isNull())
             {
-                setFormat(pos - len, len, formats.at(mode));
+                setFormat(pos - len, len, r.formats.at(mode));
                 mode = 0xFF;
                 lastWordInfo = nullptr;
             }
@@ -219,9 +463,9 @@ void SqlSyntaxHighlighter::highlightBlock(const QString &text)
         case 5:
             if (!(*i).isDigit() && *i != '.')
             {
-                if (delimiters.contains(*i) || (*i).isNull())
+                if (r.delimiters.contains(*i) || (*i).isNull())
                 {
-                    setFormat(pos - len, len - 1, formats.at(mode));
+                    setFormat(pos - len, len - 1, r.formats.at(mode));
                     --i; --pos;
                 }
                 mode = 0xFF;
@@ -229,36 +473,37 @@ void SqlSyntaxHighlighter::highlightBlock(const QString &text)
             break;
         case 9:
         {
-            int delimPos = delimiters.indexOf(*i);
+            int delimPos = r.delimiters.indexOf(*i);
             if (delimPos >= 0 || (*i).isNull())
             {
-                QString word = text.mid(pos - len, len - 1).toLower();
+                const QChar *word = text.constData() + pos - len;
+                int wordLen = len - 1;
                 int delta = 0;
 
                 // skip space characters to detect possible trailing '('
                 while (delimPos >= 0 && delimPos < 4)
-                    delimPos = delimiters.indexOf(*(i + ++delta));
+                    delimPos = r.delimiters.indexOf(*(i + ++delta));
 
-                if (*(i + delta) == '(' && functions.constFind(word) != functions.constEnd())
+                if (*(i + delta) == '(' && r.functionIndex.find(word, wordLen))
                     // function
-                    setFormat(pos - len, len - 1, formats.at(7));
+                    setFormat(pos - len, len - 1, r.formats.at(7));
                 else
                 {
                     // ms sql variable
-                    if (word.at(0) == '@' && len > 2 && word.at(1) != '@')
-                        setFormat(pos - len, len - 1, formats.at(6));
+                    if (word[0] == '@' && len > 2 && word[1] != '@')
+                        setFormat(pos - len, len - 1, r.formats.at(6));
 
                     auto processFirstWord = [&](bool standalone = false) {
-                        auto const it = keywords.find(word);
-                        if (it != keywords.end())
+                        const WordInfo *info = r.keywordIndex.find(word, wordLen);
+                        if (info)
                         {
-                            if (it.value().isLastWord != LastWordOption::No)
-                                setFormat(pos - len, len - 1, formats.at(it.value().formatIndex));
+                            if (info->isLastWord != LastWordOption::No)
+                                setFormat(pos - len, len - 1, r.formats.at(info->formatIndex));
 
-                            if (!standalone && it.value().isLastWord != LastWordOption::Yes)
+                            if (!standalone && info->isLastWord != LastWordOption::Yes)
                             {
                                 firstWordStartPos = pos - len;
-                                lastWordInfo = &(it.value());
+                                lastWordInfo = info;
                             }
                         }
                         // ascii and non-ascii character within single word
@@ -278,14 +523,14 @@ void SqlSyntaxHighlighter::highlightBlock(const QString &text)
                     }
                     else
                     {
-                        auto const it = lastWordInfo->nextWords.find(word);
-                        if (it != lastWordInfo->nextWords.end())
+                        const WordInfo *info = lastWordInfo->next.find(word, wordLen);
+                        if (info)
                         {
-                            if (it.value().isLastWord != LastWordOption::No)
-                                setFormat(firstWordStartPos, pos - firstWordStartPos - 1, formats.at(it.value().formatIndex));
+                            if (info->isLastWord != LastWordOption::No)
+                                setFormat(firstWordStartPos, pos - firstWordStartPos - 1, r.formats.at(info->formatIndex));
                             else
                             {
-                                lastWordInfo = &(it.value());
+                                lastWordInfo = info;
                                 // apply "default" color untill end of phrase get found
                                 processFirstWord(true);
                             }
@@ -311,7 +556,7 @@ void SqlSyntaxHighlighter::highlightBlock(const QString &text)
             break;
         }
         default:
-            setFormat(pos - len, len - 1, formats.at(mode & 0xFF));
+            setFormat(pos - len, len - 1, r.formats.at(mode & 0xFF));
             break;
         }
         prevChar = *i;
@@ -328,7 +573,7 @@ void SqlSyntaxHighlighter::highlightBlock(const QString &text)
 
     if (mode != 0xFF)
     {
-        setFormat(pos - len, len - 1, formats.at(mode & 0xFF));
+        setFormat(pos - len, len - 1, r.formats.at(mode & 0xFF));
         if ((mode & 0xFF) > 3)
             mode = 0xFF;
     }
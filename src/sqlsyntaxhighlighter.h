@@ -2,30 +2,120 @@
 #define SQLSYNTAXHIGHLIGHTER_H
 
 #include <QSyntaxHighlighter>
+#include <QTextCursor>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QVector>
+#include <QList>
+#include <QHash>
+#include <memory>
 
+class QJsonObject;
+class QPlainTextEdit;
+
+// documents up to the number of blocks are always highlighted at once
+#define HL_EAGER_BLOCKS 2000
+// blocks around the viewport highlighted at once in viewport mode
+#define HL_VIEWPORT_MARGIN 50
+// duration of background highlighting step, ms
+#define HL_IDLE_SLICE 15
+
+/*!
+ * \brief Highlighter of sql by the rules of hl.conf of the dbms scripts.
+ *
+ * Rules of a file are compiled once per process (until the file is modified) and shared
+ * by all the highlighters, preload() compiles all the files by a thread at startup.
+ */
 class SqlSyntaxHighlighter : public QSyntaxHighlighter
 {
     Q_OBJECT
 public:
-    explicit SqlSyntaxHighlighter(const QJsonObject &settings, QObject *parent = nullptr);
+    /*!
+     * \param confFile hl.conf, empty for the default rules
+     * \param error set if the file is not valid json (the default rules are used then)
+     */
+    SqlSyntaxHighlighter(const QString &confFile, QString &error, QObject *parent = nullptr);
+    /*!
+     * \brief compile rules of every hl.conf of the scripts folder in background
+     */
+    static void preload();
+    /*!
+     * \brief highlight only blocks near the editor's viewport at once and the rest in idle time
+     *
+     * A change of the carried state (e.g. an open quote) stops cascading at the viewport edge
+     * instead of rehighlighting the rest of document synchronously.
+     */
+    void setViewportMode(QPlainTextEdit *editor);
 
 protected:
     virtual void highlightBlock(const QString &text);
 
+private slots:
+    void highlightPending();
+
 private:
     enum class LastWordOption { Yes, No, MayBe };
+    struct WordInfo;
+
+    /*!
+     * \brief flat open addressing table of lowercase words, looked up case-insensitively
+     * without making a string of the word
+     */
+    template<class T>
+    class WordTable
+    {
+    public:
+        void build(const QHash<QString, T> &words);
+        const T* find(const QChar *word, int len) const;
+    private:
+        static uint hash(const QChar *word, int len);
+        struct Slot
+        {
+            QString word;
+            const T *value = nullptr;
+        };
+        QVector<Slot> _slots;
+        uint _mask = 0;
+    };
+
     struct WordInfo
     {
         char formatIndex;
         LastWordOption isLastWord;
         QHash <QString, WordInfo> nextWords;
+        WordTable<WordInfo> next;   ///< index of nextWords
+    };
+    static void buildIndex(QHash<QString, WordInfo> &words, WordTable<WordInfo> &index);
+    /*!
+     * \brief compiled hl.conf, immutable (the tables refer to values of the dictionaries)
+     */
+    struct Rules
+    {
+        Rules() = default;
+        Rules(const Rules&) = delete;
+        Rules& operator=(const Rules&) = delete;
+        void build(const QJsonObject &settings);
+
+        QHash <QString, WordInfo> keywords;
+        WordTable<WordInfo> keywordIndex;
+
+        QVector<QTextCharFormat> formats;
+        QHash<QString, char> functions;
+        WordTable<char> functionIndex;
+        QString delimiters;
+        bool tsqlBrackets = false;
     };
-    QHash <QString, WordInfo> keywords;
+    static std::shared_ptr<const Rules> compiled(const QString &confFile, QString &error);
+    bool isEager(const QTextBlock &block) const;
+    void postpone(const QTextBlock &block);
+
+    std::shared_ptr<const Rules> _rules;
 
-    QVector<QTextCharFormat> formats;
-    QHash<QString, char> functions;
-    QString delimiters;
-    bool tsqlBrackets;
+    QPlainTextEdit *_editor = nullptr;
+    QList<QTextCursor> _pending;    ///< ranges of postponed blocks
+    QTimer _idle;
+    QElapsedTimer _slice;           ///< valid while postponed blocks are processed
+    int _last_highlighted = -1;
 };
 
 #endif // SQLSYNTAXHIGHLIGHTER_H
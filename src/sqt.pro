@@ -16,24 +16,53 @@ SOURCES += main.cpp\
     odbcconnection.cpp \
     querywidget.cpp \
     tablemodel.cpp \
+    cursortablemodel.cpp \
     extfiledialog.cpp \
     dbtreeitemdelegate.cpp \
     findandreplacepanel.cpp \
     connectiondialog.cpp \
     dbconnection.cpp \
     datatable.cpp \
+    columnstorage.cpp \
     dbconnectionfactory.cpp \
     pgconnection.cpp \
+    pgsessionpool.cpp \
+    pgtypemap.cpp \
     pgparams.cpp \
+    pgbinarydecoder.cpp \
     sqlsyntaxhighlighter.cpp \
     scripting.cpp \
+    metadatacache.cpp \
     appeventhandler.cpp \
     copycontext.cpp \
+    copystreams.cpp \
     codeeditor.cpp \
     settings.cpp \
     settingsdialog.cpp \
     jsonsyntaxhighlighter.cpp \
-    sqlparser.cpp
+    sqlparser.cpp \
+    resultwriter.cpp \
+    largefile.cpp \
+    statementsplitter.cpp \
+    searchindex.cpp \
+    completionindex.cpp \
+    rowindex.cpp \
+    gridcopy.cpp \
+    selectionaggregate.cpp \
+    executionservice.cpp \
+    spillfile.cpp \
+    notificationlistener.cpp \
+    notificationspanel.cpp \
+    jsonformatter.cpp \
+    jsonviewer.cpp \
+    resultcache.cpp \
+    objectpreview.cpp \
+    pgcolumndecoder.cpp \
+    scriptcursor.cpp \
+    trace.cpp \
+    fanout.cpp \
+    planviewer.cpp \
+    gridsearch.cpp
 
 HEADERS  += mainwindow.h \
     dbobjectsmodel.h \
@@ -43,25 +72,55 @@ HEADERS  += mainwindow.h \
     odbcconnection.h \
     querywidget.h \
     tablemodel.h \
+    cursortablemodel.h \
     extfiledialog.h \
     dbtreeitemdelegate.h \
     findandreplacepanel.h \
     connectiondialog.h \
     dbconnection.h \
     datatable.h \
+    columnstorage.h \
     dbconnectionfactory.h \
     pgconnection.h \
+    pgsessionpool.h \
+    pgtypemap.h \
     pgtypes.h \
     pgparams.h \
+    pgbinarydecoder.h \
     sqlsyntaxhighlighter.h \
     scripting.h \
+    metadatacache.h \
     appeventhandler.h \
     copycontext.h \
+    copystreams.h \
     codeeditor.h \
     settings.h \
     settingsdialog.h \
     jsonsyntaxhighlighter.h \
-    sqlparser.h
+    sqlparser.h \
+    resultwriter.h \
+    largefile.h \
+    statementsplitter.h \
+    searchindex.h \
+    completionindex.h \
+    rowindex.h \
+    gridcopy.h \
+    selectionaggregate.h \
+    executionservice.h \
+    lambdarunnable.h \
+    spillfile.h \
+    notificationlistener.h \
+    notificationspanel.h \
+    jsonformatter.h \
+    jsonviewer.h \
+    resultcache.h \
+    objectpreview.h \
+    pgcolumndecoder.h \
+    scriptcursor.h \
+    trace.h \
+    fanout.h \
+    planviewer.h \
+    gridsearch.h
 
 FORMS    += mainwindow.ui \
     logindialog.ui \
@@ -72,10 +131,33 @@ FORMS    += mainwindow.ui \
 RESOURCES += \
     sqt.qrc
 
+# scoped trace points (Help > Record trace), qmake CONFIG+=no_trace compiles them out
+!CONFIG(no_trace): DEFINES += SQT_TRACING
+
+# throughput of the hot paths, qmake CONFIG+=benchmark builds sqt-benchmark instead of the application
+CONFIG(benchmark) {
+    TARGET = sqt-benchmark
+    SOURCES -= main.cpp
+    SOURCES += benchmark.cpp \
+        benchmarkmain.cpp
+    HEADERS += benchmark.h
+    # peak memory usage
+    win32: LIBS += -lpsapi
+}
+
 #https://wiki.qt.io/Install_Qt_5_on_Ubuntu
 unix {
     INCLUDEPATH += /usr/include/postgresql
     LIBS += -lodbc -lpq -lssl
+    # compressed COPY files
+    packagesExist(zlib) {
+        DEFINES += SQT_HAS_ZLIB
+        LIBS += -lz
+    }
+    packagesExist(libzstd) {
+        DEFINES += SQT_HAS_ZSTD
+        LIBS += -lzstd
+    }
     QMAKE_POST_LINK += $$quote($$QMAKE_SYMBOLIC_LINK $$system_quote($${_PRO_FILE_PWD_}/../decor) $$system_quote($$OUT_PWD))$$escape_expand(\n\t)
     QMAKE_POST_LINK += $$quote($$QMAKE_SYMBOLIC_LINK $$system_quote($${_PRO_FILE_PWD_}/../scripts) $$system_quote($$OUT_PWD))$$escape_expand(\n\t)
 }
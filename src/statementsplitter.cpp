@@ -0,0 +1,345 @@
+#include "statementsplitter.h"
+#include "sqlparser.h"
+#include <QRegularExpression>
+
+// consumed input kept until the buffer grows, chars
+#define SPLITTER_COMPACT_SIZE (64 * 1024)
+// inline COPY data taken at once, chars
+#define SPLITTER_COPY_CHUNK (256 * 1024)
+
+StatementSplitter::StatementSplitter(Dialect dialect, int firstLine) :
+    _dialect(dialect),
+    _line(firstLine)
+{
+}
+
+void StatementSplitter::feed(const QString &text)
+{
+    if (_start > SPLITTER_COMPACT_SIZE && _start > _buf.length() / 2)
+    {
+        _buf.remove(0, _start);
+        _pos -= _start;
+        _start = 0;
+    }
+    _buf += text;
+}
+
+void StatementSplitter::finish()
+{
+    _finished = true;
+}
+
+void StatementSplitter::putBack(const Statement &statement)
+{
+    _held = true;
+    _held_statement = statement;
+}
+
+void StatementSplitter::take(int end, int next, Statement &statement)
+{
+    QStringRef text(&_buf, _start, end - _start);
+    // the statement starts at the first non-space line
+    int skip = 0;
+    while (skip < text.length() && text.at(skip).isSpace())
+        ++skip;
+    statement.line = _line + text.left(skip).count('\n');
+    statement.text = text.mid(skip).toString();
+    statement.copyIn = false;
+    this->skip(next);
+    _blank = true;
+}
+
+void StatementSplitter::skip(int next)
+{
+    _line += QStringRef(&_buf, _start, next - _start).count('\n');
+    _start = _pos = next;
+}
+
+bool StatementSplitter::isCopyFromStdin(int end) const
+{
+    QString text = _buf.mid(_start, end - _start);
+    if (SqlParser::firstKeyword(text) != "copy")
+        return false;
+    static const QRegularExpression stdin_re(R"(\bfrom\s+stdin\b)", QRegularExpression::CaseInsensitiveOption);
+    return stdin_re.match(text).hasMatch();
+}
+
+bool StatementSplitter::next(Statement &statement)
+{
+    if (_held)
+    {
+        _held = false;
+        statement = _held_statement;
+        _held_statement = Statement();
+        return true;
+    }
+
+    for (;;)
+    {
+        const int len = _buf.length();
+        if (_pos >= len && _state != State::CopyData)
+        {
+            if (!_finished)
+                return false;
+            // unterminated statement (or unclosed literal) is left to the server to complain
+            if (_blank)
+            {
+                _start = _pos = len;
+                return false;
+            }
+            take(len, len, statement);
+            _state = State::Code;
+            return true;
+        }
+
+        switch (_state)
+        {
+        case State::Code:
+        {
+            // lookahead is needed to recognize comments
+            if (_pos + 1 >= len && !_finished)
+                return false;
+            QChar c = _buf.at(_pos);
+            QChar next = (_pos + 1 < len ? _buf.at(_pos + 1) : QChar());
+
+            if (_line_start && _dialect == Dialect::Go)
+            {
+                int eol = _buf.indexOf('\n', _pos);
+                if (eol < 0 && !_finished)
+                    return false;
+                int end = (eol < 0 ? len : eol);
+                // repeat count of GO is not supported
+                static const QRegularExpression go_re(R"(^\s*go(\s+\d+)?\s*$)", QRegularExpression::CaseInsensitiveOption);
+                if (go_re.match(_buf.midRef(_pos, end - _pos)).hasMatch())
+                {
+                    bool blank = _blank;
+                    take(_pos, (eol < 0 ? len : eol + 1), statement);
+                    if (!blank)
+                        return true;
+                    continue;
+                }
+            }
+            _line_start = false;
+
+            if (c == '\n')
+            {
+                _line_start = true;
+                ++_pos;
+                continue;
+            }
+            if (c == '-' && next == '-')
+            {
+                _state = State::LineComment;
+                _pos += 2;
+                continue;
+            }
+            if (c == '/' && next == '*')
+            {
+                _state = State::BlockComment;
+                _depth = 1;
+                _pos += 2;
+                continue;
+            }
+            ++_pos;
+            if (c.isSpace())
+                continue;
+            if (c == ';' && _dialect == Dialect::Semicolon)
+            {
+                if (!_blank && isCopyFromStdin(_pos - 1))
+                {
+                    take(_pos - 1, _pos, statement);
+                    statement.copyIn = true;
+                    _state = State::CopyData;
+                    _copy_started = false;
+                    return true;
+                }
+                bool blank = _blank;
+                take(_pos - 1, _pos, statement);
+                if (!blank)
+                    return true;
+                continue;
+            }
+            _blank = false;
+
+            if (c == '\'' || c == '"')
+            {
+                _quote = c;
+                _escapes = (c == '\'' && _dialect == Dialect::Semicolon && _pos >= 2 && _buf.at(_pos - 2).toLower() == 'e');
+                _state = State::Quote;
+            }
+            else if (c == '[' && _dialect == Dialect::Go)
+                _state = State::Bracket;
+            else if (c == '$' && _dialect == Dialect::Semicolon && !next.isDigit())
+            {
+                int tag_end = _pos;
+                while (tag_end < len && (_buf.at(tag_end).isLetterOrNumber() || _buf.at(tag_end) == '_'))
+                    ++tag_end;
+                // the tag must be complete
+                if (tag_end >= len && !_finished)
+                {
+                    --_pos;
+                    return false;
+                }
+                if (tag_end < len && _buf.at(tag_end) == '$')
+                {
+                    _tag = _buf.mid(_pos - 1, tag_end - _pos + 2);
+                    _pos = tag_end + 1;
+                    _state = State::DollarQuote;
+                }
+            }
+            break;
+        }
+        case State::LineComment:
+        {
+            int eol = _buf.indexOf('\n', _pos);
+            if (eol < 0)
+            {
+                _pos = len;
+                continue;
+            }
+            // the line break is a code
+            _pos = eol;
+            _state = State::Code;
+            break;
+        }
+        case State::BlockComment:
+            for (; _pos < len && _depth; ++_pos)
+            {
+                QChar c = _buf.at(_pos);
+                if (c != '/' && c != '*')
+                    continue;
+                if (_pos + 1 >= len)
+                {
+                    if (!_finished)
+                        return false;
+                    continue;
+                }
+                if (c == '/' && _buf.at(_pos + 1) == '*')
+                    ++_depth, ++_pos;
+                else if (c == '*' && _buf.at(_pos + 1) == '/')
+                    --_depth, ++_pos;
+            }
+            if (!_depth)
+                _state = State::Code;
+            break;
+        case State::Quote:
+            for (; _pos < len; ++_pos)
+            {
+                QChar c = _buf.at(_pos);
+                if (_escapes && c == '\\')
+                {
+                    if (_pos + 1 >= len && !_finished)
+                        return false;
+                    ++_pos;
+                    continue;
+                }
+                if (c == _quote)
+                    break;
+            }
+            if (_pos < len)
+            {
+                ++_pos;
+                _state = State::Code;
+            }
+            break;
+        case State::Bracket:
+        {
+            int close = _buf.indexOf(']', _pos);
+            if (close < 0)
+            {
+                _pos = len;
+                continue;
+            }
+            if (close + 1 >= len && !_finished)
+            {
+                _pos = close;
+                return false;
+            }
+            // ]] is an escaped bracket
+            if (close + 1 < len && _buf.at(close + 1) == ']')
+            {
+                _pos = close + 2;
+                continue;
+            }
+            _pos = close + 1;
+            _state = State::Code;
+            break;
+        }
+        case State::DollarQuote:
+        {
+            int close = _buf.indexOf(_tag, _pos);
+            if (close < 0)
+            {
+                // the tag may be split by chunks
+                _pos = (_finished ? len : qMax(_pos, len - _tag.length() + 1));
+                if (!_finished)
+                    return false;
+                continue;
+            }
+            _pos = close + _tag.length();
+            _state = State::Code;
+            break;
+        }
+        case State::CopyData:
+        {
+            // data not taken by the caller is skipped
+            QByteArray data;
+            if (!nextCopyData(data))
+                return false;
+            break;
+        }
+        }
+    }
+}
+
+bool StatementSplitter::nextCopyData(QByteArray &data)
+{
+    data = QByteArray();
+    if (_state != State::CopyData)
+        return true;
+    const int len = _buf.length();
+    if (!_copy_started)
+    {
+        // data starts at the next line
+        int eol = _buf.indexOf('\n', _pos);
+        if (eol < 0 && !_finished)
+            return false;
+        skip(eol < 0 ? len : eol + 1);
+        _copy_started = true;
+    }
+    // whole lines are taken, so the terminator is never split
+    int end = _pos;
+    int next = -1;
+    while (end - _pos < SPLITTER_COPY_CHUNK)
+    {
+        int eol = _buf.indexOf('\n', end);
+        if (eol < 0 && !_finished)
+            break;
+        int line_end = (eol < 0 ? len : eol);
+        if (_buf.midRef(end, line_end - end).trimmed() == QLatin1String("\\."))
+        {
+            next = (eol < 0 ? len : eol + 1);
+            break;
+        }
+        // data without the terminator lasts till the end of input
+        if (eol < 0)
+        {
+            end = next = len;
+            break;
+        }
+        end = eol + 1;
+    }
+    if (end > _pos)
+    {
+        data = _buf.midRef(_pos, end - _pos).toUtf8();
+        skip(end);
+        return true;
+    }
+    if (next < 0)
+        return false;
+    skip(next);
+    _state = State::Code;
+    _line_start = true;
+    _copy_started = false;
+    return true;
+}
@@ -0,0 +1,78 @@
+#ifndef STATEMENTSPLITTER_H
+#define STATEMENTSPLITTER_H
+
+#include <QString>
+#include <QByteArray>
+
+/*!
+ * \brief Incremental splitter of a script into statements, fed by chunks of any size.
+ *
+ * Literals (incl. dollar quotes) and nested comments are respected. Inline data of
+ * COPY ... FROM STDIN (up to the \. line) follows the COPY statement and is taken by chunks.
+ * T-SQL scripts are split by GO lines instead of semicolons. Consumed input is
+ * dropped, so memory is bounded by the longest statement.
+ */
+class StatementSplitter
+{
+public:
+    enum class Dialect { Semicolon, Go };
+    struct Statement
+    {
+        QString text;           ///< without the terminating semicolon or GO
+        bool copyIn = false;    ///< COPY FROM STDIN, its data is taken by nextCopyData()
+        int line = 0;           ///< 0-based line of the statement start within the whole input
+    };
+
+    explicit StatementSplitter(Dialect dialect = Dialect::Semicolon, int firstLine = 0);
+    void feed(const QString &text);
+    /*!
+     * \brief no more input, the rest is a statement even if it's not terminated
+     */
+    void finish();
+    bool isFinished() const noexcept { return _finished; }
+    /*!
+     * \brief take the next complete statement
+     * \return false if more input is needed (or there is nothing left after finish())
+     */
+    bool next(Statement &statement);
+    /*!
+     * \brief return the statement taken by next() to be taken again
+     */
+    void putBack(const Statement &statement);
+    /*!
+     * \brief take the next chunk (utf-8, whole lines) of inline data of COPY FROM STDIN
+     * \return false if more input is needed, data is null at the end of the data
+     */
+    bool nextCopyData(QByteArray &data);
+
+private:
+    enum class State { Code, LineComment, BlockComment, Quote, DollarQuote, Bracket, CopyData };
+    /*!
+     * \brief cut the statement [_start, end) and start the next one at next
+     */
+    void take(int end, int next, Statement &statement);
+    /*!
+     * \brief drop the input before next
+     */
+    void skip(int next);
+    bool isCopyFromStdin(int end) const;
+
+    Dialect _dialect;
+    QString _buf;
+    int _start = 0;         ///< current statement start within _buf
+    int _pos = 0;           ///< scanning position
+    int _line;              ///< line of _start
+    State _state = State::Code;
+    int _depth = 0;         ///< nesting of block comments
+    QChar _quote;
+    bool _escapes = false;  ///< backslash escapes within E'...'
+    QString _tag;           ///< dollar quote tag
+    bool _blank = true;     ///< the statement has nothing but spaces and comments so far
+    bool _line_start = true;
+    bool _copy_started = false; ///< the line of COPY statement is skipped
+    bool _finished = false;
+    bool _held = false;
+    Statement _held_statement;
+};
+
+#endif // STATEMENTSPLITTER_H
@@ -2,15 +2,29 @@
 #include "tablemodel.h"
 #include <QBrush>
 #include <QDateTime>
+#include <QTableView>
+#include <QHeaderView>
+#include <QStyle>
+#include <QHash>
+#include <algorithm>
+#include <cstring>
+#include "spillfile.h"
+#include "settings.h"
+#include "trace.h"
+
+QList<TableModel*> TableModel::_models;
 
 TableModel::TableModel(QObject *parent) :
-    QAbstractItemModel(parent)
+    QAbstractItemModel(parent),
+    _display_cache(TABLE_MODEL_CACHED_CELLS)
 {
     _table = new DataTable();
+    _models.append(this);
 }
 
 TableModel::~TableModel()
 {
+    _models.removeOne(this);
     delete _table;
 }
 
@@ -21,7 +35,7 @@ QModelIndex TableModel::parent(const QModelIndex &) const
 
 int TableModel::rowCount(const QModelIndex &) const
 {
-    return _table->rowCount();
+    return _indexed ? int(_rows.size()) : _table->rowCount();
 }
 
 int TableModel::columnCount(const QModelIndex &) const
@@ -38,26 +52,140 @@ QVariant TableModel::data(const QModelIndex &index, int role) const
 {
     if (!index.isValid())
         return QVariant();
-    //int sqlType = _table->getColumn(index.column()).sqlType();
+    const int row = sourceRow(index.row());
+    if (role != Qt::DisplayRole)
+        return cellData(*_table, row, index.column(), role);
+
+    // rows are not altered once fetched, so rendered text is valid until clear()
+    const quint64 key = (quint64(quint32(row)) << 32) | quint32(index.column());
+    if (const QString *text = _display_cache.object(key))
+        return *text;
+    QVariant res = cellData(*_table, row, index.column(), role);
+    if (res.type() == QVariant::String)
+        _display_cache.insert(key, new QString(res.toString()));
+    return res;
+}
+
+static inline void put2(QChar *p, int value) noexcept
+{
+    p[0] = QChar('0' + value / 10);
+    p[1] = QChar('0' + value % 10);
+}
+
+// yyyy-MM-dd
+static void putDate(QChar *p, int y, int m, int d) noexcept
+{
+    put2(p, y / 100);
+    put2(p + 2, y % 100);
+    p[4] = '-';
+    put2(p + 5, m);
+    p[7] = '-';
+    put2(p + 8, d);
+}
+
+// hh:mm:ss.zzz
+static void putTime(QChar *p, int msecs) noexcept
+{
+    put2(p, msecs / 3600000);
+    p[2] = ':';
+    put2(p + 3, msecs / 60000 % 60);
+    p[5] = ':';
+    put2(p + 6, msecs / 1000 % 60);
+    p[8] = '.';
+    p[9] = QChar('0' + msecs % 1000 / 100);
+    put2(p + 10, msecs % 100);
+}
+
+/*!
+ * \brief the same text as QDate/QTime/QDateTime::toString() with the formats of grids gives, without parsing formats
+ * \return false if the value is out of the range of years 0..9999
+ */
+static bool formatTemporal(ColumnStorage::Kind kind, qint64 value, QString &res)
+{
+    if (kind == ColumnStorage::Kind::Time)
+    {
+        res.resize(12);
+        putTime(res.data(), int(value));
+        return true;
+    }
+    const qint64 msecs_per_day = 86400000;
+    qint64 day = (kind == ColumnStorage::Kind::Date ? value : value / msecs_per_day);
+    int msecs = (kind == ColumnStorage::Kind::Date ? 0 : int(value % msecs_per_day));
+    int y, m, d;
+    QDate::fromJulianDay(day).getDate(&y, &m, &d);
+    if (y < 0 || y > 9999)
+        return false;
+    res.resize(msecs ? 23 : 10);
+    putDate(res.data(), y, m, d);
+    if (msecs)
+    {
+        res[10] = ' ';
+        putTime(res.data() + 11, msecs);
+    }
+    return true;
+}
+
+QVariant TableModel::cellData(const DataTable &table, int row, int column, int role) const
+{
+    //int sqlType = table.getColumn(column).sqlType();
     switch (role)
     {
     case Qt::SizeHintRole:
     {
         // keep default cell width convenient to use
-        QVariant &res = _table->getRow(index.row())[index.column()];
-        if (!res.isNull() && res.toString().length() > 100)
-            return QSize(500, -1);
+        const ColumnStorage &s = table.storage(column);
+        if (s.kind() != ColumnStorage::Kind::String || s.isNull(row))
+            return QVariant();
+        int length;
+        const char *data = s.utf8At(row, length);
+        if (length > TABLE_MODEL_WIDE_CHARS && ColumnStorage::utf8Chars(data, length) > TABLE_MODEL_WIDE_CHARS)
+            return QSize(TABLE_MODEL_WIDE_WIDTH, -1);
         return QVariant();
     }
     case Qt::TextAlignmentRole:
-        return int(_table->getColumn(index.column()).hAlignment() | Qt::AlignVCenter);
+    {
+        static const QVariant left(int(Qt::AlignLeft | Qt::AlignVCenter));
+        static const QVariant right(int(Qt::AlignRight | Qt::AlignVCenter));
+        Qt::AlignmentFlag alignment = table.getColumn(column).hAlignment();
+        if (alignment == Qt::AlignLeft)
+            return left;
+        if (alignment == Qt::AlignRight)
+            return right;
+        return int(alignment | Qt::AlignVCenter);
+    }
     case Qt::BackgroundRole:
-        if (_table->getRow(index.row())[index.column()].isNull())
-            return QBrush(QColor(0, 0, 0, 15));
+    {
+        static const QVariant null_brush(QBrush(QColor(0, 0, 0, 15)));
+        if (table.storage(column).isNull(row))
+            return null_brush;
         return QVariant();
+    }
     case Qt::DisplayRole:
     {
-        QVariant &res = _table->getRow(index.row())[index.column()];
+        const ColumnStorage &s = table.storage(column);
+        if (s.isNull(row))
+            return QVariant();
+        QString text;
+        switch (s.kind())
+        {
+        case ColumnStorage::Kind::String:
+            // the whole value is shown by the viewer (Ctrl+J)
+            if (s.isTruncated(row))
+                return s.stringAt(row) + QChar(0x2026);
+            return s.stringAt(row);
+        case ColumnStorage::Kind::Time:
+            if (formatTemporal(s.kind(), s.int32At(row), text))
+                return text;
+            break;
+        case ColumnStorage::Kind::Date:
+        case ColumnStorage::Kind::DateTime:
+            if (formatTemporal(s.kind(), s.int64At(row), text))
+                return text;
+            break;
+        default:
+            break;
+        }
+        QVariant res = s.value(row);
         QMetaType::Type type = QMetaType::Type(res.type());
         if (type == QMetaType::QTime)
         {
@@ -77,7 +205,9 @@ QVariant TableModel::data(const QModelIndex &index, int role) const
     }
     //[[fallthrough]];
     case Qt::EditRole:
-        return _table->getRow(index.row())[index.column()];
+        if (table.storage(column).isTruncated(row))
+            return table.storage(column).wholeString(row);
+        return table.storage(column).value(row);
     }
     return QVariant();
 }
@@ -119,8 +249,23 @@ QVariant TableModel::headerData(int section, Qt::Orientation orientation, int ro
     return QVariant();
 }
 
+void TableModel::resizeColumns(QTableView *view) const
+{
+    QHeaderView *header = view->horizontalHeader();
+    const int char_width = view->fontMetrics().width('0');
+    // room of the grid and the cell padding
+    const int margin = 2 * view->style()->pixelMetric(QStyle::PM_FocusFrameHMargin, nullptr, view) + 1 + char_width;
+    for (int c = 0; c < columnCount(); ++c)
+    {
+        int chars = _table->storage(c).displayWidth();
+        int width = (chars > TABLE_MODEL_WIDE_CHARS ? TABLE_MODEL_WIDE_WIDTH : chars * char_width + margin);
+        header->resizeSection(c, std::max(width, header->sectionSizeHint(c)));
+    }
+}
+
 void TableModel::take(DataTable *srcTable)
 {
+    SQT_TRACE_SCOPE("TableModel::take");
     // the columns do not alter in parallel - no need to use mutex
     if (srcTable->columnCount() != columnCount())
     {
@@ -136,15 +281,357 @@ void TableModel::take(DataTable *srcTable)
     {
         QMutexLocker dstLocker(&_table->mutex);
         int rowcount = _table->rowCount();
-        beginInsertRows(QModelIndex(), rowcount, rowcount + rows - 1);
+        if (!_indexed)
+        {
+            beginInsertRows(QModelIndex(), rowcount, rowcount + rows - 1);
+            _table->takeRows(srcTable);
+            keepWithinBudget();
+            endInsertRows();
+            return;
+        }
+        // rows fetched after sorting are appended as they are
         _table->takeRows(srcTable);
+        keepWithinBudget();
+        std::vector<int> added;
+        if (_filter.isEmpty())
+        {
+            for (int r = rowcount; r < rowcount + rows; ++r)
+                added.push_back(r);
+        }
+        else
+            _filter.apply(*_table, rowcount, rowcount + rows, added);
+        if (added.empty())
+            return;
+        int shown = int(_rows.size());
+        beginInsertRows(QModelIndex(), shown, shown + int(added.size()) - 1);
+        _rows.insert(_rows.end(), added.begin(), added.end());
+        indexViewRows(size_t(shown));
         endInsertRows();
     }
 }
 
+static QByteArray rowKey(const ColumnStorage &s, int row)
+{
+    if (s.isNull(row))
+        return QByteArray();
+    switch (s.kind())
+    {
+    case ColumnStorage::Kind::Int32:
+    case ColumnStorage::Kind::Time:
+        return QByteArray::number(s.int32At(row));
+    case ColumnStorage::Kind::Int64:
+    case ColumnStorage::Kind::Date:
+    case ColumnStorage::Kind::DateTime:
+        return QByteArray::number(s.int64At(row));
+    case ColumnStorage::Kind::String:
+    {
+        int length;
+        const char *data = s.utf8At(row, length);
+        // distinct from the null key
+        return QByteArray(data, length).prepend('s');
+    }
+    default:
+        return s.value(row).toString().toUtf8().prepend('v');
+    }
+}
+
+static bool sameCell(const ColumnStorage &a, int ra, const ColumnStorage &b, int rb)
+{
+    bool null = a.isNull(ra);
+    if (null != b.isNull(rb))
+        return false;
+    if (null)
+        return true;
+    if (a.kind() != b.kind())
+        return a.value(ra) == b.value(rb);
+    switch (a.kind())
+    {
+    case ColumnStorage::Kind::Int32:
+    case ColumnStorage::Kind::Time:
+        return a.int32At(ra) == b.int32At(rb);
+    case ColumnStorage::Kind::Int64:
+    case ColumnStorage::Kind::Date:
+    case ColumnStorage::Kind::DateTime:
+        return a.int64At(ra) == b.int64At(rb);
+    case ColumnStorage::Kind::Float:
+        return a.floatAt(ra) == b.floatAt(rb);
+    case ColumnStorage::Kind::Double:
+        return a.doubleAt(ra) == b.doubleAt(rb);
+    case ColumnStorage::Kind::Bool:
+        return a.boolAt(ra) == b.boolAt(rb);
+    case ColumnStorage::Kind::String:
+    {
+        int la, lb;
+        const char *da = a.utf8At(ra, la);
+        const char *db = b.utf8At(rb, lb);
+        return la == lb && !memcmp(da, db, size_t(la));
+    }
+    default:
+        return a.value(ra) == b.value(rb);
+    }
+}
+
+void TableModel::applyDelta(DataTable *srcTable, int keyColumn)
+{
+    bool same_columns = (srcTable->columnCount() == columnCount());
+    for (int c = 0; c < columnCount() && same_columns; ++c)
+        same_columns = (srcTable->getColumn(c).name() == _table->getColumn(c).name());
+    if (!same_columns || keyColumn < 0 || keyColumn >= columnCount())
+    {
+        clear();
+        take(srcTable);
+        return;
+    }
+
+    // the rows are matched under the locks, which are released before any signal:
+    // slots of the views (e.g. selection aggregates) lock the table too
+    int src_rows;
+    std::vector<int> matches;
+    std::vector<bool> taken;
+    std::vector<bool> changed;
+    {
+        QMutexLocker srcLocker(&srcTable->mutex);
+        src_rows = srcTable->rowCount();
+        QHash<QByteArray, int> src_keys;
+        src_keys.reserve(src_rows);
+        const ColumnStorage &src_key = srcTable->storage(keyColumn);
+        // the first row of a duplicated key is matched
+        for (int r = src_rows - 1; r >= 0; --r)
+            src_keys.insert(rowKey(src_key, r), r);
+
+        // shown rows are kept in their order, they refer to rows of srcTable once it is taken
+        QMutexLocker dstLocker(&_table->mutex);
+        const int shown = rowCount();
+        matches.assign(size_t(shown), -1);
+        taken.assign(size_t(src_rows), false);
+        changed.assign(size_t(shown), false);
+        const ColumnStorage &dst_key = _table->storage(keyColumn);
+        for (int d = 0; d < shown; ++d)
+        {
+            int r = sourceRow(d);
+            auto it = src_keys.constFind(rowKey(dst_key, r));
+            if (it == src_keys.constEnd() || taken[size_t(*it)])
+                continue;
+            matches[size_t(d)] = *it;
+            taken[size_t(*it)] = true;
+            for (int c = 0; c < columnCount() && !changed[size_t(d)]; ++c)
+                changed[size_t(d)] = !sameCell(_table->storage(c), r, srcTable->storage(c), *it);
+        }
+    }
+
+    // removals by blocks from the bottom, so the rows above keep their numbers
+    if (!_indexed)
+    {
+        _rows.resize(size_t(_table->rowCount()));
+        for (int r = 0; r < _table->rowCount(); ++r)
+            _rows[size_t(r)] = r;
+        _indexed = true;
+    }
+    for (int d = int(matches.size()) - 1; d >= 0;)
+    {
+        if (matches[size_t(d)] >= 0)
+        {
+            --d;
+            continue;
+        }
+        int last = d;
+        while (d >= 0 && matches[size_t(d)] < 0)
+            --d;
+        beginRemoveRows(QModelIndex(), d + 1, last);
+        _rows.erase(_rows.begin() + d + 1, _rows.begin() + last + 1);
+        matches.erase(matches.begin() + d + 1, matches.begin() + last + 1);
+        changed.erase(changed.begin() + d + 1, changed.begin() + last + 1);
+        endRemoveRows();
+    }
+
+    {
+        QMutexLocker srcLocker(&srcTable->mutex);
+        QMutexLocker dstLocker(&_table->mutex);
+        _table->removeRows();
+        _table->takeRows(srcTable);
+        keepWithinBudget();
+        _display_cache.clear();
+        for (size_t d = 0; d < matches.size(); ++d)
+            _rows[d] = matches[d];
+        indexViewRows(0);
+    }
+    for (int d = 0; d < int(changed.size());)
+    {
+        if (!changed[size_t(d)])
+        {
+            ++d;
+            continue;
+        }
+        int first = d;
+        while (d < int(changed.size()) && changed[size_t(d)])
+            ++d;
+        emit dataChanged(index(first, 0), index(d - 1, columnCount() - 1));
+    }
+
+    // rows of new keys are appended as they are (sorted or not)
+    std::vector<int> candidates, added;
+    if (_filter.isEmpty())
+    {
+        for (int r = 0; r < src_rows; ++r)
+            candidates.push_back(r);
+    }
+    else
+        _filter.apply(*_table, 0, src_rows, candidates);
+    for (int r: candidates)
+    {
+        if (!taken[size_t(r)])
+            added.push_back(r);
+    }
+    if (added.empty())
+        return;
+    int count = int(_rows.size());
+    beginInsertRows(QModelIndex(), count, count + int(added.size()) - 1);
+    _rows.insert(_rows.end(), added.begin(), added.end());
+    indexViewRows(size_t(count));
+    endInsertRows();
+}
+
+void TableModel::keepWithinBudget()
+{
+    qint64 budget = SqtSettings::value("resultMemoryBudget", TABLE_MODEL_MEMORY_BUDGET).toLongLong() * 1024 * 1024;
+    if (budget <= 0)
+        return;
+    qint64 excess = _table->residentBytes() - budget;
+    if (excess <= 0)
+        return;
+    // a quarter of the budget is spilled beyond the limit, so the file grows by large portions
+    spill(excess + budget / 4);
+}
+
+qint64 TableModel::spill(qint64 bytes)
+{
+    if (!_spill)
+    {
+        // the rows stay in memory then
+        if (_spill_failed)
+            return 0;
+        std::shared_ptr<SpillFile> file = std::make_shared<SpillFile>();
+        QString error;
+        if (!file->open(error))
+        {
+            _spill_failed = true;
+            emit spillFailed(error);
+            return 0;
+        }
+        _spill = file;
+    }
+    return _table->spill(_spill, bytes);
+}
+
+int TableModel::viewRow(int sourceRow) const noexcept
+{
+    if (!_indexed)
+        return sourceRow;
+    return (sourceRow >= 0 && size_t(sourceRow) < _view_rows.size() ? _view_rows[size_t(sourceRow)] : -1);
+}
+
+void TableModel::indexViewRows(size_t first)
+{
+    if (!first)
+        _view_rows.assign(size_t(_table->rowCount()), -1);
+    // rows appended to the table may be shown later
+    for (size_t d = first; d < _rows.size(); ++d)
+    {
+        size_t r = size_t(_rows[d]);
+        if (r >= _view_rows.size())
+            _view_rows.resize(r + 1, -1);
+        _view_rows[r] = int(d);
+    }
+}
+
+qint64 TableModel::residentBytes() const noexcept
+{
+    return _table->residentBytes() + qint64((_rows.capacity() + _view_rows.capacity()) * sizeof(int));
+}
+
+qint64 TableModel::totalResidentBytes() noexcept
+{
+    qint64 bytes = 0;
+    for (const TableModel *m: _models)
+        bytes += m->residentBytes();
+    return bytes;
+}
+
+bool TableModel::keepWithinCap()
+{
+    qint64 cap = SqtSettings::value("resultsMemoryCap", TABLE_MODEL_MEMORY_CAP).toLongLong() * 1024 * 1024;
+    if (cap <= 0)
+        return true;
+    qint64 excess = totalResidentBytes() - cap;
+    for (int i = 0; i < _models.size() && excess > 0; ++i)
+    {
+        TableModel *m = _models.at(i);
+        QMutexLocker lk(&m->_table->mutex);
+        excess -= m->spill(excess);
+    }
+    return excess <= 0;
+}
+
 void TableModel::clear()
 {
     beginResetModel();
     _table->clear();
+    _display_cache.clear();
+    _spill.reset();
+    _rows.clear();
+    _view_rows.clear();
+    _indexed = false;
+    _sort_column = -1;
+    _sort_order = Qt::AscendingOrder;
+    _filter = RowIndex::Filter();
+    endResetModel();
+}
+
+void TableModel::sort(int column, Qt::SortOrder order)
+{
+    if (column == _sort_column && (order == _sort_order || column < 0))
+        return;
+    _sort_column = (column < columnCount() ? column : -1);
+    _sort_order = order;
+    rebuildIndex();
+}
+
+bool TableModel::setFilter(const QString &expression, QString &error)
+{
+    QMutexLocker locker(&_table->mutex);
+    RowIndex::Filter filter;
+    bool ok = filter.parse(*_table, expression, error);
+    locker.unlock();
+    _filter = filter;
+    rebuildIndex();
+    return ok;
+}
+
+void TableModel::rebuildIndex()
+{
+    beginResetModel();
+    {
+        QMutexLocker locker(&_table->mutex);
+        const int rows = _table->rowCount();
+        _rows.clear();
+        _indexed = (_sort_column >= 0 || !_filter.isEmpty());
+        if (_indexed)
+        {
+            if (_filter.isEmpty())
+            {
+                _rows.resize(size_t(rows));
+                for (int r = 0; r < rows; ++r)
+                    _rows[size_t(r)] = r;
+            }
+            else
+                _filter.apply(*_table, 0, rows, _rows);
+            if (_sort_column >= 0)
+                RowIndex::sort(*_table, _sort_column, _sort_order == Qt::DescendingOrder, _rows);
+        }
+        if (_indexed)
+            indexViewRows(0);
+        else
+            _view_rows.clear();
+    }
     endResetModel();
 }
@@ -2,8 +2,24 @@
 #define TABLEMODEL_H
 
 #include <QAbstractItemModel>
+#include <QCache>
+#include "rowindex.h"
+#include <vector>
+#include <memory>
+
+// values longer than that (chars) get the fixed width of column (px)
+#define TABLE_MODEL_WIDE_CHARS 100
+#define TABLE_MODEL_WIDE_WIDTH 500
+// rendered display strings kept (a few screens of cells)
+#define TABLE_MODEL_CACHED_CELLS 8192
+// default memory of a result (MB, resultMemoryBudget setting), text beyond it is spilled to disk
+#define TABLE_MODEL_MEMORY_BUDGET 2048
+// default memory of the results of all the tabs (MB, resultsMemoryCap setting), the oldest are spilled beyond it
+#define TABLE_MODEL_MEMORY_CAP 8192
 
 class DataTable;
+class QTableView;
+class SpillFile;
 class TableModel : public QAbstractItemModel
 {
     Q_OBJECT
@@ -18,13 +34,101 @@ public:
     virtual QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
     virtual Qt::ItemFlags flags(const QModelIndex &index) const override;
     virtual QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    /*!
+     * \brief order rows by the column, -1 restores the fetch order
+     */
+    virtual void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+    /*!
+     * \brief show rows matching the RowIndex::Filter expression only, empty one shows all the rows
+     * \return false if the expression does not suit the table (the filter is reset then)
+     */
+    bool setFilter(const QString &expression, QString &error);
+    int sortColumn() const noexcept { return _sort_column; }
+    Qt::SortOrder sortOrder() const noexcept { return _sort_order; }
+    /*!
+     * \brief rows are sorted or filtered
+     */
+    bool isIndexed() const noexcept { return _indexed; }
+    /*!
+     * \brief row of the table() shown as the row of the model
+     */
+    int sourceRow(int row) const noexcept { return _indexed ? _rows[size_t(row)] : row; }
+    /*!
+     * \brief table rows shown by the rows of the model, meaningful if isIndexed()
+     */
+    const std::vector<int>& sourceRows() const noexcept { return _rows; }
+    /*!
+     * \brief row of the model showing the row of the table(), -1 if it is filtered out
+     */
+    int viewRow(int sourceRow) const noexcept;
+    /*!
+     * \brief text of the row of the table() as the grid shows it (the display cache is not used)
+     */
+    QString displayText(int sourceRow, int column) const { return cellData(*_table, sourceRow, column, Qt::DisplayRole).toString(); }
     void take(DataTable *srcTable);
+    /*!
+     * \brief replace the rows by the rows of srcTable signalling the difference only (watch mode)
+     * \param keyColumn rows of the same key are updated in place, the others are removed or appended
+     */
+    void applyDelta(DataTable *srcTable, int keyColumn);
     void clear();
     DataTable* table() const { return _table; }
+    /*!
+     * \brief set widths of view columns by lengths of values tracked by ColumnStorage (cells are not measured)
+     */
+    void resizeColumns(QTableView *view) const;
+    /*!
+     * \brief bytes of the table and of the index of the rows
+     */
+    qint64 residentBytes() const noexcept;
+    /*!
+     * \brief bytes of all the models existing
+     */
+    static qint64 totalResidentBytes() noexcept;
+    /*!
+     * \brief spill text of the oldest models while all of them exceed the cap
+     * \return false if the models exceed the cap after spilling (the rest is not text or not sealed yet)
+     */
+    static bool keepWithinCap();
+
+signals:
+    /*!
+     * \brief the spill file is not available, text beyond the memory budget stays in memory
+     */
+    void spillFailed(const QString &error);
+
+protected:
+    QVariant cellData(const DataTable &table, int row, int column, int role) const;
 
 private:
+    void rebuildIndex();
+    /*!
+     * \brief index the model rows from the first one on by the rows of the table they show
+     */
+    void indexViewRows(size_t first);
+    /*!
+     * \brief spill text of the oldest rows if the table exceeds the memory budget (the table is locked)
+     */
+    void keepWithinBudget();
+    /*!
+     * \brief move text of the table into the spill file (the table is locked)
+     * \return bytes released
+     */
+    qint64 spill(qint64 bytes);
+
     DataTable *_table;
-    
+    // permutation of the table rows, identity unless sorted or filtered
+    std::vector<int> _rows;
+    std::vector<int> _view_rows;    ///< inverse of _rows, -1 for the rows filtered out
+    bool _indexed = false;
+    int _sort_column = -1;
+    Qt::SortOrder _sort_order = Qt::AscendingOrder;
+    RowIndex::Filter _filter;
+    mutable QCache<quint64, QString> _display_cache;    ///< text of (row << 32 | column) of the table
+    std::shared_ptr<SpillFile> _spill;  ///< text of the table beyond the memory budget
+    bool _spill_failed = false;         ///< spillFailed() is emitted once
+    static QList<TableModel*> _models;  ///< in order of creation, the gui thread only
+
 };
 
 #endif // TABLEMODEL_H
@@ -0,0 +1,166 @@
+#include "trace.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <QMutex>
+#include <QObject>
+#include <QVector>
+#include <chrono>
+#include <memory>
+
+std::atomic<bool> Trace::_enabled(false);
+
+namespace
+{
+struct Event
+{
+    const char *name;
+    qint64 start;
+    qint64 duration;
+};
+
+struct Ring
+{
+    int tid;
+    std::atomic<quint64> generation;    ///< recording the events belong to
+    std::atomic<quint64> written;   ///< events ever recorded, the last ones are within the ring
+    Event events[TRACE_RING_EVENTS];
+    Ring(int tid): tid(tid), generation(0), written(0) {}
+};
+
+// rings outlive their threads, events of finished threads are exported too,
+// a ring of the finished thread is taken by the next new one
+QMutex _rings_mutex;
+QVector<std::shared_ptr<Ring>> _rings;
+QVector<Ring*> _free_rings;
+// increased by start(), a ring of the previous recording is reset by its writer
+std::atomic<quint64> _generation(0);
+
+struct RingOwner
+{
+    Ring *ring = nullptr;
+    ~RingOwner()
+    {
+        if (!ring)
+            return;
+        QMutexLocker lk(&_rings_mutex);
+        _free_rings.append(ring);
+    }
+};
+thread_local RingOwner _owner;
+
+Ring* threadRing()
+{
+    if (!_owner.ring)
+    {
+        QMutexLocker lk(&_rings_mutex);
+        if (!_free_rings.isEmpty())
+        {
+            _owner.ring = _free_rings.last();
+            _free_rings.removeLast();
+        }
+        else
+        {
+            _rings.append(std::make_shared<Ring>(_rings.size() + 1));
+            _owner.ring = _rings.last().get();
+        }
+    }
+    return _owner.ring;
+}
+
+void appendEscaped(QByteArray &out, const char *text)
+{
+    for (const char *p = text; *p; ++p)
+    {
+        if (*p == '"' || *p == '\\')
+            out += '\\';
+        out += *p;
+    }
+}
+}
+
+void Trace::start()
+{
+    QMutexLocker lk(&_rings_mutex);
+    // events of finished threads are dropped with their rings
+    for (Ring *ring: _free_rings)
+    {
+        for (int i = 0; i < _rings.size(); ++i)
+        {
+            if (_rings.at(i).get() == ring)
+            {
+                _rings.remove(i);
+                break;
+            }
+        }
+    }
+    _free_rings.clear();
+    _generation.fetch_add(1, std::memory_order_release);
+    lk.unlock();
+    _enabled = true;
+}
+
+void Trace::stop() noexcept
+{
+    _enabled = false;
+}
+
+qint64 Trace::now() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace::record(const char *name, qint64 start, qint64 duration) noexcept
+{
+    Ring *ring = threadRing();
+    // only the owner thread writes the ring, so it's reset here rather than by start()
+    quint64 generation = _generation.load(std::memory_order_acquire);
+    if (ring->generation.load(std::memory_order_relaxed) != generation)
+    {
+        ring->written.store(0, std::memory_order_relaxed);
+        ring->generation.store(generation, std::memory_order_release);
+    }
+    quint64 n = ring->written.load(std::memory_order_relaxed);
+    ring->events[n % TRACE_RING_EVENTS] = { name, start, duration };
+    ring->written.store(n + 1, std::memory_order_release);
+}
+
+bool Trace::save(const QString &fileName, QString &error)
+{
+    QByteArray out = "{\"traceEvents\":[\n";
+    bool first = true;
+    QMutexLocker lk(&_rings_mutex);
+    const quint64 generation = _generation.load(std::memory_order_acquire);
+    for (const std::shared_ptr<Ring> &ring: _rings)
+    {
+        // rings not written since the start keep events of an older recording
+        if (ring->generation.load(std::memory_order_acquire) != generation)
+            continue;
+        // events of a scope still recording (if any) may be torn, the last ring lap is exported
+        quint64 written = ring->written.load(std::memory_order_acquire);
+        quint64 from = (written > TRACE_RING_EVENTS ? written - TRACE_RING_EVENTS : 0);
+        for (quint64 i = from; i < written; ++i)
+        {
+            const Event &e = ring->events[i % TRACE_RING_EVENTS];
+            out += (first ? "" : ",\n");
+            first = false;
+            out += "{\"name\":\"";
+            appendEscaped(out, e.name);
+            // microseconds with fractions keep the order of short scopes
+            out += "\",\"ph\":\"X\",\"pid\":" + QByteArray::number(QCoreApplication::applicationPid()) +
+                    ",\"tid\":" + QByteArray::number(ring->tid) +
+                    ",\"ts\":" + QByteArray::number(double(e.start) / 1000, 'f', 3) +
+                    ",\"dur\":" + QByteArray::number(double(e.duration) / 1000, 'f', 3) + "}";
+        }
+    }
+    lk.unlock();
+    out += "\n]}\n";
+
+    QFile f(fileName);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate) || f.write(out) != out.size())
+    {
+        error = QObject::tr("Unable to save %1: %2").arg(fileName).arg(f.errorString());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,69 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+#include <atomic>
+
+// events kept per thread, older ones are overwritten
+#define TRACE_RING_EVENTS 65536
+
+/*!
+ * \brief Scoped trace points exported as Chrome trace (chrome://tracing, Perfetto) json.
+ *
+ * SQT_TRACE_SCOPE("name") records the duration of the enclosing scope into a ring buffer of
+ * the calling thread while recording is on, a disabled point costs a relaxed atomic load.
+ * Each ring has a single writer, so recording takes no locks. Points are compiled out
+ * when sqt is built with CONFIG+=no_trace.
+ */
+class Trace
+{
+public:
+    struct Scope
+    {
+        explicit Scope(const char *name) noexcept :
+            _name(Trace::enabled() ? name : nullptr),
+            _start(_name ? Trace::now() : 0)
+        {
+        }
+        ~Scope()
+        {
+            if (_name)
+                Trace::record(_name, _start, Trace::now() - _start);
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char *_name;
+        qint64 _start;
+    };
+
+    static bool enabled() noexcept { return _enabled.load(std::memory_order_relaxed); }
+    /*!
+     * \brief drop the recorded events and start recording
+     */
+    static void start();
+    static void stop() noexcept;
+    /*!
+     * \brief write the events recorded, call after stop()
+     */
+    static bool save(const QString &fileName, QString &error);
+    static qint64 now() noexcept;   ///< ns
+    /*!
+     * \param name string literal (kept by pointer)
+     */
+    static void record(const char *name, qint64 start, qint64 duration) noexcept;
+
+private:
+    static std::atomic<bool> _enabled;
+};
+
+#ifdef SQT_TRACING
+#define SQT_TRACE_CONCAT2(a, b) a##b
+#define SQT_TRACE_CONCAT(a, b) SQT_TRACE_CONCAT2(a, b)
+#define SQT_TRACE_SCOPE(name) Trace::Scope SQT_TRACE_CONCAT(_trace_scope_, __LINE__)(name)
+#else
+#define SQT_TRACE_SCOPE(name) do {} while (false)
+#endif
+
+#endif // TRACE_H